@@ -0,0 +1,230 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "Instance.hpp"
+#include "Material.hpp"
+#include "Ray.hpp"
+#include "Sampler.hpp"
+#include "Scene.hpp"
+#include "Sphere.hpp"
+#include "TriangleMesh.hpp"
+#include "Utility.hpp"
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+
+namespace mp::bench {
+
+// Geometry and materials of a scene before they are put into a World, so
+// that the same spheres can be benchmarked in every layout.
+struct SphereScene {
+  std::vector<Sphere> spheres;
+  MaterialTable materials;
+};
+
+// The final scene of "Ray Tracing in One Weekend": small spheres on a
+// (2 * gridHalfExtent)^2 grid around three large ones. gridHalfExtent 11 is
+// the book's scene with 488 spheres; every scene is fully determined by
+// gridHalfExtent and seed.
+inline SphereScene make_final_scene(const int gridHalfExtent,
+                                    const std::uint32_t seed = 42) {
+  SphereScene scene;
+  scene.spheres.push_back(
+      Sphere{{0.0f, -1000.0f, 0.0f},
+             1000.0f,
+             scene.materials.add(Lambertian{glm::vec3{0.5f}})});
+
+  Sampler sampler{seed};
+  for (int a = -gridHalfExtent; a < gridHalfExtent; ++a) {
+    for (int b = -gridHalfExtent; b < gridHalfExtent; ++b) {
+      const auto chooseMaterial = random_float(sampler);
+      const glm::vec3 center(a + 0.9f * random_float(sampler), 0.2f,
+                             b + 0.9f * random_float(sampler));
+      MaterialId material;
+      if (chooseMaterial < 0.8f) {
+        const auto albedo = random_vec(sampler) * random_vec(sampler);
+        material = scene.materials.add(Lambertian{albedo});
+      } else if (chooseMaterial < 0.95f) {
+        const auto albedo = random_vec(sampler, 0.5f, 1.0f);
+        const auto fuzz = random_float(sampler, 0.0f, 0.5f);
+        material = scene.materials.add(Metal{albedo, fuzz});
+      } else {
+        material = scene.materials.add(Dielectric{1.5f});
+      }
+      scene.spheres.push_back(Sphere{center, 0.2f, material});
+    }
+  }
+
+  scene.spheres.push_back(Sphere{
+      {0.0f, 1.0f, 0.0f}, 1.0f, scene.materials.add(Dielectric{1.5f})});
+  scene.spheres.push_back(
+      Sphere{{-4.0f, 1.0f, 0.0f},
+             1.0f,
+             scene.materials.add(Lambertian{glm::vec3{0.4f, 0.2f, 0.1f}})});
+  scene.spheres.push_back(
+      Sphere{{4.0f, 1.0f, 0.0f},
+             1.0f,
+             scene.materials.add(Metal{glm::vec3{0.7f, 0.6f, 0.5f}, 0.0f})});
+  return scene;
+}
+
+// Rays from the book's camera position towards random points over the
+// sphere grid, roughly the primary rays of a render.
+inline std::vector<Ray> make_scene_rays(const int gridHalfExtent,
+                                        const std::size_t count,
+                                        const std::uint32_t seed = 7) {
+  const glm::vec3 origin{13.0f, 2.0f, 3.0f};
+  const auto extent = static_cast<float>(gridHalfExtent);
+  Sampler sampler{seed};
+  std::vector<Ray> rays;
+  rays.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    const auto x = random_float(sampler, -extent, extent);
+    const auto y = random_float(sampler, 0.0f, 2.0f);
+    const auto z = random_float(sampler, -extent, extent);
+    rays.emplace_back(origin, normalize(glm::vec3{x, y, z} - origin));
+  }
+  return rays;
+}
+
+// Closed unit sphere tessellated into segments * 2 * (rings - 1) triangles,
+// with vertex normals.
+inline MeshData make_sphere_mesh(const std::uint32_t segments,
+                                 const std::uint32_t rings) {
+  MeshData mesh;
+  const auto add_vertex = [&mesh](const glm::vec3& p) {
+    mesh.x.push_back(p.x);
+    mesh.y.push_back(p.y);
+    mesh.z.push_back(p.z);
+    mesh.normalX.push_back(p.x);
+    mesh.normalY.push_back(p.y);
+    mesh.normalZ.push_back(p.z);
+  };
+  add_vertex({0.0f, 1.0f, 0.0f});
+  for (std::uint32_t ring = 1; ring < rings; ++ring) {
+    const float theta = pi_f * static_cast<float>(ring) / rings;
+    for (std::uint32_t segment = 0; segment < segments; ++segment) {
+      const float phi = 2.0f * pi_f * static_cast<float>(segment) / segments;
+      add_vertex({std::sin(theta) * std::cos(phi), std::cos(theta),
+                  std::sin(theta) * std::sin(phi)});
+    }
+  }
+  add_vertex({0.0f, -1.0f, 0.0f});
+
+  const auto southPole = static_cast<std::uint32_t>(mesh.vertex_count() - 1);
+  const auto vertex = [segments](const std::uint32_t ring,
+                                 const std::uint32_t segment) {
+    return 1 + (ring - 1) * segments + segment % segments;
+  };
+  for (std::uint32_t s = 0; s < segments; ++s) {
+    mesh.indices.insert(mesh.indices.end(),
+                        {0u, vertex(1, s + 1), vertex(1, s)});
+    for (std::uint32_t ring = 1; ring + 1 < rings; ++ring) {
+      mesh.indices.insert(mesh.indices.end(),
+                          {vertex(ring, s), vertex(ring, s + 1),
+                           vertex(ring + 1, s + 1), vertex(ring, s),
+                           vertex(ring + 1, s + 1), vertex(ring + 1, s)});
+    }
+    mesh.indices.insert(mesh.indices.end(),
+                        {southPole, vertex(rings - 1, s),
+                         vertex(rings - 1, s + 1)});
+  }
+  return mesh;
+}
+
+// side * side randomly scaled and rotated instances of geometry 0 on a grid
+// with unit spacing, standing on y = 0 if the geometry is the unit sphere.
+inline std::vector<Instance> make_forest(const std::uint32_t side,
+                                         const std::uint32_t seed = 11) {
+  Sampler sampler{seed};
+  std::vector<Instance> instances;
+  instances.reserve(static_cast<std::size_t>(side) * side);
+  for (std::uint32_t i = 0; i < side; ++i) {
+    for (std::uint32_t j = 0; j < side; ++j) {
+      const float scale = random_float(sampler, 0.2f, 0.45f);
+      const float angle = random_float(sampler, 0.0f, 2.0f * pi_f);
+      const glm::vec3 position{static_cast<float>(i), 2.0f * scale,
+                               static_cast<float>(j)};
+      instances.emplace_back(
+          0, glm::translate(glm::mat4{1.0f}, position) *
+                 glm::rotate(glm::mat4{1.0f}, angle, glm::vec3{0, 1, 0}) *
+                 glm::scale(glm::mat4{1.0f},
+                            glm::vec3{scale, 2.0f * scale, scale}));
+    }
+  }
+  return instances;
+}
+
+// Rays from above the forest looking down at it at varying angles.
+inline std::vector<Ray> make_forest_rays(const std::uint32_t side,
+                                         const std::size_t count,
+                                         const std::uint32_t seed = 13) {
+  const auto extent = static_cast<float>(side);
+  Sampler sampler{seed};
+  std::vector<Ray> rays;
+  rays.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    const glm::vec3 origin{random_float(sampler, 0.0f, extent), 10.0f,
+                           random_float(sampler, 0.0f, extent)};
+    const glm::vec3 direction{random_float(sampler, -1.0f, 1.0f), -1.0f,
+                              random_float(sampler, -1.0f, 1.0f)};
+    rays.emplace_back(origin, normalize(direction));
+  }
+  return rays;
+}
+
+// A closed 2 x 2 x 4 room lit only by a panel on the ceiling and a small
+// glowing sphere, with diffuse surfaces throughout: scenes/lights.scene
+// without the glass and metal. Seen from (0, 1, 2.9) towards (0, 1, 0).
+inline Scene make_lit_room() {
+  Scene scene;
+  const auto white = scene.materials.add(Lambertian{glm::vec3{0.73f}});
+  const auto red = scene.materials.add(Lambertian{{0.65f, 0.05f, 0.05f}});
+  const auto green = scene.materials.add(Lambertian{{0.12f, 0.45f, 0.15f}});
+  const auto blue = scene.materials.add(Lambertian{{0.3f, 0.5f, 0.8f}});
+  const auto panel = scene.materials.add(DiffuseLight{glm::vec3{12.0f}});
+  const auto bulb = scene.materials.add(DiffuseLight{{40.0f, 28.0f, 12.0f}});
+
+  // Corners go around each quad; a light emits towards the side from which
+  // they run counter-clockwise.
+  const auto quads = [](const std::vector<glm::vec3>& corners) {
+    MeshData mesh;
+    for (std::uint32_t first = 0; first < corners.size(); first += 4) {
+      for (std::uint32_t i = 0; i < 4; ++i) {
+        mesh.x.push_back(corners[first + i].x);
+        mesh.y.push_back(corners[first + i].y);
+        mesh.z.push_back(corners[first + i].z);
+      }
+      mesh.indices.insert(mesh.indices.end(), {first, first + 1, first + 2,
+                                               first, first + 2, first + 3});
+    }
+    return mesh;
+  };
+  scene.world.add(TriangleMesh{
+      quads({{-1, 0, -1}, {-1, 0, 3}, {1, 0, 3}, {1, 0, -1},
+             {-1, 2, -1}, {1, 2, -1}, {1, 2, 3}, {-1, 2, 3},
+             {-1, 0, -1}, {1, 0, -1}, {1, 2, -1}, {-1, 2, -1},
+             {-1, 0, 3}, {-1, 2, 3}, {1, 2, 3}, {1, 0, 3}}),
+      white});
+  scene.world.add(
+      TriangleMesh{quads({{-1, 0, -1}, {-1, 2, -1}, {-1, 2, 3}, {-1, 0, 3}}),
+                   red});
+  scene.world.add(TriangleMesh{
+      quads({{1, 0, -1}, {1, 0, 3}, {1, 2, 3}, {1, 2, -1}}), green});
+  scene.world.add(TriangleMesh{quads({{-0.3f, 1.98f, -0.3f},
+                                      {0.3f, 1.98f, -0.3f},
+                                      {0.3f, 1.98f, 0.3f},
+                                      {-0.3f, 1.98f, 0.3f}}),
+                               panel});
+  const std::vector<Sphere> spheres{{{-0.45f, 0.35f, -0.4f}, 0.35f, white},
+                                    {{0.45f, 0.3f, -0.1f}, 0.3f, blue},
+                                    {{0.1f, 0.25f, 0.6f}, 0.25f, white},
+                                    {{-0.6f, 0.08f, 0.5f}, 0.08f, bulb}};
+  scene.world.add(SphereBVH{spheres});
+  scene.lights = collect_lights(scene.world, scene.materials);
+  return scene;
+}
+
+}  // namespace mp::bench
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace mp::bench {
+
+// Keeps the compiler from discarding a result that is otherwise unused.
+template <typename T>
+inline void do_not_optimize(const T& value) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  static_cast<void>(*reinterpret_cast<const volatile char*>(&value));
+  _ReadWriteBarrier();
+#else
+  asm volatile("" : : "g"(&value) : "memory");
+#endif
+}
+
+struct Measurement {
+  std::uint64_t operations{};
+  std::chrono::nanoseconds elapsed{};
+
+  [[nodiscard]]
+  double ns_per_op() const noexcept {
+    return operations == 0 ? 0.0
+                           : static_cast<double>(elapsed.count()) / operations;
+  }
+
+  [[nodiscard]]
+  double mops_per_second() const noexcept {
+    return elapsed.count() == 0
+               ? 0.0
+               : 1e3 * static_cast<double>(operations) / elapsed.count();
+  }
+};
+
+// Runs batch() once to warm caches, then repeatedly until minTime has
+// passed. batch() returns the number of operations it performed.
+template <typename F>
+Measurement measure(F&& batch, const std::chrono::nanoseconds minTime =
+                                   std::chrono::milliseconds(200)) {
+  using Clock = std::chrono::steady_clock;
+  do_not_optimize(batch());
+  Measurement measurement;
+  const auto start = Clock::now();
+  do {
+    measurement.operations += batch();
+    measurement.elapsed = Clock::now() - start;
+  } while (measurement.elapsed < minTime);
+  return measurement;
+}
+
+// One benchmark result as a flat JSON object. Fields keep insertion order.
+class Result {
+ public:
+  explicit Result(std::string name) { add("name", std::move(name)); }
+
+  Result& add(const std::string_view key, const std::string& value) {
+    m_fields.emplace_back(key, std::format("\"{}\"", value));
+    return *this;
+  }
+
+  Result& add(const std::string_view key, const double value) {
+    m_fields.emplace_back(key, std::format("{:.6g}", value));
+    return *this;
+  }
+
+  Result& add(const std::string_view key, const std::uint64_t value) {
+    m_fields.emplace_back(key, std::format("{}", value));
+    return *this;
+  }
+
+  [[nodiscard]]
+  std::string json() const {
+    std::string out = "{";
+    for (std::size_t i = 0; i < m_fields.size(); ++i) {
+      out += std::format("{}\"{}\": {}", i == 0 ? "" : ", ", m_fields[i].first,
+                         m_fields[i].second);
+    }
+    return out + "}";
+  }
+
+ private:
+  std::vector<std::pair<std::string, std::string>> m_fields;
+};
+
+}  // namespace mp::bench
@@ -0,0 +1,1013 @@
+// Micro and macro benchmarks. Results go to stdout (or --output) as one JSON
+// document so that runs can be diffed and tracked; progress goes to stderr.
+//
+//   RayTracingBench [--filter <substring>] [--output <file>]
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "BVH.hpp"
+#include "BVHCache.hpp"
+#include "BenchScenes.hpp"
+#include "Benchmark.hpp"
+#include "Camera.hpp"
+#include "CpuFeatures.hpp"
+#include "Denoiser.hpp"
+#include "ImageBuffer.hpp"
+#include "Instance.hpp"
+#include "Material.hpp"
+#include "Sampler.hpp"
+#include "Scene.hpp"
+#include "Sphere.hpp"
+#include "SphereSoA.hpp"
+#include "Texture.hpp"
+#include "TextureCache.hpp"
+#include "TriangleMesh.hpp"
+#include "Utility.hpp"
+#include "ViewBatch.hpp"
+
+namespace {
+
+using namespace mp;
+using namespace mp::bench;
+
+constexpr std::size_t kRayCount = 1 << 12;
+// Grid half extents of the final scene: 40, 488 and 1940 spheres.
+constexpr std::array kSceneExtents{3, 11, 22};
+// Segments of the sphere meshes: about 4k, 65k and 1M triangles.
+constexpr std::array kMeshSegments{64u, 256u, 1024u};
+// Sides of the instanced forests: 10k and 1M instances of a 4k triangle mesh.
+constexpr std::array kForestSides{100u, 1000u};
+// Side of the texture looked up, 21 MiB of tiles with its mip levels, and
+// texture cache capacities in MiB: all of it, and a fifth.
+constexpr std::uint32_t kTextureSide = 2048;
+constexpr std::array kTextureCacheMiB{64u, 4u};
+
+class Suite {
+ public:
+  explicit Suite(std::string filter) : m_filter(std::move(filter)) {}
+
+  [[nodiscard]]
+  bool enabled(const std::string_view name) const {
+    return name.find(m_filter) != std::string_view::npos;
+  }
+
+  void record(Result result, const std::string_view name) {
+    std::cerr << std::format("  {}\n", name);
+    m_results.push_back(result.json());
+  }
+
+  [[nodiscard]]
+  std::string json() const {
+    std::string out = "{\n";
+    out += std::format("  \"simd_level\": \"{}\",\n",
+                       to_string(SphereSoA::simd_level()));
+    out += std::format("  \"hardware_threads\": {},\n",
+                       std::thread::hardware_concurrency());
+    out += "  \"results\": [\n";
+    for (std::size_t i = 0; i < m_results.size(); ++i) {
+      out += std::format("    {}{}\n", m_results[i],
+                         i + 1 == m_results.size() ? "" : ",");
+    }
+    return out + "  ]\n}\n";
+  }
+
+ private:
+  std::string m_filter;
+  std::vector<std::string> m_results;
+};
+
+// Times closest-hit queries over rays, one ray per operation.
+template <typename T>
+Result bench_rays(const std::string& name, const T& target,
+                  const std::vector<Ray>& rays) {
+  constexpr Interval<float> kInterval{.min = 0.001f, .max = infinity_f};
+  std::uint64_t hits = 0;
+  HitRecord hitRecord;
+  for (const auto& ray : rays) {
+    hits += Hit(target, ray, kInterval, hitRecord);
+  }
+
+  const auto m = measure([&] {
+    HitRecord hitRecord;
+    bool hit = false;
+    for (const auto& ray : rays) {
+      hit ^= Hit(target, ray, kInterval, hitRecord);
+    }
+    do_not_optimize(hit);
+    do_not_optimize(hitRecord);
+    return rays.size();
+  });
+  return Result(name)
+      .add("rays", m.operations)
+      .add("ns_per_ray", m.ns_per_op())
+      .add("mrays_per_s", m.mops_per_second())
+      .add("hit_fraction", static_cast<double>(hits) / rays.size());
+}
+
+void bench_sphere_hit(Suite& suite) {
+  const std::string name = "sphere_hit";
+  if (!suite.enabled(name)) {
+    return;
+  }
+  const Sphere sphere{{0.0f, 0.0f, 0.0f}, 1.0f, 0};
+  // Rays from a shell around the sphere aimed at a slightly larger ball, so
+  // that both the hit and the miss branch are taken.
+  Sampler sampler{3};
+  std::vector<Ray> rays;
+  rays.reserve(kRayCount);
+  for (std::size_t i = 0; i < kRayCount; ++i) {
+    const auto origin = 5.0f * random_unit_vector(sampler);
+    const auto target = 1.5f * random_unit_vector(sampler);
+    rays.emplace_back(origin, normalize(target - origin));
+  }
+  suite.record(bench_rays(name, sphere, rays), name);
+}
+
+void bench_mesh_hit(Suite& suite) {
+  // Same rays as sphere_hit, against tessellations of the unit sphere.
+  Sampler sampler{3};
+  std::vector<Ray> rays;
+  rays.reserve(kRayCount);
+  for (std::size_t i = 0; i < kRayCount; ++i) {
+    const auto origin = 5.0f * random_unit_vector(sampler);
+    const auto target = 1.5f * random_unit_vector(sampler);
+    rays.emplace_back(origin, normalize(target - origin));
+  }
+  for (const auto segments : kMeshSegments) {
+    const auto rings = segments / 2;
+    const std::uint64_t triangles = 2 * segments * (rings - 1);
+    const auto name = std::format("mesh_hit/{}", triangles);
+    if (suite.enabled(name)) {
+      const TriangleMesh mesh{make_sphere_mesh(segments, rings), 0};
+      suite.record(bench_rays(name, mesh, rays).add("triangles", triangles),
+                   name);
+    }
+  }
+}
+
+// Constructing the meshes of mesh_hit without a cache, with an empty one
+// that stores the tree and with one that holds it.
+void bench_bvh_cache(Suite& suite) {
+  const auto directory =
+      std::filesystem::temp_directory_path() / "RayTracingBench-bvh-cache";
+  for (const auto segments : kMeshSegments) {
+    const auto rings = segments / 2;
+    const std::uint64_t triangles = 2 * segments * (rings - 1);
+    const auto name = std::format("bvh_cache/{}", triangles);
+    if (!suite.enabled(name)) {
+      continue;
+    }
+    std::filesystem::remove_all(directory);
+    const auto data = make_sphere_mesh(segments, rings);
+    BVHCache cache(directory);
+    const auto construct = [&](BVHCache* const cache) {
+      auto copy = data;
+      const auto start = std::chrono::steady_clock::now();
+      const TriangleMesh mesh{std::move(copy), 0, cache};
+      const std::chrono::duration<double, std::milli> elapsed =
+          std::chrono::steady_clock::now() - start;
+      do_not_optimize(mesh);
+      return elapsed.count();
+    };
+    const double buildMs = construct(nullptr);
+    const double storeMs = construct(&cache);
+    const double loadMs = construct(&cache);
+    suite.record(Result(name)
+                     .add("triangles", triangles)
+                     .add("build_ms", buildMs)
+                     .add("build_and_store_ms", storeMs)
+                     .add("load_ms", loadMs)
+                     .add("speedup", buildMs / loadMs)
+                     .add("loaded", static_cast<std::uint64_t>(
+                                        cache.report().loaded)),
+                 name);
+  }
+  std::filesystem::remove_all(directory);
+}
+
+void bench_instance_hit(Suite& suite) {
+  for (const auto side : kForestSides) {
+    const std::uint64_t instances = static_cast<std::uint64_t>(side) * side;
+    const auto name = std::format("instance_hit/{}", instances);
+    if (!suite.enabled(name)) {
+      continue;
+    }
+    std::vector<Hittable> geometries;
+    geometries.emplace_back(TriangleMesh{make_sphere_mesh(64, 32), 0});
+    const auto start = std::chrono::steady_clock::now();
+    const InstanceBVH forest{std::move(geometries), make_forest(side)};
+    const std::chrono::duration<double, std::milli> build =
+        std::chrono::steady_clock::now() - start;
+    suite.record(bench_rays(name, forest, make_forest_rays(side, kRayCount))
+                     .add("instances", instances)
+                     .add("build_ms", build.count()),
+                 name);
+  }
+}
+
+// Times occlusion queries over rays against closest-hit queries over the
+// same rays, one ray per operation. Both search the whole ray.
+template <typename T>
+Result bench_shadow_rays(const std::string& name, const T& target,
+                         const std::vector<Ray>& rays) {
+  constexpr Interval<float> kInterval{.min = 0.001f, .max = infinity_f};
+  const auto m = measure([&] {
+    bool occluded = false;
+    for (const auto& ray : rays) {
+      occluded ^= Occluded(target, ray, kInterval);
+    }
+    do_not_optimize(occluded);
+    return rays.size();
+  });
+  const auto closest = measure([&] {
+    HitRecord hitRecord;
+    bool hit = false;
+    for (const auto& ray : rays) {
+      hit ^= Hit(target, ray, kInterval, hitRecord);
+    }
+    do_not_optimize(hit);
+    do_not_optimize(hitRecord);
+    return rays.size();
+  });
+  return Result(name)
+      .add("rays", m.operations)
+      .add("ns_per_ray", m.ns_per_op())
+      .add("closest_hit_ns_per_ray", closest.ns_per_op())
+      .add("speedup", closest.ns_per_op() / m.ns_per_op());
+}
+
+void bench_occlusion(Suite& suite) {
+  {
+    constexpr int kExtent = 11;
+    const auto name = "occlusion/sphere_bvh";
+    if (suite.enabled(name)) {
+      World world;
+      world.add(SphereBVH{make_final_scene(kExtent).spheres});
+      suite.record(
+          bench_shadow_rays(name, world, make_scene_rays(kExtent, kRayCount)),
+          name);
+    }
+  }
+  {
+    constexpr std::uint32_t kSide = kForestSides.front();
+    const auto name = "occlusion/instances";
+    if (suite.enabled(name)) {
+      std::vector<Hittable> geometries;
+      geometries.emplace_back(TriangleMesh{make_sphere_mesh(64, 32), 0});
+      World world;
+      world.add(InstanceBVH{std::move(geometries), make_forest(kSide)});
+      suite.record(bench_shadow_rays(name, world,
+                                     make_forest_rays(kSide, kRayCount)),
+                   name);
+    }
+  }
+}
+
+void bench_world_hit(Suite& suite) {
+  for (const auto extent : kSceneExtents) {
+    const auto sphereScene = make_final_scene(extent);
+    const auto& spheres = sphereScene.spheres;
+    const auto rays = make_scene_rays(extent, kRayCount);
+    const auto run = [&](const std::string& layout, const World& world) {
+      const auto name =
+          std::format("world_hit/{}/{}", layout, spheres.size());
+      if (suite.enabled(name)) {
+        suite.record(bench_rays(name, world, rays)
+                         .add("spheres",
+                              static_cast<std::uint64_t>(spheres.size())),
+                     name);
+      }
+    };
+
+    {
+      // Spheres added one by one are scanned linearly.
+      World world;
+      for (const auto& sphere : spheres) {
+        world.add(sphere);
+      }
+      run("sphere_list", world);
+    }
+    {
+      World world;
+      world.add(SphereSoA{spheres});
+      run("sphere_soa", world);
+    }
+    {
+      World world;
+      world.add(SphereBVH{spheres});
+      run("sphere_bvh", world);
+    }
+    {
+      std::vector<Hittable> hittables;
+      hittables.reserve(spheres.size());
+      for (const auto& sphere : spheres) {
+        hittables.emplace_back(sphere);
+      }
+      World world;
+      world.add(BVH{std::move(hittables)});
+      run("bvh", world);
+    }
+  }
+}
+
+template <typename M>
+void bench_scatter(Suite& suite, const std::string& material,
+                   const M& scatterer) {
+  const auto name = std::format("scatter/{}", material);
+  if (!suite.enabled(name)) {
+    return;
+  }
+  // Hits on the unit sphere from random incoming directions.
+  const Sphere sphere{{0.0f, 0.0f, 0.0f}, 1.0f, 0};
+  Sampler sampler{5};
+  std::vector<std::pair<Ray, HitRecord>> hits;
+  hits.reserve(kRayCount);
+  while (hits.size() < kRayCount) {
+    const auto origin = 5.0f * random_unit_vector(sampler);
+    const Ray ray{origin, normalize(0.9f * random_unit_vector(sampler) -
+                                    origin)};
+    HitRecord hitRecord;
+    if (Hit(sphere, ray, Interval<float>{.min = 0.001f, .max = infinity_f},
+            hitRecord)) {
+      hitRecord.footprint = 0.0f;
+      hits.emplace_back(ray, hitRecord);
+    }
+  }
+
+  std::uint32_t batch = 0;
+  const auto m = measure([&] {
+    Ray scattered;
+    glm::vec3 attenuation;
+    std::uint32_t i = 0;
+    for (const auto& [ray, hitRecord] : hits) {
+      Sampler s{1, i++, batch};
+      do_not_optimize(
+          scatterer.scatter(ray, hitRecord, attenuation, scattered, s));
+    }
+    ++batch;
+    do_not_optimize(scattered);
+    return hits.size();
+  });
+  suite.record(Result(name)
+                   .add("calls", m.operations)
+                   .add("ns_per_call", m.ns_per_op()),
+               name);
+}
+
+// Bilinear lookups of an image texture through texture_cache(), at uv
+// coordinates that either sweep the texture row by row, as camera rays
+// do, or jump around it, as secondary rays do. Small capacities keep a
+// fraction of the tiles and show what eviction costs.
+void bench_texture_lookup(Suite& suite) {
+  const auto directory =
+      std::filesystem::temp_directory_path() / "RayTracingBench-texture";
+  std::shared_ptr<const TextureImage> image;
+  for (const std::string_view pattern : {"coherent", "random"}) {
+    for (const auto capacityMiB : kTextureCacheMiB) {
+      const auto name = std::format("texture/lookup/{}/capacity_mib/{}",
+                                    pattern, capacityMiB);
+      if (!suite.enabled(name)) {
+        continue;
+      }
+      if (!image) {
+        std::filesystem::create_directories(directory);
+        const auto ppm = directory / "texture.ppm";
+        {
+          std::ofstream file(ppm, std::ios::binary);
+          file << std::format("P6\n{} {}\n255\n", kTextureSide,
+                              kTextureSide);
+          std::vector<char> row(3 * std::size_t{kTextureSide});
+          for (std::uint32_t y = 0; y < kTextureSide; ++y) {
+            for (std::uint32_t x = 0; x < kTextureSide; ++x) {
+              row[3 * x] = static_cast<char>(x ^ y);
+              row[3 * x + 1] = static_cast<char>(x);
+              row[3 * x + 2] = static_cast<char>(y);
+            }
+            file.write(row.data(), static_cast<std::streamsize>(row.size()));
+          }
+        }
+        if (!bake_texture(ppm, directory / "texture.tex")) {
+          std::cerr << "could not bake the benchmark texture\n";
+          return;
+        }
+        image = std::make_shared<const TextureImage>(directory /
+                                                     "texture.tex");
+      }
+      const ImageTexture texture{image};
+
+      Sampler sampler{7};
+      std::vector<glm::vec2> uvs(kRayCount * 16);
+      for (std::size_t i = 0; i < uvs.size(); ++i) {
+        if (pattern == "coherent") {
+          // Neighbouring texels along rows, a new row every 256 lookups.
+          const auto row = static_cast<float>(i / 256);
+          const auto column = static_cast<float>(i % 256);
+          uvs[i] = {column / static_cast<float>(kTextureSide),
+                    row * 8.0f / static_cast<float>(kTextureSide)};
+        } else {
+          uvs[i] = {random_float(sampler), random_float(sampler)};
+        }
+      }
+
+      auto& cache = texture_cache();
+      cache.clear();
+      cache.set_capacity(std::size_t{capacityMiB} << 20);
+      HitRecord hitRecord;
+      hitRecord.sphericalUv = false;
+      hitRecord.uvDensity = 1.0f;
+      hitRecord.footprint = 0.0f;
+      const auto m = measure([&] {
+        glm::vec3 sum{0.0f};
+        for (const auto& uv : uvs) {
+          hitRecord.uv = uv;
+          sum += texture.value(hitRecord);
+        }
+        do_not_optimize(sum);
+        return uvs.size();
+      });
+      const auto report = cache.report();
+      suite.record(
+          Result(name)
+              .add("lookups", m.operations)
+              .add("ns_per_lookup", m.ns_per_op())
+              .add("tile_requests", report.requests)
+              .add("miss_rate", report.requests == 0
+                                    ? 0.0
+                                    : static_cast<double>(report.misses) /
+                                          report.requests)
+              .add("peak_mib", static_cast<double>(report.peakBytes) /
+                                   (1024.0 * 1024.0)),
+          name);
+    }
+  }
+  texture_cache().clear();
+  texture_cache().set_capacity(TextureCache::kDefaultCapacity);
+  image.reset();
+  std::filesystem::remove_all(directory);
+}
+
+template <typename F>
+void bench_sampling(Suite& suite, const std::string& helper, F&& draw) {
+  const auto name = std::format("sampling/{}", helper);
+  if (!suite.enabled(name)) {
+    return;
+  }
+  constexpr std::uint32_t kDraws = 1 << 14;
+  std::uint32_t batch = 0;
+  const auto m = measure([&] {
+    Sampler sampler{1, batch++};
+    for (std::uint32_t i = 0; i < kDraws; ++i) {
+      do_not_optimize(draw(sampler));
+    }
+    return kDraws;
+  });
+  suite.record(Result(name)
+                   .add("calls", static_cast<std::uint64_t>(m.operations))
+                   .add("ns_per_call", m.ns_per_op()),
+               name);
+}
+
+void bench_render(Suite& suite) {
+  constexpr int kExtent = 11;
+  constexpr std::size_t kWidth = 160;
+  constexpr std::uint16_t kSamplesPerPixel = 8;
+  constexpr int kMaxDepth = 50;
+
+  auto sphereScene = make_final_scene(kExtent);
+  Scene scene;
+  scene.materials = std::move(sphereScene.materials);
+  scene.world.add(SphereBVH{sphereScene.spheres});
+
+  std::vector<unsigned int> threadCounts;
+  const unsigned int hardwareThreads =
+      std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned int t = 1; t < hardwareThreads; t *= 2) {
+    threadCounts.push_back(t);
+  }
+  threadCounts.push_back(hardwareThreads);
+
+  double singleThreadSeconds = 0.0;
+  for (const auto threads : threadCounts) {
+    const auto name = std::format("render/final_scene/threads/{}", threads);
+    if (!suite.enabled(name)) {
+      continue;
+    }
+    Camera camera{kWidth,
+                  16.0 / 9.0,
+                  kSamplesPerPixel,
+                  kMaxDepth,
+                  20.0f,
+                  0.2f,
+                  10.0f,
+                  glm::vec3{13.0f, 2.0f, 3.0f},
+                  glm::vec3{0.0f, 0.0f, 0.0f}};
+    camera.set_thread_count(threads);
+    // Best of a few renders, the first one also warms up the caches.
+    double seconds = 0.0;
+    std::uint64_t samples = 0;
+    for (int run = 0; run < 3; ++run) {
+      do_not_optimize(camera.render(scene));
+      const auto wall =
+          std::chrono::duration<double>(camera.report().wall).count();
+      if (run == 0 || wall < seconds) {
+        seconds = wall;
+      }
+      samples = camera.report().samples();
+    }
+    if (threads == 1) {
+      singleThreadSeconds = seconds;
+    }
+    const double speedup =
+        singleThreadSeconds > 0.0 ? singleThreadSeconds / seconds : 0.0;
+    suite.record(Result(name)
+                     .add("threads", static_cast<std::uint64_t>(threads))
+                     .add("spheres", static_cast<std::uint64_t>(
+                                         sphereScene.spheres.size()))
+                     .add("samples", samples)
+                     .add("wall_ms", 1e3 * seconds)
+                     .add("msamples_per_s", samples / seconds * 1e-6)
+                     .add("speedup", speedup)
+                     .add("efficiency", speedup / threads),
+                 name);
+  }
+}
+
+// Root mean square of the per-pixel standard error of mean luminance,
+// relative to the mean luminance of the image.
+double relative_noise(const AccumulationBuffer& accumulation) {
+  double variance = 0.0;
+  double mean = 0.0;
+  for (const auto& pixel : accumulation.pixels()) {
+    const double n = pixel.sampleCount;
+    const double pixelMean = luminance(pixel.sum) / n;
+    variance += std::max(0.0, (pixel.luminanceSquaredSum -
+                               pixelMean * pixelMean * n) /
+                                  (n - 1.0)) /
+                n;
+    mean += pixelMean;
+  }
+  const auto pixels = static_cast<double>(accumulation.pixels().size());
+  return std::sqrt(variance / pixels) / (mean / pixels);
+}
+
+// Next-event estimation against BSDF sampling alone, which is the same
+// scene without a light list. The noise ratio tells how many samples the
+// latter needs to match the former.
+void bench_lights(Suite& suite) {
+  constexpr std::size_t kWidth = 96;
+  constexpr std::array<std::uint16_t, 2> kSamplesPerPixel{16, 64};
+  constexpr int kMaxDepth = 16;
+
+  const auto withLights = make_lit_room();
+  auto withoutLights = make_lit_room();
+  withoutLights.lights = LightList{};
+
+  for (const auto samplesPerPixel : kSamplesPerPixel) {
+    const auto bsdfName =
+        std::format("render/lights/bsdf/spp/{}", samplesPerPixel);
+    const auto neeName =
+        std::format("render/lights/nee/spp/{}", samplesPerPixel);
+    if (!suite.enabled(bsdfName) && !suite.enabled(neeName)) {
+      continue;
+    }
+    Camera camera{kWidth,
+                  1.0,
+                  samplesPerPixel,
+                  kMaxDepth,
+                  40.0f,
+                  0.0f,
+                  10.0f,
+                  glm::vec3{0.0f, 1.0f, 2.9f},
+                  glm::vec3{0.0f, 1.0f, 0.0f}};
+    camera.set_thread_count(1);
+    const auto run = [&](const Scene& scene) {
+      do_not_optimize(camera.render(scene));
+      return std::pair{
+          std::chrono::duration<double>(camera.report().wall).count(),
+          relative_noise(camera.accumulation())};
+    };
+    const auto [bsdfSeconds, bsdfNoise] = run(withoutLights);
+    const auto [neeSeconds, neeNoise] = run(withLights);
+    const std::uint64_t samples = camera.report().samples();
+    // Noise falls with the square root of the sample count.
+    const double sampleRatio =
+        (bsdfNoise / neeNoise) * (bsdfNoise / neeNoise);
+    if (suite.enabled(bsdfName)) {
+      suite.record(Result(bsdfName)
+                       .add("samples", samples)
+                       .add("wall_ms", 1e3 * bsdfSeconds)
+                       .add("relative_noise", bsdfNoise),
+                   bsdfName);
+    }
+    if (suite.enabled(neeName)) {
+      suite.record(
+          Result(neeName)
+              .add("samples", samples)
+              .add("wall_ms", 1e3 * neeSeconds)
+              .add("relative_noise", neeNoise)
+              .add("bsdf_spp_for_equal_noise", sampleRatio * samplesPerPixel)
+              .add("time_speedup_at_equal_noise",
+                   sampleRatio * bsdfSeconds / neeSeconds),
+          neeName);
+    }
+  }
+}
+
+// Root mean square difference of the gamma-corrected channels, 0 to 1.
+double image_error(const std::vector<Color>& image,
+                   const std::vector<Color>& reference) {
+  double sum = 0.0;
+  for (std::size_t i = 0; i < image.size(); ++i) {
+    const auto& a = image[i];
+    const auto& b = reference[i];
+    const glm::vec3 diff{static_cast<float>(a.r) - b.r,
+                         static_cast<float>(a.g) - b.g,
+                         static_cast<float>(a.b) - b.b};
+    sum += dot(diff, diff);
+  }
+  return std::sqrt(sum / (3.0 * image.size())) / 255.0;
+}
+
+// The lit room at kRoomWidth pixels, as the quality benchmarks render it.
+constexpr std::size_t kRoomWidth = 64;
+
+Camera make_room_camera(const std::uint16_t samplesPerPixel) {
+  constexpr int kMaxDepth = 16;
+  return Camera{kRoomWidth,
+                1.0,
+                samplesPerPixel,
+                kMaxDepth,
+                40.0f,
+                0.0f,
+                10.0f,
+                glm::vec3{0.0f, 1.0f, 2.9f},
+                glm::vec3{0.0f, 1.0f, 0.0f}};
+}
+
+std::vector<Color> image_pixels(const ImageBuffer& image) {
+  std::vector<Color> pixels;
+  pixels.reserve(image.get_width() * image.get_height());
+  for (std::size_t y = 0; y < image.get_height(); ++y) {
+    for (std::size_t x = 0; x < image.get_width(); ++x) {
+      pixels.push_back(image[x, y]);
+    }
+  }
+  return pixels;
+}
+
+// The room with 1024 samples per pixel, which the quality benchmarks take
+// as ground truth. Rendered on every core the first time it is needed.
+const std::vector<Color>& room_reference(const Scene& scene) {
+  constexpr std::uint16_t kReferenceSamples = 1024;
+  static const std::vector<Color> reference = [&] {
+    auto camera = make_room_camera(kReferenceSamples);
+    return image_pixels(camera.render(scene));
+  }();
+  return reference;
+}
+
+// A denoised render with few samples against renders without denoising,
+// all compared to a reference with far more samples. The preview is worth
+// it when it gets close to the error of the full render in less time.
+void bench_denoise(Suite& suite) {
+  constexpr std::uint16_t kPreviewSamples = 16;
+  constexpr std::uint16_t kFullSamples = 256;
+
+  const auto rawName =
+      std::format("render/denoise/raw/spp/{}", kPreviewSamples);
+  const auto fullName = std::format("render/denoise/raw/spp/{}", kFullSamples);
+  const auto denoisedName =
+      std::format("render/denoise/denoised/spp/{}", kPreviewSamples);
+  if (!suite.enabled(rawName) && !suite.enabled(fullName) &&
+      !suite.enabled(denoisedName)) {
+    return;
+  }
+  const auto scene = make_lit_room();
+  struct Run {
+    std::vector<Color> image;
+    double seconds;
+    double denoiseSeconds;
+  };
+  const auto run = [&](const std::uint16_t samplesPerPixel,
+                       const std::optional<DenoiseSettings>& denoiser) {
+    auto camera = make_room_camera(samplesPerPixel);
+    camera.set_thread_count(1);
+    camera.set_denoiser(denoiser);
+    auto image = image_pixels(camera.render(scene));
+    return Run{
+        std::move(image),
+        std::chrono::duration<double>(camera.report().wall).count(),
+        std::chrono::duration<double>(camera.report().denoise).count()};
+  };
+
+  const auto& reference = room_reference(scene);
+  const auto raw = run(kPreviewSamples, std::nullopt);
+  const auto full = run(kFullSamples, std::nullopt);
+  const auto denoised = run(kPreviewSamples, DenoiseSettings{});
+  const double fullError = image_error(full.image, reference);
+  const double denoisedError = image_error(denoised.image, reference);
+  if (suite.enabled(rawName)) {
+    suite.record(Result(rawName)
+                     .add("wall_ms", 1e3 * raw.seconds)
+                     .add("error", image_error(raw.image, reference)),
+                 rawName);
+  }
+  if (suite.enabled(fullName)) {
+    suite.record(Result(fullName)
+                     .add("wall_ms", 1e3 * full.seconds)
+                     .add("error", fullError),
+                 fullName);
+  }
+  if (suite.enabled(denoisedName)) {
+    suite.record(
+        Result(denoisedName)
+            .add("wall_ms", 1e3 * denoised.seconds)
+            .add("denoise_ms", 1e3 * denoised.denoiseSeconds)
+            .add("error", denoisedError)
+            .add("error_vs_full", denoisedError / fullError)
+            .add("time_speedup_vs_full",
+                 full.seconds / (denoised.seconds + denoised.denoiseSeconds)),
+        denoisedName);
+  }
+}
+
+// Every sampler at the same sample counts, compared to the reference. Error
+// falls with the square root of the sample count for independent samples,
+// so the error ratio tells how many of those a sampler is worth.
+void bench_samplers(Suite& suite) {
+  constexpr std::array<std::uint16_t, 2> kSamplesPerPixel{16, 64};
+  constexpr auto kSamplers = static_cast<std::size_t>(SamplerType::Count);
+
+  const auto scene = make_lit_room();
+  for (const auto samplesPerPixel : kSamplesPerPixel) {
+    std::array<std::string, kSamplers> names;
+    for (std::size_t i = 0; i < kSamplers; ++i) {
+      names[i] = std::format("render/sampler/{}/spp/{}",
+                             to_string(static_cast<SamplerType>(i)),
+                             samplesPerPixel);
+    }
+    if (std::ranges::none_of(
+            names, [&](const auto& name) { return suite.enabled(name); })) {
+      continue;
+    }
+    const auto& reference = room_reference(scene);
+    const auto run = [&](const SamplerType sampler) {
+      auto camera = make_room_camera(samplesPerPixel);
+      camera.set_thread_count(1);
+      camera.set_sampler(sampler);
+      const double error =
+          image_error(image_pixels(camera.render(scene)), reference);
+      return std::pair{
+          std::chrono::duration<double>(camera.report().wall).count(), error};
+    };
+    const auto [independentSeconds, independentError] =
+        run(SamplerType::Independent);
+    for (std::size_t i = 0; i < kSamplers; ++i) {
+      if (!suite.enabled(names[i])) {
+        continue;
+      }
+      const auto type = static_cast<SamplerType>(i);
+      const auto [seconds, error] =
+          type == SamplerType::Independent
+              ? std::pair{independentSeconds, independentError}
+              : run(type);
+      const double errorRatio = independentError / error;
+      suite.record(Result(names[i])
+                       .add("wall_ms", 1e3 * seconds)
+                       .add("error", error)
+                       .add("independent_spp_for_equal_error",
+                            errorRatio * errorRatio * samplesPerPixel),
+                   names[i]);
+    }
+  }
+}
+
+// The kernel compiled for each scene against the generic one on the same
+// render. Both must give the same image; only the time may differ.
+void bench_kernels(Suite& suite) {
+  const auto compare = [&](const std::string& name, const Scene& scene,
+                           Camera camera) {
+    camera.set_thread_count(1);
+    // Best of a few renders, the first one also warms up the caches.
+    const auto run = [&](const bool specialized) {
+      camera.set_specialized_kernels(specialized);
+      double seconds = 0.0;
+      std::vector<Color> image;
+      for (int run = 0; run < 3; ++run) {
+        image = image_pixels(camera.render(scene));
+        const auto wall =
+            std::chrono::duration<double>(camera.report().wall).count();
+        if (run == 0 || wall < seconds) {
+          seconds = wall;
+        }
+      }
+      return std::pair{seconds, std::move(image)};
+    };
+    const auto [genericSeconds, genericImage] = run(false);
+    const auto [specializedSeconds, specializedImage] = run(true);
+    std::uint64_t differing = 0;
+    for (std::size_t i = 0; i < genericImage.size(); ++i) {
+      const auto& a = genericImage[i];
+      const auto& b = specializedImage[i];
+      differing += a.r != b.r || a.g != b.g || a.b != b.b ? 1 : 0;
+    }
+    suite.record(Result(name)
+                     .add("kernel", camera.report().kernel)
+                     .add("samples", camera.report().samples())
+                     .add("generic_ms", 1e3 * genericSeconds)
+                     .add("specialized_ms", 1e3 * specializedSeconds)
+                     .add("speedup", genericSeconds / specializedSeconds)
+                     .add("differing_pixels", differing),
+                 name);
+  };
+
+  const std::string pinholeName = "render/kernel/final_scene/pinhole";
+  const std::string thinLensName = "render/kernel/final_scene/thin_lens";
+  if (suite.enabled(pinholeName) || suite.enabled(thinLensName)) {
+    auto sphereScene = make_final_scene(11);
+    Scene scene;
+    scene.materials = std::move(sphereScene.materials);
+    scene.world.add(SphereBVH{sphereScene.spheres});
+    const auto makeCamera = [](const float defocusAngle) {
+      constexpr std::uint16_t kSamplesPerPixel = 16;
+      constexpr int kMaxDepth = 8;
+      return Camera{160,
+                    16.0 / 9.0,
+                    kSamplesPerPixel,
+                    kMaxDepth,
+                    20.0f,
+                    defocusAngle,
+                    10.0f,
+                    glm::vec3{13.0f, 2.0f, 3.0f},
+                    glm::vec3{0.0f, 0.0f, 0.0f}};
+    };
+    if (suite.enabled(pinholeName)) {
+      compare(pinholeName, scene, makeCamera(0.0f));
+    }
+    if (suite.enabled(thinLensName)) {
+      compare(thinLensName, scene, makeCamera(0.6f));
+    }
+  }
+  const std::string roomName = "render/kernel/lit_room";
+  if (suite.enabled(roomName)) {
+    compare(roomName, make_lit_room(), make_room_camera(16));
+  }
+}
+
+// A ring of small views around the final scene, product shot style, each
+// rendered on its own against all of them from one pool of threads.
+void bench_views(Suite& suite) {
+  constexpr std::size_t kViewCount = 12;
+  constexpr std::size_t kWidth = 96;
+  constexpr std::uint16_t kSamplesPerPixel = 4;
+  constexpr int kMaxDepth = 8;
+  const auto name = std::format("render/views/{}", kViewCount);
+  if (!suite.enabled(name)) {
+    return;
+  }
+  auto sphereScene = make_final_scene(11);
+  Scene scene;
+  scene.materials = std::move(sphereScene.materials);
+  scene.world.add(SphereBVH{sphereScene.spheres});
+  const unsigned int threads =
+      std::max(1u, std::thread::hardware_concurrency());
+
+  std::vector<Camera> views;
+  views.reserve(kViewCount);
+  for (std::size_t i = 0; i < kViewCount; ++i) {
+    const float angle = 2.0f * pi_f * static_cast<float>(i) / kViewCount;
+    views.emplace_back(kWidth, 1.0, kSamplesPerPixel, kMaxDepth, 30.0f, 0.0f,
+                       10.0f,
+                       glm::vec3{13.0f * std::cos(angle), 2.0f,
+                                 13.0f * std::sin(angle)},
+                       glm::vec3{0.0f, 0.0f, 0.0f});
+    views.back().set_thread_count(threads);
+  }
+
+  // Best of a few runs each, the first one also warms up the caches.
+  double sequentialSeconds = 0.0;
+  double batchSeconds = 0.0;
+  std::vector<std::vector<Color>> sequentialImages(kViewCount);
+  for (int run = 0; run < 3; ++run) {
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < kViewCount; ++i) {
+      sequentialImages[i] = image_pixels(views[i].render(scene));
+    }
+    const std::chrono::duration<double> sequential =
+        std::chrono::steady_clock::now() - start;
+    const auto batch = render_views(views, scene, threads);
+    const std::chrono::duration<double> batchWall = batch.wall;
+    if (run == 0 || sequential.count() < sequentialSeconds) {
+      sequentialSeconds = sequential.count();
+    }
+    if (run == 0 || batchWall.count() < batchSeconds) {
+      batchSeconds = batchWall.count();
+    }
+  }
+  std::uint64_t differing = 0;
+  std::uint64_t samples = 0;
+  for (std::size_t i = 0; i < kViewCount; ++i) {
+    const auto batchImage = image_pixels(*views[i].image());
+    for (std::size_t p = 0; p < batchImage.size(); ++p) {
+      const auto& a = sequentialImages[i][p];
+      const auto& b = batchImage[p];
+      differing += a.r != b.r || a.g != b.g || a.b != b.b ? 1 : 0;
+    }
+    samples += views[i].report().samples();
+  }
+  suite.record(Result(name)
+                   .add("views", static_cast<std::uint64_t>(kViewCount))
+                   .add("threads", static_cast<std::uint64_t>(threads))
+                   .add("samples", samples)
+                   .add("sequential_ms", 1e3 * sequentialSeconds)
+                   .add("batch_ms", 1e3 * batchSeconds)
+                   .add("speedup", sequentialSeconds / batchSeconds)
+                   .add("differing_pixels", differing),
+               name);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::string filter;
+  std::string output;
+  for (int i = 1; i < argc; i += 2) {
+    const std::string_view flag{argv[i]};
+    if ((flag == "--filter" || flag == "--output") && i + 1 == argc) {
+      std::cerr << std::format(
+          "{} needs a value\n"
+          "usage: RayTracingBench [--filter <substring>] [--output <file>]\n",
+          flag);
+      return EXIT_FAILURE;
+    }
+    if (flag == "--filter") {
+      filter = argv[i + 1];
+    } else if (flag == "--output") {
+      output = argv[i + 1];
+    } else {
+      std::cerr << std::format("unknown argument {}\n", flag);
+      return EXIT_FAILURE;
+    }
+  }
+
+  Suite suite{filter};
+  bench_sphere_hit(suite);
+  bench_mesh_hit(suite);
+  bench_bvh_cache(suite);
+  bench_instance_hit(suite);
+  bench_world_hit(suite);
+  bench_occlusion(suite);
+  bench_scatter(suite, "lambertian", Lambertian{glm::vec3{0.5f}});
+  bench_scatter(suite, "metal", Metal{glm::vec3{0.7f, 0.6f, 0.5f}, 0.3f});
+  bench_scatter(suite, "dielectric", Dielectric{1.5f});
+  bench_scatter(suite, "lambertian_checker",
+                Lambertian{glm::vec3{1.0f},
+                           std::make_shared<const Texture>(CheckerTexture{
+                               glm::vec3{0.9f}, glm::vec3{0.1f}, 0.25f})});
+  bench_scatter(suite, "lambertian_noise",
+                Lambertian{glm::vec3{1.0f},
+                           std::make_shared<const Texture>(
+                               NoiseTexture{glm::vec3{1.0f}, 4.0f})});
+  bench_texture_lookup(suite);
+  bench_sampling(suite, "random_float",
+                 [](Sampler& s) { return random_float(s); });
+  bench_sampling(suite, "random_vec", [](Sampler& s) { return random_vec(s); });
+  bench_sampling(suite, "random_unit_vector",
+                 [](Sampler& s) { return random_unit_vector(s); });
+  bench_sampling(suite, "random_on_hemisphere", [](Sampler& s) {
+    return random_on_hemisphere(s, glm::vec3{0.0f, 1.0f, 0.0f});
+  });
+  bench_sampling(suite, "random_in_unit_disk",
+                 [](Sampler& s) { return random_in_unit_disk(s); });
+  bench_render(suite);
+  bench_lights(suite);
+  bench_denoise(suite);
+  bench_samplers(suite);
+  bench_kernels(suite);
+  bench_views(suite);
+
+  if (output.empty()) {
+    std::cout << suite.json();
+    return EXIT_SUCCESS;
+  }
+  std::ofstream file(output);
+  file << suite.json();
+  return file ? EXIT_SUCCESS : EXIT_FAILURE;
+}
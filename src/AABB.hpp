@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Interval.hpp"
+#include "Ray.hpp"
+#include "Utility.hpp"
+#include "glm/glm.hpp"
+
+namespace mp {
+
+struct AABB {
+  glm::vec3 min{+infinity_f};
+  glm::vec3 max{-infinity_f};
+
+  [[nodiscard]]
+  constexpr bool empty() const noexcept {
+    return min.x > max.x || min.y > max.y || min.z > max.z;
+  }
+
+  void expand(const glm::vec3& p) noexcept {
+    min = glm::min(min, p);
+    max = glm::max(max, p);
+  }
+
+  void expand(const AABB& other) noexcept {
+    min = glm::min(min, other.min);
+    max = glm::max(max, other.max);
+  }
+
+  [[nodiscard]]
+  glm::vec3 centroid() const noexcept {
+    return 0.5f * (min + max);
+  }
+
+  [[nodiscard]]
+  glm::vec3 extent() const noexcept {
+    return max - min;
+  }
+
+  [[nodiscard]]
+  float surface_area() const noexcept {
+    if (empty()) {
+      return 0.0f;
+    }
+    const auto e = extent();
+    return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+  }
+
+  // Slab test. invDirection is 1 / ray.direction(), precomputed once per ray
+  // by the caller. On success tEntry holds the distance at which the ray
+  // enters the box, clamped to the interval.
+  //
+  // The exit distance is enlarged by the worst-case rounding error of its
+  // computation (Ize, "Robust BVH Ray Traversal", JCGT 2013), so a ray that
+  // grazes a box face or passes through a vertex shared by primitives is
+  // never culled, as watertight triangle tests require.
+  [[nodiscard]]
+  bool hit(const Ray& ray, const glm::vec3& invDirection,
+           const Interval<float> interval, float& tEntry) const noexcept {
+    constexpr float kExitScale = 1.0f + 2.0f * 3.0f * 0x1p-24f;
+    const auto t0 = (min - ray.origin()) * invDirection;
+    const auto t1 = (max - ray.origin()) * invDirection;
+    const auto tNear = glm::min(t0, t1);
+    const auto tFar = glm::max(t0, t1);
+    const float tEnter =
+        glm::max(interval.min, glm::max(tNear.x, glm::max(tNear.y, tNear.z)));
+    const float tExit = glm::min(
+        interval.max,
+        kExitScale * glm::min(tFar.x, glm::min(tFar.y, tFar.z)));
+    tEntry = tEnter;
+    return tEnter <= tExit;
+  }
+
+  [[nodiscard]]
+  static AABB merge(const AABB& a, const AABB& b) noexcept {
+    return AABB{.min = glm::min(a.min, b.min), .max = glm::max(a.max, b.max)};
+  }
+};
+
+}  // namespace mp
@@ -0,0 +1,104 @@
+#include "AccumulationBuffer.hpp"
+
+#include <array>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+
+#include "MappedFile.hpp"
+
+namespace mp {
+namespace {
+
+constexpr std::array<char, 8> kCheckpointMagic{'M', 'P', 'A', 'C',
+                                               'C', 'U', 'M', '\0'};
+constexpr std::uint32_t kCheckpointVersion = 1;
+
+// 32 bytes, so the pixel array that follows stays 4-byte aligned within the
+// page-aligned mapping.
+struct CheckpointHeader {
+  std::array<char, 8> magic;
+  std::uint32_t version;
+  std::uint32_t pixelSize;
+  std::uint64_t width;
+  std::uint64_t height;
+};
+
+static_assert(sizeof(CheckpointHeader) == 32);
+static_assert(std::is_trivially_copyable_v<CheckpointHeader>);
+
+}  // namespace
+
+void tonemap(const AccumulationBuffer& accumulation, ImageBuffer& image) {
+  for (std::size_t y = 0; y < image.get_height(); ++y) {
+    for (std::size_t x = 0; x < image.get_width(); ++x) {
+      image[x, y] = Color::gamma(accumulation[x, y].mean());
+    }
+  }
+}
+
+bool save_checkpoint(const AccumulationBuffer& accumulation,
+                     const std::filesystem::path& path) {
+  const CheckpointHeader header{
+      .magic = kCheckpointMagic,
+      .version = kCheckpointVersion,
+      .pixelSize = sizeof(AccumulatedPixel),
+      .width = accumulation.get_width(),
+      .height = accumulation.get_height(),
+  };
+  auto temporary = path;
+  temporary += ".tmp";
+  {
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    const auto pixels = std::as_bytes(accumulation.pixels());
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(pixels.data()),
+               static_cast<std::streamsize>(pixels.size()));
+    file.close();
+    if (!file) {
+      return false;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(temporary, path, error);
+  return !error;
+}
+
+AccumulationBuffer load_checkpoint(const std::filesystem::path& path) {
+  const MappedFile file(path);
+  const auto data = file.data();
+  CheckpointHeader header;
+  if (data.size() < sizeof(header)) {
+    throw std::runtime_error(
+        std::format("{}: too small for a checkpoint", path.string()));
+  }
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (header.magic != kCheckpointMagic ||
+      header.version != kCheckpointVersion ||
+      header.pixelSize != sizeof(AccumulatedPixel)) {
+    throw std::runtime_error(
+        std::format("{}: not a version {} checkpoint", path.string(),
+                    kCheckpointVersion));
+  }
+  // Validate the dimensions against the file size before allocating.
+  const auto pixelBytes = data.size() - sizeof(header);
+  const auto pixelCount = pixelBytes / sizeof(AccumulatedPixel);
+  const bool sizeMatches =
+      pixelBytes % sizeof(AccumulatedPixel) == 0 &&
+      (header.width == 0 ? pixelCount == 0
+                         : pixelCount % header.width == 0 &&
+                               pixelCount / header.width == header.height);
+  if (!sizeMatches) {
+    throw std::runtime_error(std::format(
+        "{}: expected {}x{} pixels, file is truncated or has trailing data",
+        path.string(), header.width, header.height));
+  }
+  AccumulationBuffer accumulation(header.width, header.height);
+  const auto pixels = std::as_writable_bytes(accumulation.pixels());
+  std::memcpy(pixels.data(), data.data() + sizeof(header), pixels.size());
+  return accumulation;
+}
+
+}  // namespace mp
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "ImageBuffer.hpp"
+#include "glm/glm.hpp"
+
+namespace mp {
+
+struct AccumulatedPixel {
+  // Sum of all linear radiance samples taken for the pixel.
+  glm::vec3 sum{0.0f};
+  // Sum of squared sample luminance, so that adaptive sampling can pick up
+  // the variance estimate of a resumed render.
+  float luminanceSquaredSum{0.0f};
+  std::uint32_t sampleCount{0};
+
+  [[nodiscard]]
+  glm::vec3 mean() const noexcept {
+    return sampleCount == 0 ? glm::vec3{0.0f}
+                            : sum * (1.0f / static_cast<float>(sampleCount));
+  }
+};
+
+static_assert(std::is_trivially_copyable_v<AccumulatedPixel>);
+static_assert(sizeof(AccumulatedPixel) == 20);
+
+// Linear HDR framebuffer holding running sums and sample counts instead of
+// final colors. Renders add samples to it, so a render can be stopped,
+// checkpointed, resumed or refined with more samples; tonemap() produces the
+// 8-bit image as a separate pass.
+class AccumulationBuffer {
+ public:
+  using image_dimensions_t = std::size_t;
+
+  AccumulationBuffer() = default;
+  AccumulationBuffer(const image_dimensions_t width,
+                     const image_dimensions_t height)
+      : m_width(width), m_height(height), m_pixels(width * height) {}
+
+  [[nodiscard]]
+  image_dimensions_t get_width() const noexcept {
+    return m_width;
+  }
+
+  [[nodiscard]]
+  image_dimensions_t get_height() const noexcept {
+    return m_height;
+  }
+
+  [[nodiscard]]
+  AccumulatedPixel& operator[](const image_dimensions_t x,
+                               const image_dimensions_t y) noexcept {
+    return m_pixels[y * m_width + x];
+  }
+
+  [[nodiscard]]
+  const AccumulatedPixel& operator[](
+      const image_dimensions_t x, const image_dimensions_t y) const noexcept {
+    return m_pixels[y * m_width + x];
+  }
+
+  [[nodiscard]]
+  std::span<AccumulatedPixel> pixels() noexcept {
+    return m_pixels;
+  }
+
+  [[nodiscard]]
+  std::span<const AccumulatedPixel> pixels() const noexcept {
+    return m_pixels;
+  }
+
+  // Drops every sample, keeping the dimensions.
+  void clear() noexcept {
+    std::ranges::fill(m_pixels, AccumulatedPixel{});
+  }
+
+ private:
+  image_dimensions_t m_width{};
+  image_dimensions_t m_height{};
+  std::vector<AccumulatedPixel> m_pixels;
+};
+
+// Gamma-corrects the mean of every pixel into an 8-bit image of the same
+// size. Pixels without samples come out black.
+void tonemap(const AccumulationBuffer& accumulation, ImageBuffer& image);
+
+// Checkpoint files are a fixed header followed by the raw pixel array in
+// native byte order, so loading them is a single copy out of a memory
+// mapping. The file is written next to the target and renamed over it, a
+// crash while saving leaves the previous checkpoint intact.
+[[nodiscard]]
+bool save_checkpoint(const AccumulationBuffer& accumulation,
+                     const std::filesystem::path& path);
+
+// Throws std::system_error if the file cannot be mapped and
+// std::runtime_error if it is not a checkpoint written by this build.
+[[nodiscard]]
+AccumulationBuffer load_checkpoint(const std::filesystem::path& path);
+
+}  // namespace mp
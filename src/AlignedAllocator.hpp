@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace mp {
+
+// Allocator for SIMD-friendly arrays: storage starts on an Alignment-byte
+// boundary (a cache line by default).
+template <typename T, std::size_t Alignment = 64>
+struct AlignedAllocator {
+  using value_type = T;
+
+  template <typename U>
+  struct rebind {
+    using other = AlignedAllocator<U, Alignment>;
+  };
+
+  constexpr AlignedAllocator() noexcept = default;
+  template <typename U>
+  constexpr explicit AlignedAllocator(
+      const AlignedAllocator<U, Alignment>&) noexcept {}
+
+  [[nodiscard]]
+  T* allocate(const std::size_t n) {
+    return static_cast<T*>(
+        ::operator new(n * sizeof(T), std::align_val_t{Alignment}));
+  }
+
+  void deallocate(T* p, const std::size_t) noexcept {
+    ::operator delete(p, std::align_val_t{Alignment});
+  }
+
+  template <typename U>
+  constexpr bool operator==(const AlignedAllocator<U, Alignment>&)
+      const noexcept {
+    return true;
+  }
+};
+
+template <typename T, std::size_t Alignment = 64>
+using AlignedVector = std::vector<T, AlignedAllocator<T, Alignment>>;
+
+}  // namespace mp
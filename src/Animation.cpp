@@ -0,0 +1,167 @@
+#include "Animation.hpp"
+
+#include <algorithm>
+#include <future>
+#include <tuple>
+#include <utility>
+
+#include "glm/gtc/matrix_transform.hpp"
+
+namespace mp {
+namespace {
+// The keyframes around frame and how far frame is from the first to the
+// second, 0 to 1. Both are the same keyframe outside the keyed range.
+template <typename Keyframe>
+[[nodiscard]]
+std::tuple<const Keyframe&, const Keyframe&, float> bracket(
+    const std::span<const Keyframe> keyframes, const std::uint32_t frame) {
+  const auto next = std::ranges::upper_bound(keyframes, frame, {},
+                                             &Keyframe::frame);
+  if (next == keyframes.begin()) {
+    return {keyframes.front(), keyframes.front(), 0.0f};
+  }
+  if (next == keyframes.end()) {
+    return {keyframes.back(), keyframes.back(), 0.0f};
+  }
+  const auto& previous = *(next - 1);
+  const float t = static_cast<float>(frame - previous.frame) /
+                  static_cast<float>(next->frame - previous.frame);
+  return {previous, *next, t};
+}
+}  // namespace
+
+glm::mat4 to_matrix(const std::span<const TransformStep> steps) {
+  glm::mat4 objectToWorld{1.0f};
+  for (const auto& step : steps) {
+    switch (step.operation) {
+      case TransformOperation::Translate:
+        objectToWorld =
+            glm::translate(glm::mat4{1.0f}, step.vector) * objectToWorld;
+        break;
+      case TransformOperation::Scale:
+        objectToWorld = glm::scale(glm::mat4{1.0f}, step.vector) *
+                        objectToWorld;
+        break;
+      case TransformOperation::Rotate:
+        if (glm::length(step.vector) > 0.0f) {
+          objectToWorld =
+              glm::rotate(glm::mat4{1.0f}, glm::radians(step.degrees),
+                          glm::normalize(step.vector)) *
+              objectToWorld;
+        }
+        break;
+    }
+  }
+  return objectToWorld;
+}
+
+std::optional<CameraKeyframe> camera_at(const Animation& animation,
+                                        const std::uint32_t frame) {
+  if (animation.camera.empty()) {
+    return std::nullopt;
+  }
+  const auto [a, b, t] =
+      bracket(std::span<const CameraKeyframe>(animation.camera), frame);
+  return CameraKeyframe{
+      .frame = frame,
+      .lookFrom = glm::mix(a.lookFrom, b.lookFrom, t),
+      .lookAt = glm::mix(a.lookAt, b.lookAt, t),
+      .vfov = glm::mix(a.vfov, b.vfov, t),
+      .focusDistance = glm::mix(a.focusDistance, b.focusDistance, t)};
+}
+
+std::vector<glm::mat4> instance_transforms_at(
+    const Animation& animation, const std::span<const Instance> instances,
+    const std::uint32_t frame) {
+  std::vector<glm::mat4> transforms;
+  transforms.reserve(instances.size());
+  for (const auto& instance : instances) {
+    transforms.push_back(instance.object_to_world());
+  }
+  std::vector<TransformStep> steps;
+  for (const auto& track : animation.instances) {
+    if (track.instance >= transforms.size() || track.keyframes.empty()) {
+      continue;
+    }
+    const auto [a, b, t] = bracket(
+        std::span<const InstanceKeyframe>(track.keyframes), frame);
+    steps = a.transform;
+    for (std::size_t i = 0; i < steps.size(); ++i) {
+      steps[i].vector = glm::mix(a.transform[i].vector,
+                                 b.transform[i].vector, t);
+      steps[i].degrees = glm::mix(a.transform[i].degrees,
+                                  b.transform[i].degrees, t);
+    }
+    transforms[track.instance] = to_matrix(steps);
+  }
+  return transforms;
+}
+
+bool pose_frame(Camera& camera, Scene& scene,
+                const std::span<const Instance> instances,
+                const Animation& animation, const std::uint32_t frame) {
+  if (const auto view = camera_at(animation, frame)) {
+    camera.look_at(view->lookFrom, view->lookAt, view->vfov,
+                   view->focusDistance);
+  }
+  bool rebuilt = false;
+  if (!animation.instances.empty()) {
+    const auto transforms =
+        instance_transforms_at(animation, instances, frame);
+    for (auto& bvh : scene.world.get<InstanceBVH>()) {
+      rebuilt = bvh.set_transforms(transforms) || rebuilt;
+    }
+  }
+  return rebuilt;
+}
+
+AnimationReport render_animation(Camera& camera, Scene& scene,
+                                 const std::span<const Instance> instances,
+                                 const Animation& animation,
+                                 const FrameSink& writeFrame) {
+  using Clock = std::chrono::steady_clock;
+  AnimationReport report;
+  const auto start = Clock::now();
+  // Holds the frame being written; the destructor waits for it if a render
+  // throws.
+  std::future<void> encoding;
+  for (std::uint32_t frame = 0; frame < animation.frameCount; ++frame) {
+    const auto updateStart = Clock::now();
+    if (pose_frame(camera, scene, instances, animation, frame)) {
+      ++report.rebuilds;
+    }
+
+    const auto renderStart = Clock::now();
+    report.update += renderStart - updateStart;
+    const auto& rendered = camera.render(scene);
+    // The camera reuses its image for the next frame.
+    ImageBuffer image(rendered.get_width(), rendered.get_height());
+    for (std::size_t y = 0; y < image.get_height(); ++y) {
+      for (std::size_t x = 0; x < image.get_width(); ++x) {
+        image[x, y] = rendered[x, y];
+      }
+    }
+
+    const auto waitStart = Clock::now();
+    report.render += waitStart - renderStart;
+    if (encoding.valid()) {
+      encoding.get();
+    }
+    report.encodeWait += Clock::now() - waitStart;
+    encoding = std::async(
+        std::launch::async,
+        [&writeFrame, frame, image = std::move(image)] {
+          writeFrame(frame, image);
+        });
+    ++report.frames;
+  }
+  const auto waitStart = Clock::now();
+  if (encoding.valid()) {
+    encoding.get();
+  }
+  report.encodeWait += Clock::now() - waitStart;
+  report.wall = Clock::now() - start;
+  return report;
+}
+
+}  // namespace mp
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <functional>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <vector>
+
+#include "Camera.hpp"
+#include "ImageBuffer.hpp"
+#include "Instance.hpp"
+#include "Scene.hpp"
+#include "glm/glm.hpp"
+
+namespace mp {
+
+enum class TransformOperation : std::uint8_t { Translate, Scale, Rotate };
+
+// One operation of an instance transform. Rotations turn by degrees about
+// vector, the others use vector as offset or scale factors.
+struct TransformStep {
+  TransformOperation operation{TransformOperation::Translate};
+  glm::vec3 vector{0.0f};
+  float degrees{0.0f};
+};
+
+// Applies steps in order, each on top of the previous ones. Rotations about
+// a zero axis are skipped.
+[[nodiscard]]
+glm::mat4 to_matrix(std::span<const TransformStep> steps);
+
+// Where the camera is at a frame. The other CameraSettings stay fixed for
+// the whole animation.
+struct CameraKeyframe {
+  std::uint32_t frame{};
+  glm::vec3 lookFrom{0.0f};
+  glm::vec3 lookAt{0.0f, 0.0f, -1.0f};
+  float vfov{90.0f};
+  float focusDistance{10.0f};
+};
+
+struct InstanceKeyframe {
+  std::uint32_t frame{};
+  std::vector<TransformStep> transform;
+};
+
+// Motion of one instance. All keyframes have the same operations in the
+// same order, so that their parameters can be interpolated: a turntable is
+// "rotate 0 1 0 0" at the first frame and "rotate 0 1 0 360" at the last.
+struct InstanceTrack {
+  // Position among the instances of the scene.
+  std::uint32_t instance{};
+  // Sorted by frame.
+  std::vector<InstanceKeyframe> keyframes;
+};
+
+// Keyframed camera and instance motion. Values are interpolated linearly
+// between keyframes and hold their first and last keyframe outside of them.
+struct Animation {
+  std::uint32_t frameCount{1};
+  // Sorted by frame. Empty for a still camera.
+  std::vector<CameraKeyframe> camera;
+  std::vector<InstanceTrack> instances;
+
+  [[nodiscard]]
+  bool animated() const noexcept {
+    return frameCount > 1;
+  }
+};
+
+// Camera placement at frame, empty if the camera has no keyframes.
+[[nodiscard]]
+std::optional<CameraKeyframe> camera_at(const Animation& animation,
+                                        std::uint32_t frame);
+
+// Object-to-world transform of each of instances at frame. Instances
+// without a track keep their own.
+[[nodiscard]]
+std::vector<glm::mat4> instance_transforms_at(
+    const Animation& animation, std::span<const Instance> instances,
+    std::uint32_t frame);
+
+// Moves camera and the instances of scene, as it was made from instances,
+// to frame of animation by refitting every InstanceBVH of scene.world.
+// Returns whether the top level of one had to be rebuilt instead.
+bool pose_frame(Camera& camera, Scene& scene,
+                std::span<const Instance> instances,
+                const Animation& animation, std::uint32_t frame);
+
+// Totals over the frames of render_animation().
+struct AnimationReport {
+  std::uint32_t frames{};
+  // Frames on which the top level of an InstanceBVH was rebuilt instead of
+  // refit.
+  std::uint32_t rebuilds{};
+  // Moving the camera and refitting the instances.
+  std::chrono::nanoseconds update{};
+  std::chrono::nanoseconds render{};
+  // Time the render loop waited for the previous frame to be written.
+  std::chrono::nanoseconds encodeWait{};
+  std::chrono::nanoseconds wall{};
+};
+
+inline std::ostream& operator<<(std::ostream& os,
+                                const AnimationReport& report) {
+  using Milliseconds = std::chrono::duration<double, std::milli>;
+  os << std::format("animation: {} frames in {:.1f} ms\n", report.frames,
+                    Milliseconds(report.wall).count());
+  os << std::format("  render: {:.1f} ms\n",
+                    Milliseconds(report.render).count());
+  os << std::format("  scene update: {:.1f} ms, {} rebuilds\n",
+                    Milliseconds(report.update).count(), report.rebuilds);
+  os << std::format("  waiting for encoder: {:.1f} ms\n",
+                    Milliseconds(report.encodeWait).count());
+  return os;
+}
+
+// Receives every finished frame, in order, on an encoding thread.
+using FrameSink = std::function<void(std::uint32_t frame,
+                                     const ImageBuffer& image)>;
+
+// Renders the frames of animation with one camera and one scene, reused
+// from frame to frame. The instances, as scene was made from them, are
+// moved by refitting every InstanceBVH of scene.world; the rest of the
+// geometry and the lights stay where they are. While a frame renders, the
+// previous one is handed to writeFrame, so encoding overlaps rendering;
+// at most one frame waits to be written. Exceptions thrown by writeFrame
+// stop the animation and are rethrown.
+AnimationReport render_animation(Camera& camera, Scene& scene,
+                                 std::span<const Instance> instances,
+                                 const Animation& animation,
+                                 const FrameSink& writeFrame);
+
+}  // namespace mp
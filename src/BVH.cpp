@@ -0,0 +1,425 @@
+#include "BVH.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <format>
+#include <future>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include "BVHCache.hpp"
+
+namespace mp {
+namespace {
+constexpr std::size_t kBinCount = 16;
+constexpr float kTraversalCost = 1.0f;
+constexpr float kIntersectionCost = 1.0f;
+// Subtrees bigger than this are built on their own thread.
+constexpr std::uint32_t kParallelBuildThreshold = 4096;
+
+struct Bin {
+  AABB bounds;
+  std::uint32_t count = 0;
+};
+
+struct Split {
+  int axis = -1;
+  std::size_t bin = 0;
+  float cost = infinity_f;
+};
+
+class Builder {
+ public:
+  Builder(std::span<const AABB> primitiveBounds, std::vector<BVHNode>& nodes,
+          std::vector<std::uint32_t>& indices)
+      : m_bounds(primitiveBounds), m_nodes(nodes), m_indices(indices) {
+    m_centroids.reserve(m_bounds.size());
+    for (const auto& b : m_bounds) {
+      m_centroids.push_back(b.centroid());
+    }
+    const auto hardwareThreads =
+        std::max(1u, std::thread::hardware_concurrency());
+    m_parallelDepth =
+        static_cast<std::size_t>(std::bit_width(hardwareThreads));
+  }
+
+  [[nodiscard]]
+  std::uint32_t node_count() const noexcept {
+    return m_nodeCount.load();
+  }
+
+  void build(const std::uint32_t nodeIndex, const std::uint32_t begin,
+             const std::uint32_t end, const std::size_t depth) {
+    auto& node = m_nodes[nodeIndex];
+    AABB centroidBounds;
+    node.bounds = AABB{};
+    for (std::uint32_t i = begin; i < end; ++i) {
+      node.bounds.expand(m_bounds[m_indices[i]]);
+      centroidBounds.expand(m_centroids[m_indices[i]]);
+    }
+
+    const std::uint32_t count = end - begin;
+    if (count <= 2 || depth + 1 >= BVHTree::kMaxDepth) {
+      make_leaf(node, begin, count);
+      return;
+    }
+
+    const auto split = find_split(begin, end, node.bounds, centroidBounds);
+    const float leafCost = kIntersectionCost * static_cast<float>(count);
+    if (split.axis < 0 ||
+        (split.cost >= leafCost && count <= BVHTree::kMaxLeafSize)) {
+      make_leaf(node, begin, count);
+      return;
+    }
+
+    const auto mid = partition(begin, end, centroidBounds, split);
+    const auto left = m_nodeCount.fetch_add(2);
+    node.offset = left;
+    node.count = 0;
+
+    if (count >= kParallelBuildThreshold && depth < m_parallelDepth) {
+      auto leftTask = std::async(std::launch::async, [=, this] {
+        build(left, begin, mid, depth + 1);
+      });
+      build(left + 1, mid, end, depth + 1);
+      leftTask.get();
+    } else {
+      build(left, begin, mid, depth + 1);
+      build(left + 1, mid, end, depth + 1);
+    }
+  }
+
+ private:
+  std::span<const AABB> m_bounds;
+  std::vector<glm::vec3> m_centroids;
+  std::vector<BVHNode>& m_nodes;
+  std::vector<std::uint32_t>& m_indices;
+  std::atomic<std::uint32_t> m_nodeCount{1};
+  std::size_t m_parallelDepth;
+
+  static void make_leaf(BVHNode& node, const std::uint32_t begin,
+                        const std::uint32_t count) {
+    node.offset = begin;
+    node.count = count;
+  }
+
+  [[nodiscard]]
+  static std::size_t bin_index(const float centroid, const float min,
+                               const float scale) {
+    const auto bin = static_cast<std::size_t>((centroid - min) * scale);
+    return std::min(bin, kBinCount - 1);
+  }
+
+  [[nodiscard]]
+  Split find_split(const std::uint32_t begin, const std::uint32_t end,
+                   const AABB& nodeBounds, const AABB& centroidBounds) const {
+    Split best;
+    const auto extent = centroidBounds.extent();
+    for (int axis = 0; axis < 3; ++axis) {
+      if (extent[axis] <= 0.0f) {
+        continue;
+      }
+      const float scale = static_cast<float>(kBinCount) / extent[axis];
+      std::array<Bin, kBinCount> bins{};
+      for (std::uint32_t i = begin; i < end; ++i) {
+        const auto primitive = m_indices[i];
+        auto& bin = bins[bin_index(m_centroids[primitive][axis],
+                                   centroidBounds.min[axis], scale)];
+        bin.bounds.expand(m_bounds[primitive]);
+        ++bin.count;
+      }
+
+      // Sweep from the right to get the area and count of every suffix, then
+      // from the left to evaluate each of the kBinCount - 1 split planes.
+      std::array<float, kBinCount - 1> rightArea{};
+      std::array<std::uint32_t, kBinCount - 1> rightCount{};
+      AABB accumulated;
+      std::uint32_t accumulatedCount = 0;
+      for (std::size_t b = kBinCount - 1; b > 0; --b) {
+        accumulated.expand(bins[b].bounds);
+        accumulatedCount += bins[b].count;
+        rightArea[b - 1] = accumulated.surface_area();
+        rightCount[b - 1] = accumulatedCount;
+      }
+
+      accumulated = AABB{};
+      accumulatedCount = 0;
+      for (std::size_t b = 0; b < kBinCount - 1; ++b) {
+        accumulated.expand(bins[b].bounds);
+        accumulatedCount += bins[b].count;
+        if (accumulatedCount == 0 || rightCount[b] == 0) {
+          continue;
+        }
+        const float cost =
+            accumulated.surface_area() * static_cast<float>(accumulatedCount) +
+            rightArea[b] * static_cast<float>(rightCount[b]);
+        if (cost < best.cost) {
+          best = Split{.axis = axis, .bin = b, .cost = cost};
+        }
+      }
+    }
+
+    if (best.axis >= 0) {
+      best.cost = kTraversalCost + kIntersectionCost * best.cost /
+                                       nodeBounds.surface_area();
+    }
+    return best;
+  }
+
+  [[nodiscard]]
+  std::uint32_t partition(const std::uint32_t begin, const std::uint32_t end,
+                          const AABB& centroidBounds, const Split& split) {
+    const auto first = m_indices.begin() + begin;
+    const auto last = m_indices.begin() + end;
+
+    if (split.axis >= 0) {
+      const auto axis = split.axis;
+      const float min = centroidBounds.min[axis];
+      const float scale =
+          static_cast<float>(kBinCount) / centroidBounds.extent()[axis];
+      const auto mid =
+          std::partition(first, last, [&](const std::uint32_t primitive) {
+            return bin_index(m_centroids[primitive][axis], min, scale) <=
+                   split.bin;
+          });
+      if (mid != first && mid != last) {
+        return static_cast<std::uint32_t>(mid - m_indices.begin());
+      }
+    }
+
+    // Every centroid coincides: any split is as good as another.
+    const auto mid = first + (last - first) / 2;
+    return static_cast<std::uint32_t>(mid - m_indices.begin());
+  }
+};
+}  // namespace
+
+BVHTree::BVHTree(const std::span<const AABB> primitiveBounds) {
+  if (primitiveBounds.empty()) {
+    return;
+  }
+  const auto primitiveCount =
+      static_cast<std::uint32_t>(primitiveBounds.size());
+  m_arrays = std::make_shared<Arrays>();
+  auto& [nodes, primitiveIndices] = *m_arrays;
+  primitiveIndices.resize(primitiveCount);
+  std::iota(primitiveIndices.begin(), primitiveIndices.end(), 0u);
+  nodes.resize(2 * static_cast<std::size_t>(primitiveCount) - 1);
+
+  Builder builder(primitiveBounds, nodes, primitiveIndices);
+  builder.build(0, 0, primitiveCount, 0);
+  nodes.resize(builder.node_count());
+  nodes.shrink_to_fit();
+  m_nodes = nodes;
+  m_primitiveIndices = primitiveIndices;
+}
+
+BVHTree::BVHTree(std::shared_ptr<const MappedFile> mapping,
+                 const std::span<const BVHNode> nodes,
+                 const std::span<const std::uint32_t> primitiveIndices)
+    : m_mapping(std::move(mapping)),
+      m_nodes(nodes),
+      m_primitiveIndices(primitiveIndices) {}
+
+bool BVHTree::valid(const std::span<const BVHNode> nodes,
+                    const std::span<const std::uint32_t> primitiveIndices,
+                    const std::span<const AABB> primitiveBounds) {
+  const auto contains = [](const AABB& outer, const AABB& inner) {
+    return inner.empty() ||
+           (glm::all(glm::lessThanEqual(outer.min, inner.min)) &&
+            glm::all(glm::greaterThanEqual(outer.max, inner.max)));
+  };
+  if (primitiveIndices.size() != primitiveBounds.size()) {
+    return false;
+  }
+  if (nodes.empty()) {
+    return primitiveIndices.empty();
+  }
+  std::vector<bool> seen(primitiveBounds.size());
+  for (const auto index : primitiveIndices) {
+    if (index >= seen.size() || seen[index]) {
+      return false;
+    }
+    seen[index] = true;
+  }
+
+  // Depth of every node reached so far, 0 for the others. Parents come
+  // first, so one pass in storage order sees each node after its parent.
+  std::vector<std::uint8_t> depth(nodes.size());
+  depth[0] = 1;
+  std::size_t covered = 0;
+  for (std::size_t i = 0; i < nodes.size(); ++i) {
+    const auto& node = nodes[i];
+    if (depth[i] == 0) {
+      return false;
+    }
+    if (node.is_leaf()) {
+      if (node.offset > primitiveIndices.size() ||
+          node.count > primitiveIndices.size() - node.offset) {
+        return false;
+      }
+      for (auto p = node.offset; p < node.offset + node.count; ++p) {
+        if (!contains(node.bounds, primitiveBounds[primitiveIndices[p]])) {
+          return false;
+        }
+      }
+      covered += node.count;
+      continue;
+    }
+    if (node.offset <= i || node.offset >= nodes.size() - 1 ||
+        depth[i] >= kMaxDepth) {
+      return false;
+    }
+    for (const auto child : {node.offset, node.offset + 1}) {
+      if (depth[child] != 0 || !contains(node.bounds, nodes[child].bounds)) {
+        return false;
+      }
+      depth[child] = static_cast<std::uint8_t>(depth[i] + 1);
+    }
+  }
+  // Every node was reached once, so the leaves are disjoint exactly when
+  // they add up to the primitive count.
+  return covered == primitiveIndices.size();
+}
+
+void BVHTree::refit(const std::span<const AABB> leafBounds) {
+  if (leafBounds.size() != m_primitiveIndices.size()) {
+    throw std::invalid_argument(
+        std::format("BVH built over {} primitives refit with {}",
+                    m_primitiveIndices.size(), leafBounds.size()));
+  }
+  if (!m_arrays || m_arrays.use_count() > 1) {
+    m_arrays = std::make_shared<Arrays>(
+        Arrays{{m_nodes.begin(), m_nodes.end()},
+               {m_primitiveIndices.begin(), m_primitiveIndices.end()}});
+    m_mapping.reset();
+    m_nodes = m_arrays->nodes;
+    m_primitiveIndices = m_arrays->primitiveIndices;
+  }
+  auto& nodes = m_arrays->nodes;
+  // Children are always stored after their parent.
+  for (auto i = nodes.size(); i-- > 0;) {
+    auto& node = nodes[i];
+    if (node.is_leaf()) {
+      node.bounds = AABB{};
+      for (auto p = node.offset; p < node.offset + node.count; ++p) {
+        node.bounds.expand(leafBounds[p]);
+      }
+    } else {
+      node.bounds = AABB::merge(nodes[node.offset].bounds,
+                                nodes[node.offset + 1].bounds);
+    }
+  }
+}
+
+float BVHTree::sah_cost() const noexcept {
+  if (m_nodes.empty()) {
+    return 0.0f;
+  }
+  const float rootArea = m_nodes.front().bounds.surface_area();
+  if (rootArea <= 0.0f) {
+    return kIntersectionCost * static_cast<float>(m_primitiveIndices.size());
+  }
+  float cost = 0.0f;
+  for (const auto& node : m_nodes) {
+    cost += node.bounds.surface_area() *
+            (node.is_leaf()
+                 ? kIntersectionCost * static_cast<float>(node.count)
+                 : kTraversalCost);
+  }
+  return cost / rootArea;
+}
+
+BVH::BVH(std::vector<Hittable> objects) {
+  std::vector<AABB> bounds;
+  bounds.reserve(objects.size());
+  for (const auto& o : objects) {
+    bounds.push_back(o.bounding_box());
+  }
+  m_tree = BVHTree(bounds);
+
+  m_objects.reserve(objects.size());
+  for (const auto index : m_tree.primitive_indices()) {
+    m_objects.push_back(std::move(objects[index]));
+  }
+}
+
+bool Hit(const BVH& bvh, const Ray& ray, Interval<float> interval,
+         HitRecord& hitRecord) {
+  const auto& objects = bvh.objects();
+  HitRecord tmpHitRecord;
+  return bvh.tree().traverse(
+      ray, interval,
+      [&](const std::uint32_t first, const std::uint32_t count,
+          Interval<float>& currentInterval) {
+        bool hitAnything = false;
+        for (std::uint32_t i = first; i < first + count; ++i) {
+          if (objects[i].hit(ray, currentInterval, tmpHitRecord)) {
+            hitRecord = tmpHitRecord;
+            currentInterval.max = tmpHitRecord.t;
+            hitAnything = true;
+          }
+        }
+        return hitAnything;
+      });
+}
+
+bool Occluded(const BVH& bvh, const Ray& ray,
+              const Interval<float> interval) {
+  const auto& objects = bvh.objects();
+  return bvh.tree().occluded(
+      ray, interval,
+      [&](const std::uint32_t first, const std::uint32_t count) {
+        for (std::uint32_t i = first; i < first + count; ++i) {
+          if (objects[i].occluded(ray, interval)) {
+            return true;
+          }
+        }
+        return false;
+      });
+}
+
+AABB BoundingBox(const BVH& bvh) { return bvh.tree().bounds(); }
+
+SphereBVH::SphereBVH(const std::span<const Sphere> spheres,
+                     BVHCache* const cache) {
+  std::vector<AABB> bounds;
+  bounds.reserve(spheres.size());
+  for (const auto& s : spheres) {
+    bounds.push_back(BoundingBox(s));
+  }
+  m_tree = cached_tree(cache, bounds);
+
+  std::vector<Sphere> ordered;
+  ordered.reserve(spheres.size());
+  for (const auto index : m_tree.primitive_indices()) {
+    ordered.push_back(spheres[index]);
+  }
+  m_spheres = SphereSoA(ordered);
+}
+
+bool Hit(const SphereBVH& bvh, const Ray& ray, Interval<float> interval,
+         HitRecord& hitRecord) {
+  return bvh.tree().traverse(
+      ray, interval,
+      [&](const std::uint32_t first, const std::uint32_t count,
+          Interval<float>& currentInterval) {
+        return bvh.spheres().hit_range(first, count, ray, currentInterval,
+                                       hitRecord);
+      });
+}
+
+bool Occluded(const SphereBVH& bvh, const Ray& ray,
+              const Interval<float> interval) {
+  return bvh.tree().occluded(
+      ray, interval, [&](const std::uint32_t first, const std::uint32_t count) {
+        return bvh.spheres().occluded_range(first, count, ray, interval);
+      });
+}
+
+AABB BoundingBox(const SphereBVH& bvh) { return bvh.tree().bounds(); }
+}  // namespace mp
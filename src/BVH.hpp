@@ -0,0 +1,296 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "AABB.hpp"
+#include "Hittable.hpp"
+#include "Instrumentation.hpp"
+#include "Interval.hpp"
+#include "Ray.hpp"
+#include "Sphere.hpp"
+#include "SphereSoA.hpp"
+
+namespace mp {
+
+class BVHCache;
+class MappedFile;
+
+struct BVHNode {
+  AABB bounds;
+  // Leaves: index of the first primitive. Interior nodes: index of the left
+  // child, the right child always follows it at offset + 1.
+  std::uint32_t offset;
+  // Number of primitives in a leaf, 0 for interior nodes.
+  std::uint32_t count;
+
+  [[nodiscard]]
+  constexpr bool is_leaf() const noexcept {
+    return count != 0;
+  }
+};
+
+// Node topology built with the binned surface area heuristic. The tree only
+// knows about primitive bounds, the owner keeps primitives in the order given
+// by primitive_indices() and supplies the leaf intersection to traverse().
+// Nodes refer to each other by index, so the arrays can be stored and mapped
+// back as they are (see BVHCache).
+class BVHTree {
+ public:
+  static constexpr std::size_t kMaxDepth = 64;
+  static constexpr std::uint32_t kMaxLeafSize = 8;
+
+  BVHTree() = default;
+  explicit BVHTree(std::span<const AABB> primitiveBounds);
+
+  // Uses nodes and primitiveIndices, which lie in mapping, in place. The
+  // tree and its copies keep mapping alive. The arrays must pass valid().
+  BVHTree(std::shared_ptr<const MappedFile> mapping,
+          std::span<const BVHNode> nodes,
+          std::span<const std::uint32_t> primitiveIndices);
+
+  [[nodiscard]]
+  const AABB& bounds() const noexcept {
+    static constexpr AABB kEmpty{};
+    return m_nodes.empty() ? kEmpty : m_nodes.front().bounds;
+  }
+
+  [[nodiscard]]
+  std::span<const BVHNode> nodes() const noexcept {
+    return m_nodes;
+  }
+
+  [[nodiscard]]
+  std::span<const std::uint32_t> primitive_indices() const noexcept {
+    return m_primitiveIndices;
+  }
+
+  // Whether nodes and primitiveIndices make a tree over primitiveBounds
+  // that traverse() can walk: every node is reached once from the root,
+  // children are stored after their parent, no path is deeper than
+  // kMaxDepth, the leaves cover every primitive once and every box holds
+  // what lies below it. Linear in the size of the tree, for arrays read
+  // from files.
+  [[nodiscard]]
+  static bool valid(std::span<const BVHNode> nodes,
+                    std::span<const std::uint32_t> primitiveIndices,
+                    std::span<const AABB> primitiveBounds);
+
+  // Recomputes the node bounds bottom-up for primitives that moved, keeping
+  // the topology. leafBounds are in the order of primitive_indices(), the
+  // order owners store their primitives in. Much cheaper than a rebuild,
+  // but the tree degrades as primitives drift away from the neighbours
+  // they were grouped with; sah_cost() tells by how much. A tree that
+  // shares its arrays with copies or a mapping gets its own first. Throws
+  // std::invalid_argument if the primitive count differs from the build.
+  void refit(std::span<const AABB> leafBounds);
+
+  // Expected cost of a ray that hits the root, in units of one primitive
+  // test, under the surface area heuristic the tree was built with.
+  [[nodiscard]]
+  float sah_cost() const noexcept;
+
+  // Visits leaves front-to-back. hitLeaf(first, count, interval) intersects
+  // the primitives of one leaf, shrinks interval.max to the closest hit and
+  // returns whether anything was hit. Subtrees entered beyond interval.max
+  // are skipped.
+  template <typename LeafFn>
+  bool traverse(const Ray& ray, Interval<float>& interval,
+                LeafFn&& hitLeaf) const;
+
+  // Any-hit traversal for shadow rays. occludedLeaf(first, count) returns
+  // whether a primitive of the leaf blocks the ray inside interval; the
+  // first leaf that does ends the traversal. Children are visited in
+  // storage order since no closest hit has to be found.
+  template <typename LeafFn>
+  bool occluded(const Ray& ray, Interval<float> interval,
+                LeafFn&& occludedLeaf) const;
+
+ private:
+  struct Arrays {
+    std::vector<BVHNode> nodes;
+    std::vector<std::uint32_t> primitiveIndices;
+  };
+
+  // Built trees own their arrays, mapped ones point into the mapping.
+  // Copies share either, the arrays do not change after the build but in
+  // refit().
+  std::shared_ptr<Arrays> m_arrays;
+  std::shared_ptr<const MappedFile> m_mapping;
+  std::span<const BVHNode> m_nodes;
+  std::span<const std::uint32_t> m_primitiveIndices;
+};
+
+template <typename LeafFn>
+bool BVHTree::traverse(const Ray& ray, Interval<float>& interval,
+                       LeafFn&& hitLeaf) const {
+  struct StackEntry {
+    std::uint32_t node;
+    float tEntry;
+  };
+
+  if (m_nodes.empty()) {
+    return false;
+  }
+  const glm::vec3 invDirection = 1.0f / ray.direction();
+  float tEntry;
+  instrumentation::count_box_tests(1);
+  if (!m_nodes.front().bounds.hit(ray, invDirection, interval, tEntry)) {
+    return false;
+  }
+
+  std::array<StackEntry, kMaxDepth> stack;
+  std::size_t stackSize = 0;
+  std::uint32_t current = 0;
+  bool hitAnything = false;
+
+  while (true) {
+    const auto& node = m_nodes[current];
+    if (node.is_leaf()) {
+      if (hitLeaf(node.offset, node.count, interval)) {
+        hitAnything = true;
+      }
+    } else {
+      instrumentation::count_box_tests(2);
+      float tLeft, tRight;
+      const bool hitLeft = m_nodes[node.offset].bounds.hit(
+          ray, invDirection, interval, tLeft);
+      const bool hitRight = m_nodes[node.offset + 1].bounds.hit(
+          ray, invDirection, interval, tRight);
+      if (hitLeft && hitRight) {
+        const bool leftFirst = tLeft <= tRight;
+        stack[stackSize++] = leftFirst
+                                 ? StackEntry{node.offset + 1, tRight}
+                                 : StackEntry{node.offset, tLeft};
+        current = leftFirst ? node.offset : node.offset + 1;
+        continue;
+      }
+      if (hitLeft || hitRight) {
+        current = hitLeft ? node.offset : node.offset + 1;
+        continue;
+      }
+    }
+
+    // Pop the next subtree that can still contain a closer hit.
+    do {
+      if (stackSize == 0) {
+        return hitAnything;
+      }
+      --stackSize;
+    } while (stack[stackSize].tEntry > interval.max);
+    current = stack[stackSize].node;
+  }
+}
+
+template <typename LeafFn>
+bool BVHTree::occluded(const Ray& ray, const Interval<float> interval,
+                       LeafFn&& occludedLeaf) const {
+  if (m_nodes.empty()) {
+    return false;
+  }
+  const glm::vec3 invDirection = 1.0f / ray.direction();
+  float tEntry;
+  instrumentation::count_box_tests(1);
+  if (!m_nodes.front().bounds.hit(ray, invDirection, interval, tEntry)) {
+    return false;
+  }
+
+  std::array<std::uint32_t, kMaxDepth> stack;
+  std::size_t stackSize = 0;
+  std::uint32_t current = 0;
+  while (true) {
+    const auto& node = m_nodes[current];
+    if (node.is_leaf()) {
+      if (occludedLeaf(node.offset, node.count)) {
+        return true;
+      }
+    } else {
+      instrumentation::count_box_tests(2);
+      float tLeft, tRight;
+      const bool hitLeft = m_nodes[node.offset].bounds.hit(
+          ray, invDirection, interval, tLeft);
+      const bool hitRight = m_nodes[node.offset + 1].bounds.hit(
+          ray, invDirection, interval, tRight);
+      if (hitLeft && hitRight) {
+        stack[stackSize++] = node.offset + 1;
+      }
+      if (hitLeft || hitRight) {
+        current = hitLeft ? node.offset : node.offset + 1;
+        continue;
+      }
+    }
+    if (stackSize == 0) {
+      return false;
+    }
+    current = stack[--stackSize];
+  }
+}
+
+// Bounding volume hierarchy over arbitrary hittables. Plugs into the world as
+// a Hittable itself.
+class BVH {
+ public:
+  explicit BVH(std::vector<Hittable> objects);
+
+  [[nodiscard]]
+  const BVHTree& tree() const noexcept {
+    return m_tree;
+  }
+
+  [[nodiscard]]
+  const std::vector<Hittable>& objects() const noexcept {
+    return m_objects;
+  }
+
+ private:
+  BVHTree m_tree;
+  std::vector<Hittable> m_objects;
+};
+
+[[nodiscard]]
+bool Hit(const BVH& bvh, const Ray& ray, Interval<float> interval,
+         HitRecord& hitRecord);
+
+[[nodiscard]]
+bool Occluded(const BVH& bvh, const Ray& ray, Interval<float> interval);
+
+[[nodiscard]]
+AABB BoundingBox(const BVH& bvh);
+
+// BVH over spheres only. Leaves are contiguous ranges of a SphereSoA and are
+// intersected with its SIMD kernel instead of one virtual call per sphere.
+class SphereBVH {
+ public:
+  // Takes the tree from cache if given, see BVHCache.
+  explicit SphereBVH(std::span<const Sphere> spheres,
+                     BVHCache* cache = nullptr);
+
+  [[nodiscard]]
+  const BVHTree& tree() const noexcept {
+    return m_tree;
+  }
+
+  [[nodiscard]]
+  const SphereSoA& spheres() const noexcept {
+    return m_spheres;
+  }
+
+ private:
+  BVHTree m_tree;
+  SphereSoA m_spheres;
+};
+
+[[nodiscard]]
+bool Hit(const SphereBVH& bvh, const Ray& ray, Interval<float> interval,
+         HitRecord& hitRecord);
+
+[[nodiscard]]
+bool Occluded(const SphereBVH& bvh, const Ray& ray, Interval<float> interval);
+
+[[nodiscard]]
+AABB BoundingBox(const SphereBVH& bvh);
+
+}  // namespace mp
@@ -0,0 +1,206 @@
+#include "BVHCache.hpp"
+
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include "MappedFile.hpp"
+
+namespace mp {
+namespace {
+
+constexpr std::array<char, 8> kCacheMagic{'M', 'P', 'B', 'V',
+                                          'H', '\0', '\0', '\0'};
+// Raise whenever the builder changes, so that trees of the old one are
+// rebuilt rather than reused.
+constexpr std::uint32_t kCacheVersion = 1;
+
+// Arrays start at multiples of this, so the mapped data is suitably aligned
+// for every element type.
+constexpr std::uint64_t kArrayAlignment = 16;
+
+struct CacheHeader {
+  std::array<char, 8> magic;
+  std::uint32_t version;
+  std::uint32_t nodeSize;
+  std::uint64_t key;
+  std::uint64_t primitiveCount;
+  std::uint64_t nodeCount;
+  std::uint64_t nodeOffset;
+  std::uint64_t indexOffset;
+};
+
+static_assert(std::is_trivially_copyable_v<CacheHeader>);
+static_assert(std::is_trivially_copyable_v<BVHNode>);
+// The key hashes the bounds as they are in memory, padding would make it
+// depend on garbage.
+static_assert(sizeof(AABB) == 6 * sizeof(float));
+
+constexpr std::uint64_t align_up(const std::uint64_t offset) noexcept {
+  return (offset + kArrayAlignment - 1) / kArrayAlignment * kArrayAlignment;
+}
+
+}  // namespace
+
+BVHCache::BVHCache(std::filesystem::path directory)
+    : m_directory(std::move(directory)) {
+  std::filesystem::create_directories(m_directory);
+}
+
+BVHTree BVHCache::tree(const std::span<const AABB> primitiveBounds) {
+  if (primitiveBounds.empty()) {
+    return BVHTree{};
+  }
+  const auto hash = key(primitiveBounds);
+  if (auto tree = load(hash, primitiveBounds)) {
+    ++m_report.loaded;
+    return *std::move(tree);
+  }
+  BVHTree tree(primitiveBounds);
+  ++m_report.built;
+  if (!store(hash, tree)) {
+    ++m_report.storeFailures;
+  }
+  return tree;
+}
+
+std::uint64_t BVHCache::key(
+    const std::span<const AABB> primitiveBounds) noexcept {
+  // Eight bytes at a time, since the bounds of a large mesh run to hundreds
+  // of megabytes; collisions only cost a rebuild.
+  const auto bytes = std::as_bytes(primitiveBounds);
+  std::uint64_t hash = 0xcbf29ce484222325ull ^ primitiveBounds.size();
+  for (std::size_t i = 0; i + sizeof(std::uint64_t) <= bytes.size();
+       i += sizeof(std::uint64_t)) {
+    std::uint64_t word;
+    std::memcpy(&word, bytes.data() + i, sizeof(word));
+    hash = (std::rotl(hash, 5) ^ word) * 0x9e3779b97f4a7c15ull;
+  }
+  // Mix the high bits, which every word reached last, back into the low
+  // ones.
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+std::filesystem::path BVHCache::path_of(const std::uint64_t key) const {
+  return m_directory / std::format("{:016x}.bvh", key);
+}
+
+std::optional<BVHTree> BVHCache::load(
+    const std::uint64_t key, const std::span<const AABB> primitiveBounds) {
+  const auto path = path_of(key);
+  std::error_code error;
+  if (!std::filesystem::exists(path, error)) {
+    return std::nullopt;
+  }
+  std::shared_ptr<const MappedFile> mapping;
+  try {
+    mapping = std::make_shared<const MappedFile>(path);
+  } catch (const std::system_error&) {
+    ++m_report.rejected;
+    return std::nullopt;
+  }
+
+  const auto data = mapping->data();
+  CacheHeader header;
+  const auto fits = [&data](const std::uint64_t offset,
+                            const std::uint64_t count,
+                            const std::size_t elementSize) {
+    return offset % kArrayAlignment == 0 && offset <= data.size() &&
+           count <= (data.size() - offset) / elementSize;
+  };
+  if (data.size() < sizeof(header)) {
+    ++m_report.rejected;
+    return std::nullopt;
+  }
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (header.magic != kCacheMagic || header.version != kCacheVersion ||
+      header.nodeSize != sizeof(BVHNode) || header.key != key ||
+      header.primitiveCount != primitiveBounds.size() ||
+      !fits(header.nodeOffset, header.nodeCount, sizeof(BVHNode)) ||
+      !fits(header.indexOffset, header.primitiveCount,
+            sizeof(std::uint32_t))) {
+    ++m_report.rejected;
+    return std::nullopt;
+  }
+  const std::span nodes(
+      reinterpret_cast<const BVHNode*>(data.data() + header.nodeOffset),
+      static_cast<std::size_t>(header.nodeCount));
+  const std::span primitiveIndices(
+      reinterpret_cast<const std::uint32_t*>(data.data() +
+                                             header.indexOffset),
+      static_cast<std::size_t>(header.primitiveCount));
+  if (!BVHTree::valid(nodes, primitiveIndices, primitiveBounds)) {
+    ++m_report.rejected;
+    return std::nullopt;
+  }
+  return BVHTree(std::move(mapping), nodes, primitiveIndices);
+}
+
+bool BVHCache::store(const std::uint64_t key, const BVHTree& tree) const {
+  const auto nodes = tree.nodes();
+  const auto primitiveIndices = tree.primitive_indices();
+  CacheHeader header{
+      .magic = kCacheMagic,
+      .version = kCacheVersion,
+      .nodeSize = sizeof(BVHNode),
+      .key = key,
+      .primitiveCount = primitiveIndices.size(),
+      .nodeCount = nodes.size(),
+      .nodeOffset = align_up(sizeof(CacheHeader)),
+      .indexOffset = 0,
+  };
+  header.indexOffset =
+      align_up(header.nodeOffset + nodes.size() * sizeof(BVHNode));
+
+  // Readers only ever see complete files under the final name. The random
+  // part keeps processes and threads storing the same tree at once from
+  // writing to the same temporary file.
+  const auto path = path_of(key);
+  auto temporary = path;
+  std::random_device entropy;
+  temporary += std::format(
+      ".{}.{:08x}{:08x}.tmp",
+      std::chrono::steady_clock::now().time_since_epoch().count(), entropy(),
+      entropy());
+  {
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    const auto pad_to = [&file](const std::uint64_t offset) {
+      constexpr std::array<char, kArrayAlignment> kZeros{};
+      const auto position = static_cast<std::uint64_t>(file.tellp());
+      file.write(kZeros.data(),
+                 static_cast<std::streamsize>(offset - position));
+    };
+    const auto write = [&file](const auto elements) {
+      file.write(reinterpret_cast<const char*>(elements.data()),
+                 static_cast<std::streamsize>(elements.size_bytes()));
+    };
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    pad_to(header.nodeOffset);
+    write(nodes);
+    pad_to(header.indexOffset);
+    write(primitiveIndices);
+    file.close();
+    if (file.good()) {
+      std::error_code error;
+      std::filesystem::rename(temporary, path, error);
+      if (!error) {
+        return true;
+      }
+    }
+  }
+  std::error_code error;
+  std::filesystem::remove(temporary, error);
+  return false;
+}
+
+}  // namespace mp
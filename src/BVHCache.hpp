@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <optional>
+#include <ostream>
+#include <span>
+
+#include "AABB.hpp"
+#include "BVH.hpp"
+
+namespace mp {
+
+struct BVHCacheReport {
+  // Trees mapped from the cache.
+  std::size_t loaded{};
+  // Trees built because the cache had none for their primitives.
+  std::size_t built{};
+  // Cache files found but not used: unreadable, of another version, or not
+  // a valid tree over the primitives they were looked up for. Each costs a
+  // build and is replaced.
+  std::size_t rejected{};
+  // Built trees that could not be written to the cache.
+  std::size_t storeFailures{};
+};
+
+inline std::ostream& operator<<(std::ostream& os,
+                                const BVHCacheReport& report) {
+  os << std::format("bvh cache: {} loaded, {} built, {} rejected",
+                    report.loaded, report.built, report.rejected);
+  if (report.storeFailures != 0) {
+    os << std::format(", {} could not be stored", report.storeFailures);
+  }
+  return os << '\n';
+}
+
+// Directory of built BVHTrees, so that renders of the same geometry skip the
+// build. A tree is stored under a hash of the bounds it was built over, the
+// only input of the build, as a header followed by its node and primitive
+// index arrays in native layout. Loading maps the file and uses the arrays
+// in place: nodes refer to each other by index, so there is nothing to fix
+// up. Before a mapped tree is used, BVHTree::valid() checks it against the
+// bounds it was looked up for, so a stale, corrupt or colliding file costs a
+// rebuild, never a wrong image. Files are written under a temporary name
+// and renamed, so processes can share a directory. Not thread safe.
+class BVHCache {
+ public:
+  // Creates directory if it does not exist. Throws
+  // std::filesystem::filesystem_error if that fails.
+  explicit BVHCache(std::filesystem::path directory);
+
+  // The tree over primitiveBounds, mapped from the cache if it holds one,
+  // else built and stored.
+  [[nodiscard]]
+  BVHTree tree(std::span<const AABB> primitiveBounds);
+
+  [[nodiscard]]
+  const BVHCacheReport& report() const noexcept {
+    return m_report;
+  }
+
+  // 64-bit hash of the bytes of primitiveBounds, which names the file.
+  [[nodiscard]]
+  static std::uint64_t key(std::span<const AABB> primitiveBounds) noexcept;
+
+ private:
+  std::filesystem::path m_directory;
+  BVHCacheReport m_report;
+
+  [[nodiscard]]
+  std::filesystem::path path_of(std::uint64_t key) const;
+
+  [[nodiscard]]
+  std::optional<BVHTree> load(std::uint64_t key,
+                              std::span<const AABB> primitiveBounds);
+
+  [[nodiscard]]
+  bool store(std::uint64_t key, const BVHTree& tree) const;
+};
+
+// cache->tree(primitiveBounds), or a build without a cache.
+[[nodiscard]]
+inline BVHTree cached_tree(BVHCache* const cache,
+                           const std::span<const AABB> primitiveBounds) {
+  return cache != nullptr ? cache->tree(primitiveBounds)
+                          : BVHTree(primitiveBounds);
+}
+
+}  // namespace mp
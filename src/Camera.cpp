@@ -1,27 +1,102 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <format>
+#include <functional>
+#include <mutex>
+#include <numeric>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
 #include <thread>
+#include <utility>
 #include <vector>
 
 #include "Camera.hpp"
+#include "Instrumentation.hpp"
 #include "Material.hpp"
+#include "PathBatch.hpp"
+#include "TileScheduler.hpp"
 #include "glm/glm.hpp"
 
 namespace mp {
-bool Hit(const std::vector<Hittable>& objects, const Ray& ray,
-         Interval<float> interval, HitRecord& hitRecord) {
-  HitRecord tmpHitRecord;
-  bool hitAnything = false;
-  float currentMax = interval.max;
+namespace {
+constexpr MaterialSet kSurfaceMaterials =
+    material_bit(MaterialType::Lambertian) |
+    material_bit(MaterialType::Metal) |
+    material_bit(MaterialType::Dielectric);
 
-  for (const auto& o : objects) {
-    if (o.hit(ray, Interval{.min = interval.min, .max = currentMax},
-              tmpHitRecord)) {
-      hitRecord = tmpHitRecord;
-      currentMax = tmpHitRecord.t;
-      hitAnything = true;
+// Depths with a kernel of their own; 0 stands for the others up to
+// Camera::kMaxKernelDepth, which read the depth at run time.
+constexpr std::array kKernelDepths{0, 4, 8, 16};
+
+// Material sets and light sampling worth a kernel: scenes lit by the sky
+// alone, scenes with emitters but nothing to sample, and scenes with
+// sampled lights.
+constexpr std::array<std::pair<MaterialSet, bool>, 3> kKernelShading{{
+    {kSurfaceMaterials, false},
+    {kAllMaterials, false},
+    {kAllMaterials, true},
+}};
+
+// Every render_tile() instance compiled, the generic one first.
+constexpr auto kKernels = [] {
+  std::array<KernelOptions,
+             1 + 2 * kKernelDepths.size() * kKernelShading.size()>
+      kernels{};
+  std::size_t i = 1;
+  for (const bool thinLens : {false, true}) {
+    for (const int maxDepth : kKernelDepths) {
+      for (const auto& [materials, lightSampling] : kKernelShading) {
+        kernels[i++] = KernelOptions{.generic = false,
+                                     .thinLens = thinLens,
+                                     .maxDepth = maxDepth,
+                                     .materials = materials,
+                                     .lightSampling = lightSampling};
+      }
     }
   }
+  return kernels;
+}();
+
+// Spread of the ray cone leaving a non-specular bounce. Such a bounce
+// scatters a pixel over most of the hemisphere; the cone only needs to be
+// wide enough that textures seen through it are read from coarse mip
+// levels.
+constexpr float kDiffuseSpread = 0.1f;
+
+// Footprint of the hit of ray, whose cone is cone.
+void set_footprint(HitRecord& hitRecord, const Ray& ray, const RayCone& cone) {
+  hitRecord.footprint =
+      cone.width_at(hitRecord.t * glm::length(ray.direction()));
+}
 
-  return hitAnything;
+// Cone of the ray scattered at hitRecord, after set_footprint().
+[[nodiscard]]
+RayCone scattered_cone(const HitRecord& hitRecord, const bool specular,
+                       const RayCone& cone) {
+  return {hitRecord.footprint, specular ? cone.spread : kDiffuseSpread};
+}
+}  // namespace
+
+std::string to_string(const KernelOptions& options) {
+  if (options.generic) {
+    return "generic";
+  }
+  std::string materials;
+  for (unsigned i = 0; i < static_cast<unsigned>(MaterialType::Count); ++i) {
+    const auto type = static_cast<MaterialType>(i);
+    if ((options.materials & material_bit(type)) != 0) {
+      materials += std::format("{}{}", materials.empty() ? "" : "+",
+                               to_string(type));
+    }
+  }
+  return std::format(
+      "{}, depth {}, {}{}", options.thinLens ? "thin lens" : "pinhole",
+      options.maxDepth > 0 ? std::to_string(options.maxDepth) : "any",
+      materials, options.lightSampling ? ", light sampling" : "");
 }
 
 Camera::Camera(const std::size_t baseWindowWidth, const double aspectRatio,
@@ -29,100 +104,1102 @@ Camera::Camera(const std::size_t baseWindowWidth, const double aspectRatio,
                const float vfov, const float defocusAngle,
                const float focusDistance, const glm::vec3& lookFrom,
                const glm::vec3& lookAt, const glm::vec3& worldUp)
-    : m_image(baseWindowWidth, aspectRatio),
+    : m_width(baseWindowWidth),
+      m_height(std::max<std::size_t>(
+          1, static_cast<std::size_t>(baseWindowWidth / aspectRatio))),
       m_cameraPos(lookFrom),
       m_samplesPerPixel(samplesPerPixel),
-      m_pixelSamplesScale(1.0f / samplesPerPixel),
       m_maxDepth(maxDepth),
       m_defocusAngle(defocusAngle),
-      m_focusDist(focusDistance) {
+      m_focusDist(focusDistance),
+      m_worldUp(worldUp) {
+  look_at(lookFrom, lookAt, vfov, focusDistance);
+}
+
+void Camera::look_at(const glm::vec3& lookFrom, const glm::vec3& lookAt,
+                     const float vfov, const float focusDistance) {
+  m_cameraPos = lookFrom;
+  m_focusDist = focusDistance;
   const auto theta = glm::radians(vfov);
   const auto h = glm::tan(theta / 2);
   const float viewportHeight = 2.0f * h * focusDistance;
   const float viewportWidth =
       viewportHeight *
-      (static_cast<double>(m_image.get_width()) / m_image.get_height());
+      (static_cast<double>(m_width) / m_height);
 
   const auto cameraBack = normalize(lookFrom - lookAt);  // +Z
   const auto cameraRight =
-      normalize(cross(worldUp, cameraBack));        // +X
+      normalize(cross(m_worldUp, cameraBack));      // +X
   const auto cameraUp = cross(cameraBack, cameraRight);  // +Y
 
   const auto viewportU = cameraRight * viewportWidth;
   const auto viewportV = -cameraUp * viewportHeight;
 
-  m_pixelDeltaU = viewportU / static_cast<float>(m_image.get_width());
-  m_pixelDeltaV = viewportV / static_cast<float>(m_image.get_height());
+  m_pixelDeltaU = viewportU / static_cast<float>(m_width);
+  m_pixelDeltaV = viewportV / static_cast<float>(m_height);
+  m_pixelSpread = 2.0f * h / static_cast<float>(m_height);
 
   const auto viewportUpperLeft = m_cameraPos - focusDistance * cameraBack -
                                  viewportU / 2.0f - viewportV / 2.0f;
   m_startPixel = viewportUpperLeft + 0.5f * (m_pixelDeltaU + m_pixelDeltaV);
 
   const auto defocusRadius =
-      focusDistance * std::tan(glm::radians(defocusAngle / 2));
+      focusDistance * std::tan(glm::radians(m_defocusAngle / 2));
   m_defocusDist_u = cameraRight * defocusRadius;
   m_defocusDist_v = cameraUp * defocusRadius;
 }
 
-const ImageBuffer& Camera::render(const std::vector<Hittable>& world) {
-  const int width = m_image.get_width();
-  const int height = m_image.get_height();
-  const unsigned int threadCount = std::thread::hardware_concurrency();
-  std::vector<std::thread> threads;
-  const int rowsPerThread = height / threadCount;
-  int y = 0;
-  auto renderRows = [this, &world, width](const int yStart, const int yEnd) {
-    for (int y = yStart; y < yEnd; ++y) {
+const ImageBuffer& Camera::render(const Scene& scene) {
+  if (m_accumulation.get_width() != m_width ||
+      m_accumulation.get_height() != m_height) {
+    m_accumulation = AccumulationBuffer(m_width, m_height);
+  } else {
+    m_accumulation.clear();
+  }
+  return render(scene, m_accumulation);
+}
+
+const ImageBuffer& Camera::render(const Scene& scene,
+                                  AccumulationBuffer& accumulation) {
+  using Clock = std::chrono::steady_clock;
+  if (accumulation.get_width() != m_width ||
+      accumulation.get_height() != m_height) {
+    throw std::invalid_argument(std::format(
+        "Accumulation buffer is {}x{}, camera renders {}x{}",
+        accumulation.get_width(), accumulation.get_height(), m_width,
+        m_height));
+  }
+  const std::uint32_t targetSamples = target_samples();
+  begin_render(scene, accumulation, targetSamples);
+  const auto renderStart = Clock::now();
+  add_samples(scene, accumulation, targetSamples, Clock::time_point::max(),
+              {});
+  resolve(accumulation, targetSamples);
+  m_report.wall = Clock::now() - renderStart - m_report.denoise;
+  return *m_image;
+}
+
+const ImageBuffer& Camera::render_progressive(
+    const Scene& scene, const ProgressiveSettings& settings,
+    const std::stop_token stop, const ProgressSink& onPass) {
+  using Clock = std::chrono::steady_clock;
+  if (m_accumulation.get_width() != m_width ||
+      m_accumulation.get_height() != m_height) {
+    m_accumulation = AccumulationBuffer(m_width, m_height);
+  } else {
+    m_accumulation.clear();
+  }
+  const std::uint32_t targetSamples = target_samples();
+  begin_render(scene, m_accumulation, targetSamples);
+  const auto renderStart = Clock::now();
+  ProgressivePass pass{
+      .samplesPerPixel = std::clamp<std::uint32_t>(settings.firstPassSamples,
+                                                   1, targetSamples)};
+  for (;; ++pass.index) {
+    pass.complete = add_samples(scene, m_accumulation, pass.samplesPerPixel,
+                                settings.deadline, stop);
+    pass.elapsed = Clock::now() - renderStart;
+    if (onPass) {
+      onPass(pass, m_accumulation);
+    }
+    if (!pass.complete || pass.samplesPerPixel == targetSamples ||
+        stop.stop_requested() || Clock::now() >= settings.deadline) {
+      break;
+    }
+    pass.samplesPerPixel = std::min(targetSamples, pass.samplesPerPixel * 2);
+  }
+  resolve(m_accumulation, targetSamples);
+  m_report.wall = Clock::now() - renderStart - m_report.denoise;
+  return *m_image;
+}
+
+void Camera::begin_render(const Scene& scene,
+                          const AccumulationBuffer& accumulation,
+                          const std::uint32_t targetSamples) {
+  m_report.threads.assign(thread_count(), ThreadUtilization{});
+  m_report.checkpoints = 0;
+  select_kernel(scene);
+  if constexpr (instrumentation::kEnabled) {
+    m_pixelCost.assign(m_width * m_height, 0);
+  }
+  if (!m_denoise) {
+    m_features = FeatureBuffer{};
+  } else if (m_features.get_width() != m_width ||
+             m_features.get_height() != m_height) {
+    m_features = FeatureBuffer(m_width, m_height);
+  } else {
+    m_features.clear();
+  }
+  m_report.sampleBudget = 0;
+  for (const auto& pixel : accumulation.pixels()) {
+    m_report.sampleBudget +=
+        targetSamples - std::min(targetSamples, pixel.sampleCount);
+  }
+}
+
+bool Camera::add_samples(const Scene& scene,
+                         AccumulationBuffer& accumulation,
+                         const std::uint32_t targetSamples,
+                         const std::chrono::steady_clock::time_point deadline,
+                         const std::stop_token stop) {
+  using Clock = std::chrono::steady_clock;
+  const int width = static_cast<int>(m_width);
+  const int height = static_cast<int>(m_height);
+  TileScheduler scheduler(width, height, m_tileSize);
+  std::atomic<std::size_t> tilesDone{0};
+
+  // Tiles are rendered into a thread-local copy of their pixels and committed
+  // under a shared lock, a checkpoint takes the lock exclusively so that it
+  // never sees a half-written tile.
+  std::shared_mutex commitMutex;
+  const bool checkpointing = !m_checkpointPath.empty();
+  std::atomic<Clock::time_point> nextCheckpoint{Clock::now() +
+                                                m_checkpointInterval};
+  std::atomic<std::uint32_t> checkpoints{0};
+  const auto writeCheckpoint = [&] {
+    AccumulationBuffer snapshot;
+    {
+      std::unique_lock lock(commitMutex);
+      snapshot = accumulation;
+    }
+    if (save_checkpoint(snapshot, m_checkpointPath)) {
+      ++checkpoints;
+    }
+  };
+  // Stopping leaves the tiles already started to finish; the deadline is
+  // only read once per tile.
+  const auto stopped = [&] {
+    return stop.stop_requested() || Clock::now() >= deadline;
+  };
+
+  auto renderTiles = [&, this](ThreadUtilization& utilization) {
+    PathBatch batch;
+    std::vector<AccumulatedPixel> tilePixels;
+    instrumentation::counters() = RenderCounters{};
+    std::optional<Tile> tile;
+    while (!stopped() && (tile = scheduler.next())) {
+      const auto tileStart = Clock::now();
+      const int tileWidth = tile->x1 - tile->x0;
+      tilePixels.resize(static_cast<std::size_t>(tileWidth) *
+                        (tile->y1 - tile->y0));
+      // Only this thread writes the pixels of the tile, reading them does
+      // not need the lock.
+      for (int y = tile->y0; y < tile->y1; ++y) {
+        for (int x = tile->x0; x < tile->x1; ++x) {
+          tilePixels[(y - tile->y0) * tileWidth + (x - tile->x0)] =
+              accumulation[x, y];
+        }
+      }
+
+      utilization.samples +=
+          sample_tile(*tile, scene, targetSamples, tilePixels, batch);
+
+      {
+        std::shared_lock lock(commitMutex);
+        for (int y = tile->y0; y < tile->y1; ++y) {
+          for (int x = tile->x0; x < tile->x1; ++x) {
+            accumulation[x, y] =
+                tilePixels[(y - tile->y0) * tileWidth + (x - tile->x0)];
+          }
+        }
+      }
+      utilization.busy += Clock::now() - tileStart;
+      ++utilization.tiles;
+      ++tilesDone;
+
+      // Whichever thread notices the interval has passed writes the
+      // checkpoint; the others keep rendering.
+      auto due = nextCheckpoint.load();
+      const auto now = Clock::now();
+      if (checkpointing && now >= due &&
+          nextCheckpoint.compare_exchange_strong(
+              due, now + m_checkpointInterval)) {
+        writeCheckpoint();
+      }
+    }
+    utilization.counters += instrumentation::counters();
+  };
+
+  {
+    std::vector<std::jthread> threads;
+    threads.reserve(m_report.threads.size());
+    for (auto& utilization : m_report.threads) {
+      threads.emplace_back(renderTiles, std::ref(utilization));
+    }
+  }
+  if (checkpointing) {
+    writeCheckpoint();
+  }
+  m_report.checkpoints += checkpoints;
+  return tilesDone == scheduler.size();
+}
+
+void Camera::resolve(const AccumulationBuffer& accumulation,
+                     const std::uint32_t targetSamples) {
+  using Clock = std::chrono::steady_clock;
+  const int width = static_cast<int>(m_width);
+  const int height = static_cast<int>(m_height);
+  if (!m_image) {
+    m_image.emplace(m_width, m_height);
+  }
+  m_report.denoise = {};
+  if (m_denoise) {
+    const auto denoiseStart = Clock::now();
+    const auto denoised =
+        denoise(accumulation, m_features, *m_denoise, thread_count());
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        (*m_image)[x, y] = Color::gamma(denoised[pixel_index(x, y)]);
+      }
+    }
+    m_report.denoise = Clock::now() - denoiseStart;
+  } else {
+    tonemap(accumulation, *m_image);
+  }
+  if (adaptive()) {
+    m_sampleCountImage.emplace(m_width, m_height);
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        (*m_sampleCountImage)[x, y] =
+            Color{glm::vec3{static_cast<float>(accumulation[x, y].sampleCount) /
+                            static_cast<float>(targetSamples)}};
+      }
+    }
+  } else {
+    m_sampleCountImage.reset();
+  }
+  if constexpr (instrumentation::kEnabled) {
+    m_report.maxPixelCost = std::ranges::max(m_pixelCost);
+    m_costImage.emplace(m_width, m_height);
+    for (int y = 0; y < height; ++y) {
       for (int x = 0; x < width; ++x) {
-        glm::vec3 finalColor{0, 0, 0};
-        for (decltype(m_samplesPerPixel) i = 0; i < m_samplesPerPixel; ++i) {
-          finalColor += ray_color(get_ray(x, y), m_maxDepth, world);
+        (*m_costImage)[x, y] = heat_color(
+            m_report.maxPixelCost == 0
+                ? 0.0f
+                : static_cast<float>(m_pixelCost[pixel_index(x, y)]) /
+                      static_cast<float>(m_report.maxPixelCost));
+      }
+    }
+  }
+}
+
+void Camera::render_streaming(const Scene& scene,
+                              const std::size_t maxScanlinesInFlight,
+                              const ScanlineSink& writeRow) {
+  using Clock = std::chrono::steady_clock;
+  const int width = static_cast<int>(m_width);
+  const int height = static_cast<int>(m_height);
+  const unsigned int threadCount = thread_count();
+  // Tiles go out row by row so that bands finish roughly top to bottom.
+  TileScheduler scheduler(width, height, m_tileSize, TileOrder::Scanline);
+  m_report.threads.assign(threadCount, ThreadUtilization{});
+  m_report.checkpoints = 0;
+  select_kernel(scene);
+  const std::uint32_t targetSamples = target_samples();
+  m_report.sampleBudget =
+      static_cast<std::uint64_t>(targetSamples) * width * height;
+  m_sampleCountImage.reset();
+  // A cost image would need the whole frame.
+  m_pixelCost.clear();
+  m_costImage.reset();
+  m_report.maxPixelCost = 0;
+  m_features = FeatureBuffer{};
+  m_report.denoise = {};
+
+  // A band is one row of tiles. Only bandSlots bands are resident at a
+  // time; a thread that picks a tile from a later band waits until the
+  // writer has flushed the oldest one.
+  const int tilesX = (width + m_tileSize - 1) / m_tileSize;
+  const int bandCount = (height + m_tileSize - 1) / m_tileSize;
+  const int bandSlots = std::clamp(
+      static_cast<int>(maxScanlinesInFlight) / m_tileSize, 1, bandCount);
+  std::vector<Color> bands(static_cast<std::size_t>(bandSlots) * m_tileSize *
+                           width);
+  std::vector<int> tilesPending(bandSlots, tilesX);
+  std::mutex bandMutex;
+  std::condition_variable bandFinished;
+  std::condition_variable bandFlushed;
+  int firstResidentBand = 0;
+  // Set when writeRow throws, releases the workers so the render can unwind.
+  bool writerFailed = false;
+
+  auto renderTiles = [&, this](ThreadUtilization& utilization) {
+    PathBatch batch;
+    std::vector<AccumulatedPixel> tilePixels;
+    instrumentation::counters() = RenderCounters{};
+    while (const auto tile = scheduler.next()) {
+      const int band = tile->y0 / m_tileSize;
+      {
+        std::unique_lock lock(bandMutex);
+        bandFlushed.wait(lock, [&] {
+          return writerFailed || band < firstResidentBand + bandSlots;
+        });
+        if (writerFailed) {
+          break;
+        }
+      }
+      const auto tileStart = Clock::now();
+      const int tileWidth = tile->x1 - tile->x0;
+      tilePixels.assign(
+          static_cast<std::size_t>(tileWidth) * (tile->y1 - tile->y0),
+          AccumulatedPixel{});
+      utilization.samples +=
+          sample_tile(*tile, scene, targetSamples, tilePixels, batch);
+
+      // The slot belongs to this band until the writer is done with it, so
+      // the tile is written without holding the lock.
+      Color* slot =
+          bands.data() + static_cast<std::size_t>(band % bandSlots) *
+                             m_tileSize * width;
+      for (int y = tile->y0; y < tile->y1; ++y) {
+        for (int x = tile->x0; x < tile->x1; ++x) {
+          slot[(y - tile->y0) * width + x] = Color::gamma(
+              tilePixels[(y - tile->y0) * tileWidth + (x - tile->x0)].mean());
+        }
+      }
+      utilization.busy += Clock::now() - tileStart;
+      ++utilization.tiles;
+      {
+        std::scoped_lock lock(bandMutex);
+        if (--tilesPending[band % bandSlots] != 0) {
+          continue;
+        }
+      }
+      bandFinished.notify_one();
+    }
+    utilization.counters = instrumentation::counters();
+  };
+
+  const auto renderStart = Clock::now();
+  {
+    std::vector<std::jthread> threads;
+    threads.reserve(threadCount);
+    for (auto& utilization : m_report.threads) {
+      threads.emplace_back(renderTiles, std::ref(utilization));
+    }
+
+    // This thread encodes finished bands in order while the workers render
+    // the following ones.
+    try {
+      for (int band = 0; band < bandCount; ++band) {
+        const int slot = band % bandSlots;
+        {
+          std::unique_lock lock(bandMutex);
+          bandFinished.wait(lock, [&] { return tilesPending[slot] == 0; });
+        }
+        const int y0 = band * m_tileSize;
+        const int y1 = std::min(height, y0 + m_tileSize);
+        const Color* rows =
+            bands.data() + static_cast<std::size_t>(slot) * m_tileSize * width;
+        for (int y = y0; y < y1; ++y) {
+          writeRow(y, std::span<const Color>(
+                          rows + static_cast<std::size_t>(y - y0) * width,
+                          static_cast<std::size_t>(width)));
+        }
+        {
+          std::scoped_lock lock(bandMutex);
+          tilesPending[slot] = tilesX;
+          ++firstResidentBand;
+        }
+        bandFlushed.notify_all();
+      }
+    } catch (...) {
+      {
+        std::scoped_lock lock(bandMutex);
+        writerFailed = true;
+      }
+      bandFlushed.notify_all();
+      throw;
+    }
+  }
+  m_report.wall = Clock::now() - renderStart;
+}
+
+std::uint64_t Camera::render_region(const Scene& scene, const Tile& region,
+                                    std::span<AccumulatedPixel> pixels) {
+  using Clock = std::chrono::steady_clock;
+  const int width = static_cast<int>(m_width);
+  const int height = static_cast<int>(m_height);
+  if (region.x0 < 0 || region.y0 < 0 || region.x1 > width ||
+      region.y1 > height || region.x0 >= region.x1 ||
+      region.y0 >= region.y1) {
+    throw std::invalid_argument(std::format(
+        "Region [{}, {}) x [{}, {}) is not inside the {}x{} image",
+        region.x0, region.x1, region.y0, region.y1, width, height));
+  }
+  const int regionWidth = region.x1 - region.x0;
+  if (pixels.size() !=
+      static_cast<std::size_t>(regionWidth) * (region.y1 - region.y0)) {
+    throw std::invalid_argument(
+        std::format("{} pixels given for a {}x{} region", pixels.size(),
+                    regionWidth, region.y1 - region.y0));
+  }
+  const unsigned int threadCount = thread_count();
+  TileScheduler scheduler(region, m_tileSize);
+  m_report.threads.assign(threadCount, ThreadUtilization{});
+  m_report.checkpoints = 0;
+  select_kernel(scene);
+  const std::uint32_t targetSamples = target_samples();
+  m_report.sampleBudget =
+      static_cast<std::uint64_t>(targetSamples) * pixels.size();
+  m_pixelCost.clear();
+  m_features = FeatureBuffer{};
+  m_report.denoise = {};
+
+  // Tiles cover disjoint pixels of the region, threads write them back
+  // unlocked.
+  auto renderTiles = [&, this](ThreadUtilization& utilization) {
+    PathBatch batch;
+    std::vector<AccumulatedPixel> tilePixels;
+    instrumentation::counters() = RenderCounters{};
+    while (const auto tile = scheduler.next()) {
+      const auto tileStart = Clock::now();
+      const int tileWidth = tile->x1 - tile->x0;
+      tilePixels.assign(
+          static_cast<std::size_t>(tileWidth) * (tile->y1 - tile->y0),
+          AccumulatedPixel{});
+      utilization.samples +=
+          sample_tile(*tile, scene, targetSamples, tilePixels, batch);
+      for (int y = tile->y0; y < tile->y1; ++y) {
+        std::ranges::copy_n(
+            tilePixels.begin() + (y - tile->y0) * tileWidth, tileWidth,
+            pixels.begin() + (y - region.y0) * regionWidth +
+                (tile->x0 - region.x0));
+      }
+      utilization.busy += Clock::now() - tileStart;
+      ++utilization.tiles;
+    }
+    utilization.counters = instrumentation::counters();
+  };
+
+  const auto renderStart = Clock::now();
+  {
+    std::vector<std::jthread> threads;
+    threads.reserve(threadCount);
+    for (auto& utilization : m_report.threads) {
+      threads.emplace_back(renderTiles, std::ref(utilization));
+    }
+  }
+  m_report.wall = Clock::now() - renderStart;
+  return m_report.samples();
+}
+
+bool Camera::adaptive() const noexcept {
+  return m_adaptive.has_value() && m_integrator == Integrator::Recursive;
+}
+
+unsigned int Camera::thread_count() const noexcept {
+  return m_threadCount != 0 ? m_threadCount
+                            : std::max(1u, std::thread::hardware_concurrency());
+}
+
+std::uint32_t Camera::target_samples() const noexcept {
+  if (adaptive()) {
+    return std::max<std::uint32_t>(
+        1, std::max(m_adaptive->minSamples, m_adaptive->maxSamples));
+  }
+  return m_samplesPerPixel;
+}
+
+void Camera::select_kernel(const Scene& scene) {
+  KernelOptions options;
+  if (m_specializedKernels && m_maxDepth > 0 &&
+      m_maxDepth <= kMaxKernelDepth) {
+    MaterialSet used = 0;
+    for (MaterialId id = 0; id < scene.materials.size(); ++id) {
+      used |= material_bit(MaterialTypeOf(scene.materials[id]));
+    }
+    const bool emitters =
+        (used & material_bit(MaterialType::DiffuseLight)) != 0;
+    const bool fixedDepth =
+        std::ranges::find(kKernelDepths, m_maxDepth) != kKernelDepths.end();
+    options = KernelOptions{
+        .generic = false,
+        .thinLens = m_defocusAngle > 0,
+        .maxDepth = fixedDepth ? m_maxDepth : 0,
+        .materials = emitters ? kAllMaterials : kSurfaceMaterials,
+        .lightSampling = !scene.lights.empty()};
+  }
+  static constexpr auto kTileKernels =
+      []<std::size_t... kIndices>(std::index_sequence<kIndices...>) {
+        return std::array<TileKernel, sizeof...(kIndices)>{
+            &Camera::render_tile<kKernels[kIndices]>...};
+      }(std::make_index_sequence<kKernels.size()>{});
+  const auto found = std::ranges::find(kKernels, options);
+  const auto index =
+      found == kKernels.end() ? 0 : std::distance(kKernels.begin(), found);
+  m_tileKernel = kTileKernels[index];
+  m_report.kernel = to_string(kKernels[index]);
+}
+
+std::uint64_t Camera::sample_tile(const Tile& tile, const Scene& scene,
+                                  const std::uint32_t targetSamples,
+                                  std::span<AccumulatedPixel> tilePixels,
+                                  PathBatch& batch) {
+  std::uint64_t samples = 0;
+  if (m_integrator == Integrator::Wavefront) {
+    samples =
+        render_tile_wavefront(tile, scene, targetSamples, tilePixels, batch);
+  } else if (adaptive()) {
+    samples = render_tile_adaptive(tile, scene, targetSamples, tilePixels);
+  } else {
+    samples = (this->*m_tileKernel)(tile, scene, targetSamples, tilePixels);
+  }
+  if (!m_features.empty()) {
+    fill_missing_features(tile, scene);
+  }
+  return samples;
+}
+
+template <KernelOptions kOptions>
+std::uint64_t Camera::render_tile(const Tile& tile, const Scene& scene,
+                                  const std::uint32_t targetSamples,
+                                  std::span<AccumulatedPixel> tilePixels) {
+  const int tileWidth = tile.x1 - tile.x0;
+  std::uint64_t samples = 0;
+  for (int y = tile.y0; y < tile.y1; ++y) {
+    for (int x = tile.x0; x < tile.x1; ++x) {
+      auto& pixel = tilePixels[(y - tile.y0) * tileWidth + (x - tile.x0)];
+      glm::vec3 finalColor{0, 0, 0};
+      float luminanceSquared = 0.0f;
+      const auto pixelIndex = pixel_index(x, y);
+      const auto costBefore = instrumentation::cost();
+      // Sample indices continue from the samples already accumulated, a
+      // resumed render draws new samples instead of repeating old ones.
+      for (auto i = pixel.sampleCount; i < targetSamples; ++i) {
+        auto sampler = make_sampler(pixelIndex, i);
+        SurfaceFeatures features;
+        glm::vec3 color;
+        if constexpr (kOptions.generic) {
+          const auto ray = get_ray(x, y, sampler);
+          color = ray_color(ray, m_maxDepth, scene, sampler, 0.0f,
+                            camera_cone(), features_wanted(features));
+        } else {
+          const auto ray = get_ray<kOptions.thinLens>(x, y, sampler);
+          color = trace_path<kOptions>(ray, scene, sampler,
+                                       features_wanted(features));
+        }
+        add_pixel_features(pixelIndex, features);
+        finalColor += color;
+        luminanceSquared += luminance(color) * luminance(color);
+      }
+      if (pixel.sampleCount < targetSamples) {
+        samples += targetSamples - pixel.sampleCount;
+        pixel.sum += finalColor;
+        pixel.luminanceSquaredSum += luminanceSquared;
+        pixel.sampleCount = targetSamples;
+      }
+      add_pixel_cost(pixelIndex, instrumentation::cost() - costBefore);
+    }
+  }
+  return samples;
+}
+
+std::uint64_t Camera::render_tile_adaptive(
+    const Tile& tile, const Scene& scene, const std::uint32_t targetSamples,
+    std::span<AccumulatedPixel> tilePixels) {
+  // Convergence is only re-evaluated every few samples: a single lucky run
+  // of similar samples should not end a pixel early.
+  constexpr std::uint32_t kCheckInterval = 4;
+  // Keeps the relative threshold meaningful for pixels that are almost
+  // black.
+  constexpr float kMinLuminance = 1e-2f;
+
+  const int tileWidth = tile.x1 - tile.x0;
+  const auto& settings = *m_adaptive;
+  std::uint64_t samples = 0;
+  for (int y = tile.y0; y < tile.y1; ++y) {
+    for (int x = tile.x0; x < tile.x1; ++x) {
+      auto& pixel = tilePixels[(y - tile.y0) * tileWidth + (x - tile.x0)];
+      // The variance comes from the accumulated first and second moments of
+      // luminance, which also covers samples taken by an earlier run.
+      const auto converged = [&] {
+        const auto n = pixel.sampleCount;
+        if (n < settings.minSamples || n < 2 ||
+            (n - settings.minSamples) % kCheckInterval != 0) {
+          return false;
         }
-        m_image[x, y] = Color::gamma(finalColor * m_pixelSamplesScale);
+        const auto count = static_cast<float>(n);
+        const float mean = luminance(pixel.sum) / count;
+        const float variance = std::max(
+            0.0f, (pixel.luminanceSquaredSum - mean * mean * count) /
+                      (count - 1.0f));
+        const float standardError = std::sqrt(variance / count);
+        return standardError <=
+               settings.noiseThreshold * std::max(mean, kMinLuminance);
+      };
+
+      const auto pixelIndex = pixel_index(x, y);
+      const auto costBefore = instrumentation::cost();
+      while (pixel.sampleCount < targetSamples && !converged()) {
+        auto sampler = make_sampler(pixelIndex, pixel.sampleCount);
+        const auto ray = get_ray(x, y, sampler);
+        SurfaceFeatures features;
+        const auto color =
+            ray_color(ray, m_maxDepth, scene, sampler, 0.0f, camera_cone(),
+                      features_wanted(features));
+        add_pixel_features(pixelIndex, features);
+        pixel.sum += color;
+        pixel.luminanceSquaredSum += luminance(color) * luminance(color);
+        ++pixel.sampleCount;
+        ++samples;
       }
+      add_pixel_cost(pixelIndex, instrumentation::cost() - costBefore);
     }
+  }
+  return samples;
+}
+
+std::uint64_t Camera::render_tile_wavefront(
+    const Tile& tile, const Scene& scene, const std::uint32_t targetSamples,
+    std::span<AccumulatedPixel> tilePixels, PathBatch& batch) {
+  const int tileWidth = tile.x1 - tile.x0;
+  const auto pixelCount =
+      static_cast<std::uint32_t>(tileWidth * (tile.y1 - tile.y0));
+  const auto imagePixel = [&](const std::uint32_t localPixel) {
+    const auto x = tile.x0 + static_cast<int>(localPixel) % tileWidth;
+    const auto y = tile.y0 + static_cast<int>(localPixel) / tileWidth;
+    return pixel_index(x, y);
   };
-  for (unsigned int t = 0; t < threadCount; ++t) {
-    int yEnd = (t == threadCount - 1) ? height : y + rowsPerThread;
-    threads.emplace_back(renderRows, y, yEnd);
-    y = yEnd;
+
+  // Pixels of a resumed render can be at different sample counts, chunks
+  // are counted relative to where each pixel starts.
+  std::uint32_t samplesMissing = 0;
+  for (const auto& pixel : tilePixels) {
+    samplesMissing = std::max(
+        samplesMissing,
+        targetSamples - std::min(targetSamples, pixel.sampleCount));
+  }
+
+  // Samples are generated in chunks, and tiles of more pixels than a batch
+  // holds in runs of pixels, so that the batch stays bounded for any tile
+  // size and sample count.
+  constexpr auto kMaxRunPixels =
+      static_cast<std::uint32_t>(kMaxWavefrontPaths);
+  std::uint64_t samples = 0;
+  for (std::uint32_t runBegin = 0; runBegin < pixelCount;
+       runBegin += kMaxRunPixels) {
+    const auto runEnd = std::min(pixelCount, runBegin + kMaxRunPixels);
+    const auto samplesPerChunk = static_cast<std::uint32_t>(
+        std::max<std::size_t>(1, kMaxWavefrontPaths / (runEnd - runBegin)));
+    for (std::uint32_t chunkBegin = 0; chunkBegin < samplesMissing;
+         chunkBegin += samplesPerChunk) {
+      const auto chunkEnd =
+          std::min<std::uint32_t>(samplesMissing, chunkBegin + samplesPerChunk);
+
+      // Generate: one camera ray per pixel sample.
+      batch.clear();
+      for (std::uint32_t p = runBegin; p < runEnd; ++p) {
+        const auto x = tile.x0 + static_cast<int>(p) % tileWidth;
+        const auto y = tile.y0 + static_cast<int>(p) / tileWidth;
+        const auto sampleBegin = tilePixels[p].sampleCount;
+        const auto sampleEnd =
+            std::min<std::uint32_t>(targetSamples, sampleBegin + chunkEnd);
+        for (auto i = sampleBegin + chunkBegin; i < sampleEnd; ++i) {
+          auto sampler = make_sampler(imagePixel(p), i);
+          batch.push_back(get_ray(x, y, sampler), camera_cone(), p, i);
+        }
+      }
+      samples += batch.size();
+
+      // A path adds its radiance to the pixel once, when it ends, so that the
+      // luminance moments are those of whole samples.
+      const auto finishPath = [&](const std::size_t i,
+                                  const std::uint32_t pathLength) {
+        auto& pixel = tilePixels[batch.pixel[i]];
+        const auto& color = batch.radiance[i];
+        pixel.sum += color;
+        pixel.luminanceSquaredSum += luminance(color) * luminance(color);
+        batch.alive[i] = 0;
+        instrumentation::record_path_length(pathLength);
+      };
+
+      for (int bounce = 0; bounce < m_maxDepth && batch.size() > 0; ++bounce) {
+        // Extend: closest hit for every path. Misses pick up the sky and end,
+        // hits pick up the emission of the surface. Camera rays also leave
+        // their features for the denoiser.
+        batch.hit.resize(batch.size());
+        constexpr auto kMaterialTypes =
+            static_cast<std::size_t>(MaterialType::Count);
+        std::array<std::uint32_t, kMaterialTypes> materialCounts{};
+        const auto typeOf = [&scene](const HitRecord& hitRecord) {
+          return static_cast<std::size_t>(
+              MaterialTypeOf(scene.materials[hitRecord.material]));
+        };
+        instrumentation::count_ray(static_cast<std::uint32_t>(bounce),
+                                   batch.size());
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+          const auto ray = batch.ray(i);
+          const auto costBefore = instrumentation::cost();
+          const bool hit =
+              Hit(scene.world, ray,
+                  Interval<float>{.min = 0.001f, .max = infinity_f},
+                  batch.hit[i]);
+          add_pixel_cost(imagePixel(batch.pixel[i]),
+                         instrumentation::cost() - costBefore);
+          if (hit) {
+            set_footprint(batch.hit[i], ray, batch.cone[i]);
+          }
+          if (bounce == 0) {
+            add_pixel_features(imagePixel(batch.pixel[i]),
+                               hit ? features_of(scene, ray, batch.hit[i])
+                                   : SurfaceFeatures{});
+          }
+          if (hit) {
+            batch.radiance[i] +=
+                batch.throughput[i] *
+                emitted_radiance(scene, ray, batch.hit[i], batch.scatterPdf[i]);
+            ++materialCounts[typeOf(batch.hit[i])];
+          } else {
+            batch.radiance[i] += batch.throughput[i] * sky_color(ray);
+            finishPath(i, static_cast<std::uint32_t>(bounce) + 1);
+          }
+        }
+
+        // Shade: counting sort of the surviving paths by material type, so
+        // each scatter implementation runs over a contiguous run of paths.
+        // Diffuse hits also queue a shadow ray towards a sampled light.
+        std::array<std::uint32_t, kMaterialTypes> materialOffsets{};
+        std::exclusive_scan(materialCounts.begin(), materialCounts.end(),
+                            materialOffsets.begin(), 0u);
+        batch.shadeOrder.resize(materialOffsets.back() + materialCounts.back());
+        for (std::uint32_t i = 0; i < batch.size(); ++i) {
+          if (batch.alive[i]) {
+            batch.shadeOrder[materialOffsets[typeOf(batch.hit[i])]++] = i;
+          }
+        }
+        batch.shadowRays.clear();
+        for (const auto i : batch.shadeOrder) {
+          const auto& hitRecord = batch.hit[i];
+          auto sampler =
+              make_sampler(imagePixel(batch.pixel[i]), batch.sample[i]);
+          sampler.start_bounce(static_cast<std::uint32_t>(bounce));
+          Ray scattered;
+          glm::vec3 att;
+          const auto& material = scene.materials[hitRecord.material];
+          instrumentation::count_scatter(MaterialTypeOf(material));
+          if (!Scatter(material, batch.ray(i), hitRecord, att, scattered,
+                       sampler)) {
+            finishPath(i, static_cast<std::uint32_t>(bounce) + 1);
+            continue;
+          }
+          batch.scatterPdf[i] = 0.0f;
+          if (!scene.lights.empty() && !IsSpecular(material)) {
+            Ray shadowRay;
+            float shadowDistance;
+            glm::vec3 direct;
+            if (connect_to_light(scene, material, hitRecord, sampler, shadowRay,
+                                 shadowDistance, direct)) {
+              batch.shadowRays.push_back(shadowRay, shadowDistance,
+                                         batch.throughput[i] * direct, i);
+            }
+            batch.scatterPdf[i] = ScatterPdf(material, hitRecord,
+                                             normalize(scattered.direction()));
+          }
+          batch.origin[i] = scattered.origin();
+          batch.direction[i] = scattered.direction();
+          batch.throughput[i] *= att;
+          batch.cone[i] =
+              scattered_cone(hitRecord, IsSpecular(material), batch.cone[i]);
+        }
+
+        // Occlude: the queued shadow rays only ask whether anything is in the
+        // way, which is cheaper than finding the closest hit.
+        const auto& shadowRays = batch.shadowRays;
+        instrumentation::count_shadow_rays(shadowRays.size());
+        for (std::size_t s = 0; s < shadowRays.size(); ++s) {
+          const auto path = shadowRays.path[s];
+          const auto costBefore = instrumentation::cost();
+          const bool occluded =
+              Occluded(scene.world, shadowRays.ray(s),
+                       Interval<float>{.min = 0.001f,
+                                       .max = shadowRays.distance[s]});
+          add_pixel_cost(imagePixel(batch.pixel[path]),
+                         instrumentation::cost() - costBefore);
+          if (!occluded) {
+            batch.radiance[path] += shadowRays.radiance[s];
+          }
+        }
+
+        // Compact: terminated paths leave the batch before the next bounce.
+        batch.compact();
+      }
+      // Paths still alive ran into the depth limit.
+      for (std::size_t i = 0; i < batch.size(); ++i) {
+        finishPath(i, static_cast<std::uint32_t>(m_maxDepth));
+      }
+    }
+  }
+
+  for (auto& pixel : tilePixels) {
+    pixel.sampleCount = std::max(pixel.sampleCount, targetSamples);
   }
-  for (auto& th : threads) th.join();
-  return m_image;
+  return samples;
 }
 
-Ray Camera::get_ray(const int x, const int y) const {
-  const auto offset = sample_square();
+template <bool kThinLens>
+Ray Camera::get_ray(const int x, const int y, Sampler& sampler) const {
+  const auto offset = sample_square(sampler);
 
   const auto pixelSample =
       m_startPixel + ((static_cast<float>(x) + offset.x) * m_pixelDeltaU) +
       ((static_cast<float>(y) + offset.y) * m_pixelDeltaV);
 
-  const auto rayOrigin =
-      m_defocusAngle <= 0 ? m_cameraPos : defocus_disk_sample();
-  return {rayOrigin, normalize(pixelSample - m_cameraPos)};
+  if constexpr (kThinLens) {
+    return {defocus_disk_sample(sampler),
+            normalize(pixelSample - m_cameraPos)};
+  } else {
+    return {m_cameraPos, normalize(pixelSample - m_cameraPos)};
+  }
 }
 
-glm::vec3 Camera::defocus_disk_sample() const {
-  const auto p = random_in_unit_disk();
+glm::vec3 Camera::defocus_disk_sample(Sampler& sampler) const {
+  const auto p = random_in_unit_disk(sampler);
   return m_cameraPos + (p.x * m_defocusDist_u) + (p.y * m_defocusDist_v);
 }
 
 inline glm::vec3 Camera::ray_color(const Ray& ray, const int depth,
-                                   const std::vector<Hittable>& world) {
+                                   const Scene& scene, Sampler& sampler,
+                                   const float scatterPdf,
+                                   const RayCone cone,
+                                   SurfaceFeatures* features) const {
+  const auto bounce = static_cast<std::uint32_t>(m_maxDepth - depth);
   if (depth <= 0) {
+    instrumentation::record_path_length(bounce);
     return glm::vec3{};
   }
+  instrumentation::count_ray(bounce);
   HitRecord hitRecord;
-  if (Hit(world, ray, mp::Interval<float>{.min = 0.001f, .max = infinity_f},
-          hitRecord)) {
+  if (Hit(scene.world, ray,
+          mp::Interval<float>{.min = 0.001f, .max = infinity_f}, hitRecord)) {
+    set_footprint(hitRecord, ray, cone);
+    if (features != nullptr) {
+      *features = features_of(scene, ray, hitRecord);
+    }
     Ray scattered;
     glm::vec3 att;
-    if (hitRecord.mat->scatter(ray, hitRecord, att, scattered)) {
-      return att * ray_color(scattered, depth - 1, world);
+    sampler.start_bounce(bounce);
+    const auto& material = scene.materials[hitRecord.material];
+    instrumentation::count_scatter(MaterialTypeOf(material));
+    auto color = emitted_radiance(scene, ray, hitRecord, scatterPdf);
+    if (Scatter(material, ray, hitRecord, att, scattered, sampler)) {
+      float nextScatterPdf = 0.0f;
+      if (!scene.lights.empty() && !IsSpecular(material)) {
+        Ray shadowRay;
+        float shadowDistance;
+        glm::vec3 direct;
+        if (connect_to_light(scene, material, hitRecord, sampler, shadowRay,
+                             shadowDistance, direct)) {
+          instrumentation::count_shadow_rays();
+          if (!Occluded(scene.world, shadowRay,
+                        Interval<float>{.min = 0.001f,
+                                        .max = shadowDistance})) {
+            color += direct;
+          }
+        }
+        nextScatterPdf = ScatterPdf(material, hitRecord,
+                                    normalize(scattered.direction()));
+      }
+      return color +
+             att * ray_color(scattered, depth - 1, scene, sampler,
+                             nextScatterPdf,
+                             scattered_cone(hitRecord, IsSpecular(material),
+                                            cone));
     }
-    return glm::vec3{};
+    instrumentation::record_path_length(bounce + 1);
+    return color;
+  }
+  instrumentation::record_path_length(bounce + 1);
+  if (features != nullptr) {
+    *features = SurfaceFeatures{};
+  }
+  return sky_color(ray);
+}
+
+template <KernelOptions kOptions>
+glm::vec3 Camera::trace_path(Ray ray, const Scene& scene, Sampler& sampler,
+                             SurfaceFeatures* features) const {
+  constexpr bool kEmitters =
+      (kOptions.materials & material_bit(MaterialType::DiffuseLight)) != 0;
+  // Without emitters or light sampling nothing is added at a bounce, only
+  // attenuated.
+  constexpr bool kAddsRadiance = kEmitters || kOptions.lightSampling;
+  constexpr int kCapacity =
+      kOptions.maxDepth > 0 ? kOptions.maxDepth : kMaxKernelDepth;
+  const int maxDepth = kOptions.maxDepth > 0 ? kOptions.maxDepth : m_maxDepth;
+
+  std::array<glm::vec3, kCapacity> added;
+  std::array<glm::vec3, kCapacity> attenuation;
+  // Radiance arriving at the last bounce; zero if the path ran out of
+  // depth.
+  glm::vec3 radiance{};
+  float scatterPdf = 0.0f;
+  auto cone = camera_cone();
+  int bounce = 0;
+  for (;; ++bounce) {
+    const auto bounceIndex = static_cast<std::uint32_t>(bounce);
+    if (bounce == maxDepth) {
+      instrumentation::record_path_length(bounceIndex);
+      break;
+    }
+    instrumentation::count_ray(bounceIndex);
+    HitRecord hitRecord;
+    if (!Hit(scene.world, ray,
+             mp::Interval<float>{.min = 0.001f, .max = infinity_f},
+             hitRecord)) {
+      instrumentation::record_path_length(bounceIndex + 1);
+      if (bounce == 0 && features != nullptr) {
+        *features = SurfaceFeatures{};
+      }
+      radiance = sky_color(ray);
+      break;
+    }
+    set_footprint(hitRecord, ray, cone);
+    if (bounce == 0 && features != nullptr) {
+      *features = features_of(scene, ray, hitRecord);
+    }
+    Ray scattered;
+    glm::vec3 att;
+    sampler.start_bounce(bounceIndex);
+    const auto& material = scene.materials[hitRecord.material];
+    instrumentation::count_scatter(MaterialTypeOf(material));
+    glm::vec3 color{};
+    if constexpr (kEmitters) {
+      color = emitted_radiance<kOptions.materials>(scene, ray, hitRecord,
+                                                   scatterPdf);
+    }
+    if (!Scatter<kOptions.materials>(material, ray, hitRecord, att,
+                                     scattered, sampler)) {
+      instrumentation::record_path_length(bounceIndex + 1);
+      radiance = color;
+      break;
+    }
+    scatterPdf = 0.0f;
+    if constexpr (kOptions.lightSampling) {
+      if (!IsSpecular<kOptions.materials>(material)) {
+        Ray shadowRay;
+        float shadowDistance;
+        glm::vec3 direct;
+        if (connect_to_light<kOptions.materials>(scene, material, hitRecord,
+                                                 sampler, shadowRay,
+                                                 shadowDistance, direct)) {
+          instrumentation::count_shadow_rays();
+          if (!Occluded(scene.world, shadowRay,
+                        Interval<float>{.min = 0.001f,
+                                        .max = shadowDistance})) {
+            color += direct;
+          }
+        }
+        scatterPdf = ScatterPdf<kOptions.materials>(
+            material, hitRecord, normalize(scattered.direction()));
+      }
+    }
+    if constexpr (kAddsRadiance) {
+      added[bounce] = color;
+    }
+    attenuation[bounce] = att;
+    cone = scattered_cone(hitRecord, IsSpecular<kOptions.materials>(material),
+                          cone);
+    ray = scattered;
+  }
+  for (int i = bounce - 1; i >= 0; --i) {
+    if constexpr (kAddsRadiance) {
+      radiance = added[i] + attenuation[i] * radiance;
+    } else {
+      radiance = attenuation[i] * radiance;
+    }
+  }
+  return radiance;
+}
+
+SurfaceFeatures Camera::features_of(const Scene& scene, const Ray& ray,
+                                    const HitRecord& hitRecord) {
+  return {Albedo(scene.materials[hitRecord.material], hitRecord),
+          hitRecord.normal,
+          hitRecord.t * glm::length(ray.direction())};
+}
+
+void Camera::fill_missing_features(const Tile& tile, const Scene& scene) {
+  for (int y = tile.y0; y < tile.y1; ++y) {
+    for (int x = tile.x0; x < tile.x1; ++x) {
+      if (m_features[x, y].sampleCount != 0) {
+        continue;
+      }
+      const auto pixelIndex = pixel_index(x, y);
+      auto sampler = make_sampler(pixelIndex, 0);
+      const auto ray = get_ray(x, y, sampler);
+      HitRecord hitRecord;
+      const bool hit =
+          Hit(scene.world, ray,
+              Interval<float>{.min = 0.001f, .max = infinity_f}, hitRecord);
+      if (hit) {
+        set_footprint(hitRecord, ray, camera_cone());
+      }
+      add_pixel_features(pixelIndex, hit ? features_of(scene, ray, hitRecord)
+                                         : SurfaceFeatures{});
+    }
+  }
+}
+
+template <MaterialSet kMaterials>
+glm::vec3 Camera::emitted_radiance(const Scene& scene, const Ray& ray,
+                                   const HitRecord& hitRecord,
+                                   const float scatterPdf) {
+  const auto emitted =
+      Emitted<kMaterials>(scene.materials[hitRecord.material], hitRecord);
+  const float lightPdfArea = scene.lights.pdf_area(hitRecord.material);
+  if (scatterPdf <= 0.0f || lightPdfArea <= 0.0f) {
+    return emitted;
+  }
+  // The light's density per unit area, as a density per solid angle seen
+  // from the previous hit.
+  const float length = glm::length(ray.direction());
+  const float distance = hitRecord.t * length;
+  const float cosLight = -dot(hitRecord.normal, ray.direction()) / length;
+  if (cosLight <= 0.0f) {
+    return emitted;
+  }
+  const float lightPdf = lightPdfArea * distance * distance / cosLight;
+  return emitted * power_heuristic(scatterPdf, lightPdf);
+}
+
+template <MaterialSet kMaterials>
+bool Camera::connect_to_light(const Scene& scene, const Material& material,
+                              const HitRecord& hitRecord, Sampler& sampler,
+                              Ray& shadowRay, float& shadowDistance,
+                              glm::vec3& radiance) {
+  // Shadow rays end this fraction short of the light so that they do not
+  // hit the light itself.
+  constexpr float kShadowRayEpsilon = 1e-3f;
+
+  const auto light = scene.lights.sample(hitRecord.p, sampler);
+  const auto toLight = light.point - hitRecord.p;
+  const float distance = glm::length(toLight);
+  if (!(distance > 0.0f)) {
+    return false;
+  }
+  const auto direction = toLight / distance;
+  const float cosLight = -dot(light.normal, direction);
+  const float scatterPdf =
+      ScatterPdf<kMaterials>(material, hitRecord, direction);
+  if (cosLight <= 0.0f || scatterPdf <= 0.0f) {
+    return false;
   }
+  const float lightPdf = light.pdfArea * distance * distance / cosLight;
+  shadowRay = Ray(hitRecord.p, direction);
+  shadowDistance = distance * (1.0f - kShadowRayEpsilon);
+  radiance = Evaluate<kMaterials>(material, hitRecord, direction) *
+             light.emission *
+             (power_heuristic(lightPdf, scatterPdf) / lightPdf);
+  return true;
+}
+
+Color Camera::heat_color(const float t) {
+  // Black through red and yellow to white.
+  return Color{3.0f * t, 3.0f * t - 1.0f, 3.0f * t - 2.0f};
+}
+
+glm::vec3 Camera::sky_color(const Ray& ray) {
   const auto a = 0.5f * (ray.direction().y + 1.0f);
   return mix(glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.5f, 0.7f, 1.0f), a);
 }
@@ -1,14 +1,126 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <stop_token>
 #include <vector>
 
+#include "AccumulationBuffer.hpp"
+#include "Denoiser.hpp"
 #include "Hittable.hpp"
 #include "ImageBuffer.hpp"
+#include "Instrumentation.hpp"
+#include "Material.hpp"
 #include "Ray.hpp"
+#include "RenderReport.hpp"
+#include "Scene.hpp"
 #include "Utility.hpp"
 
 namespace mp {
 
+class Camera;
+struct PathBatch;
+struct Tile;
+struct ViewBatchReport;
+
+ViewBatchReport render_views(std::span<Camera> views, const Scene& scene,
+                             unsigned int threadCount);
+
+enum class Integrator {
+  // One path at a time, recursing on every bounce.
+  Recursive,
+  // Batches of paths advanced one bounce at a time in stages: generate,
+  // extend, shade grouped by material type, trace the shadow rays queued
+  // while shading, compact.
+  Wavefront,
+};
+
+// Pixels draw the same sample indices as a fixed-rate render, so with
+// minSamples equal to maxSamples every pixel takes the samples of one with
+// samplesPerPixel = maxSamples. The image is not guaranteed to match it bit
+// for bit, since the two paths accumulate the samples differently.
+struct AdaptiveSampling {
+  std::uint16_t minSamples{16};
+  std::uint16_t maxSamples{1024};
+  // A pixel stops sampling once the standard error of its mean luminance is
+  // below this fraction of the mean.
+  float noiseThreshold{0.01f};
+};
+
+// What the path tracing kernel of a render is compiled for. The camera
+// picks one per render from the scene and its own settings, so that the
+// code run per ray tests nothing that cannot change during the render.
+struct KernelOptions {
+  // The recursive ray_color() path, which reads all of the below at run
+  // time.
+  bool generic{true};
+  // Rays start on the lens disk instead of at the camera position.
+  bool thinLens{true};
+  // Bounces per path, fixed at compile time; 0 reads the camera's.
+  int maxDepth{0};
+  // Materials the scene holds, nothing else is dispatched to.
+  MaterialSet materials{kAllMaterials};
+  // Lights are sampled at every non-specular hit.
+  bool lightSampling{true};
+
+  bool operator==(const KernelOptions&) const = default;
+};
+
+[[nodiscard]]
+std::string to_string(const KernelOptions& options);
+
+// Everything the Camera constructor takes, as one trivially copyable value
+// that scene files can store.
+struct CameraSettings {
+  std::uint64_t imageWidth{400};
+  double aspectRatio{16.0 / 9.0};
+  std::uint16_t samplesPerPixel{100};
+  std::int32_t maxDepth{50};
+  float vfov{90.0f};
+  float defocusAngle{0.0f};
+  float focusDistance{10.0f};
+  glm::vec3 lookFrom{0.0f, 0.0f, 0.0f};
+  glm::vec3 lookAt{0.0f, 0.0f, -1.0f};
+  glm::vec3 worldUp{0.0f, 1.0f, 0.0f};
+};
+
+struct ProgressiveSettings {
+  // The render stops handing out tiles at this point and returns what it
+  // has.
+  std::chrono::steady_clock::time_point deadline{
+      std::chrono::steady_clock::time_point::max()};
+  // Samples per pixel after the first pass. Every further pass doubles
+  // them, up to the camera's samplesPerPixel.
+  std::uint32_t firstPassSamples{1};
+};
+
+struct ProgressivePass {
+  // 0 for the first pass.
+  std::uint32_t index{};
+  // Samples every pixel holds once the pass is complete.
+  std::uint32_t samplesPerPixel{};
+  // False if the deadline or a stop request cut the pass short. Its
+  // finished tiles already hold samplesPerPixel, the others what the
+  // previous pass left.
+  bool complete{};
+  // Since the render started.
+  std::chrono::nanoseconds elapsed{};
+};
+
+// Called on the rendering thread after every pass of a progressive render,
+// with the linear sums so far.
+using ProgressSink = std::function<void(
+    const ProgressivePass& pass, const AccumulationBuffer& accumulation)>;
+
+// Receives finished rows of a streaming render, in order from the top.
+using ScanlineSink = std::function<void(int y, std::span<const Color> row)>;
+
 class Camera final {
  public:
   explicit Camera(const std::size_t baseWindowWidth, const double aspectRatio,
@@ -18,37 +130,400 @@ class Camera final {
                   const glm::vec3& lookFrom = {0, 0, .0f},
                   const glm::vec3& lookAt = {0.0f, 0.0f, -1.0f},
                   const glm::vec3& worldUp = {0.0f, 1.0f, 0.0f});
+  explicit Camera(const CameraSettings& settings)
+      : Camera(settings.imageWidth, settings.aspectRatio,
+               settings.samplesPerPixel, settings.maxDepth, settings.vfov,
+               settings.defocusAngle, settings.focusDistance,
+               settings.lookFrom, settings.lookAt, settings.worldUp) {}
+
+  // Moves the camera between renders, e.g. to the next frame of an
+  // animation. Image size, sampling settings, defocus angle and up
+  // direction stay as constructed, and so do the buffers.
+  void look_at(const glm::vec3& lookFrom, const glm::vec3& lookAt,
+               float vfov, float focusDistance);
+
+  // Renders from scratch into the camera's own accumulation buffer.
+  [[nodiscard]]
+  const ImageBuffer& render(const Scene& scene);
+
+  // Adds samples to accumulation until every pixel holds samplesPerPixel
+  // (or the adaptive sampling limits), continuing the sample sequence of
+  // each pixel where the buffer left off. Resuming a checkpoint with the
+  // same seed therefore gives the image an uninterrupted render would have,
+  // and a camera with more samples per pixel refines an earlier result.
+  // Throws std::invalid_argument if the buffer size does not match.
+  [[nodiscard]]
+  const ImageBuffer& render(const Scene& scene,
+                            AccumulationBuffer& accumulation);
+
+  // Renders from scratch in passes of increasing sample count, so that a
+  // noisy image of the whole frame is there early, until the camera's
+  // samplesPerPixel are reached, settings.deadline passes or stop is
+  // requested. Either way the result holds every sample taken. The deadline
+  // is checked before each tile, so it is overrun by at most the time one
+  // thread takes for one tile of the current pass, plus the denoiser.
+  // onPass may be empty; the time it takes counts against the deadline.
+  [[nodiscard]]
+  const ImageBuffer& render_progressive(const Scene& scene,
+                                        const ProgressiveSettings& settings,
+                                        std::stop_token stop = {},
+                                        const ProgressSink& onPass = {});
+
+  // Renders without holding the whole image: rows are handed to writeRow
+  // as soon as their row of tiles is finished, from a thread that encodes
+  // while the workers render further down. Peak memory is bounded by
+  // maxScanlinesInFlight, rounded to whole rows of tiles. There is no
+  // accumulation buffer, checkpoint or sample count image in this mode.
+  // Exceptions thrown by writeRow stop the render and are rethrown.
+  void render_streaming(const Scene& scene, std::size_t maxScanlinesInFlight,
+                        const ScanlineSink& writeRow);
+
+  // Renders the pixels of region alone, starting from no samples, into
+  // pixels given row by row, with all render threads. A pixel gets the same
+  // samples as in a render of the whole image, so regions rendered apart,
+  // e.g. by the workers of a distributed render, add up to that image.
+  // Returns the number of samples taken. Features, cost image and
+  // checkpoints are not produced. Throws std::invalid_argument if region
+  // is not inside the image or pixels does not match its size.
+  std::uint64_t render_region(const Scene& scene, const Tile& region,
+                              std::span<AccumulatedPixel> pixels);
+
+  [[nodiscard]]
+  std::size_t width() const noexcept {
+    return m_width;
+  }
+
+  [[nodiscard]]
+  std::size_t height() const noexcept {
+    return m_height;
+  }
+
+  // Linear radiance sums of the last render(scene) call.
+  [[nodiscard]]
+  const AccumulationBuffer& accumulation() const noexcept {
+    return m_accumulation;
+  }
+
+  // Periodically saves the accumulation buffer to path while rendering, and
+  // once more when the render finishes. An empty path disables checkpoints.
+  void set_checkpoint(std::filesystem::path path,
+                      const std::chrono::seconds interval) {
+    m_checkpointPath = std::move(path);
+    m_checkpointInterval = interval;
+  }
+
+  // Renders with the same seed are bit-identical.
+  void set_seed(const std::uint32_t seed) noexcept { m_seed = seed; }
+
+  // Side length in pixels of the square tiles handed out to render threads.
+  void set_tile_size(const int tileSize) noexcept {
+    m_tileSize = std::max(1, tileSize);
+  }
+
+  void set_integrator(const Integrator integrator) noexcept {
+    m_integrator = integrator;
+  }
+
+  // Sequence the pixel, lens and bounce samples are drawn from.
+  void set_sampler(const SamplerType sampler) noexcept {
+    m_samplerType = sampler;
+  }
+
+  // Lets renders use a kernel compiled for the lens, the maximum depth,
+  // if it is small, and the materials and lights of the scene instead of
+  // the generic one. On by default; the result is the same either way.
+  // Applies to Integrator::Recursive without adaptive sampling.
+  void set_specialized_kernels(const bool enabled) noexcept {
+    m_specializedKernels = enabled;
+  }
+
+  // Replaces the fixed samplesPerPixel with per-pixel early termination.
+  // Applies to Integrator::Recursive; the wavefront integrator always takes
+  // samplesPerPixel samples.
+  void set_adaptive_sampling(
+      const std::optional<AdaptiveSampling>& adaptive) noexcept {
+    m_adaptive = adaptive;
+  }
+
+  // Filters the HDR result of render() before gamma correction, guided by
+  // the first-hit albedo, normal and depth gathered while sampling. The
+  // accumulation buffer and checkpoints keep the noisy radiance. Not
+  // applied by render_streaming().
+  void set_denoiser(const std::optional<DenoiseSettings>& settings) noexcept {
+    m_denoise = settings;
+  }
+
+  // First-hit features of the samples taken by the last render() with a
+  // denoiser; empty otherwise.
+  [[nodiscard]]
+  const FeatureBuffer& features() const noexcept {
+    return m_features;
+  }
+
+  // Image of the last render() or render_views(), empty before the first.
+  [[nodiscard]]
+  const std::optional<ImageBuffer>& image() const noexcept {
+    return m_image;
+  }
+
+  // Samples accumulated per pixel after the last adaptive render, scaled so
+  // that white is AdaptiveSampling::maxSamples.
   [[nodiscard]]
-  const ImageBuffer& render(const std::vector<Hittable>& world);
+  const std::optional<ImageBuffer>& sample_count_image() const noexcept {
+    return m_sampleCountImage;
+  }
+
+  // Primitive and box tests spent on each pixel by the last render(), as a
+  // heatmap scaled to RenderReport::maxPixelCost. Only produced by builds
+  // with MP_INSTRUMENTATION.
+  [[nodiscard]]
+  const std::optional<ImageBuffer>& cost_image() const noexcept {
+    return m_costImage;
+  }
+
+  // 0 uses std::thread::hardware_concurrency().
+  void set_thread_count(const unsigned int threadCount) noexcept {
+    m_threadCount = threadCount;
+  }
+
+  // Timing and per-thread utilization of the last render() call.
+  [[nodiscard]]
+  const RenderReport& report() const noexcept {
+    return m_report;
+  }
 
  private:
-  ImageBuffer m_image;
+  // Drives the tiles of many cameras from one pool of threads.
+  friend ViewBatchReport render_views(std::span<Camera> views,
+                                      const Scene& scene,
+                                      unsigned int threadCount);
+
+  std::size_t m_width;
+  std::size_t m_height;
+  // Allocated by the first non-streaming render.
+  std::optional<ImageBuffer> m_image;
+  AccumulationBuffer m_accumulation;
   glm::vec3 m_cameraPos;
   glm::vec3 m_startPixel{};
   glm::vec3 m_pixelDeltaU{};
   glm::vec3 m_pixelDeltaV{};
+  // Angle between the rays through neighbouring pixel centers, the spread
+  // of the ray cones of camera rays.
+  float m_pixelSpread{};
   std::uint16_t m_samplesPerPixel{};
-  float m_pixelSamplesScale{};
   int m_maxDepth{};
   float m_defocusAngle;
   float m_focusDist;
+  glm::vec3 m_worldUp;
+  std::uint32_t m_seed{};
+  int m_tileSize{16};
+  unsigned int m_threadCount{};
+  Integrator m_integrator{Integrator::Recursive};
+  SamplerType m_samplerType{SamplerType::Independent};
+  std::optional<AdaptiveSampling> m_adaptive;
+  bool m_specializedKernels{true};
+  // render_tile() instance picked by select_kernel().
+  using TileKernel = std::uint64_t (Camera::*)(const Tile&, const Scene&,
+                                               std::uint32_t,
+                                               std::span<AccumulatedPixel>);
+  TileKernel m_tileKernel{};
+  std::optional<DenoiseSettings> m_denoise;
+  FeatureBuffer m_features;
+  std::optional<ImageBuffer> m_sampleCountImage;
+  std::vector<std::uint64_t> m_pixelCost;
+  std::optional<ImageBuffer> m_costImage;
+  std::filesystem::path m_checkpointPath;
+  std::chrono::seconds m_checkpointInterval{};
+  RenderReport m_report;
 
   glm::vec3 m_defocusDist_u;
   glm::vec3 m_defocusDist_v;
 
+  // Longest path the specialized kernels keep on the stack, deeper renders
+  // take the generic one.
+  static constexpr int kMaxKernelDepth = 64;
+
+  // Upper bound on the paths kept in flight by the wavefront integrator.
+  static constexpr std::size_t kMaxWavefrontPaths = 1 << 16;
+
+  [[nodiscard]]
+  bool adaptive() const noexcept;
+
+  [[nodiscard]]
+  unsigned int thread_count() const noexcept;
+
+  // Samples per pixel a render brings every pixel up to.
+  [[nodiscard]]
+  std::uint32_t target_samples() const noexcept;
+
+  // Resets the report and the per-pixel outputs and picks the kernel for a
+  // render of scene that brings accumulation up to targetSamples.
+  void begin_render(const Scene& scene, const AccumulationBuffer& accumulation,
+                    std::uint32_t targetSamples);
+
+  // Adds samples to accumulation on all render threads until every pixel
+  // holds targetSamples, writing checkpoints if enabled. Stops handing out
+  // tiles once stop is requested or deadline passes, and returns false if
+  // that left tiles out.
+  bool add_samples(const Scene& scene, AccumulationBuffer& accumulation,
+                   std::uint32_t targetSamples,
+                   std::chrono::steady_clock::time_point deadline,
+                   std::stop_token stop);
+
+  // Turns accumulation into m_image, denoised if enabled, along with the
+  // sample count and cost images.
+  void resolve(const AccumulationBuffer& accumulation,
+               std::uint32_t targetSamples);
+
+  // Each adds samples to the tile's pixels, given row by row, until they
+  // hold targetSamples, and returns the number of samples taken.
+  // sample_tile() picks the one matching the integrator and sampling
+  // settings.
+  std::uint64_t sample_tile(const Tile& tile, const Scene& scene,
+                            std::uint32_t targetSamples,
+                            std::span<AccumulatedPixel> tilePixels,
+                            PathBatch& batch);
+
+  template <KernelOptions kOptions>
+  std::uint64_t render_tile(const Tile& tile, const Scene& scene,
+                            std::uint32_t targetSamples,
+                            std::span<AccumulatedPixel> tilePixels);
+
+  std::uint64_t render_tile_adaptive(const Tile& tile, const Scene& scene,
+                                     std::uint32_t targetSamples,
+                                     std::span<AccumulatedPixel> tilePixels);
+
+  std::uint64_t render_tile_wavefront(const Tile& tile, const Scene& scene,
+                                      std::uint32_t targetSamples,
+                                      std::span<AccumulatedPixel> tilePixels,
+                                      PathBatch& batch);
+
+  // Index of pixel (x, y) in the image, row by row, which also addresses
+  // the per-pixel buffers. Computed in std::size_t, images can exceed 2^32
+  // pixels.
+  [[nodiscard]]
+  std::size_t pixel_index(const int x, const int y) const noexcept {
+    return static_cast<std::size_t>(y) * m_width +
+           static_cast<std::size_t>(x);
+  }
+
+  // Sampler of sample sampleIndex of the pixel at pixelIndex. The sampler
+  // keys its sequences with 32 bits: the pixel index itself for images
+  // below 2^32 pixels, beyond that with the high bits hashed into it so
+  // that the rows past the wrap do not repeat the sequences of the first.
+  [[nodiscard]]
+  Sampler make_sampler(const std::size_t pixelIndex,
+                       const std::uint32_t sampleIndex) const noexcept {
+    const auto wide = static_cast<std::uint64_t>(pixelIndex);
+    const auto key = static_cast<std::uint32_t>(wide) ^
+                     static_cast<std::uint32_t>(wide >> 32) * 0x9E3779B9u;
+    return Sampler{m_samplerType, m_seed, key, sampleIndex,
+                   glm::uvec2{static_cast<std::uint32_t>(pixelIndex % m_width),
+                              static_cast<std::uint32_t>(pixelIndex /
+                                                         m_width)}};
+  }
+
+  // Points m_tileKernel at the render_tile() for scene and the current
+  // settings.
+  void select_kernel(const Scene& scene);
+
+  template <bool kThinLens>
+  [[nodiscard]]
+  Ray get_ray(const int x, const int y, Sampler& sampler) const;
+
   [[nodiscard]]
-  Ray get_ray(const int x, const int y) const;
+  Ray get_ray(const int x, const int y, Sampler& sampler) const {
+    return m_defocusAngle <= 0 ? get_ray<false>(x, y, sampler)
+                               : get_ray<true>(x, y, sampler);
+  }
 
   [[nodiscard]]
-  glm::vec3 defocus_disk_sample() const;
+  glm::vec3 defocus_disk_sample(Sampler& sampler) const;
 
   [[nodiscard]]
-  static glm::vec3 sample_square() {
-    return glm::vec3{random_float() - 0.5f, random_float() - 0.5f, 0.0f};
+  RayCone camera_cone() const noexcept {
+    return {0.0f, m_pixelSpread};
   }
 
   [[nodiscard]]
-  static glm::vec3 ray_color(const Ray& ray, const int depth,
-                             const std::vector<Hittable>& world);
+  static glm::vec3 sample_square(Sampler& sampler) {
+    const auto offset = sampler.next_2d();
+    return glm::vec3{offset.x - 0.5f, offset.y - 0.5f, 0.0f};
+  }
+
+  // scatterPdf is the density the previous bounce sampled ray with, 0 for
+  // camera rays and after specular bounces, and cone the ray cone of ray.
+  // A camera ray stores what it hits first in features, if given.
+  [[nodiscard]]
+  glm::vec3 ray_color(const Ray& ray, const int depth, const Scene& scene,
+                      Sampler& sampler, float scatterPdf, RayCone cone,
+                      SurfaceFeatures* features = nullptr) const;
+
+  // ray_color() as a loop, compiled for kOptions. The radiance of each
+  // bounce is kept and added up back to front, in the order the recursion
+  // does, so both give the same result to the bit.
+  template <KernelOptions kOptions>
+  [[nodiscard]]
+  glm::vec3 trace_path(Ray ray, const Scene& scene, Sampler& sampler,
+                       SurfaceFeatures* features) const;
+
+  [[nodiscard]]
+  static SurfaceFeatures features_of(const Scene& scene, const Ray& ray,
+                                     const HitRecord& hitRecord);
+
+  // Emission of the hit surface towards the ray origin. When scene.lights
+  // could also have sampled the hit point, the contribution is weighted
+  // against that by multiple importance sampling.
+  template <MaterialSet kMaterials = kAllMaterials>
+  [[nodiscard]]
+  static glm::vec3 emitted_radiance(const Scene& scene, const Ray& ray,
+                                    const HitRecord& hitRecord,
+                                    float scatterPdf);
+
+  // Next-event estimation at a non-specular hit: picks a point on one of
+  // scene.lights and returns the shadow ray towards it, how far it has to
+  // stay unblocked, and the radiance it then adds to the path, already
+  // weighted against BSDF sampling. Returns false when the point cannot
+  // contribute, which needs no shadow ray.
+  template <MaterialSet kMaterials = kAllMaterials>
+  [[nodiscard]]
+  static bool connect_to_light(const Scene& scene, const Material& material,
+                               const HitRecord& hitRecord, Sampler& sampler,
+                               Ray& shadowRay, float& shadowDistance,
+                               glm::vec3& radiance);
+
+  [[nodiscard]]
+  static glm::vec3 sky_color(const Ray& ray);
+
+  // Tiles cover disjoint pixels, so threads add to m_pixelCost unlocked.
+  void add_pixel_cost(const std::size_t pixelIndex,
+                      const std::uint64_t cost) noexcept {
+    if constexpr (instrumentation::kEnabled) {
+      if (!m_pixelCost.empty()) {
+        m_pixelCost[pixelIndex] += cost;
+      }
+    }
+  }
+
+  // Features of a camera ray, or nullptr when the render gathers none.
+  [[nodiscard]]
+  SurfaceFeatures* features_wanted(SurfaceFeatures& features) noexcept {
+    return m_features.empty() ? nullptr : &features;
+  }
+
+  // Same as m_pixelCost, tiles write their own pixels unlocked.
+  void add_pixel_features(const std::size_t pixelIndex,
+                          const SurfaceFeatures& features) noexcept {
+    if (!m_features.empty()) {
+      m_features.pixels()[pixelIndex].add(features);
+    }
+  }
+
+  // Gives pixels of the tile that took no sample in this render, because
+  // the accumulation buffer already had enough, one camera ray's features.
+  void fill_missing_features(const Tile& tile, const Scene& scene);
+
+  [[nodiscard]]
+  static Color heat_color(float t);
 };
 }  // namespace mp
\ No newline at end of file
@@ -0,0 +1,52 @@
+#include "CpuFeatures.hpp"
+
+#if MP_SIMD_X86 && defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace mp {
+namespace {
+SimdLevel query_simd_level() noexcept {
+#if MP_SIMD_X86 && defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  const int maxLeaf = info[0];
+  __cpuid(info, 1);
+  const bool osxsave = (info[2] & (1 << 27)) != 0;
+  const bool avx = (info[2] & (1 << 28)) != 0;
+  if (!osxsave || !avx) {
+    return SimdLevel::SSE;
+  }
+  // The OS must save the YMM (and for AVX-512 the opmask and ZMM) state.
+  const auto xcr0 = _xgetbv(0);
+  if ((xcr0 & 0x6) != 0x6 || maxLeaf < 7) {
+    return SimdLevel::SSE;
+  }
+  __cpuidex(info, 7, 0);
+  const bool avx2 = (info[1] & (1 << 5)) != 0;
+  const bool avx512f = (info[1] & (1 << 16)) != 0;
+  if (avx512f && (xcr0 & 0xE6) == 0xE6) {
+    return SimdLevel::AVX512;
+  }
+  return avx2 ? SimdLevel::AVX2 : SimdLevel::SSE;
+#elif MP_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return SimdLevel::AVX512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return SimdLevel::AVX2;
+  }
+  return SimdLevel::SSE;
+#else
+  return SimdLevel::Scalar;
+#endif
+}
+}  // namespace
+
+SimdLevel detect_simd_level() noexcept {
+  static const SimdLevel level = query_simd_level();
+  return level;
+}
+}  // namespace mp
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string_view>
+
+namespace mp {
+
+// Widest vector instruction set the kernels in this project are compiled
+// for, in increasing order.
+enum class SimdLevel { Scalar, SSE, AVX2, AVX512 };
+
+// Best level supported by both the CPU and the operating system, detected
+// once.
+[[nodiscard]]
+SimdLevel detect_simd_level() noexcept;
+
+[[nodiscard]]
+constexpr std::string_view to_string(const SimdLevel level) noexcept {
+  switch (level) {
+    case SimdLevel::Scalar:
+      return "scalar";
+    case SimdLevel::SSE:
+      return "sse";
+    case SimdLevel::AVX2:
+      return "avx2";
+    case SimdLevel::AVX512:
+      return "avx512";
+  }
+  return "unknown";
+}
+
+}  // namespace mp
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MP_SIMD_X86 1
+#else
+#define MP_SIMD_X86 0
+#endif
+
+// Lets GCC and Clang compile a single function for a wider instruction set
+// than the rest of the translation unit. MSVC accepts intrinsics anywhere.
+// Contraction stays off so that enabling FMA-capable targets does not change
+// rounding relative to the scalar code. Clang ignores optimize(), the build
+// passes -ffp-contract=off for the files using this instead.
+#if MP_SIMD_X86 && defined(__clang__)
+#define MP_TARGET(isa) __attribute__((target(isa)))
+#elif MP_SIMD_X86 && defined(__GNUC__)
+#define MP_TARGET(isa) \
+  __attribute__((target(isa), optimize("fp-contract=off")))
+#else
+#define MP_TARGET(isa)
+#endif
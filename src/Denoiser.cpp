@@ -0,0 +1,360 @@
+#include "Denoiser.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <format>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+
+#include "AlignedAllocator.hpp"
+#include "CpuFeatures.hpp"
+#include "Utility.hpp"
+
+#if MP_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace mp {
+namespace {
+// B3 spline, the 1D kernel of every pass.
+constexpr std::array<float, 5> kKernel{1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f,
+                                       1.0f / 4.0f, 1.0f / 16.0f};
+// Keeps black albedo channels invertible.
+constexpr float kAlbedoEpsilon = 1e-3f;
+// Floor of the color variance, so converged pixels still blend with equal
+// neighbours.
+constexpr float kVarianceEpsilon = 1e-4f;
+// Depth of the sky before the logarithm.
+constexpr float kMinDepth = 1e-4f;
+// Normal, albedo and log depth, each divided by its tolerance.
+constexpr std::size_t kGuideCount = 7;
+
+using Plane = AlignedVector<float>;
+
+// One pass reads color and writes out, both as separate r, g and b planes.
+struct PassPlanes {
+  int width;
+  int height;
+  int step;
+  // colorSigma^2 of this pass.
+  float colorSigmaSquared;
+  std::array<const float*, 3> color;
+  std::array<float*, 3> out;
+  std::array<const float*, kGuideCount> guide;
+  const float* variance;
+};
+
+// Taps this far apart get no weight at all. Weights of e^-87 and below
+// would turn the weighted colors into denormals, which are many times slower
+// to add up.
+constexpr float kMaxDistance = 64.0f;
+
+// exp(-d) for d >= 0, from 2^floor and a cubic for the fraction (relative
+// error below 1e-4), and 0 from kMaxDistance on or for NaN. The AVX2 kernel
+// evaluates the same operations, so both paths give the same weights.
+[[nodiscard]]
+float exp_negative(const float d) {
+  constexpr float kLog2e = 1.44269504f;
+  if (!(d < kMaxDistance)) {
+    return 0.0f;
+  }
+  const float t = -d * kLog2e;
+  const float i = std::floor(t);
+  const float f = t - i;
+  const float p = 1.0f + f * (0.695556856f + f * (0.226173572f +
+                                                  f * 0.0781455737f));
+  return p * std::bit_cast<float>((static_cast<std::int32_t>(i) + 127) << 23);
+}
+
+void filter_pixel(const PassPlanes& planes, const int x, const int y) {
+  const auto center = static_cast<std::size_t>(y) * planes.width + x;
+  const float precision =
+      1.0f / (planes.variance[center] * planes.colorSigmaSquared +
+              kVarianceEpsilon);
+  glm::vec3 sum{0.0f};
+  float weightSum = 0.0f;
+  for (int ty = 0; ty < 5; ++ty) {
+    const int sy = y + (ty - 2) * planes.step;
+    if (sy < 0 || sy >= planes.height) {
+      continue;
+    }
+    for (int tx = 0; tx < 5; ++tx) {
+      const int sx = x + (tx - 2) * planes.step;
+      if (sx < 0 || sx >= planes.width) {
+        continue;
+      }
+      const auto tap = static_cast<std::size_t>(sy) * planes.width + sx;
+      float distance = 0.0f;
+      for (const float* guide : planes.guide) {
+        const float diff = guide[tap] - guide[center];
+        distance += diff * diff;
+      }
+      float colorDistance = 0.0f;
+      for (const float* channel : planes.color) {
+        const float diff = channel[tap] - channel[center];
+        colorDistance += diff * diff;
+      }
+      distance += colorDistance * precision;
+      const float weight = kKernel[ty] * kKernel[tx] * exp_negative(distance);
+      sum += weight * glm::vec3{planes.color[0][tap], planes.color[1][tap],
+                                planes.color[2][tap]};
+      weightSum += weight;
+    }
+  }
+  // The center tap has weight kKernel[2]^2, weightSum is never zero.
+  for (std::size_t c = 0; c < 3; ++c) {
+    planes.out[c][center] = sum[c] / weightSum;
+  }
+}
+
+// Filters row y of a pass.
+using RowKernel = void (*)(const PassPlanes& planes, int y);
+
+void filter_row_scalar(const PassPlanes& planes, const int y) {
+  for (int x = 0; x < planes.width; ++x) {
+    filter_pixel(planes, x, y);
+  }
+}
+
+#if MP_SIMD_X86
+MP_TARGET("avx2")
+__m256 exp_negative_avx2(const __m256 d) {
+  const __m256 maxDistance = _mm256_set1_ps(kMaxDistance);
+  const __m256 inRange = _mm256_cmp_ps(d, maxDistance, _CMP_LT_OQ);
+  const __m256 clamped = _mm256_min_ps(d, maxDistance);
+  const __m256 t = _mm256_mul_ps(_mm256_sub_ps(_mm256_setzero_ps(), clamped),
+                                 _mm256_set1_ps(1.44269504f));
+  const __m256 i = _mm256_floor_ps(t);
+  const __m256 f = _mm256_sub_ps(t, i);
+  __m256 p = _mm256_mul_ps(f, _mm256_set1_ps(0.0781455737f));
+  p = _mm256_mul_ps(f, _mm256_add_ps(_mm256_set1_ps(0.226173572f), p));
+  p = _mm256_mul_ps(f, _mm256_add_ps(_mm256_set1_ps(0.695556856f), p));
+  p = _mm256_add_ps(_mm256_set1_ps(1.0f), p);
+  const __m256i exponent = _mm256_slli_epi32(
+      _mm256_add_epi32(_mm256_cvtps_epi32(i), _mm256_set1_epi32(127)), 23);
+  return _mm256_and_ps(inRange,
+                       _mm256_mul_ps(p, _mm256_castsi256_ps(exponent)));
+}
+
+// Eight pixels at a time wherever all 25 taps are inside the row, the
+// border columns go through filter_pixel().
+MP_TARGET("avx2")
+void filter_row_avx2(const PassPlanes& planes, const int y) {
+  const int reach = 2 * planes.step;
+  const int interiorEnd = planes.width - reach;
+  int x = 0;
+  for (; x < std::min(reach, planes.width); ++x) {
+    filter_pixel(planes, x, y);
+  }
+  const auto row = static_cast<std::size_t>(y) * planes.width;
+  for (; x + 8 <= interiorEnd; x += 8) {
+    const auto center = row + x;
+    __m256 guide[kGuideCount];
+    for (std::size_t g = 0; g < kGuideCount; ++g) {
+      guide[g] = _mm256_loadu_ps(planes.guide[g] + center);
+    }
+    __m256 color[3];
+    for (std::size_t c = 0; c < 3; ++c) {
+      color[c] = _mm256_loadu_ps(planes.color[c] + center);
+    }
+    const __m256 precision = _mm256_div_ps(
+        _mm256_set1_ps(1.0f),
+        _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(planes.variance + center),
+                                    _mm256_set1_ps(planes.colorSigmaSquared)),
+                      _mm256_set1_ps(kVarianceEpsilon)));
+    __m256 sum[3] = {_mm256_setzero_ps(), _mm256_setzero_ps(),
+                     _mm256_setzero_ps()};
+    __m256 weightSum = _mm256_setzero_ps();
+    for (int ty = 0; ty < 5; ++ty) {
+      const int sy = y + (ty - 2) * planes.step;
+      if (sy < 0 || sy >= planes.height) {
+        continue;
+      }
+      for (int tx = 0; tx < 5; ++tx) {
+        const auto tap = static_cast<std::size_t>(sy) * planes.width + x +
+                         (tx - 2) * planes.step;
+        __m256 distance = _mm256_setzero_ps();
+        for (std::size_t g = 0; g < kGuideCount; ++g) {
+          const __m256 diff =
+              _mm256_sub_ps(_mm256_loadu_ps(planes.guide[g] + tap), guide[g]);
+          distance = _mm256_add_ps(distance, _mm256_mul_ps(diff, diff));
+        }
+        __m256 tapColor[3];
+        __m256 colorDistance = _mm256_setzero_ps();
+        for (std::size_t c = 0; c < 3; ++c) {
+          tapColor[c] = _mm256_loadu_ps(planes.color[c] + tap);
+          const __m256 diff = _mm256_sub_ps(tapColor[c], color[c]);
+          colorDistance =
+              _mm256_add_ps(colorDistance, _mm256_mul_ps(diff, diff));
+        }
+        distance =
+            _mm256_add_ps(distance, _mm256_mul_ps(colorDistance, precision));
+        const __m256 weight =
+            _mm256_mul_ps(_mm256_set1_ps(kKernel[ty] * kKernel[tx]),
+                          exp_negative_avx2(distance));
+        for (std::size_t c = 0; c < 3; ++c) {
+          sum[c] = _mm256_add_ps(sum[c], _mm256_mul_ps(weight, tapColor[c]));
+        }
+        weightSum = _mm256_add_ps(weightSum, weight);
+      }
+    }
+    for (std::size_t c = 0; c < 3; ++c) {
+      _mm256_storeu_ps(planes.out[c] + center,
+                       _mm256_div_ps(sum[c], weightSum));
+    }
+  }
+  for (; x < planes.width; ++x) {
+    filter_pixel(planes, x, y);
+  }
+}
+#endif
+
+RowKernel row_kernel() noexcept {
+#if MP_SIMD_X86
+  if (detect_simd_level() >= SimdLevel::AVX2) {
+    return filter_row_avx2;
+  }
+#endif
+  return filter_row_scalar;
+}
+
+// Calls rowJob for every row, in contiguous bands of rows, one per thread.
+void for_each_row(const int height, const unsigned int threadCount,
+                  const std::function<void(int)>& rowJob) {
+  const auto bands = static_cast<int>(
+      std::clamp<unsigned int>(threadCount, 1, std::max(1, height)));
+  std::vector<std::jthread> threads;
+  threads.reserve(bands);
+  for (int band = 0; band < bands; ++band) {
+    threads.emplace_back([&, band] {
+      const int y0 = height * band / bands;
+      const int y1 = height * (band + 1) / bands;
+      for (int y = y0; y < y1; ++y) {
+        rowJob(y);
+      }
+    });
+  }
+}
+}  // namespace
+
+std::vector<glm::vec3> denoise(const AccumulationBuffer& color,
+                               const FeatureBuffer& features,
+                               const DenoiseSettings& settings,
+                               const unsigned int threadCount) {
+  if (color.get_width() != features.get_width() ||
+      color.get_height() != features.get_height()) {
+    throw std::invalid_argument(std::format(
+        "Color buffer is {}x{}, feature buffer {}x{}", color.get_width(),
+        color.get_height(), features.get_width(), features.get_height()));
+  }
+  const int width = static_cast<int>(color.get_width());
+  const int height = static_cast<int>(color.get_height());
+  const auto pixelCount = static_cast<std::size_t>(width) * height;
+  const unsigned int threads =
+      threadCount != 0 ? threadCount
+                       : std::max(1u, std::thread::hardware_concurrency());
+
+  std::array<Plane, 3> current;
+  std::array<Plane, 3> next;
+  std::array<Plane, kGuideCount> guide;
+  std::array<Plane, 3> albedo;
+  for (auto& plane : current) {
+    plane.resize(pixelCount);
+  }
+  for (auto& plane : next) {
+    plane.resize(pixelCount);
+  }
+  for (auto& plane : guide) {
+    plane.resize(pixelCount);
+  }
+  for (auto& plane : albedo) {
+    plane.resize(pixelCount);
+  }
+  Plane rawVariance(pixelCount);
+  Plane variance(pixelCount);
+
+  // Split the buffers into planes and demodulate. The variance is that of
+  // the pixel mean's luminance, from the sums the sampler kept.
+  const glm::vec3 guideScale{1.0f / settings.normalSigma,
+                             1.0f / settings.albedoSigma,
+                             1.0f / settings.depthSigma};
+  for_each_row(height, threads, [&](const int y) {
+    for (int x = 0; x < width; ++x) {
+      const auto i = static_cast<std::size_t>(y) * width + x;
+      const auto& pixel = color[x, y];
+      const auto surface = features[x, y].mean();
+      const auto reflectance = surface.albedo + kAlbedoEpsilon;
+      const auto irradiance = pixel.mean() / reflectance;
+      for (std::size_t c = 0; c < 3; ++c) {
+        current[c][i] = irradiance[c];
+        albedo[c][i] = reflectance[c];
+        guide[c][i] = surface.normal[c] * guideScale.x;
+        guide[3 + c][i] = surface.albedo[c] * guideScale.y;
+      }
+      guide[6][i] =
+          std::log(std::max(surface.depth, kMinDepth)) * guideScale.z;
+
+      const auto n = static_cast<float>(pixel.sampleCount);
+      const float mean = luminance(pixel.mean());
+      float meanVariance = mean * mean;
+      if (pixel.sampleCount >= 2) {
+        meanVariance = std::max(0.0f, pixel.luminanceSquaredSum -
+                                          n * mean * mean) /
+                       ((n - 1.0f) * n);
+      }
+      const float demodulation = 1.0f / luminance(reflectance);
+      rawVariance[i] = meanVariance * demodulation * demodulation;
+    }
+  });
+  // A 3x3 box over the variance steadies the estimate of a few samples.
+  for_each_row(height, threads, [&](const int y) {
+    for (int x = 0; x < width; ++x) {
+      float sum = 0.0f;
+      int count = 0;
+      for (int sy = std::max(0, y - 1); sy <= std::min(height - 1, y + 1);
+           ++sy) {
+        for (int sx = std::max(0, x - 1); sx <= std::min(width - 1, x + 1);
+             ++sx) {
+          sum += rawVariance[static_cast<std::size_t>(sy) * width + sx];
+          ++count;
+        }
+      }
+      variance[static_cast<std::size_t>(y) * width + x] = sum / count;
+    }
+  });
+
+  const auto filterRow = row_kernel();
+  float colorSigma = settings.colorSigma;
+  for (int pass = 0; pass < settings.iterations; ++pass) {
+    PassPlanes planes{
+        .width = width,
+        .height = height,
+        .step = 1 << pass,
+        .colorSigmaSquared = colorSigma * colorSigma,
+        .color = {current[0].data(), current[1].data(), current[2].data()},
+        .out = {next[0].data(), next[1].data(), next[2].data()},
+        .guide = {},
+        .variance = variance.data(),
+    };
+    for (std::size_t g = 0; g < kGuideCount; ++g) {
+      planes.guide[g] = guide[g].data();
+    }
+    for_each_row(height, threads,
+                 [&](const int y) { filterRow(planes, y); });
+    std::swap(current, next);
+    colorSigma *= 0.5f;
+  }
+
+  std::vector<glm::vec3> result(pixelCount);
+  for (std::size_t i = 0; i < pixelCount; ++i) {
+    result[i] = glm::vec3{current[0][i] * albedo[0][i],
+                          current[1][i] * albedo[1][i],
+                          current[2][i] * albedo[2][i]};
+  }
+  return result;
+}
+
+}  // namespace mp
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "AccumulationBuffer.hpp"
+#include "glm/glm.hpp"
+
+namespace mp {
+
+// What a camera ray sees at its first hit. The defaults are those of a ray
+// that escapes to the sky.
+struct SurfaceFeatures {
+  glm::vec3 albedo{1.0f};
+  // Shading normal, facing the camera. Zero for the sky.
+  glm::vec3 normal{0.0f};
+  // Distance along the ray, zero for the sky.
+  float depth{0.0f};
+};
+
+// Features summed over the samples of a pixel, like AccumulatedPixel sums
+// radiance.
+struct AccumulatedFeatures {
+  glm::vec3 albedo{0.0f};
+  glm::vec3 normal{0.0f};
+  float depth{0.0f};
+  std::uint32_t sampleCount{0};
+
+  void add(const SurfaceFeatures& features) noexcept {
+    albedo += features.albedo;
+    normal += features.normal;
+    depth += features.depth;
+    ++sampleCount;
+  }
+
+  [[nodiscard]]
+  SurfaceFeatures mean() const noexcept {
+    if (sampleCount == 0) {
+      return SurfaceFeatures{};
+    }
+    const float scale = 1.0f / static_cast<float>(sampleCount);
+    return {albedo * scale, normal * scale, depth * scale};
+  }
+};
+
+static_assert(std::is_trivially_copyable_v<AccumulatedFeatures>);
+
+// Auxiliary buffers of a render, one AccumulatedFeatures per pixel.
+class FeatureBuffer {
+ public:
+  using image_dimensions_t = std::size_t;
+
+  FeatureBuffer() = default;
+  FeatureBuffer(const image_dimensions_t width,
+                const image_dimensions_t height)
+      : m_width(width), m_height(height), m_pixels(width * height) {}
+
+  [[nodiscard]]
+  image_dimensions_t get_width() const noexcept {
+    return m_width;
+  }
+
+  [[nodiscard]]
+  image_dimensions_t get_height() const noexcept {
+    return m_height;
+  }
+
+  [[nodiscard]]
+  bool empty() const noexcept {
+    return m_pixels.empty();
+  }
+
+  [[nodiscard]]
+  AccumulatedFeatures& operator[](const image_dimensions_t x,
+                                  const image_dimensions_t y) noexcept {
+    return m_pixels[y * m_width + x];
+  }
+
+  [[nodiscard]]
+  const AccumulatedFeatures& operator[](
+      const image_dimensions_t x, const image_dimensions_t y) const noexcept {
+    return m_pixels[y * m_width + x];
+  }
+
+  [[nodiscard]]
+  std::span<AccumulatedFeatures> pixels() noexcept {
+    return m_pixels;
+  }
+
+  [[nodiscard]]
+  std::span<const AccumulatedFeatures> pixels() const noexcept {
+    return m_pixels;
+  }
+
+  void clear() noexcept {
+    std::ranges::fill(m_pixels, AccumulatedFeatures{});
+  }
+
+ private:
+  image_dimensions_t m_width{};
+  image_dimensions_t m_height{};
+  std::vector<AccumulatedFeatures> m_pixels;
+};
+
+struct DenoiseSettings {
+  // Filter passes. Pass i spaces its 5x5 taps 2^i pixels apart, three
+  // passes reach 14 pixels out from the center.
+  int iterations{3};
+  // How far apart two colors may be, in standard errors of the pixel mean,
+  // before they stop being averaged. Halved after every pass.
+  float colorSigma{8.0f};
+  // Tolerated difference of the normals, albedos and relative depth.
+  float normalSigma{0.3f};
+  float albedoSigma{0.1f};
+  float depthSigma{0.1f};
+};
+
+// Edge-avoiding à-trous wavelet filter (Dammertz et al., "Edge-Avoiding
+// À-Trous Wavelet Transform for fast Global Illumination Filtering", HPG
+// 2010) over the mean radiance of color. Radiance is divided by the albedo
+// before filtering and multiplied back afterwards, so texture detail stays
+// sharp, and taps are weighed down where normal, albedo or depth change.
+// The color tolerance scales with the noise each pixel measured, which
+// filters a 16 sample render much harder than a converged one.
+//
+// Rows are split across threadCount threads (0 uses all cores), and the
+// interior of each row goes through an AVX2 kernel where the CPU has one.
+// Returns the linear radiance of every pixel, row by row. Throws
+// std::invalid_argument if the buffers differ in size.
+[[nodiscard]]
+std::vector<glm::vec3> denoise(const AccumulationBuffer& color,
+                               const FeatureBuffer& features,
+                               const DenoiseSettings& settings,
+                               unsigned int threadCount = 0);
+
+}  // namespace mp
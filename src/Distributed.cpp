@@ -0,0 +1,353 @@
+#include "Distributed.hpp"
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+
+#include "MappedFile.hpp"
+#include "Socket.hpp"
+#include "TileScheduler.hpp"
+
+namespace mp {
+namespace {
+
+constexpr std::array<char, 8> kProtocolMagic{'M', 'P', 'T', 'I',
+                                             'L', 'E', 'S', '\0'};
+constexpr std::uint32_t kProtocolVersion = 1;
+
+// How often the coordinator looks up from accepting workers to check
+// whether the render is done or abandoned.
+constexpr std::chrono::milliseconds kAcceptPoll{100};
+
+// The messages are sent as they are, so none of them has padding.
+
+// Worker to coordinator, once after connecting.
+struct Hello {
+  std::array<char, 8> magic;
+  std::uint32_t version;
+  std::uint32_t pixelSize;
+  std::uint64_t sceneHash;
+  std::uint32_t width;
+  std::uint32_t height;
+  std::uint32_t samplesPerPixel;
+  std::uint32_t seed;
+  std::uint32_t sampler;
+  std::uint32_t reserved;
+};
+
+enum class RequestType : std::uint32_t { Tile, Done, Rejected };
+
+// Coordinator to worker: the next tile, or the end of the render.
+struct Request {
+  RequestType type;
+  std::int32_t x0, y0;
+  std::int32_t x1, y1;
+};
+
+// Worker to coordinator, followed by the pixels of the tile row by row.
+struct Result {
+  std::int32_t x0, y0;
+  std::int32_t x1, y1;
+  std::uint64_t samples;
+  std::int64_t busyNanoseconds;
+};
+
+static_assert(sizeof(Hello) == 48);
+static_assert(sizeof(Request) == 20);
+static_assert(sizeof(Result) == 32);
+static_assert(std::is_trivially_copyable_v<Hello>);
+
+Hello make_hello(const RenderJob& job) {
+  return Hello{.magic = kProtocolMagic,
+               .version = kProtocolVersion,
+               .pixelSize = sizeof(AccumulatedPixel),
+               .sceneHash = job.sceneHash,
+               .width = job.width,
+               .height = job.height,
+               .samplesPerPixel = job.samplesPerPixel,
+               .seed = job.seed,
+               .sampler = static_cast<std::uint32_t>(job.sampler),
+               .reserved = 0};
+}
+
+// Why a worker saying hello cannot take part in job, empty if it can.
+std::string mismatch(const Hello& hello, const RenderJob& job) {
+  if (hello.magic != kProtocolMagic || hello.version != kProtocolVersion ||
+      hello.pixelSize != sizeof(AccumulatedPixel)) {
+    return "different protocol version";
+  }
+  if (hello.sceneHash != job.sceneHash) {
+    return "different scene";
+  }
+  if (hello.width != job.width || hello.height != job.height) {
+    return std::format("renders {}x{}, not {}x{}", hello.width, hello.height,
+                       job.width, job.height);
+  }
+  if (hello.samplesPerPixel != job.samplesPerPixel ||
+      hello.seed != job.seed ||
+      hello.sampler != static_cast<std::uint32_t>(job.sampler)) {
+    return "different sampling settings";
+  }
+  return {};
+}
+
+template <typename T>
+void send_value(Socket& socket, const T& value) {
+  socket.send(std::as_bytes(std::span(&value, 1)));
+}
+
+// False if the peer closed the connection before sending anything.
+template <typename T>
+[[nodiscard]]
+bool receive_value(Socket& socket, T& value) {
+  return socket.receive(std::as_writable_bytes(std::span(&value, 1)));
+}
+
+[[nodiscard]]
+std::size_t pixel_count(const Tile& tile) noexcept {
+  return static_cast<std::size_t>(tile.x1 - tile.x0) *
+         static_cast<std::size_t>(tile.y1 - tile.y0);
+}
+
+}  // namespace
+
+std::uint64_t scene_fingerprint(const std::filesystem::path& path) {
+  const MappedFile file(path);
+  std::uint64_t hash = 0xcbf29ce484222325ull;
+  for (const auto byte : file.data()) {
+    hash = (hash ^ static_cast<std::uint8_t>(byte)) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+CoordinatorReport coordinate_render(const std::string_view endpoint,
+                                    const RenderJob& job,
+                                    const CoordinatorSettings& settings,
+                                    AccumulationBuffer& accumulation) {
+  using Clock = std::chrono::steady_clock;
+  if (accumulation.get_width() != job.width ||
+      accumulation.get_height() != job.height) {
+    throw std::invalid_argument(std::format(
+        "Accumulation buffer is {}x{}, job renders {}x{}",
+        accumulation.get_width(), accumulation.get_height(), job.width,
+        job.height));
+  }
+  Socket listener = Socket::listen(endpoint);
+
+  // Everything below is shared by the connection threads, one per worker,
+  // and guarded by mutex. Tiles of lost workers go to the front of pending
+  // so that the image is not held up by its last tile.
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<Tile> pending;
+  {
+    TileScheduler scheduler(static_cast<int>(job.width),
+                            static_cast<int>(job.height),
+                            std::max(1, settings.tileSize));
+    while (const auto tile = scheduler.next()) {
+      pending.push_back(*tile);
+    }
+  }
+  std::size_t remaining = pending.size();
+  std::size_t connections = 0;
+  bool abandoned = false;
+  CoordinatorReport report;
+  report.tiles = remaining;
+  // A deque, so that connection threads keep their entry while others are
+  // added.
+  std::deque<WorkerReport> workers;
+
+  const auto serve = [&](Socket socket, WorkerReport& worker) {
+    const auto connectedAt = Clock::now();
+    std::optional<Tile> tile;
+    std::vector<AccumulatedPixel> pixels;
+    try {
+      socket.set_receive_timeout(settings.tileTimeout);
+      Hello hello;
+      if (!receive_value(socket, hello)) {
+        throw std::runtime_error("closed the connection before saying hello");
+      }
+      if (auto reason = mismatch(hello, job); !reason.empty()) {
+        send_value(socket, Request{.type = RequestType::Rejected});
+        std::scoped_lock lock(mutex);
+        worker.status = WorkerStatus::Rejected;
+        worker.error = std::move(reason);
+      } else {
+        for (;;) {
+          {
+            std::unique_lock lock(mutex);
+            changed.wait(lock, [&] {
+              return abandoned || remaining == 0 || !pending.empty();
+            });
+            if (abandoned || pending.empty()) {
+              break;
+            }
+            tile = pending.front();
+            pending.pop_front();
+          }
+          send_value(socket, Request{.type = RequestType::Tile,
+                                     .x0 = tile->x0,
+                                     .y0 = tile->y0,
+                                     .x1 = tile->x1,
+                                     .y1 = tile->y1});
+          Result result;
+          if (!receive_value(socket, result)) {
+            throw std::runtime_error("closed the connection");
+          }
+          if (result.x0 != tile->x0 || result.y0 != tile->y0 ||
+              result.x1 != tile->x1 || result.y1 != tile->y1) {
+            throw std::runtime_error("returned a different tile");
+          }
+          pixels.resize(pixel_count(*tile));
+          if (!socket.receive(std::as_writable_bytes(std::span(pixels)))) {
+            throw std::runtime_error("closed the connection");
+          }
+
+          bool last = false;
+          {
+            std::scoped_lock lock(mutex);
+            const int tileWidth = tile->x1 - tile->x0;
+            for (int y = tile->y0; y < tile->y1; ++y) {
+              for (int x = tile->x0; x < tile->x1; ++x) {
+                const auto& from =
+                    pixels[(y - tile->y0) * tileWidth + (x - tile->x0)];
+                auto& to = accumulation[x, y];
+                to.sum += from.sum;
+                to.luminanceSquaredSum += from.luminanceSquaredSum;
+                to.sampleCount += from.sampleCount;
+              }
+            }
+            ++worker.tiles;
+            worker.samples += result.samples;
+            worker.busy += std::chrono::nanoseconds{result.busyNanoseconds};
+            tile.reset();
+            last = --remaining == 0;
+          }
+          if (last) {
+            changed.notify_all();
+          }
+        }
+        // The worker is released either way, it has nothing left to lose.
+        try {
+          send_value(socket, Request{.type = RequestType::Done});
+        } catch (const std::system_error&) {
+        }
+      }
+    } catch (const std::exception& e) {
+      {
+        std::scoped_lock lock(mutex);
+        worker.status = WorkerStatus::Lost;
+        worker.error = e.what();
+        if (tile) {
+          pending.push_front(*tile);
+          ++report.reissued;
+        }
+      }
+      changed.notify_all();
+    }
+    std::scoped_lock lock(mutex);
+    worker.connected = Clock::now() - connectedAt;
+    --connections;
+  };
+
+  const auto start = Clock::now();
+  {
+    std::vector<std::jthread> threads;
+    std::unique_lock lock(mutex);
+    auto unattendedSince = start;
+    while (remaining > 0) {
+      lock.unlock();
+      auto socket = listener.accept(kAcceptPoll);
+      lock.lock();
+      if (socket.valid()) {
+        auto& worker =
+            workers.emplace_back(WorkerReport{.peer = socket.peer()});
+        ++connections;
+        threads.emplace_back(serve, std::move(socket), std::ref(worker));
+      } else if (connections > 0) {
+        unattendedSince = Clock::now();
+      } else if (Clock::now() - unattendedSince >= settings.workerWait) {
+        abandoned = true;
+        break;
+      }
+    }
+    lock.unlock();
+    changed.notify_all();
+  }
+  report.wall = Clock::now() - start;
+  report.workers.assign(std::make_move_iterator(workers.begin()),
+                        std::make_move_iterator(workers.end()));
+  if (abandoned) {
+    throw std::runtime_error(std::format(
+        "No worker connected to {} for {} ms, {} of {} tiles left", endpoint,
+        settings.workerWait.count(), remaining, report.tiles));
+  }
+  return report;
+}
+
+std::size_t serve_tiles(const std::string_view endpoint, const RenderJob& job,
+                        Camera& camera, const Scene& scene,
+                        const std::chrono::milliseconds connectTimeout) {
+  using Clock = std::chrono::steady_clock;
+  const auto giveUp = Clock::now() + connectTimeout;
+  Socket socket;
+  while (!socket.valid()) {
+    try {
+      socket = Socket::connect(endpoint);
+    } catch (const std::system_error&) {
+      if (Clock::now() >= giveUp) {
+        throw;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    }
+  }
+  send_value(socket, make_hello(job));
+
+  std::vector<AccumulatedPixel> pixels;
+  std::size_t tiles = 0;
+  for (;;) {
+    Request request;
+    if (!receive_value(socket, request)) {
+      throw std::runtime_error(
+          std::format("{} closed the connection", endpoint));
+    }
+    if (request.type == RequestType::Done) {
+      return tiles;
+    }
+    if (request.type == RequestType::Rejected) {
+      throw std::runtime_error(std::format(
+          "{} rejected this worker: it renders a different scene or with "
+          "different settings",
+          endpoint));
+    }
+    const Tile tile{.x0 = request.x0,
+                    .y0 = request.y0,
+                    .x1 = request.x1,
+                    .y1 = request.y1};
+    pixels.resize(pixel_count(tile));
+
+    const auto renderStart = Clock::now();
+    const auto samples = camera.render_region(scene, tile, pixels);
+    const Result result{
+        .x0 = tile.x0,
+        .y0 = tile.y0,
+        .x1 = tile.x1,
+        .y1 = tile.y1,
+        .samples = samples,
+        .busyNanoseconds = std::chrono::nanoseconds(Clock::now() - renderStart)
+                               .count()};
+    send_value(socket, result);
+    socket.send(std::as_bytes(std::span(pixels)));
+    ++tiles;
+  }
+}
+
+}  // namespace mp
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "AccumulationBuffer.hpp"
+#include "Camera.hpp"
+#include "Sampler.hpp"
+#include "Scene.hpp"
+
+namespace mp {
+
+// What a worker renders. The coordinator only hands tiles to workers whose
+// job equals its own, so that every tile belongs to the same image.
+struct RenderJob {
+  // scene_fingerprint() of the scene file the worker loaded.
+  std::uint64_t sceneHash{};
+  std::uint32_t width{};
+  std::uint32_t height{};
+  std::uint32_t samplesPerPixel{};
+  std::uint32_t seed{};
+  SamplerType sampler{SamplerType::Independent};
+
+  bool operator==(const RenderJob&) const = default;
+};
+
+// 64-bit FNV-1a hash of the file's bytes. Meshes the scene refers to are
+// not part of it. Throws std::system_error if the file cannot be mapped.
+[[nodiscard]]
+std::uint64_t scene_fingerprint(const std::filesystem::path& path);
+
+struct CoordinatorSettings {
+  // Side of the tiles handed out. Each costs a round trip, but smaller
+  // tiles balance better across workers of different speed and lose less
+  // work when a worker dies.
+  int tileSize{64};
+  // A worker that takes longer than this for one tile counts as lost and
+  // the tile goes to another worker, so that one that hangs cannot hold up
+  // the image. Zero waits as long as the connection stays up.
+  std::chrono::milliseconds tileTimeout{std::chrono::minutes{5}};
+  // The render fails once tiles are left and no worker has been connected
+  // for this long.
+  std::chrono::milliseconds workerWait{std::chrono::seconds{60}};
+};
+
+enum class WorkerStatus : std::uint8_t {
+  // Stayed connected until the image was done.
+  Finished,
+  // Disconnected, failed or timed out; its tile was handed out again.
+  Lost,
+  // Loaded a different scene or settings.
+  Rejected,
+};
+
+struct WorkerReport {
+  std::string peer;
+  WorkerStatus status{WorkerStatus::Finished};
+  // Why the worker was lost or rejected.
+  std::string error;
+  std::size_t tiles{};
+  std::uint64_t samples{};
+  // Time the worker spent rendering the tiles it returned, as it measured
+  // it, and time from its connection to its release or loss.
+  std::chrono::nanoseconds busy{};
+  std::chrono::nanoseconds connected{};
+
+  [[nodiscard]]
+  double samples_per_second() const noexcept {
+    const std::chrono::duration<double> seconds = connected;
+    return seconds.count() > 0.0 ? static_cast<double>(samples) /
+                                       seconds.count()
+                                 : 0.0;
+  }
+};
+
+struct CoordinatorReport {
+  std::chrono::nanoseconds wall{};
+  std::size_t tiles{};
+  // Tiles handed out again because the worker rendering them was lost.
+  std::size_t reissued{};
+  // In the order they connected.
+  std::vector<WorkerReport> workers;
+};
+
+inline std::ostream& operator<<(std::ostream& os,
+                                const CoordinatorReport& report) {
+  using Milliseconds = std::chrono::duration<double, std::milli>;
+  os << std::format("distributed: {} tiles in {:.1f} ms on {} workers, {} "
+                    "reissued\n",
+                    report.tiles, Milliseconds(report.wall).count(),
+                    report.workers.size(), report.reissued);
+  for (const auto& worker : report.workers) {
+    os << std::format(
+        "  {}: {:>5} tiles, {:>8.2f} Msamples/s, busy {:.1f}%", worker.peer,
+        worker.tiles, worker.samples_per_second() * 1e-6,
+        worker.connected.count() == 0
+            ? 0.0
+            : 100.0 * static_cast<double>(worker.busy.count()) /
+                  static_cast<double>(worker.connected.count()));
+    if (worker.status == WorkerStatus::Lost) {
+      os << std::format(", lost: {}", worker.error);
+    } else if (worker.status == WorkerStatus::Rejected) {
+      os << std::format(", rejected: {}", worker.error);
+    }
+    os << '\n';
+  }
+  return os;
+}
+
+// Renders job by listening on endpoint (see Socket) for workers started
+// with serve_tiles() and handing each one tile at a time. The sums they
+// return are added to accumulation, which should start empty. Workers may
+// join at any time; the tile of a worker that is lost goes back to the
+// queue. Messages are raw structs in native byte order, so every machine
+// involved must share it. Throws std::invalid_argument if accumulation
+// does not match the job, std::system_error if endpoint cannot be listened
+// on and std::runtime_error if the workers stay away for
+// settings.workerWait.
+CoordinatorReport coordinate_render(std::string_view endpoint,
+                                    const RenderJob& job,
+                                    const CoordinatorSettings& settings,
+                                    AccumulationBuffer& accumulation);
+
+// Connects to the coordinator at endpoint, retrying for connectTimeout so
+// that workers can start first, and renders the tiles it hands out with
+// camera and scene until the image is done. Returns the number of tiles
+// rendered. Throws std::system_error if the coordinator cannot be reached
+// or the connection fails, and std::runtime_error if it rejects job.
+std::size_t serve_tiles(std::string_view endpoint, const RenderJob& job,
+                        Camera& camera, const Scene& scene,
+                        std::chrono::milliseconds connectTimeout);
+
+}  // namespace mp
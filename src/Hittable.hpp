@@ -1,21 +1,37 @@
 #pragma once
+#include <concepts>
+#include <cstdint>
 #include <memory>
+#include <type_traits>
 #include <utility>
 
+#include "AABB.hpp"
 #include "Interval.hpp"
 #include "Ray.hpp"
 #include "glm/glm.hpp"
 
 namespace mp {
 
-class Material;
+// Index into the scene's MaterialTable.
+using MaterialId = std::uint32_t;
 
 struct HitRecord {
   glm::vec3 p;
   glm::vec3 normal;
   float t;
+  MaterialId material;
   bool frontFace;
-  std::shared_ptr<Material> mat;
+  // Spheres leave uv unset: surface_uv() derives it from the normal, for
+  // the few hits that look up an image texture.
+  bool sphericalUv;
+  // Texture coordinates of p.
+  glm::vec2 uv;
+  // Change of uv per unit of distance along the surface around p.
+  float uvDensity;
+  // Width of the surface around p that the ray stands for, set by the
+  // integrator once the hit is found. Image textures filter over it; 0 asks
+  // for their finest level.
+  float footprint;
 
   void set_face_normal(const Ray& r, const glm::vec3& outwardNormal) {
     frontFace = dot(r.direction(), outwardNormal) < 0.0f;
@@ -23,6 +39,25 @@ struct HitRecord {
   }
 };
 
+static_assert(std::is_trivially_copyable_v<HitRecord>);
+
+// Whether anything blocks ray inside interval. Shadow rays only need a yes or
+// no, so primitives with an Occluded overload stop at the first hit and never
+// fill a HitRecord; the others fall back to a closest-hit query.
+template <typename T>
+[[nodiscard]]
+bool occludes(const T& primitive, const Ray& ray,
+              const Interval<float> interval) {
+  if constexpr (requires {
+                  { Occluded(primitive, ray, interval) } -> std::same_as<bool>;
+                }) {
+    return Occluded(primitive, ray, interval);
+  } else {
+    HitRecord hitRecord;
+    return Hit(primitive, ray, interval, hitRecord);
+  }
+}
+
 class Hittable final {
  private:
   struct IHittable {
@@ -31,6 +66,10 @@ class Hittable final {
     virtual std::unique_ptr<IHittable> copy() const = 0;
     virtual bool hit(const Ray& ray, Interval<float> interval,
                      HitRecord& hitRecord) const = 0;
+    [[nodiscard]]
+    virtual bool occluded(const Ray& ray, Interval<float> interval) const = 0;
+    [[nodiscard]]
+    virtual AABB bounding_box() const = 0;
   };
 
   template <typename T>
@@ -47,6 +86,16 @@ class Hittable final {
              HitRecord& hitRecord) const override {
       return Hit(data, ray, interval, hitRecord);
     }
+
+    [[nodiscard]]
+    bool occluded(const Ray& ray, Interval<float> interval) const override {
+      return occludes(data, ray, interval);
+    }
+
+    [[nodiscard]]
+    AABB bounding_box() const override {
+      return BoundingBox(data);
+    }
   };
 
   std::unique_ptr<IHittable> m_self;
@@ -62,6 +111,16 @@ class Hittable final {
     return m_self->hit(ray, interval, hitRecord);
   }
 
+  [[nodiscard]]
+  bool occluded(const Ray& ray, Interval<float> interval) const {
+    return m_self->occluded(ray, interval);
+  }
+
+  [[nodiscard]]
+  AABB bounding_box() const {
+    return m_self->bounding_box();
+  }
+
  public:
   Hittable(const Hittable& other) : m_self(other.m_self->copy()) {}
   Hittable(Hittable&& other) noexcept
@@ -77,4 +136,21 @@ class Hittable final {
   ~Hittable() = default;
 };
 
+[[nodiscard]]
+inline bool Hit(const Hittable& hittable, const Ray& ray,
+                const Interval<float> interval, HitRecord& hitRecord) {
+  return hittable.hit(ray, interval, hitRecord);
+}
+
+[[nodiscard]]
+inline bool Occluded(const Hittable& hittable, const Ray& ray,
+                     const Interval<float> interval) {
+  return hittable.occluded(ray, interval);
+}
+
+[[nodiscard]]
+inline AABB BoundingBox(const Hittable& hittable) {
+  return hittable.bounding_box();
+}
+
 }  // namespace mp
\ No newline at end of file
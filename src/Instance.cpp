@@ -0,0 +1,172 @@
+#include "Instance.hpp"
+
+#include <cmath>
+#include <format>
+#include <stdexcept>
+#include <utility>
+
+#include "BVHCache.hpp"
+
+namespace mp {
+
+Instance::Instance(const GeometryId geometry, const glm::mat4& objectToWorld)
+    : worldToObject(glm::inverse(objectToWorld)), geometry(geometry) {}
+
+glm::mat4 Instance::object_to_world() const {
+  return glm::inverse(glm::mat4(worldToObject));
+}
+
+namespace {
+// World bounds of the eight corners of local.
+[[nodiscard]]
+AABB world_bounds(const AABB& local, const glm::mat4& objectToWorld) {
+  AABB world;
+  for (int corner = 0; corner < 8; ++corner) {
+    const glm::vec4 p{corner & 1 ? local.max.x : local.min.x,
+                      corner & 2 ? local.max.y : local.min.y,
+                      corner & 4 ? local.max.z : local.min.z, 1.0f};
+    world.expand(glm::vec3(objectToWorld * p));
+  }
+  return world;
+}
+}  // namespace
+
+InstanceBVH::InstanceBVH(std::vector<Hittable> geometries,
+                         const std::span<const Instance> instances,
+                         BVHCache* const cache)
+    : m_geometries(std::move(geometries)), m_sourceCount(instances.size()) {
+  m_geometryBounds.reserve(m_geometries.size());
+  for (const auto& geometry : m_geometries) {
+    m_geometryBounds.push_back(geometry.bounding_box());
+  }
+
+  // Instances of empty geometry can never be hit and are left out.
+  m_instances.reserve(instances.size());
+  m_sourceIndices.reserve(instances.size());
+  for (std::size_t i = 0; i < instances.size(); ++i) {
+    const auto& instance = instances[i];
+    if (instance.geometry >= m_geometries.size()) {
+      throw std::invalid_argument("instance of a geometry that does not exist");
+    }
+    if (m_geometryBounds[instance.geometry].empty()) {
+      continue;
+    }
+    m_instances.push_back(instance);
+    m_sourceIndices.push_back(static_cast<std::uint32_t>(i));
+  }
+  build(cache);
+}
+
+bool InstanceBVH::set_transforms(
+    const std::span<const glm::mat4> objectToWorld) {
+  if (objectToWorld.size() != m_sourceCount) {
+    throw std::invalid_argument(
+        std::format("{} transforms for {} instances", objectToWorld.size(),
+                    m_sourceCount));
+  }
+  std::vector<AABB> bounds;
+  bounds.reserve(m_instances.size());
+  for (std::size_t i = 0; i < m_instances.size(); ++i) {
+    auto& instance = m_instances[i];
+    const auto& transform = objectToWorld[m_sourceIndices[i]];
+    instance = Instance(instance.geometry, transform);
+    bounds.push_back(world_bounds(m_geometryBounds[instance.geometry],
+                                  transform));
+  }
+  m_tree.refit(bounds);
+  if (m_tree.sah_cost() <= kMaxRefitDegradation * m_builtCost) {
+    return false;
+  }
+  build();
+  return true;
+}
+
+void InstanceBVH::build(BVHCache* const cache) {
+  std::vector<AABB> bounds;
+  bounds.reserve(m_instances.size());
+  for (const auto& instance : m_instances) {
+    bounds.push_back(world_bounds(m_geometryBounds[instance.geometry],
+                                  instance.object_to_world()));
+  }
+  m_tree = cached_tree(cache, bounds);
+  m_builtCost = m_tree.sah_cost();
+
+  std::vector<Instance> instances;
+  std::vector<std::uint32_t> sourceIndices;
+  instances.reserve(m_instances.size());
+  sourceIndices.reserve(m_instances.size());
+  for (const auto index : m_tree.primitive_indices()) {
+    instances.push_back(m_instances[index]);
+    sourceIndices.push_back(m_sourceIndices[index]);
+  }
+  m_instances = std::move(instances);
+  m_sourceIndices = std::move(sourceIndices);
+}
+
+bool Hit(const InstanceBVH& bvh, const Ray& ray, Interval<float> interval,
+         HitRecord& hitRecord) {
+  const auto& instances = bvh.instances();
+  const auto& geometries = bvh.geometries();
+  const Instance* closest = nullptr;
+  HitRecord tmpHitRecord;
+  bvh.tree().traverse(
+      ray, interval,
+      [&](const std::uint32_t first, const std::uint32_t count,
+          Interval<float>& currentInterval) {
+        bool hitAnything = false;
+        for (std::uint32_t i = first; i < first + count; ++i) {
+          const auto& instance = instances[i];
+          // The direction is not renormalized, so t is the same in both
+          // spaces and the interval carries over.
+          const Ray objectRay{
+              instance.worldToObject * glm::vec4(ray.origin(), 1.0f),
+              instance.worldToObject * glm::vec4(ray.direction(), 0.0f)};
+          if (geometries[instance.geometry].hit(objectRay, currentInterval,
+                                                tmpHitRecord)) {
+            hitRecord = tmpHitRecord;
+            currentInterval.max = tmpHitRecord.t;
+            closest = &instance;
+            hitAnything = true;
+          }
+        }
+        return hitAnything;
+      });
+  if (closest == nullptr) {
+    return false;
+  }
+
+  // Normals transform with the inverse transpose of object-to-world, which
+  // is the transpose of world-to-object. Facing is preserved by affine maps.
+  hitRecord.p = ray.at(hitRecord.t);
+  hitRecord.normal = glm::normalize(
+      glm::transpose(glm::mat3(closest->worldToObject)) * hitRecord.normal);
+  // A uniform scale by s divides the uv change per unit by s; other maps
+  // get the mean scale of their volume.
+  hitRecord.uvDensity *= std::cbrt(
+      std::abs(glm::determinant(glm::mat3(closest->worldToObject))));
+  return true;
+}
+
+bool Occluded(const InstanceBVH& bvh, const Ray& ray,
+              const Interval<float> interval) {
+  const auto& instances = bvh.instances();
+  const auto& geometries = bvh.geometries();
+  return bvh.tree().occluded(
+      ray, interval,
+      [&](const std::uint32_t first, const std::uint32_t count) {
+        for (std::uint32_t i = first; i < first + count; ++i) {
+          const auto& instance = instances[i];
+          const Ray objectRay{
+              instance.worldToObject * glm::vec4(ray.origin(), 1.0f),
+              instance.worldToObject * glm::vec4(ray.direction(), 0.0f)};
+          if (geometries[instance.geometry].occluded(objectRay, interval)) {
+            return true;
+          }
+        }
+        return false;
+      });
+}
+
+AABB BoundingBox(const InstanceBVH& bvh) { return bvh.tree().bounds(); }
+
+}  // namespace mp
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "AABB.hpp"
+#include "BVH.hpp"
+#include "Hittable.hpp"
+#include "Interval.hpp"
+#include "Ray.hpp"
+#include "glm/glm.hpp"
+
+namespace mp {
+
+// Index into the geometries of an InstanceBVH.
+using GeometryId = std::uint32_t;
+
+// A placement of shared geometry. Only the world-to-object transform is
+// kept: rays are moved into object space for the hit test, and hit points
+// and normals are brought back with the same matrix, so an instance costs
+// 52 bytes however large its geometry is.
+struct Instance {
+  Instance() = default;
+  Instance(GeometryId geometry, const glm::mat4& objectToWorld);
+
+  [[nodiscard]]
+  glm::mat4 object_to_world() const;
+
+  // Affine, the implicit last row is (0, 0, 0, 1).
+  glm::mat4x3 worldToObject;
+  GeometryId geometry;
+};
+
+static_assert(std::is_trivially_copyable_v<Instance>);
+
+// Two-level acceleration structure. Each geometry brings its own bottom-level
+// structure (a TriangleMesh, SphereBVH, BVH, ...) and is stored once; a
+// top-level BVHTree over the world bounds of the instances selects which of
+// them a ray is transformed into.
+class InstanceBVH {
+ public:
+  // Throws std::invalid_argument if an instance refers to a geometry that
+  // does not exist. Takes the first tree from cache if given, see BVHCache;
+  // the rebuilds of set_transforms() do not use it.
+  InstanceBVH(std::vector<Hittable> geometries,
+              std::span<const Instance> instances, BVHCache* cache = nullptr);
+
+  // Moves every instance to objectToWorld[i], indexed like the instances
+  // the structure was built from. Only the top level changes: it is refit
+  // in place, and rebuilt when refitting has made it more than
+  // kMaxRefitDegradation times as costly to traverse as after its last
+  // build. Returns whether it was rebuilt. Throws std::invalid_argument if
+  // the number of transforms differs from the number of instances.
+  bool set_transforms(std::span<const glm::mat4> objectToWorld);
+
+  static constexpr float kMaxRefitDegradation = 1.5f;
+
+  [[nodiscard]]
+  const BVHTree& tree() const noexcept {
+    return m_tree;
+  }
+
+  [[nodiscard]]
+  const std::vector<Hittable>& geometries() const noexcept {
+    return m_geometries;
+  }
+
+  // In the order of the tree leaves.
+  [[nodiscard]]
+  const std::vector<Instance>& instances() const noexcept {
+    return m_instances;
+  }
+
+ private:
+  BVHTree m_tree;
+  std::vector<Hittable> m_geometries;
+  std::vector<AABB> m_geometryBounds;
+  std::vector<Instance> m_instances;
+  // Index of each of m_instances among the instances given to the
+  // constructor. Instances of empty geometry are left out.
+  std::vector<std::uint32_t> m_sourceIndices;
+  std::size_t m_sourceCount{};
+  float m_builtCost{};
+
+  // Builds the tree over m_instances, or takes it from cache, and puts
+  // them, and m_sourceIndices, in leaf order.
+  void build(BVHCache* cache = nullptr);
+};
+
+[[nodiscard]]
+bool Hit(const InstanceBVH& bvh, const Ray& ray, Interval<float> interval,
+         HitRecord& hitRecord);
+
+[[nodiscard]]
+bool Occluded(const InstanceBVH& bvh, const Ray& ray,
+              Interval<float> interval);
+
+[[nodiscard]]
+AABB BoundingBox(const InstanceBVH& bvh);
+
+}  // namespace mp
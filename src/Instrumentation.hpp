@@ -0,0 +1,124 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "Material.hpp"
+
+// Render instrumentation is compiled out unless MP_INSTRUMENTATION is 1, in
+// which case every counter below is a plain increment of a thread-local.
+#ifndef MP_INSTRUMENTATION
+#define MP_INSTRUMENTATION 0
+#endif
+
+namespace mp {
+
+struct RenderCounters {
+  // Bounces (and path lengths) past the last bucket are counted in it.
+  static constexpr std::size_t kBounceBuckets = 64;
+
+  // Closest-hit queries against the world, by bounce depth.
+  std::array<std::uint64_t, kBounceBuckets> raysPerBounce{};
+  // Rays traced per path until it missed, was absorbed or hit the depth
+  // limit.
+  std::array<std::uint64_t, kBounceBuckets + 1> pathLengths{};
+  std::array<std::uint64_t, static_cast<std::size_t>(MaterialType::Count)>
+      scatterCalls{};
+  // Occlusion queries towards sampled lights.
+  std::uint64_t shadowRays{};
+  // Ray-primitive tests, and those that produced a new closest hit. A SIMD
+  // batch of spheres counts at most one hit.
+  std::uint64_t intersectionTests{};
+  std::uint64_t intersectionHits{};
+  // Ray-box tests during BVH traversal.
+  std::uint64_t boxTests{};
+
+  RenderCounters& operator+=(const RenderCounters& other) noexcept {
+    for (std::size_t i = 0; i < raysPerBounce.size(); ++i) {
+      raysPerBounce[i] += other.raysPerBounce[i];
+    }
+    for (std::size_t i = 0; i < pathLengths.size(); ++i) {
+      pathLengths[i] += other.pathLengths[i];
+    }
+    for (std::size_t i = 0; i < scatterCalls.size(); ++i) {
+      scatterCalls[i] += other.scatterCalls[i];
+    }
+    shadowRays += other.shadowRays;
+    intersectionTests += other.intersectionTests;
+    intersectionHits += other.intersectionHits;
+    boxTests += other.boxTests;
+    return *this;
+  }
+};
+
+namespace instrumentation {
+
+inline constexpr bool kEnabled = MP_INSTRUMENTATION != 0;
+
+// Counters of the calling thread. Render threads reset them before their
+// first tile and hand them to the RenderReport when they run out of tiles.
+inline RenderCounters& counters() noexcept {
+  thread_local RenderCounters t_counters;
+  return t_counters;
+}
+
+inline void count_ray(const std::uint32_t bounce,
+                      const std::uint64_t rays = 1) noexcept {
+  if constexpr (kEnabled) {
+    counters().raysPerBounce[std::min<std::size_t>(
+        bounce, RenderCounters::kBounceBuckets - 1)] += rays;
+  }
+}
+
+inline void record_path_length(const std::uint32_t rays,
+                               const std::uint64_t paths = 1) noexcept {
+  if constexpr (kEnabled) {
+    counters().pathLengths[std::min<std::size_t>(
+        rays, RenderCounters::kBounceBuckets)] += paths;
+  }
+}
+
+inline void count_scatter(const MaterialType type) noexcept {
+  if constexpr (kEnabled) {
+    ++counters().scatterCalls[static_cast<std::size_t>(type)];
+  }
+}
+
+inline void count_shadow_rays(const std::uint64_t rays = 1) noexcept {
+  if constexpr (kEnabled) {
+    counters().shadowRays += rays;
+  }
+}
+
+inline void count_intersection_tests(const std::uint64_t tests) noexcept {
+  if constexpr (kEnabled) {
+    counters().intersectionTests += tests;
+  }
+}
+
+inline void count_intersection_hit() noexcept {
+  if constexpr (kEnabled) {
+    ++counters().intersectionHits;
+  }
+}
+
+inline void count_box_tests(const std::uint64_t tests) noexcept {
+  if constexpr (kEnabled) {
+    counters().boxTests += tests;
+  }
+}
+
+// Work done by the calling thread so far, in primitive and box tests. The
+// difference across a pixel is its entry in the cost image.
+[[nodiscard]]
+inline std::uint64_t cost() noexcept {
+  if constexpr (kEnabled) {
+    return counters().intersectionTests + counters().boxTests;
+  }
+  return 0;
+}
+
+}  // namespace instrumentation
+}  // namespace mp
@@ -0,0 +1,151 @@
+#include "Light.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include "Scene.hpp"
+#include "Utility.hpp"
+
+namespace mp {
+namespace {
+[[nodiscard]]
+glm::vec3 emission_of(const Material& material) {
+  const auto* light = std::get_if<DiffuseLight>(&material);
+  return light != nullptr ? light->emission() : glm::vec3{0.0f};
+}
+
+// Of the hemisphere that is sampled.
+[[nodiscard]]
+float area(const SphereLight& light) {
+  return 2.0f * pi_f * light.radius * light.radius;
+}
+
+[[nodiscard]]
+float area(const TriangleLight& light) {
+  return 0.5f * glm::length(glm::cross(light.p1 - light.p0,
+                                       light.p2 - light.p0));
+}
+}  // namespace
+
+LightList::LightList(std::vector<SphereLight> spheres,
+                     std::vector<TriangleLight> triangles,
+                     const MaterialTable& materials) {
+  m_emission.reserve(materials.size());
+  for (MaterialId id = 0; id < materials.size(); ++id) {
+    m_emission.push_back(emission_of(materials[id]));
+  }
+  const auto power = [this](const auto& light) {
+    return luminance(m_emission[light.material]) * area(light);
+  };
+  const auto dark = [&](const auto& light) {
+    return light.material >= m_emission.size() || !(power(light) > 0.0f);
+  };
+  std::erase_if(spheres, [&](const SphereLight& light) {
+    return !(light.radius > 0.0f) || dark(light);
+  });
+  std::erase_if(triangles, dark);
+  m_spheres = std::move(spheres);
+  m_triangles = std::move(triangles);
+
+  // Summed in double: a mesh light can have millions of triangles.
+  double total = 0.0;
+  std::vector<double> runningSum;
+  runningSum.reserve(m_spheres.size() + m_triangles.size());
+  for (const auto& light : m_spheres) {
+    runningSum.push_back(total += power(light));
+  }
+  for (const auto& light : m_triangles) {
+    runningSum.push_back(total += power(light));
+  }
+  m_cdf.reserve(runningSum.size());
+  for (const auto sum : runningSum) {
+    m_cdf.push_back(static_cast<float>(sum / total));
+  }
+
+  m_materialPdf.assign(materials.size(), 0.0f);
+  const auto usedBy = [&](const auto& light) {
+    m_materialPdf[light.material] =
+        static_cast<float>(luminance(m_emission[light.material]) / total);
+  };
+  std::ranges::for_each(m_spheres, usedBy);
+  std::ranges::for_each(m_triangles, usedBy);
+}
+
+LightSample LightList::sample(const glm::vec3& from, Sampler& sampler) const {
+  const float u = sampler.next_float();
+  const auto uv = sampler.next_2d();
+  const auto index = static_cast<std::size_t>(
+      std::ranges::upper_bound(m_cdf, u) - m_cdf.begin());
+  const auto light = std::min(index, m_cdf.size() - 1);
+
+  LightSample sample;
+  MaterialId material;
+  if (light < m_spheres.size()) {
+    // Uniform on the sphere, mirrored onto the hemisphere facing from.
+    const auto& sphere = m_spheres[light];
+    const float z = 1.0f - 2.0f * uv.x;
+    const float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+    const float phi = 2.0f * pi_f * uv.y;
+    glm::vec3 direction{r * std::cos(phi), r * std::sin(phi), z};
+    if (dot(direction, from - sphere.center) < 0.0f) {
+      direction = -direction;
+    }
+    sample.point = sphere.center + sphere.radius * direction;
+    sample.normal = direction;
+    material = sphere.material;
+  } else {
+    // Uniform on the triangle (Osada et al., "Shape Distributions").
+    const auto& triangle = m_triangles[light - m_spheres.size()];
+    const float s = std::sqrt(uv.x);
+    const float b0 = 1.0f - s;
+    const float b1 = uv.y * s;
+    sample.point = b0 * triangle.p0 + b1 * triangle.p1 +
+                   (1.0f - b0 - b1) * triangle.p2;
+    sample.normal = glm::normalize(
+        glm::cross(triangle.p1 - triangle.p0, triangle.p2 - triangle.p0));
+    material = triangle.material;
+  }
+  sample.emission = m_emission[material];
+  sample.pdfArea = m_materialPdf[material];
+  return sample;
+}
+
+LightList collect_lights(const World& world, const MaterialTable& materials) {
+  std::vector<SphereLight> spheres;
+  std::vector<TriangleLight> triangles;
+  const auto emits = [&materials](const MaterialId material) {
+    return material < materials.size() &&
+           std::holds_alternative<DiffuseLight>(materials[material]);
+  };
+  const auto addSphere = [&](const Sphere& sphere) {
+    if (emits(sphere.material)) {
+      spheres.push_back({sphere.center, sphere.radius, sphere.material});
+    }
+  };
+  const auto addSpheres = [&](const SphereSoA& soa) {
+    for (std::size_t i = 0; i < soa.size(); ++i) {
+      addSphere(soa[i]);
+    }
+  };
+
+  std::ranges::for_each(world.get<Sphere>(), addSphere);
+  std::ranges::for_each(world.get<SphereSoA>(), addSpheres);
+  for (const auto& bvh : world.get<SphereBVH>()) {
+    addSpheres(bvh.spheres());
+  }
+  for (const auto& mesh : world.get<TriangleMesh>()) {
+    if (!emits(mesh.material())) {
+      continue;
+    }
+    const auto& data = mesh.data();
+    for (std::size_t i = 0; i < data.indices.size(); i += 3) {
+      triangles.push_back({data.position(data.indices[i]),
+                           data.position(data.indices[i + 1]),
+                           data.position(data.indices[i + 2]),
+                           mesh.material()});
+    }
+  }
+  return LightList(std::move(spheres), std::move(triangles), materials);
+}
+
+}  // namespace mp
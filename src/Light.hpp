@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "Hittable.hpp"
+#include "Material.hpp"
+#include "Sampler.hpp"
+#include "glm/glm.hpp"
+
+namespace mp {
+
+// Emitting sphere or triangle, with the DiffuseLight material it was found
+// with. Triangles emit on the side their winding faces, as in TriangleMesh.
+struct SphereLight {
+  glm::vec3 center;
+  float radius;
+  MaterialId material;
+};
+
+struct TriangleLight {
+  glm::vec3 p0;
+  glm::vec3 p1;
+  glm::vec3 p2;
+  MaterialId material;
+};
+
+// A point picked on one of the lights.
+struct LightSample {
+  glm::vec3 point;
+  // Unit normal on the emitting side.
+  glm::vec3 normal;
+  glm::vec3 emission;
+  // Density of point per unit area, including the choice of the light.
+  float pdfArea;
+};
+
+// The emitters a path samples directly at every diffuse bounce (next-event
+// estimation). A light is chosen with probability proportional to its power
+// and a point on it uniformly by area, so the area density of a point only
+// depends on the emission of its material: the integrator can weigh a path
+// that hits an emitter by chance against light sampling knowing nothing but
+// the material of the hit.
+//
+// A point outside a sphere only sees the hemisphere facing it, so spheres
+// count with the area of a hemisphere and are sampled on the one facing the
+// shading point. This keeps the density above; sampling the cone of
+// directions the sphere subtends would waste fewer samples but needs to
+// know which sphere was hit. Spheres with a negative radius emit inwards,
+// are seen whole from inside and are not sampled.
+class LightList {
+ public:
+  LightList() = default;
+  // Lights whose material does not emit, that have no area or that are
+  // inside-out spheres are dropped.
+  LightList(std::vector<SphereLight> spheres,
+            std::vector<TriangleLight> triangles,
+            const MaterialTable& materials);
+
+  [[nodiscard]]
+  bool empty() const noexcept {
+    return m_cdf.empty();
+  }
+
+  [[nodiscard]]
+  std::size_t size() const noexcept {
+    return m_cdf.size();
+  }
+
+  // Picks a point on a light to illuminate from. Draws three values from
+  // sampler.
+  [[nodiscard]]
+  LightSample sample(const glm::vec3& from, Sampler& sampler) const;
+
+  // Area density with which sample() picks a point of an emitter made of
+  // material, 0 if no light uses it.
+  [[nodiscard]]
+  float pdf_area(const MaterialId material) const noexcept {
+    return material < m_materialPdf.size() ? m_materialPdf[material] : 0.0f;
+  }
+
+ private:
+  std::vector<SphereLight> m_spheres;
+  std::vector<TriangleLight> m_triangles;
+  // Normalized running sum of light power, spheres first.
+  std::vector<float> m_cdf;
+  std::vector<glm::vec3> m_emission;
+  std::vector<float> m_materialPdf;
+};
+
+// Power heuristic with exponent 2 (Veach, "Robust Monte Carlo Methods for
+// Light Transport Simulation", ch. 9): the weight of a sample drawn with
+// density pdf that the other strategy would have drawn with otherPdf.
+[[nodiscard]]
+inline float power_heuristic(const float pdf, const float otherPdf) noexcept {
+  const float a = pdf * pdf;
+  const float b = otherPdf * otherPdf;
+  return a + b > 0.0f ? a / (a + b) : 0.0f;
+}
+
+}  // namespace mp
@@ -0,0 +1,141 @@
+#include "MappedFile.hpp"
+
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif
+
+namespace mp {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+  const auto fail = [this](const char* what) {
+    const auto error = static_cast<int>(GetLastError());
+    unmap();
+    throw std::system_error(error, std::system_category(), what);
+  };
+
+  m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (m_file == INVALID_HANDLE_VALUE) {
+    m_file = nullptr;
+    fail("CreateFileW");
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(m_file, &size)) {
+    fail("GetFileSizeEx");
+  }
+  m_size = static_cast<std::size_t>(size.QuadPart);
+  if (m_size == 0) {
+    // Empty files cannot be mapped; an empty span describes them fine.
+    return;
+  }
+  m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (m_mapping == nullptr) {
+    fail("CreateFileMappingW");
+  }
+  m_data = static_cast<const std::byte*>(
+      MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+  if (m_data == nullptr) {
+    fail("MapViewOfFile");
+  }
+}
+
+void MappedFile::unmap() noexcept {
+  if (m_data != nullptr) {
+    UnmapViewOfFile(m_data);
+  }
+  if (m_mapping != nullptr) {
+    CloseHandle(m_mapping);
+  }
+  if (m_file != nullptr) {
+    CloseHandle(m_file);
+  }
+  m_data = nullptr;
+  m_size = 0;
+  m_mapping = nullptr;
+  m_file = nullptr;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr)),
+      m_size(std::exchange(other.m_size, 0)),
+      m_file(std::exchange(other.m_file, nullptr)),
+      m_mapping(std::exchange(other.m_mapping, nullptr)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+  if (this != &other) {
+    unmap();
+    m_data = std::exchange(other.m_data, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+    m_file = std::exchange(other.m_file, nullptr);
+    m_mapping = std::exchange(other.m_mapping, nullptr);
+  }
+  return *this;
+}
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(), "open");
+  }
+  struct stat status;
+  if (::fstat(fd, &status) != 0) {
+    const int error = errno;
+    ::close(fd);
+    throw std::system_error(error, std::generic_category(), "fstat");
+  }
+  m_size = static_cast<std::size_t>(status.st_size);
+  if (m_size != 0) {
+    void* data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      const int error = errno;
+      ::close(fd);
+      throw std::system_error(error, std::generic_category(), "mmap");
+    }
+    m_data = static_cast<const std::byte*>(data);
+  }
+  // The mapping keeps its own reference to the file.
+  ::close(fd);
+}
+
+void MappedFile::unmap() noexcept {
+  if (m_data != nullptr) {
+    ::munmap(const_cast<std::byte*>(m_data), m_size);
+  }
+  m_data = nullptr;
+  m_size = 0;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr)),
+      m_size(std::exchange(other.m_size, 0)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+  if (this != &other) {
+    unmap();
+    m_data = std::exchange(other.m_data, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+  }
+  return *this;
+}
+
+#endif
+
+MappedFile::~MappedFile() { unmap(); }
+
+}  // namespace mp
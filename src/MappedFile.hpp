@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+namespace mp {
+
+// Read-only memory mapping of a whole file. The mapping stays valid for the
+// lifetime of the object; pages are loaded lazily by the OS.
+class MappedFile {
+ public:
+  // Throws std::system_error if the file cannot be opened or mapped.
+  explicit MappedFile(const std::filesystem::path& path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+
+  [[nodiscard]]
+  std::span<const std::byte> data() const noexcept {
+    return {m_data, m_size};
+  }
+
+  [[nodiscard]]
+  std::size_t size() const noexcept {
+    return m_size;
+  }
+
+ private:
+  void unmap() noexcept;
+
+  const std::byte* m_data{};
+  std::size_t m_size{};
+#ifdef _WIN32
+  void* m_file{};
+  void* m_mapping{};
+#endif
+};
+
+}  // namespace mp
@@ -1,42 +1,49 @@
 #include "Material.hpp"
 
-#include <memory>
+#include <algorithm>
 
 #include "Utility.hpp"
 
 namespace mp {
 bool Lambertian::scatter(const Ray& rIn, const HitRecord& rec,
-                         glm::vec3& attenuation, Ray& scattered) const {
-  auto direction = rec.normal + random_unit_vector();
+                         glm::vec3& attenuation, Ray& scattered,
+                         Sampler& sampler) const {
+  auto direction = rec.normal + random_unit_vector(sampler);
   if (near_zero(direction)) {
     direction = rec.normal;
   }
   scattered = Ray(rec.p, direction);
-  attenuation = m_albedo;
+  attenuation = albedo(rec);
   return true;
 }
 
-std::unique_ptr<Material> Lambertian::clone() const {
-  return std::make_unique<Lambertian>(m_albedo);
+// The scatter direction is the normal plus a uniform unit vector, which is
+// distributed with density cos(theta) / pi around the normal.
+glm::vec3 Lambertian::evaluate(const HitRecord& rec,
+                               const glm::vec3& direction) const {
+  return albedo(rec) * scatter_pdf(rec, direction);
+}
+
+float Lambertian::scatter_pdf(const HitRecord& rec,
+                              const glm::vec3& direction) const {
+  return std::max(0.0f, dot(rec.normal, direction)) / pi_f;
 }
 
 bool Metal::scatter(const Ray& rIn, const HitRecord& rec,
-                    glm::vec3& attenuation, Ray& scattered) const {
+                    glm::vec3& attenuation, Ray& scattered,
+                    Sampler& sampler) const {
   const auto reflectedVec =
       normalize(mp::reflect(rIn.direction(), rec.normal));
   const auto fuzzedVec =
-      reflectedVec + (random_unit_vector() * m_fuzzFactor);
+      reflectedVec + (random_unit_vector(sampler) * m_fuzzFactor);
   scattered = Ray(rec.p, fuzzedVec);
-  attenuation = m_albedo;
+  attenuation = albedo(rec);
   return dot(fuzzedVec, rec.normal) > 0;
 }
 
-std::unique_ptr<Material> Metal::clone() const {
-  return std::make_unique<Metal>(m_albedo, m_fuzzFactor);
-}
-
 bool Dielectric::scatter(const Ray& rIn, const HitRecord& rec,
-                         glm::vec3& attenuation, Ray& scattered) const {
+                         glm::vec3& attenuation, Ray& scattered,
+                         Sampler& sampler) const {
   attenuation = glm::vec3(1.0f);
   const float ri = rec.frontFace ? (1.0f / m_refractionRate) : m_refractionRate;
 
@@ -49,7 +56,7 @@ bool Dielectric::scatter(const Ray& rIn, const HitRecord& rec,
   const float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
 
   if (const bool bCanRefract = ri * sinTheta <= 1.0f;
-      !bCanRefract || reflectance(cosTheta, ri) > random_float()) {
+      !bCanRefract || reflectance(cosTheta, ri) > random_float(sampler)) {
     direction = mp::reflect(unitRayDirection, rec.normal);
   } else {
     direction = mp::refract(unitRayDirection, rec.normal, ri);
@@ -58,10 +65,6 @@ bool Dielectric::scatter(const Ray& rIn, const HitRecord& rec,
   return true;
 }
 
-std::unique_ptr<Material> Dielectric::clone() const {
-  return std::make_unique<Dielectric>(m_refractionRate);
-}
-
 float Dielectric::reflectance(const float cosTheta,
                               const float refractionRate) {
   const float r0 =
@@ -1,58 +1,70 @@
 #pragma once
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
 #include "Hittable.hpp"
 #include "Ray.hpp"
+#include "Sampler.hpp"
+#include "Texture.hpp"
 
 namespace mp {
 
-class Material {
+// Lambertian and Metal reflect their albedo, times the value of their
+// texture at the hit point if they have one. Materials share textures.
+class Lambertian final {
  public:
-  Material(const Material& other) = delete;
-  Material(Material&& other) noexcept = delete;
-  Material& operator=(const Material& other) = delete;
-  Material& operator=(Material&& other) noexcept = delete;
-  Material() = default;
-
-  virtual ~Material() = default;
+  explicit Lambertian(const glm::vec3& a,
+                      std::shared_ptr<const Texture> texture = nullptr)
+      : m_albedo(a), m_texture(std::move(texture)) {}
 
   [[nodiscard]]
-  virtual bool scatter(const Ray& rIn, const HitRecord& rec,
-                       glm::vec3& attenuation, Ray& scattered) const = 0;
+  bool scatter(const Ray& rIn, const HitRecord& rec, glm::vec3& attenuation,
+               Ray& scattered, Sampler& sampler) const;
 
+  // BRDF times the cosine term for a unit direction leaving rec.p.
   [[nodiscard]]
-  virtual std::unique_ptr<Material> clone() const = 0;
-};
-
-class Lambertian final : public Material {
- public:
-  explicit Lambertian(const glm::vec3& a) : m_albedo(a) {}
+  glm::vec3 evaluate(const HitRecord& rec, const glm::vec3& direction) const;
 
+  // Solid angle density with which scatter() picks a unit direction.
   [[nodiscard]]
-  bool scatter(const Ray& rIn, const HitRecord& rec, glm::vec3& attenuation,
-               Ray& scattered) const override;
+  float scatter_pdf(const HitRecord& rec, const glm::vec3& direction) const;
 
-  [[nodiscard]] std::unique_ptr<Material> clone() const override;
+  [[nodiscard]]
+  glm::vec3 albedo(const HitRecord& rec) const {
+    return m_texture ? m_albedo * Value(*m_texture, rec) : m_albedo;
+  }
 
  private:
   glm::vec3 m_albedo;
+  std::shared_ptr<const Texture> m_texture;
 };
 
-class Metal final : public Material {
+class Metal final {
  public:
-  explicit Metal(const glm::vec3& a, const float fuzz)
-      : m_albedo(a), m_fuzzFactor(fuzz) {}
+  explicit Metal(const glm::vec3& a, const float fuzz,
+                 std::shared_ptr<const Texture> texture = nullptr)
+      : m_albedo(a), m_fuzzFactor(fuzz), m_texture(std::move(texture)) {}
 
   [[nodiscard]]
   bool scatter(const Ray& rIn, const HitRecord& rec, glm::vec3& attenuation,
-               Ray& scattered) const override;
+               Ray& scattered, Sampler& sampler) const;
 
-  [[nodiscard]] std::unique_ptr<Material> clone() const override;
+  [[nodiscard]]
+  glm::vec3 albedo(const HitRecord& rec) const {
+    return m_texture ? m_albedo * Value(*m_texture, rec) : m_albedo;
+  }
 
  private:
   glm::vec3 m_albedo;
   float m_fuzzFactor;
+  std::shared_ptr<const Texture> m_texture;
 };
 
-class Dielectric final : public Material {
+class Dielectric final {
  public:
   static constexpr float kRefractionRateVacuum = 1.0f;
   static constexpr float kRefractionRateAir = 1.000273f;
@@ -66,10 +78,7 @@ class Dielectric final : public Material {
 
   [[nodiscard]]
   bool scatter(const Ray& rIn, const HitRecord& rec, glm::vec3& attenuation,
-               Ray& scattered) const override;
-
-  [[nodiscard]]
-  std::unique_ptr<Material> clone() const override;
+               Ray& scattered, Sampler& sampler) const;
 
  private:
   [[nodiscard]]
@@ -78,4 +87,218 @@ class Dielectric final : public Material {
  private:
   float m_refractionRate;
 };
-}  // namespace mp
\ No newline at end of file
+
+// Emits on its front face and absorbs everything that arrives.
+class DiffuseLight final {
+ public:
+  explicit DiffuseLight(const glm::vec3& emission) : m_emission(emission) {}
+
+  [[nodiscard]]
+  bool scatter(const Ray& rIn, const HitRecord& rec, glm::vec3& attenuation,
+               Ray& scattered, Sampler& sampler) const {
+    return false;
+  }
+
+  [[nodiscard]]
+  glm::vec3 emitted(const HitRecord& rec) const {
+    return rec.frontFace ? m_emission : glm::vec3{0.0f};
+  }
+
+  [[nodiscard]]
+  const glm::vec3& emission() const noexcept {
+    return m_emission;
+  }
+
+ private:
+  glm::vec3 m_emission;
+};
+
+// Closed set of materials, dispatched with std::visit instead of a vtable.
+// Alternatives are listed in MaterialType order.
+using Material = std::variant<Lambertian, Metal, Dielectric, DiffuseLight>;
+
+enum class MaterialType : std::uint8_t {
+  Lambertian,
+  Metal,
+  Dielectric,
+  DiffuseLight,
+  Count
+};
+
+static_assert(std::variant_size_v<Material> ==
+              static_cast<std::size_t>(MaterialType::Count));
+
+[[nodiscard]]
+constexpr std::string_view to_string(const MaterialType type) noexcept {
+  switch (type) {
+    case MaterialType::Lambertian:
+      return "lambertian";
+    case MaterialType::Metal:
+      return "metal";
+    case MaterialType::Dielectric:
+      return "dielectric";
+    case MaterialType::DiffuseLight:
+      return "diffuse_light";
+    case MaterialType::Count:
+      break;
+  }
+  return "unknown";
+}
+
+[[nodiscard]]
+inline MaterialType MaterialTypeOf(const Material& material) noexcept {
+  return static_cast<MaterialType>(material.index());
+}
+
+// Bit per MaterialType, for code compiled for the materials a scene uses.
+using MaterialSet = std::uint8_t;
+
+[[nodiscard]]
+constexpr MaterialSet material_bit(const MaterialType type) noexcept {
+  return static_cast<MaterialSet>(1u << static_cast<unsigned>(type));
+}
+
+constexpr MaterialSet kAllMaterials = static_cast<MaterialSet>(
+    (1u << static_cast<unsigned>(MaterialType::Count)) - 1);
+
+// std::visit for a material whose type is in kMaterials. Only those
+// alternatives are compiled in and told apart, the last one without a
+// test, so a kernel for a single material type dispatches with no branch
+// at all. Materials of other types must not be passed.
+template <MaterialSet kMaterials, std::size_t kIndex = 0, typename Visitor>
+[[nodiscard]]
+decltype(auto) visit_material(Visitor&& visitor, const Material& material) {
+  static_assert(kMaterials != 0 && (kMaterials & ~kAllMaterials) == 0);
+  if constexpr (kMaterials == kAllMaterials) {
+    return std::visit(visitor, material);
+  } else if constexpr (((kMaterials >> kIndex) & 1u) == 0) {
+    return visit_material<kMaterials, kIndex + 1>(visitor, material);
+  } else if constexpr ((kMaterials >> (kIndex + 1)) == 0) {
+    return visitor(*std::get_if<kIndex>(&material));
+  } else {
+    if (material.index() == kIndex) {
+      return visitor(*std::get_if<kIndex>(&material));
+    }
+    return visit_material<kMaterials, kIndex + 1>(visitor, material);
+  }
+}
+
+// The functions below take the set of materials they can be given as an
+// optional template argument, see visit_material().
+template <MaterialSet kMaterials = kAllMaterials>
+[[nodiscard]]
+inline bool Scatter(const Material& material, const Ray& rIn,
+                    const HitRecord& rec, glm::vec3& attenuation,
+                    Ray& scattered, Sampler& sampler) {
+  return visit_material<kMaterials>(
+      [&](const auto& m) {
+        return m.scatter(rIn, rec, attenuation, scattered, sampler);
+      },
+      material);
+}
+
+// Radiance leaving the hit point towards the ray origin, zero for materials
+// that do not emit.
+template <MaterialSet kMaterials = kAllMaterials>
+[[nodiscard]]
+inline glm::vec3 Emitted(const Material& material, const HitRecord& rec) {
+  return visit_material<kMaterials>(
+      [&](const auto& m) {
+        if constexpr (requires { m.emitted(rec); }) {
+          return m.emitted(rec);
+        } else {
+          return glm::vec3{0.0f};
+        }
+      },
+      material);
+}
+
+// Whether Scatter() picks directions from a discrete set instead of a
+// density. Light sampling cannot reach those directions, so only the other
+// materials are lit explicitly. Fuzzy metal counts as specular: its lobe is
+// sampled by rejection and has no closed-form density.
+template <MaterialSet kMaterials = kAllMaterials>
+[[nodiscard]]
+inline bool IsSpecular(const Material& material) {
+  return visit_material<kMaterials>(
+      [](const auto& m) {
+        return !requires(const HitRecord& rec, const glm::vec3& direction) {
+          m.scatter_pdf(rec, direction);
+        };
+      },
+      material);
+}
+
+// BSDF times the cosine term for a unit direction leaving rec.p. Zero for
+// specular materials.
+template <MaterialSet kMaterials = kAllMaterials>
+[[nodiscard]]
+inline glm::vec3 Evaluate(const Material& material, const HitRecord& rec,
+                          const glm::vec3& direction) {
+  return visit_material<kMaterials>(
+      [&](const auto& m) {
+        if constexpr (requires { m.evaluate(rec, direction); }) {
+          return m.evaluate(rec, direction);
+        } else {
+          return glm::vec3{0.0f};
+        }
+      },
+      material);
+}
+
+// Solid angle density with which Scatter() picks a unit direction. Zero for
+// specular materials.
+template <MaterialSet kMaterials = kAllMaterials>
+[[nodiscard]]
+inline float ScatterPdf(const Material& material, const HitRecord& rec,
+                        const glm::vec3& direction) {
+  return visit_material<kMaterials>(
+      [&](const auto& m) {
+        if constexpr (requires { m.scatter_pdf(rec, direction); }) {
+          return m.scatter_pdf(rec, direction);
+        } else {
+          return 0.0f;
+        }
+      },
+      material);
+}
+
+// Fraction of light the surface reflects at rec, as the denoiser's albedo
+// feature. Glass and lights count as white: their look comes from what is
+// behind them or from their emission.
+[[nodiscard]]
+inline glm::vec3 Albedo(const Material& material, const HitRecord& rec) {
+  return std::visit(
+      [&rec](const auto& m) {
+        if constexpr (requires { m.albedo(rec); }) {
+          return m.albedo(rec);
+        } else {
+          return glm::vec3{1.0f};
+        }
+      },
+      material);
+}
+
+// Scene-owned, contiguous storage for every material. Primitives and hit
+// records refer to materials by MaterialId.
+class MaterialTable {
+ public:
+  MaterialId add(const Material& material) {
+    m_materials.push_back(material);
+    return static_cast<MaterialId>(m_materials.size() - 1);
+  }
+
+  [[nodiscard]]
+  const Material& operator[](const MaterialId id) const noexcept {
+    return m_materials[id];
+  }
+
+  [[nodiscard]]
+  std::size_t size() const noexcept {
+    return m_materials.size();
+  }
+
+ private:
+  std::vector<Material> m_materials;
+};
+}  // namespace mp
@@ -0,0 +1,848 @@
+#include "MeshFile.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <future>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "MappedFile.hpp"
+
+namespace mp {
+namespace {
+
+// Chunks smaller than this are not worth a thread of their own.
+constexpr std::size_t kMinChunkBytes = std::size_t{1} << 20;
+
+[[noreturn]]
+void fail(const std::filesystem::path& path, const std::string_view message) {
+  throw std::runtime_error(std::format("{}: {}", path.string(), message));
+}
+
+[[nodiscard]]
+std::size_t chunk_count(const std::size_t bytes) {
+  const std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  return std::clamp<std::size_t>(bytes / kMinChunkBytes, 1, threads);
+}
+
+// Calls f(chunk) for every chunk in [0, count) concurrently, chunk 0 on the
+// calling thread. Exceptions are rethrown once all chunks are done.
+template <typename F>
+void parallel_for_chunks(const std::size_t count, F&& f) {
+  std::vector<std::future<void>> tasks;
+  tasks.reserve(count);
+  for (std::size_t chunk = 1; chunk < count; ++chunk) {
+    tasks.push_back(
+        std::async(std::launch::async, [&f, chunk] { f(chunk); }));
+  }
+  f(0);
+  for (auto& task : tasks) {
+    task.get();
+  }
+}
+
+// Range [begin, end) of the chunk-th of count equal parts of size items.
+[[nodiscard]]
+std::pair<std::size_t, std::size_t> chunk_range(const std::size_t chunk,
+                                                const std::size_t count,
+                                                const std::size_t size) {
+  return {size * chunk / count, size * (chunk + 1) / count};
+}
+
+void validate_indices(const MeshData& mesh,
+                      const std::filesystem::path& path) {
+  const auto vertexCount = mesh.vertex_count();
+  if (std::ranges::any_of(mesh.indices, [vertexCount](const auto index) {
+        return index >= vertexCount;
+      })) {
+    fail(path, "a face refers to a vertex that does not exist");
+  }
+}
+
+// OBJ ------------------------------------------------------------------------
+
+// One triangle corner as written in the file. Indices are 0-based; negative
+// indices in the file are relative to the end of the vertex list, which a
+// chunk only knows locally, so they are kept relative to the chunk's first
+// vertex (or normal) until the chunk offsets are known.
+struct ObjCorner {
+  static constexpr std::uint8_t kPositionRelative = 1;
+  static constexpr std::uint8_t kNormalRelative = 2;
+  static constexpr std::uint8_t kHasNormal = 4;
+
+  std::int32_t position;
+  std::int32_t normal;
+  std::uint8_t flags;
+};
+
+struct ObjChunk {
+  std::string_view text;
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> normals;
+  // Three per triangle.
+  std::vector<ObjCorner> corners;
+  std::size_t lineCount = 0;
+  // First error of the chunk and its line, counted from the chunk start.
+  std::string error;
+  std::size_t errorLine = 0;
+};
+
+class ObjTokens {
+ public:
+  explicit ObjTokens(const std::string_view line)
+      : m_rest(line.substr(0, line.find('#'))) {}
+
+  // Empty at the end of the line.
+  [[nodiscard]]
+  std::string_view next() {
+    const auto start = m_rest.find_first_not_of(" \t\r");
+    if (start == std::string_view::npos) {
+      m_rest = {};
+      return {};
+    }
+    m_rest.remove_prefix(start);
+    const auto token = m_rest.substr(0, m_rest.find_first_of(" \t\r"));
+    m_rest.remove_prefix(token.size());
+    return token;
+  }
+
+  [[nodiscard]]
+  glm::vec3 vec3() {
+    const auto x = number<float>(next());
+    const auto y = number<float>(next());
+    return {x, y, number<float>(next())};
+  }
+
+  template <typename T>
+  [[nodiscard]]
+  static T number(const std::string_view token) {
+    T value{};
+    const auto [end, error] =
+        std::from_chars(token.data(), token.data() + token.size(), value);
+    if (token.empty() || error != std::errc{} ||
+        end != token.data() + token.size()) {
+      throw std::runtime_error(
+          std::format("'{}' is not a valid number", token));
+    }
+    return value;
+  }
+
+ private:
+  std::string_view m_rest;
+};
+
+// Converts a 1-based or negative OBJ index to the 0-based form of
+// ObjCorner, given how many elements the chunk has read so far.
+[[nodiscard]]
+std::int32_t obj_index(const std::string_view token, const std::size_t count,
+                       bool& relative) {
+  const auto index = ObjTokens::number<std::int64_t>(token);
+  relative = index < 0;
+  const auto zeroBased =
+      relative ? static_cast<std::int64_t>(count) + index : index - 1;
+  if (index == 0 || zeroBased > std::numeric_limits<std::int32_t>::max() ||
+      zeroBased < std::numeric_limits<std::int32_t>::min()) {
+    throw std::runtime_error(std::format("invalid index {}", index));
+  }
+  return static_cast<std::int32_t>(zeroBased);
+}
+
+// "p", "p/t", "p//n" or "p/t/n".
+[[nodiscard]]
+ObjCorner parse_obj_corner(const std::string_view token,
+                           const ObjChunk& chunk) {
+  ObjCorner corner{};
+  bool relative = false;
+  const auto slash = token.find('/');
+  corner.position =
+      obj_index(token.substr(0, slash), chunk.positions.size(), relative);
+  corner.flags |= relative ? ObjCorner::kPositionRelative : 0;
+  const auto normalSlash = token.find('/', slash == std::string_view::npos
+                                               ? token.size()
+                                               : slash + 1);
+  if (normalSlash != std::string_view::npos) {
+    corner.normal = obj_index(token.substr(normalSlash + 1),
+                              chunk.normals.size(), relative);
+    corner.flags |= ObjCorner::kHasNormal |
+                    (relative ? ObjCorner::kNormalRelative : 0);
+  }
+  return corner;
+}
+
+void parse_obj_line(const std::string_view line, ObjChunk& chunk,
+                    std::vector<ObjCorner>& polygon) {
+  ObjTokens tokens(line);
+  const auto keyword = tokens.next();
+  if (keyword == "v") {
+    chunk.positions.push_back(tokens.vec3());
+  } else if (keyword == "vn") {
+    chunk.normals.push_back(tokens.vec3());
+  } else if (keyword == "f") {
+    polygon.clear();
+    for (auto token = tokens.next(); !token.empty(); token = tokens.next()) {
+      polygon.push_back(parse_obj_corner(token, chunk));
+    }
+    if (polygon.size() < 3) {
+      throw std::runtime_error("a face needs at least three vertices");
+    }
+    for (std::size_t i = 1; i + 1 < polygon.size(); ++i) {
+      chunk.corners.push_back(polygon[0]);
+      chunk.corners.push_back(polygon[i]);
+      chunk.corners.push_back(polygon[i + 1]);
+    }
+  }
+}
+
+void parse_obj_chunk(ObjChunk& chunk) {
+  const auto text = chunk.text;
+  std::vector<ObjCorner> polygon;
+  for (std::size_t start = 0; start < text.size();) {
+    const auto end = std::min(text.find('\n', start), text.size());
+    ++chunk.lineCount;
+    try {
+      parse_obj_line(text.substr(start, end - start), chunk, polygon);
+    } catch (const std::runtime_error& e) {
+      chunk.error = e.what();
+      chunk.errorLine = chunk.lineCount;
+      return;
+    }
+    start = end + 1;
+  }
+}
+
+// Gives every distinct (position, normal) pair of the corners its own
+// vertex, for files that index positions and normals independently.
+void split_vertices(MeshData& mesh, const std::vector<glm::vec3>& normals,
+                    const std::vector<std::uint32_t>& normalIndices) {
+  MeshData split;
+  split.indices.resize(mesh.indices.size());
+  std::unordered_map<std::uint64_t, std::uint32_t> vertices;
+  vertices.reserve(mesh.vertex_count());
+  for (std::size_t i = 0; i < mesh.indices.size(); ++i) {
+    const auto position = mesh.indices[i];
+    const auto normal = normalIndices[i];
+    const auto key = static_cast<std::uint64_t>(position) << 32 | normal;
+    const auto [vertex, inserted] = vertices.try_emplace(
+        key, static_cast<std::uint32_t>(split.vertex_count()));
+    if (inserted) {
+      split.x.push_back(mesh.x[position]);
+      split.y.push_back(mesh.y[position]);
+      split.z.push_back(mesh.z[position]);
+      split.normalX.push_back(normals[normal].x);
+      split.normalY.push_back(normals[normal].y);
+      split.normalZ.push_back(normals[normal].z);
+    }
+    split.indices[i] = vertex->second;
+  }
+  mesh = std::move(split);
+}
+
+// PLY ------------------------------------------------------------------------
+
+enum class PlyType : std::uint8_t {
+  Int8,
+  UInt8,
+  Int16,
+  UInt16,
+  Int32,
+  UInt32,
+  Float32,
+  Float64,
+};
+
+[[nodiscard]]
+std::optional<PlyType> parse_ply_type(const std::string_view name) {
+  if (name == "char" || name == "int8") return PlyType::Int8;
+  if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+  if (name == "short" || name == "int16") return PlyType::Int16;
+  if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+  if (name == "int" || name == "int32") return PlyType::Int32;
+  if (name == "uint" || name == "uint32") return PlyType::UInt32;
+  if (name == "float" || name == "float32") return PlyType::Float32;
+  if (name == "double" || name == "float64") return PlyType::Float64;
+  return std::nullopt;
+}
+
+[[nodiscard]]
+constexpr std::size_t size_of(const PlyType type) noexcept {
+  switch (type) {
+    case PlyType::Int8:
+    case PlyType::UInt8:
+      return 1;
+    case PlyType::Int16:
+    case PlyType::UInt16:
+      return 2;
+    case PlyType::Int32:
+    case PlyType::UInt32:
+    case PlyType::Float32:
+      return 4;
+    case PlyType::Float64:
+      return 8;
+  }
+  return 0;
+}
+
+template <typename T>
+[[nodiscard]]
+T load(const std::byte* data, const bool swapBytes) noexcept {
+  using Bits = std::conditional_t<
+      sizeof(T) == 1, std::uint8_t,
+      std::conditional_t<sizeof(T) == 2, std::uint16_t,
+                         std::conditional_t<sizeof(T) == 4, std::uint32_t,
+                                            std::uint64_t>>>;
+  Bits bits;
+  std::memcpy(&bits, data, sizeof(bits));
+  if (swapBytes) {
+    bits = std::byteswap(bits);
+  }
+  return std::bit_cast<T>(bits);
+}
+
+[[nodiscard]]
+double load(const std::byte* data, const PlyType type,
+            const bool swapBytes) noexcept {
+  switch (type) {
+    case PlyType::Int8:
+      return load<std::int8_t>(data, swapBytes);
+    case PlyType::UInt8:
+      return load<std::uint8_t>(data, swapBytes);
+    case PlyType::Int16:
+      return load<std::int16_t>(data, swapBytes);
+    case PlyType::UInt16:
+      return load<std::uint16_t>(data, swapBytes);
+    case PlyType::Int32:
+      return load<std::int32_t>(data, swapBytes);
+    case PlyType::UInt32:
+      return load<std::uint32_t>(data, swapBytes);
+    case PlyType::Float32:
+      return load<float>(data, swapBytes);
+    case PlyType::Float64:
+      return load<double>(data, swapBytes);
+  }
+  return 0.0;
+}
+
+struct PlyProperty {
+  std::string name;
+  PlyType type;
+  // Set for list properties, whose items are of type.
+  std::optional<PlyType> countType;
+};
+
+struct PlyElement {
+  std::string name;
+  std::uint64_t count;
+  std::vector<PlyProperty> properties;
+
+  // Record size if the element has no list properties.
+  [[nodiscard]]
+  std::optional<std::size_t> fixed_size() const {
+    std::size_t size = 0;
+    for (const auto& property : properties) {
+      if (property.countType) {
+        return std::nullopt;
+      }
+      size += size_of(property.type);
+    }
+    return size;
+  }
+};
+
+struct PlyHeader {
+  std::vector<PlyElement> elements;
+  bool swapBytes;
+  std::size_t dataOffset;
+};
+
+[[nodiscard]]
+PlyHeader parse_ply_header(const std::string_view file,
+                           const std::filesystem::path& path) {
+  constexpr std::string_view kEndHeader = "end_header";
+  const auto endHeader = file.find(kEndHeader);
+  const auto dataOffset = file.find('\n', endHeader);
+  if (!file.starts_with("ply") || endHeader == std::string_view::npos ||
+      dataOffset == std::string_view::npos) {
+    fail(path, "not a PLY file");
+  }
+
+  PlyHeader header{.elements = {}, .swapBytes = false,
+                   .dataOffset = dataOffset + 1};
+  bool hasFormat = false;
+  const auto text = file.substr(0, endHeader);
+  for (std::size_t start = text.find('\n') + 1; start < text.size();) {
+    const auto end = std::min(text.find('\n', start), text.size());
+    ObjTokens tokens(text.substr(start, end - start));
+    start = end + 1;
+
+    const auto keyword = tokens.next();
+    if (keyword == "format") {
+      const auto format = tokens.next();
+      if (format == "ascii") {
+        fail(path, "ASCII PLY is not supported, only binary");
+      }
+      if (format != "binary_little_endian" && format != "binary_big_endian") {
+        fail(path, std::format("unknown PLY format '{}'", format));
+      }
+      header.swapBytes = (format == "binary_little_endian") !=
+                         (std::endian::native == std::endian::little);
+      hasFormat = true;
+    } else if (keyword == "element") {
+      const std::string name(tokens.next());
+      header.elements.push_back(
+          {name, ObjTokens::number<std::uint64_t>(tokens.next()), {}});
+    } else if (keyword == "property") {
+      if (header.elements.empty()) {
+        fail(path, "PLY property outside of an element");
+      }
+      PlyProperty property;
+      auto typeName = tokens.next();
+      if (typeName == "list") {
+        property.countType = parse_ply_type(tokens.next());
+        typeName = tokens.next();
+        if (!property.countType) {
+          fail(path, "unknown PLY list count type");
+        }
+      }
+      const auto type = parse_ply_type(typeName);
+      if (!type) {
+        fail(path, std::format("unknown PLY type '{}'", typeName));
+      }
+      property.type = *type;
+      property.name = tokens.next();
+      header.elements.back().properties.push_back(std::move(property));
+    } else if (!keyword.empty() && keyword != "comment" &&
+               keyword != "obj_info") {
+      fail(path, std::format("unknown PLY header line '{}'", keyword));
+    }
+  }
+  if (!hasFormat) {
+    fail(path, "PLY header has no format line");
+  }
+  return header;
+}
+
+// Reads values at an advancing offset, checking every access against the
+// end of the file.
+class PlyCursor {
+ public:
+  PlyCursor(const std::span<const std::byte> data, const std::size_t offset,
+            const bool swapBytes, const std::filesystem::path& path)
+      : m_data(data), m_offset(offset), m_swapBytes(swapBytes), m_path(path) {}
+
+  [[nodiscard]]
+  std::size_t offset() const noexcept {
+    return m_offset;
+  }
+
+  [[nodiscard]]
+  double read(const PlyType type) {
+    const auto size = size_of(type);
+    require(size);
+    const auto value = load(m_data.data() + m_offset, type, m_swapBytes);
+    m_offset += size;
+    return value;
+  }
+
+  void skip(const std::size_t bytes) {
+    require(bytes);
+    m_offset += bytes;
+  }
+
+  void require(const std::size_t bytes) const {
+    if (bytes > m_data.size() - m_offset) {
+      fail(m_path, "file is truncated");
+    }
+  }
+
+  // Skips one record of element, which may contain lists.
+  void skip_record(const PlyElement& element) {
+    for (const auto& property : element.properties) {
+      const auto count =
+          property.countType ? read_count(*property.countType) : 1;
+      skip(count * size_of(property.type));
+    }
+  }
+
+  // Every item takes at least a byte, so a list cannot be longer than the
+  // rest of the file.
+  [[nodiscard]]
+  std::size_t read_count(const PlyType type) {
+    const auto count = read(type);
+    if (!std::isfinite(count) || count < 0.0 || std::trunc(count) != count) {
+      fail(m_path, "PLY list length is not a non-negative integer");
+    }
+    if (count > static_cast<double>(m_data.size() - m_offset)) {
+      fail(m_path, "file is truncated");
+    }
+    return static_cast<std::size_t>(count);
+  }
+
+ private:
+  std::span<const std::byte> m_data;
+  std::size_t m_offset;
+  bool m_swapBytes;
+  const std::filesystem::path& m_path;
+};
+
+void read_ply_vertices(const PlyElement& element, PlyCursor& cursor,
+                       const std::span<const std::byte> data,
+                       const bool swapBytes, MeshData& mesh,
+                       const std::filesystem::path& path) {
+  const auto stride = element.fixed_size();
+  if (!stride) {
+    fail(path, "PLY vertices with list properties are not supported");
+  }
+  if (element.count > std::numeric_limits<std::uint32_t>::max()) {
+    fail(path, "too many vertices for 32-bit indices");
+  }
+  const auto count = static_cast<std::size_t>(element.count);
+
+  struct Field {
+    std::size_t offset;
+    PlyType type;
+  };
+  const auto find = [&element](const std::string_view name) {
+    std::size_t offset = 0;
+    for (const auto& property : element.properties) {
+      if (property.name == name) {
+        return std::optional<Field>{Field{offset, property.type}};
+      }
+      offset += size_of(property.type);
+    }
+    return std::optional<Field>{};
+  };
+  const auto x = find("x");
+  const auto y = find("y");
+  const auto z = find("z");
+  if (!x || !y || !z) {
+    fail(path, "PLY vertices need x, y and z");
+  }
+  const auto normalX = find("nx");
+  const auto normalY = find("ny");
+  const auto normalZ = find("nz");
+  const bool hasNormals = normalX && normalY && normalZ;
+  // Exporters disagree on the names of texture coordinates.
+  auto texU = find("u");
+  auto texV = find("v");
+  if (!texU || !texV) {
+    texU = find("s");
+    texV = find("t");
+  }
+  if (!texU || !texV) {
+    texU = find("texture_u");
+    texV = find("texture_v");
+  }
+  const bool hasTexcoords = texU && texV;
+
+  const auto first = cursor.offset();
+  cursor.skip(count * *stride);
+  mesh.x.resize(count);
+  mesh.y.resize(count);
+  mesh.z.resize(count);
+  if (hasNormals) {
+    mesh.normalX.resize(count);
+    mesh.normalY.resize(count);
+    mesh.normalZ.resize(count);
+  }
+  if (hasTexcoords) {
+    mesh.texU.resize(count);
+    mesh.texV.resize(count);
+  }
+  const auto chunks = chunk_count(count * *stride);
+  parallel_for_chunks(chunks, [&](const std::size_t chunk) {
+    const auto [begin, end] = chunk_range(chunk, chunks, count);
+    const auto get = [&](const Field& field, const std::byte* record) {
+      return static_cast<float>(
+          load(record + field.offset, field.type, swapBytes));
+    };
+    for (std::size_t i = begin; i < end; ++i) {
+      const auto* record = data.data() + first + i * *stride;
+      mesh.x[i] = get(*x, record);
+      mesh.y[i] = get(*y, record);
+      mesh.z[i] = get(*z, record);
+      if (hasNormals) {
+        mesh.normalX[i] = get(*normalX, record);
+        mesh.normalY[i] = get(*normalY, record);
+        mesh.normalZ[i] = get(*normalZ, record);
+      }
+      if (hasTexcoords) {
+        mesh.texU[i] = get(*texU, record);
+        mesh.texV[i] = get(*texV, record);
+      }
+    }
+  });
+}
+
+// Faces that are all triangles and carry nothing but the index list have a
+// fixed record size, so they are read in parallel. Returns false, having
+// read nothing, if the faces are not like that.
+[[nodiscard]]
+bool read_ply_triangles(const PlyElement& element, const PlyCursor& cursor,
+                        const std::span<const std::byte> data,
+                        const bool swapBytes, MeshData& mesh) {
+  if (element.properties.size() != 1 ||
+      !element.properties.front().countType) {
+    return false;
+  }
+  const auto countType = *element.properties.front().countType;
+  const auto indexType = element.properties.front().type;
+  const auto countSize = size_of(countType);
+  const auto indexSize = size_of(indexType);
+  const auto stride = countSize + 3 * indexSize;
+  const auto count = static_cast<std::size_t>(element.count);
+  if (element.count > (data.size() - cursor.offset()) / stride) {
+    return false;
+  }
+
+  const auto first = cursor.offset();
+  std::vector<std::uint32_t> indices(3 * count);
+  std::atomic<bool> allTriangles = true;
+  const auto chunks = chunk_count(count * stride);
+  parallel_for_chunks(chunks, [&](const std::size_t chunk) {
+    const auto [begin, end] = chunk_range(chunk, chunks, count);
+    for (std::size_t i = begin; i < end && allTriangles.load(); ++i) {
+      const auto* record = data.data() + first + i * stride;
+      if (load(record, countType, swapBytes) != 3.0) {
+        allTriangles = false;
+        return;
+      }
+      for (std::size_t corner = 0; corner < 3; ++corner) {
+        // Negative indices wrap around and are rejected with the others
+        // that are out of range.
+        indices[3 * i + corner] = static_cast<std::uint32_t>(
+            static_cast<std::int64_t>(load(
+                record + countSize + corner * indexSize, indexType,
+                swapBytes)));
+      }
+    }
+  });
+  if (!allTriangles) {
+    return false;
+  }
+  mesh.indices = std::move(indices);
+  return true;
+}
+
+void read_ply_faces(const PlyElement& element, PlyCursor& cursor,
+                    const std::span<const std::byte> data,
+                    const bool swapBytes, MeshData& mesh,
+                    const std::filesystem::path& path) {
+  const auto indexList = std::ranges::find_if(
+      element.properties, [](const PlyProperty& property) {
+        return property.countType && (property.name == "vertex_indices" ||
+                                      property.name == "vertex_index");
+      });
+  if (indexList == element.properties.end()) {
+    fail(path, "PLY faces need a vertex_indices list");
+  }
+
+  if (read_ply_triangles(element, cursor, data, swapBytes, mesh)) {
+    const auto stride =
+        size_of(*indexList->countType) + 3 * size_of(indexList->type);
+    cursor.skip(static_cast<std::size_t>(element.count) * stride);
+    return;
+  }
+
+  // General case: polygons of any size, other properties in between.
+  std::vector<std::uint32_t> polygon;
+  for (std::uint64_t face = 0; face < element.count; ++face) {
+    for (const auto& property : element.properties) {
+      if (&property != &*indexList) {
+        const auto count =
+            property.countType ? cursor.read_count(*property.countType) : 1;
+        cursor.skip(count * size_of(property.type));
+        continue;
+      }
+      polygon.resize(cursor.read_count(*property.countType));
+      for (auto& index : polygon) {
+        index = static_cast<std::uint32_t>(
+            static_cast<std::int64_t>(cursor.read(property.type)));
+      }
+      if (polygon.size() < 3) {
+        fail(path, "a face needs at least three vertices");
+      }
+      for (std::size_t i = 1; i + 1 < polygon.size(); ++i) {
+        mesh.indices.insert(mesh.indices.end(),
+                            {polygon[0], polygon[i], polygon[i + 1]});
+      }
+    }
+  }
+}
+
+}  // namespace
+
+MeshData load_obj(const std::filesystem::path& path) {
+  const MappedFile file(path);
+  const std::string_view text(reinterpret_cast<const char*>(file.data().data()),
+                              file.size());
+
+  // Chunks start after a line break so that no line is split.
+  std::vector<ObjChunk> chunks(chunk_count(text.size()));
+  std::size_t start = 0;
+  for (std::size_t i = 0; i < chunks.size(); ++i) {
+    auto end = chunk_range(i, chunks.size(), text.size()).second;
+    end = i + 1 == chunks.size()
+              ? text.size()
+              : std::min(text.find('\n', std::max(end, start)), text.size());
+    chunks[i].text = text.substr(start, end - start);
+    start = std::min(end + 1, text.size());
+  }
+  parallel_for_chunks(chunks.size(), [&chunks](const std::size_t chunk) {
+    parse_obj_chunk(chunks[chunk]);
+  });
+
+  // Offsets of each chunk's vertices, normals and corners in the result.
+  std::vector<std::size_t> positionBase(chunks.size() + 1);
+  std::vector<std::size_t> normalBase(chunks.size() + 1);
+  std::vector<std::size_t> cornerBase(chunks.size() + 1);
+  std::size_t lineBase = 0;
+  for (std::size_t i = 0; i < chunks.size(); ++i) {
+    const auto& chunk = chunks[i];
+    if (!chunk.error.empty()) {
+      fail(path,
+           std::format("line {}: {}", lineBase + chunk.errorLine, chunk.error));
+    }
+    lineBase += chunk.lineCount;
+    positionBase[i + 1] = positionBase[i] + chunk.positions.size();
+    normalBase[i + 1] = normalBase[i] + chunk.normals.size();
+    cornerBase[i + 1] = cornerBase[i] + chunk.corners.size();
+  }
+  const auto vertexCount = positionBase.back();
+  const auto normalCount = normalBase.back();
+  const auto cornerCount = cornerBase.back();
+  if (vertexCount > std::numeric_limits<std::uint32_t>::max()) {
+    fail(path, "too many vertices for 32-bit indices");
+  }
+
+  MeshData mesh;
+  mesh.x.resize(vertexCount);
+  mesh.y.resize(vertexCount);
+  mesh.z.resize(vertexCount);
+  mesh.indices.resize(cornerCount);
+  std::vector<glm::vec3> normals(normalCount);
+  std::vector<std::uint32_t> normalIndices(normalCount > 0 ? cornerCount : 0);
+  std::atomic<std::size_t> cornersWithNormal = 0;
+  std::atomic<bool> sharedIndices = true;
+  std::atomic<bool> normalsInRange = true;
+  const auto resolve = [](const std::int32_t index, const bool relative,
+                          const std::size_t base) {
+    // Out of range results wrap around and fail validate_indices().
+    return static_cast<std::uint32_t>(index + (relative ? base : 0));
+  };
+  parallel_for_chunks(chunks.size(), [&](const std::size_t i) {
+    auto& chunk = chunks[i];
+    for (std::size_t v = 0; v < chunk.positions.size(); ++v) {
+      mesh.x[positionBase[i] + v] = chunk.positions[v].x;
+      mesh.y[positionBase[i] + v] = chunk.positions[v].y;
+      mesh.z[positionBase[i] + v] = chunk.positions[v].z;
+    }
+    std::ranges::copy(chunk.normals, normals.begin() + normalBase[i]);
+
+    std::size_t withNormal = 0;
+    bool shared = true;
+    bool inRange = true;
+    for (std::size_t c = 0; c < chunk.corners.size(); ++c) {
+      const auto& corner = chunk.corners[c];
+      const auto position =
+          resolve(corner.position, corner.flags & ObjCorner::kPositionRelative,
+                  positionBase[i]);
+      mesh.indices[cornerBase[i] + c] = position;
+      if (!normalIndices.empty() && (corner.flags & ObjCorner::kHasNormal)) {
+        const auto normal =
+            resolve(corner.normal, corner.flags & ObjCorner::kNormalRelative,
+                    normalBase[i]);
+        normalIndices[cornerBase[i] + c] = normal;
+        inRange = inRange && normal < normalCount;
+        shared = shared && normal == position;
+        ++withNormal;
+      }
+    }
+    cornersWithNormal += withNormal;
+    if (!shared) {
+      sharedIndices = false;
+    }
+    if (!inRange) {
+      normalsInRange = false;
+    }
+    chunk = ObjChunk{};
+  });
+  validate_indices(mesh, path);
+  if (!normalsInRange) {
+    fail(path, "a face refers to a normal that does not exist");
+  }
+
+  if (cornerCount == 0 || cornersWithNormal != cornerCount) {
+    return mesh;
+  }
+  if (!sharedIndices || normalCount < vertexCount) {
+    split_vertices(mesh, normals, normalIndices);
+    return mesh;
+  }
+  mesh.normalX.resize(vertexCount);
+  mesh.normalY.resize(vertexCount);
+  mesh.normalZ.resize(vertexCount);
+  for (std::size_t v = 0; v < vertexCount; ++v) {
+    mesh.normalX[v] = normals[v].x;
+    mesh.normalY[v] = normals[v].y;
+    mesh.normalZ[v] = normals[v].z;
+  }
+  return mesh;
+}
+
+MeshData load_ply(const std::filesystem::path& path) {
+  const MappedFile file(path);
+  const auto data = file.data();
+  const auto header = parse_ply_header(
+      std::string_view(reinterpret_cast<const char*>(data.data()),
+                       data.size()),
+      path);
+
+  MeshData mesh;
+  PlyCursor cursor(data, header.dataOffset, header.swapBytes, path);
+  for (const auto& element : header.elements) {
+    if (element.name == "vertex") {
+      read_ply_vertices(element, cursor, data, header.swapBytes, mesh, path);
+    } else if (element.name == "face") {
+      read_ply_faces(element, cursor, data, header.swapBytes, mesh, path);
+    } else if (const auto size = element.fixed_size()) {
+      cursor.skip(static_cast<std::size_t>(element.count) * *size);
+    } else {
+      for (std::uint64_t i = 0; i < element.count; ++i) {
+        cursor.skip_record(element);
+      }
+    }
+  }
+  validate_indices(mesh, path);
+  return mesh;
+}
+
+MeshData load_mesh(const std::filesystem::path& path) {
+  auto extension = path.extension().string();
+  std::ranges::transform(extension, extension.begin(), [](const char c) {
+    return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  });
+  if (extension == ".obj") {
+    return load_obj(path);
+  }
+  if (extension == ".ply") {
+    return load_ply(path);
+  }
+  fail(path, "unknown mesh format, expected .obj or .ply");
+}
+
+}  // namespace mp
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <filesystem>
+
+#include "TriangleMesh.hpp"
+
+namespace mp {
+
+// Mesh loaders. Files are memory-mapped and split into chunks that are
+// parsed on all hardware threads, then gathered into MeshData in a second
+// parallel pass. Polygons with more than three corners are triangulated as
+// fans. All loaders throw std::system_error if the file cannot be mapped and
+// std::runtime_error if its contents are malformed.
+
+// Wavefront OBJ: reads v, vn and f lines, including negative (relative)
+// indices, and ignores everything else, texture coordinates (vt) too. Faces
+// whose position and normal indices differ get their vertices split so that
+// every vertex has one normal; normals are dropped if only some faces have
+// them.
+[[nodiscard]]
+MeshData load_obj(const std::filesystem::path& path);
+
+// Binary PLY, either byte order: x, y, z and optionally nx, ny, nz and
+// texture coordinates (u, v or s, t or texture_u, texture_v) of the vertex
+// element and the vertex_indices list of the face element. Other elements
+// and properties are skipped. ASCII PLY is not supported.
+[[nodiscard]]
+MeshData load_ply(const std::filesystem::path& path);
+
+// Picks the loader from the extension, .obj or .ply.
+[[nodiscard]]
+MeshData load_mesh(const std::filesystem::path& path);
+
+}  // namespace mp
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Hittable.hpp"
+#include "Ray.hpp"
+#include "glm/glm.hpp"
+
+namespace mp {
+
+// Shadow rays queued by the shade stage of the wavefront integrator and
+// traced together afterwards. Ray i adds radiance[i] to path[i] unless
+// something blocks it before distance[i].
+struct ShadowRayBatch {
+  std::vector<glm::vec3> origin;
+  std::vector<glm::vec3> direction;
+  std::vector<float> distance;
+  std::vector<glm::vec3> radiance;
+  std::vector<std::uint32_t> path;
+
+  [[nodiscard]]
+  std::size_t size() const noexcept {
+    return path.size();
+  }
+
+  [[nodiscard]]
+  Ray ray(const std::size_t i) const {
+    return Ray{origin[i], direction[i]};
+  }
+
+  void clear() noexcept {
+    origin.clear();
+    direction.clear();
+    distance.clear();
+    radiance.clear();
+    path.clear();
+  }
+
+  void push_back(const Ray& ray, const float rayDistance,
+                 const glm::vec3& rayRadiance, const std::uint32_t pathIndex) {
+    origin.push_back(ray.origin());
+    direction.push_back(ray.direction());
+    distance.push_back(rayDistance);
+    radiance.push_back(rayRadiance);
+    path.push_back(pathIndex);
+  }
+};
+
+// State of the paths in flight in the wavefront integrator, one array per
+// field: path i is element i of every array. Each render thread owns one
+// batch and reuses its storage from tile to tile.
+struct PathBatch {
+  std::vector<glm::vec3> origin;
+  std::vector<glm::vec3> direction;
+  std::vector<glm::vec3> throughput;
+  // Radiance gathered so far, added to the pixel when the path ends.
+  std::vector<glm::vec3> radiance;
+  // Density the last bounce sampled direction with, 0 after a specular
+  // bounce and for camera rays.
+  std::vector<float> scatterPdf;
+  std::vector<RayCone> cone;
+  // Pixel index within the tile being rendered.
+  std::vector<std::uint32_t> pixel;
+  std::vector<std::uint32_t> sample;
+  std::vector<HitRecord> hit;
+  std::vector<std::uint8_t> alive;
+  // Paths that hit something, grouped by material type for shading.
+  std::vector<std::uint32_t> shadeOrder;
+  ShadowRayBatch shadowRays;
+
+  [[nodiscard]]
+  std::size_t size() const noexcept {
+    return pixel.size();
+  }
+
+  [[nodiscard]]
+  Ray ray(const std::size_t i) const {
+    return Ray{origin[i], direction[i]};
+  }
+
+  void clear() noexcept {
+    origin.clear();
+    direction.clear();
+    throughput.clear();
+    radiance.clear();
+    scatterPdf.clear();
+    cone.clear();
+    pixel.clear();
+    sample.clear();
+    hit.clear();
+    alive.clear();
+  }
+
+  void push_back(const Ray& ray, const RayCone& rayCone,
+                 const std::uint32_t pixelIndex,
+                 const std::uint32_t sampleIndex) {
+    origin.push_back(ray.origin());
+    direction.push_back(ray.direction());
+    throughput.emplace_back(1.0f);
+    radiance.emplace_back(0.0f);
+    scatterPdf.push_back(0.0f);
+    cone.push_back(rayCone);
+    pixel.push_back(pixelIndex);
+    sample.push_back(sampleIndex);
+    alive.push_back(1);
+  }
+
+  // Drops terminated paths, keeping the survivors in their current order.
+  void compact() {
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < size(); ++i) {
+      if (!alive[i]) {
+        continue;
+      }
+      origin[kept] = origin[i];
+      direction[kept] = direction[i];
+      throughput[kept] = throughput[i];
+      radiance[kept] = radiance[i];
+      scatterPdf[kept] = scatterPdf[i];
+      cone[kept] = cone[i];
+      pixel[kept] = pixel[i];
+      sample[kept] = sample[i];
+      alive[kept] = 1;
+      ++kept;
+    }
+    origin.resize(kept);
+    direction.resize(kept);
+    throughput.resize(kept);
+    radiance.resize(kept);
+    scatterPdf.resize(kept);
+    cone.resize(kept);
+    pixel.resize(kept);
+    sample.resize(kept);
+    alive.resize(kept);
+  }
+};
+
+}  // namespace mp
@@ -0,0 +1,152 @@
+#include "PngStreamWriter.hpp"
+
+#include <algorithm>
+#include <array>
+#include <format>
+#include <initializer_list>
+#include <stdexcept>
+
+namespace mp {
+namespace {
+
+constexpr std::array<std::uint32_t, 256> kCrcTable = [] {
+  std::array<std::uint32_t, 256> table{};
+  for (std::uint32_t n = 0; n < 256; ++n) {
+    std::uint32_t c = n;
+    for (int k = 0; k < 8; ++k) {
+      c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+    }
+    table[n] = c;
+  }
+  return table;
+}();
+
+std::uint32_t crc32(std::uint32_t crc,
+                    const std::span<const std::uint8_t> data) noexcept {
+  crc = ~crc;
+  for (const auto byte : data) {
+    crc = kCrcTable[(crc ^ byte) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+void append_big_endian(std::vector<std::uint8_t>& out,
+                       const std::uint32_t value) {
+  out.push_back(static_cast<std::uint8_t>(value >> 24));
+  out.push_back(static_cast<std::uint8_t>(value >> 16));
+  out.push_back(static_cast<std::uint8_t>(value >> 8));
+  out.push_back(static_cast<std::uint8_t>(value));
+}
+
+}  // namespace
+
+PngStreamWriter::PngStreamWriter(const std::filesystem::path& path,
+                                 const std::size_t width,
+                                 const std::size_t height)
+    : m_file(path, std::ios::binary | std::ios::trunc),
+      m_width(width),
+      m_height(height) {
+  // IHDR stores each dimension in 31 bits and rejects 0.
+  constexpr std::size_t kMaxDimension = 0x7FFFFFFF;
+  if (width == 0 || height == 0 || width > kMaxDimension ||
+      height > kMaxDimension) {
+    throw std::invalid_argument(std::format(
+        "{}: a PNG cannot be {}x{}", path.string(), width, height));
+  }
+  if (!m_file) {
+    throw std::runtime_error(
+        std::format("{}: cannot open for writing", path.string()));
+  }
+  constexpr std::array<char, 8> kSignature{'\x89', 'P',  'N',    'G',
+                                           '\r',   '\n', '\x1A', '\n'};
+  m_file.write(kSignature.data(), kSignature.size());
+
+  std::vector<std::uint8_t> header;
+  append_big_endian(header, static_cast<std::uint32_t>(width));
+  append_big_endian(header, static_cast<std::uint32_t>(height));
+  // 8 bits per channel, RGB, deflate, adaptive filtering, no interlace.
+  header.insert(header.end(), {8, 2, 0, 0, 0});
+  write_chunk("IHDR", header);
+
+  m_block.reserve(kMaxBlockSize);
+  // zlib header: deflate with a 32K window, no preset dictionary, the check
+  // bits make it a multiple of 31.
+  m_chunk = {0x78, 0x01};
+}
+
+void PngStreamWriter::write_row(const std::span<const Color> row) {
+  if (row.size() != m_width || m_rowsWritten == m_height) {
+    throw std::invalid_argument(std::format(
+        "Row {} has {} pixels, image is {}x{}", m_rowsWritten, row.size(),
+        m_width, m_height));
+  }
+  const auto append = [this](std::initializer_list<std::uint8_t> bytes) {
+    if (m_block.size() + bytes.size() > kMaxBlockSize) {
+      flush_block(false);
+    }
+    m_block.insert(m_block.end(), bytes);
+  };
+  // Filter type None.
+  append({0});
+  for (const auto& color : row) {
+    append({color.r, color.g, color.b});
+  }
+  ++m_rowsWritten;
+}
+
+bool PngStreamWriter::finish() {
+  flush_block(true);
+  write_chunk("IEND", {});
+  m_file.close();
+  return m_file.good() && m_rowsWritten == m_height;
+}
+
+void PngStreamWriter::flush_block(const bool final) {
+  // Adler-32 of the uncompressed data, reduced often enough that the sums
+  // cannot overflow.
+  constexpr std::uint32_t kAdlerModulus = 65521;
+  constexpr std::size_t kAdlerRun = 5552;
+  for (std::size_t i = 0; i < m_block.size(); i += kAdlerRun) {
+    const auto end = std::min(m_block.size(), i + kAdlerRun);
+    for (std::size_t j = i; j < end; ++j) {
+      m_adlerA += m_block[j];
+      m_adlerB += m_adlerA;
+    }
+    m_adlerA %= kAdlerModulus;
+    m_adlerB %= kAdlerModulus;
+  }
+
+  // Stored block: BFINAL and BTYPE 00, padded to a byte, then LEN and its
+  // complement in little endian.
+  const auto length = static_cast<std::uint16_t>(m_block.size());
+  m_chunk.push_back(final ? 1 : 0);
+  m_chunk.push_back(static_cast<std::uint8_t>(length));
+  m_chunk.push_back(static_cast<std::uint8_t>(length >> 8));
+  m_chunk.push_back(static_cast<std::uint8_t>(~length));
+  m_chunk.push_back(static_cast<std::uint8_t>(~length >> 8));
+  m_chunk.insert(m_chunk.end(), m_block.begin(), m_block.end());
+  m_block.clear();
+  if (final) {
+    append_big_endian(m_chunk, (m_adlerB << 16) | m_adlerA);
+  }
+  write_chunk("IDAT", m_chunk);
+  m_chunk.clear();
+}
+
+void PngStreamWriter::write_chunk(const char (&type)[5],
+                                  const std::span<const std::uint8_t> data) {
+  std::vector<std::uint8_t> header;
+  append_big_endian(header, static_cast<std::uint32_t>(data.size()));
+  header.insert(header.end(), type, type + 4);
+  const auto crc = crc32(
+      crc32(0, std::span<const std::uint8_t>(header).subspan(4)), data);
+  std::vector<std::uint8_t> trailer;
+  append_big_endian(trailer, crc);
+
+  m_file.write(reinterpret_cast<const char*>(header.data()), header.size());
+  m_file.write(reinterpret_cast<const char*>(data.data()),
+               static_cast<std::streamsize>(data.size()));
+  m_file.write(reinterpret_cast<const char*>(trailer.data()), trailer.size());
+}
+
+}  // namespace mp
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <vector>
+
+#include "Color.hpp"
+
+namespace mp {
+
+// Writes an 8-bit RGB PNG one row at a time, holding at most one deflate
+// block in memory regardless of the image size. Rows are stored in
+// uncompressed deflate blocks: the file is about as large as the raw
+// pixels, in exchange for no whole-image buffer and no serial encode after
+// the render.
+class PngStreamWriter {
+ public:
+  // Opens path and writes the header, so that a render is not started for
+  // an image that cannot be written. Throws std::invalid_argument if width
+  // or height is 0 or above 2^31 - 1, and std::runtime_error if the file
+  // cannot be opened.
+  PngStreamWriter(const std::filesystem::path& path, std::size_t width,
+                  std::size_t height);
+
+  // Rows must be passed top to bottom, each exactly width pixels long.
+  void write_row(std::span<const Color> row);
+
+  // Writes the end of the image data and closes the file. Returns whether
+  // every row was written successfully.
+  [[nodiscard]]
+  bool finish();
+
+ private:
+  // Largest payload of a stored deflate block.
+  static constexpr std::size_t kMaxBlockSize = 65535;
+
+  void flush_block(bool final);
+  void write_chunk(const char (&type)[5], std::span<const std::uint8_t> data);
+
+  std::ofstream m_file;
+  std::size_t m_width;
+  std::size_t m_height;
+  std::size_t m_rowsWritten{};
+  std::uint32_t m_adlerA{1};
+  std::uint32_t m_adlerB{0};
+  std::vector<std::uint8_t> m_block;
+  std::vector<std::uint8_t> m_chunk;
+};
+
+}  // namespace mp
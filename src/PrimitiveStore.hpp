@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <span>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "AABB.hpp"
+#include "Hittable.hpp"
+#include "Interval.hpp"
+#include "Ray.hpp"
+
+namespace mp {
+
+// Anything the world can hold: a Hit overload with the usual contract and a
+// BoundingBox overload, both found by argument-dependent lookup.
+template <typename T>
+concept Primitive = requires(const T& primitive, const Ray& ray,
+                             Interval<float> interval, HitRecord& hitRecord) {
+  { Hit(primitive, ray, interval, hitRecord) } -> std::convertible_to<bool>;
+  { BoundingBox(primitive) } -> std::convertible_to<AABB>;
+};
+
+// Keeps every primitive type of the type list in its own contiguous array.
+// Hit is dispatched statically over the types, so there is no per-object
+// allocation and no virtual call unless the type list contains the Hittable
+// adapter, which remains the slow path for types not listed here.
+template <Primitive... Ts>
+class PrimitiveStore {
+ public:
+  template <typename T>
+    requires(std::same_as<T, Ts> || ...)
+  void add(T primitive) {
+    std::get<std::vector<T>>(m_arrays).push_back(std::move(primitive));
+  }
+
+  template <typename T>
+    requires(std::same_as<T, Ts> || ...)
+  [[nodiscard]]
+  std::span<const T> get() const noexcept {
+    return std::get<std::vector<T>>(m_arrays);
+  }
+
+  // For updating primitives in place between renders, e.g. moving the
+  // instances of an InstanceBVH.
+  template <typename T>
+    requires(std::same_as<T, Ts> || ...)
+  [[nodiscard]]
+  std::span<T> get() noexcept {
+    return std::get<std::vector<T>>(m_arrays);
+  }
+
+  [[nodiscard]]
+  std::size_t size() const noexcept {
+    return (std::get<std::vector<Ts>>(m_arrays).size() + ... + 0);
+  }
+
+  // Calls f(std::span<const T>) once per type of the list.
+  template <typename F>
+  void for_each_array(F&& f) const {
+    (f(get<Ts>()), ...);
+  }
+
+ private:
+  std::tuple<std::vector<Ts>...> m_arrays;
+};
+
+template <Primitive... Ts>
+[[nodiscard]]
+bool Hit(const PrimitiveStore<Ts...>& store, const Ray& ray,
+         Interval<float> interval, HitRecord& hitRecord) {
+  HitRecord tmpHitRecord;
+  bool hitAnything = false;
+  store.for_each_array([&](const auto primitives) {
+    for (const auto& p : primitives) {
+      if (Hit(p, ray, interval, tmpHitRecord)) {
+        hitRecord = tmpHitRecord;
+        interval.max = tmpHitRecord.t;
+        hitAnything = true;
+      }
+    }
+  });
+  return hitAnything;
+}
+
+// Tries the arrays in type-list order and stops at the first blocker.
+template <Primitive... Ts>
+[[nodiscard]]
+bool Occluded(const PrimitiveStore<Ts...>& store, const Ray& ray,
+              const Interval<float> interval) {
+  const auto anyOccludes = [&](const auto primitives) {
+    return std::ranges::any_of(primitives, [&](const auto& p) {
+      return occludes(p, ray, interval);
+    });
+  };
+  return (anyOccludes(store.template get<Ts>()) || ...);
+}
+
+template <Primitive... Ts>
+[[nodiscard]]
+AABB BoundingBox(const PrimitiveStore<Ts...>& store) {
+  AABB bounds;
+  store.for_each_array([&](const auto primitives) {
+    for (const auto& p : primitives) {
+      bounds.expand(BoundingBox(p));
+    }
+  });
+  return bounds;
+}
+
+}  // namespace mp
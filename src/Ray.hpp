@@ -29,4 +29,20 @@ class Ray {
   glm::vec3 m_pos;
   glm::vec3 m_direction;
 };
+
+// Cone around a ray that bounds the surface a pixel sample stands for, as
+// in "Texture Level of Detail Strategies for Real-Time Ray Tracing"
+// (Akenine-Moller et al., Ray Tracing Gems 2019): width at the origin of
+// the ray, and the angle in radians it widens by. Only image textures read
+// it, to pick mip levels.
+struct RayCone {
+  float width;
+  float spread;
+
+  // Width distance along the ray.
+  [[nodiscard]]
+  constexpr float width_at(const float distance) const noexcept {
+    return width + spread * distance;
+  }
+};
 }  // namespace mp
\ No newline at end of file
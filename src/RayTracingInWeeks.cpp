@@ -1,78 +1,483 @@
 #include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
 #include <cstddef>
+#include <exception>
+#include <filesystem>
 #include <format>
+#include <fstream>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <optional>
 #include <ranges>
+#include <span>
 #include <stdexcept>
 #include <string_view>
 #include <vector>
 
+#include "AccumulationBuffer.hpp"
+#include "Animation.hpp"
+#include "BVH.hpp"
+#include "BVHCache.hpp"
 #include "Camera.hpp"
+#include "Denoiser.hpp"
+#include "Distributed.hpp"
 #include "ImageBuffer.hpp"
+#include "Instance.hpp"
+#include "Instrumentation.hpp"
 #include "Interval.hpp"
 #include "Material.hpp"
+#include "PngStreamWriter.hpp"
 #include "Ray.hpp"
+#include "Sampler.hpp"
+#include "Scene.hpp"
+#include "SceneFile.hpp"
 #include "Sphere.hpp"
+#include "TextureCache.hpp"
 #include "glm/glm.hpp"
 
 namespace rn = std::ranges;
 namespace vi = std::views;
 
+namespace {
+
+// The whole of text as a T, or nothing if it is not a number of that type.
+template <typename T>
+std::optional<T> parse_number(const std::string_view text) {
+  T value{};
+  const auto [end, error] =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  if (error != std::errc{} || end != text.data() + text.size()) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+}  // namespace
+
+// RayTracingInWeeks [scene] [--stream] [--compile <output.scenebin>]
+//                   [--spp <samples>] [--denoise] [--sampler <name>]
+//                   [--coordinator <endpoint> | --worker <endpoint>]
+//                   [--tile-timeout <milliseconds>]
+//                   [--budget <milliseconds>] [--bvh-cache <directory>]
+//                   [--texture-cache <MiB>] [--adaptive <noise threshold>]
+//                   [--checkpoint <file>] [--checkpoint-interval <seconds>]
+//                   [--resume <file>]
+// RayTracingInWeeks --bake-texture <image.ppm> <output texture file>
+//
+// Renders a text scene, or a compiled one if the path ends in .scenebin.
+// With --compile the scene is converted to the binary form instead. Text
+// scenes with keyframes render every frame to results/<scene>_<frame>.png,
+// which --stream does not support.
+// --spp overrides the samples per pixel of the scene, --denoise filters the
+// result, so that a preview with few samples comes out clean; it does not
+// combine with --stream, --coordinator or --worker. --sampler
+// picks the sample sequence: independent (default), sobol, halton or
+// blue_noise. --coordinator hands the tiles of the image out to processes
+// started with --worker on the same scene and options, at host:port or
+// unix:<path>, and writes the merged result; animations are rendered as a
+// still of their first frame that way. --tile-timeout is how long the
+// coordinator waits for a tile before handing it to another worker (five
+// minutes by default). --budget renders in passes of doubling sample count
+// and writes whatever the last pass reached when the time is up; like
+// --adaptive below, it needs a still rendered whole by this process. --bvh-cache keeps the acceleration structures in directory, so
+// that later runs over the same geometry map them instead of building them.
+// --texture-cache bounds the memory image textures keep in tiles (256 MiB by
+// default). --bake-texture converts a binary PPM image into the tiled,
+// mip-mapped file image textures of scenes read. --adaptive lets each pixel
+// stop once the standard error of its mean is below the threshold, as a
+// fraction of the mean, taking up to the samples per pixel of the scene, and
+// writes the samples taken to results/<output>_samples.png; it needs a still
+// rendered whole by this process, so it does not combine with --stream,
+// --coordinator, --worker or animated scenes. --checkpoint saves the
+// accumulated samples to a file every --checkpoint-interval seconds (300 by
+// default) and when the render finishes. --resume loads such a file and
+// adds samples to it until every pixel has the samples per pixel of the
+// scene or --spp, so a killed render picks up where its last checkpoint
+// left off, and a finished one is refined with a higher --spp; it keeps
+// checkpointing to the same file unless --checkpoint names another. Both
+// have the limits of --adaptive, and --resume does not combine with
+// --budget, which starts from no samples.
 int main(int argc, char* argv[]) {
   using namespace mp;
-  std::vector<Hittable> world;
+  std::filesystem::path scenePath = "scenes/final.scene";
+  std::filesystem::path compiledPath;
+  bool stream = false;
+  bool denoise = false;
+  std::optional<std::uint16_t> samplesPerPixel;
+  SamplerType sampler = SamplerType::Independent;
+  std::string_view coordinatorEndpoint;
+  std::string_view workerEndpoint;
+  std::optional<std::chrono::milliseconds> budget;
+  CoordinatorSettings coordinatorSettings;
+  std::optional<float> noiseThreshold;
+  std::filesystem::path checkpointPath;
+  std::chrono::seconds checkpointInterval{300};
+  std::filesystem::path resumePath;
+  std::filesystem::path bvhCachePath;
+  std::filesystem::path bakeInput;
+  std::filesystem::path bakeOutput;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg{argv[i]};
+    if (arg == "--stream") {
+      stream = true;
+    } else if (arg == "--compile" && i + 1 < argc) {
+      compiledPath = argv[++i];
+    } else if (arg == "--spp" && i + 1 < argc) {
+      const std::string_view value{argv[++i]};
+      samplesPerPixel = parse_number<std::uint16_t>(value);
+      if (!samplesPerPixel || *samplesPerPixel == 0) {
+        std::cerr << std::format(
+            "--spp: '{}' is not a sample count from 1 to 65535\n", value);
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--denoise") {
+      denoise = true;
+    } else if (arg == "--sampler" && i + 1 < argc) {
+      const std::string_view name{argv[++i]};
+      const auto types = vi::iota(0, static_cast<int>(SamplerType::Count)) |
+                         vi::transform([](const int type) {
+                           return static_cast<SamplerType>(type);
+                         });
+      const auto type = rn::find(types, name, [](const SamplerType t) {
+        return to_string(t);
+      });
+      if (type == types.end()) {
+        std::cerr << std::format("unknown sampler {}\n", name);
+        return EXIT_FAILURE;
+      }
+      sampler = *type;
+    } else if (arg == "--coordinator" && i + 1 < argc) {
+      coordinatorEndpoint = argv[++i];
+    } else if (arg == "--worker" && i + 1 < argc) {
+      workerEndpoint = argv[++i];
+    } else if (arg == "--tile-timeout" && i + 1 < argc) {
+      const std::string_view value{argv[++i]};
+      const auto timeout = parse_number<std::uint32_t>(value);
+      if (!timeout || *timeout == 0) {
+        std::cerr << std::format(
+            "--tile-timeout: '{}' is not a positive number of milliseconds\n",
+            value);
+        return EXIT_FAILURE;
+      }
+      coordinatorSettings.tileTimeout = std::chrono::milliseconds{*timeout};
+    } else if (arg == "--budget" && i + 1 < argc) {
+      const std::string_view value{argv[++i]};
+      const auto milliseconds = parse_number<std::uint32_t>(value);
+      if (!milliseconds || *milliseconds == 0) {
+        std::cerr << std::format(
+            "--budget: '{}' is not a positive number of milliseconds\n",
+            value);
+        return EXIT_FAILURE;
+      }
+      budget = std::chrono::milliseconds{*milliseconds};
+    } else if (arg == "--bvh-cache" && i + 1 < argc) {
+      bvhCachePath = argv[++i];
+    } else if (arg == "--texture-cache" && i + 1 < argc) {
+      const std::string_view value{argv[++i]};
+      const auto mebibytes = parse_number<std::size_t>(value);
+      constexpr std::size_t kMaxMebibytes =
+          std::numeric_limits<std::size_t>::max() >> 20;
+      if (!mebibytes || *mebibytes == 0 || *mebibytes > kMaxMebibytes) {
+        std::cerr << std::format(
+            "--texture-cache: '{}' is not a size from 1 to {} MiB\n", value,
+            kMaxMebibytes);
+        return EXIT_FAILURE;
+      }
+      texture_cache().set_capacity(*mebibytes << 20);
+    } else if (arg == "--adaptive" && i + 1 < argc) {
+      const std::string_view value{argv[++i]};
+      noiseThreshold = parse_number<float>(value);
+      if (!noiseThreshold || !std::isfinite(*noiseThreshold) ||
+          *noiseThreshold <= 0.0f) {
+        std::cerr << std::format(
+            "--adaptive: '{}' is not a positive noise threshold\n", value);
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--checkpoint" && i + 1 < argc) {
+      checkpointPath = argv[++i];
+    } else if (arg == "--checkpoint-interval" && i + 1 < argc) {
+      const std::string_view value{argv[++i]};
+      const auto seconds = parse_number<std::uint32_t>(value);
+      if (!seconds || *seconds == 0) {
+        std::cerr << std::format(
+            "--checkpoint-interval: '{}' is not a positive number of "
+            "seconds\n",
+            value);
+        return EXIT_FAILURE;
+      }
+      checkpointInterval = std::chrono::seconds{*seconds};
+    } else if (arg == "--resume" && i + 1 < argc) {
+      resumePath = argv[++i];
+    } else if (arg == "--bake-texture" && i + 2 < argc) {
+      bakeInput = argv[++i];
+      bakeOutput = argv[++i];
+    } else if (!arg.starts_with("--")) {
+      scenePath = arg;
+    } else {
+      std::cerr << std::format("unknown argument {}\n", arg);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (!bakeInput.empty()) {
+    try {
+      return bake_texture(bakeInput, bakeOutput) ? EXIT_SUCCESS
+                                                 : EXIT_FAILURE;
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << '\n';
+      return EXIT_FAILURE;
+    }
+  }
+  // Only scenes with image textures use the cache.
+  const auto reportTextures = [] {
+    if (const auto report = texture_cache().report(); report.requests > 0) {
+      std::cout << report;
+    }
+  };
 
-  const auto materialGround =
-      std::make_shared<Lambertian>(glm::vec3{0.5f, 0.5f, 0.5f});
-  world.emplace_back(Sphere{{0.0f, -1000.0f, 0.0f}, 1000, materialGround});
+  std::optional<Camera> camera;
+  Scene scene;
+  // Text scenes can be animated, compiled ones are stills.
+  std::vector<Instance> instances;
+  Animation animation;
+  // The coordinator only merges tiles, it needs the image size but no
+  // acceleration structures.
+  const bool traces = coordinatorEndpoint.empty();
+  std::uint16_t renderSamples = 0;
+  const auto makeCamera = [&](CameraSettings settings) {
+    if (samplesPerPixel) {
+      settings.samplesPerPixel = *samplesPerPixel;
+    }
+    renderSamples = settings.samplesPerPixel;
+    camera.emplace(settings);
+    camera->set_sampler(sampler);
+  };
+  try {
+    const auto loadStart = std::chrono::steady_clock::now();
+    std::optional<BVHCache> bvhCache;
+    if (!bvhCachePath.empty() && traces) {
+      bvhCache.emplace(bvhCachePath);
+    }
+    BVHCache* const cache = bvhCache ? &*bvhCache : nullptr;
+    if (scenePath.extension() == ".scenebin") {
+      if (!compiledPath.empty()) {
+        std::cerr << std::format("--compile needs a text scene, {} is "
+                                 "already compiled\n",
+                                 scenePath.string());
+        return EXIT_FAILURE;
+      }
+      const CompiledScene compiled(scenePath);
+      if (traces) {
+        scene = make_scene(compiled, cache);
+      }
+      makeCamera(compiled.camera());
+    } else {
+      const auto description = load_scene_text(scenePath);
+      if (!compiledPath.empty()) {
+        return save_compiled_scene(description, compiledPath) ? EXIT_SUCCESS
+                                                              : EXIT_FAILURE;
+      }
+      if (traces) {
+        scene = make_scene(description, cache);
+      }
+      makeCamera(description.camera);
+      instances = description.instances;
+      animation = description.animation;
+    }
+    std::cout << std::format(
+        "Loaded {} in {:.1f} ms\n", scenePath.string(),
+        std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - loadStart)
+            .count());
+    if (bvhCache) {
+      std::cout << bvhCache->report();
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
 
-  for (int a = -11; a < 11; ++a) {
-    for (int b = -11; b < 11; ++b) {
-      auto choose_mat = random_float();
-      glm::vec3 center(a + 0.9 * random_float(), 0.2, b + 0.9 * random_float());
+  if (denoise) {
+    // Streamed and distributed renders gather no features to guide it.
+    if (stream || !coordinatorEndpoint.empty() || !workerEndpoint.empty()) {
+      std::cerr << "--denoise needs the features of a whole image rendered "
+                   "by this process\n";
+      return EXIT_FAILURE;
+    }
+    camera->set_denoiser(DenoiseSettings{});
+  }
+  if (noiseThreshold) {
+    if (stream || animation.animated() || !coordinatorEndpoint.empty() ||
+        !workerEndpoint.empty()) {
+      std::cerr << "--adaptive needs a still rendered whole by this process\n";
+      return EXIT_FAILURE;
+    }
+    camera->set_adaptive_sampling(AdaptiveSampling{
+        .minSamples = std::min<std::uint16_t>(AdaptiveSampling{}.minSamples,
+                                              renderSamples),
+        .maxSamples = renderSamples,
+        .noiseThreshold = *noiseThreshold});
+  }
+  if (budget && (stream || animation.animated() ||
+                 !coordinatorEndpoint.empty() || !workerEndpoint.empty())) {
+    std::cerr << "--budget needs a still rendered whole by this process\n";
+    return EXIT_FAILURE;
+  }
+  std::optional<AccumulationBuffer> resumed;
+  if (!checkpointPath.empty() || !resumePath.empty()) {
+    if (stream || animation.animated() || !coordinatorEndpoint.empty() ||
+        !workerEndpoint.empty()) {
+      std::cerr << "--checkpoint and --resume need a still rendered whole by "
+                   "this process\n";
+      return EXIT_FAILURE;
+    }
+    if (!resumePath.empty()) {
+      if (budget) {
+        std::cerr << "--budget renders from no samples, it cannot --resume\n";
+        return EXIT_FAILURE;
+      }
+      try {
+        resumed = load_checkpoint(resumePath);
+      } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+      }
+      if (resumed->get_width() != camera->width() ||
+          resumed->get_height() != camera->height()) {
+        std::cerr << std::format(
+            "{} holds a {}x{} image, the scene renders {}x{}\n",
+            resumePath.string(), resumed->get_width(), resumed->get_height(),
+            camera->width(), camera->height());
+        return EXIT_FAILURE;
+      }
+    }
+    camera->set_checkpoint(checkpointPath.empty() ? resumePath
+                                                  : checkpointPath,
+                           checkpointInterval);
+  }
 
-      if ((center - glm::vec3(4, 0.2, 0)).length() > 0.9) {
-        std::shared_ptr<Material> sphereMaterial;
+  constexpr std::string_view kOutput = "results/materials_metal_nochecking.png";
+  // Adaptive renders leave the samples each pixel took next to the image.
+  const auto saveSampleCounts = [&camera, kOutput] {
+    const auto& sampleCounts = camera->sample_count_image();
+    if (!sampleCounts) {
+      return true;
+    }
+    auto path = std::filesystem::path(kOutput);
+    path.replace_filename(path.stem().string() + "_samples.png");
+    return save_png(*sampleCounts, path.string());
+  };
 
-        if (choose_mat < 0.8) {
-          // diffuse
-          auto albedo = random_vec() * random_vec();
-          sphereMaterial = std::make_shared<Lambertian>(albedo);
-          world.emplace_back(Sphere(center, 0.2, sphereMaterial));
-        } else if (choose_mat < 0.95) {
-          // metal
-          auto albedo = random_vec(0.5, 1);
-          auto fuzz = random_float(0, 0.5);
-          sphereMaterial = std::make_shared<Metal>(albedo, fuzz);
-          world.emplace_back(Sphere(center, 0.2, sphereMaterial));
-        } else {
-          // glass
-          sphereMaterial = std::make_shared<Dielectric>(1.5);
-          world.emplace_back(Sphere(center, 0.2, sphereMaterial));
-        }
+  if (!coordinatorEndpoint.empty() || !workerEndpoint.empty()) {
+    // Animations are rendered as a still of their first frame.
+    pose_frame(*camera, scene, instances, animation, 0);
+    try {
+      const RenderJob job{
+          .sceneHash = scene_fingerprint(scenePath),
+          .width = static_cast<std::uint32_t>(camera->width()),
+          .height = static_cast<std::uint32_t>(camera->height()),
+          .samplesPerPixel = renderSamples,
+          .seed = 0,
+          .sampler = sampler};
+      if (!workerEndpoint.empty()) {
+        constexpr std::chrono::seconds kConnectTimeout{30};
+        const auto tiles =
+            serve_tiles(workerEndpoint, job, *camera, scene, kConnectTimeout);
+        std::cout << std::format("rendered {} tiles for {}\n", tiles,
+                                 workerEndpoint);
+        return EXIT_SUCCESS;
       }
+      AccumulationBuffer accumulation(camera->width(), camera->height());
+      std::cout << coordinate_render(coordinatorEndpoint, job,
+                                     coordinatorSettings, accumulation);
+      ImageBuffer image(camera->width(), camera->height());
+      tonemap(accumulation, image);
+      return save_png(image, kOutput) ? EXIT_SUCCESS : EXIT_FAILURE;
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << '\n';
+      return EXIT_FAILURE;
     }
   }
-  auto material1 = std::make_shared<Dielectric>(1.5);
-  world.emplace_back(Sphere(glm::vec3(0, 1, 0), 1.0, material1));
 
-  auto material2 = std::make_shared<Lambertian>(glm::vec3(0.4, 0.2, 0.1));
-  world.emplace_back(Sphere(glm::vec3(-4, 1, 0), 1.0, material2));
+  if (animation.animated()) {
+    if (stream) {
+      std::cerr << "--stream writes a single image, not the frames of an "
+                   "animation\n";
+      return EXIT_FAILURE;
+    }
+    // Frame N is written while frame N + 1 renders.
+    const auto stem = scenePath.stem().string();
+    std::atomic<bool> written{true};
+    const auto report = render_animation(
+        *camera, scene, instances, animation,
+        [&](const std::uint32_t frame, const ImageBuffer& image) {
+          const auto path = std::format("results/{}_{:04}.png", stem, frame);
+          if (!save_png(image, path)) {
+            std::cerr << std::format("could not write {}\n", path);
+            written = false;
+          }
+        });
+    std::cout << report;
+    reportTextures();
+    return written ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
 
-  auto material3 = std::make_shared<Metal>(glm::vec3(0.7, 0.6, 0.5), 0.0);
-  world.emplace_back(Sphere(glm::vec3(4, 1, 0), 1.0, material3));
-  Camera camera{600,
-                16.0 / 9.0,
-                100,
-                50,
-                20.0f,
-                0.2f,
-                10.0f,
-                glm::vec3{13.f, 2, 3},
-                glm::vec3{0.0f, 0.0f, .0f}};
-  return save_png(camera.render(world),
-                  "results/materials_metal_nochecking.png") == 1
-             ? EXIT_SUCCESS
-             : EXIT_FAILURE;
+  if (stream) {
+    // Rows go to disk as they finish, with at most 64 scanlines resident.
+    constexpr std::size_t kScanlinesInFlight = 64;
+    try {
+      PngStreamWriter writer(kOutput, camera->width(), camera->height());
+      camera->render_streaming(scene, kScanlinesInFlight,
+                               [&writer](int, std::span<const Color> row) {
+                                 writer.write_row(row);
+                               });
+      std::cout << camera->report();
+      reportTextures();
+      return writer.finish() ? EXIT_SUCCESS : EXIT_FAILURE;
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << '\n';
+      return EXIT_FAILURE;
+    }
+  }
+  if (budget) {
+    const ProgressiveSettings progressive{
+        .deadline = std::chrono::steady_clock::now() + *budget};
+    const auto& image = camera->render_progressive(
+        scene, progressive, {},
+        [](const ProgressivePass& pass, const AccumulationBuffer&) {
+          std::cout << std::format(
+              "pass {}: {} spp{} after {:.1f} ms\n", pass.index,
+              pass.samplesPerPixel, pass.complete ? "" : " (cut short)",
+              std::chrono::duration<double, std::milli>(pass.elapsed)
+                  .count());
+        });
+    std::cout << camera->report();
+    reportTextures();
+    if (!saveSampleCounts()) {
+      return EXIT_FAILURE;
+    }
+    return save_png(image, kOutput) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  const auto& image =
+      resumed ? camera->render(scene, *resumed) : camera->render(scene);
+  std::cout << camera->report();
+  reportTextures();
+  if constexpr (instrumentation::kEnabled) {
+    std::ofstream stats("results/materials_metal_nochecking_stats.json");
+    write_json(stats, camera->report());
+    if (!save_png(*camera->cost_image(),
+                  "results/materials_metal_nochecking_cost.png")) {
+      return EXIT_FAILURE;
+    }
+  }
+  if (!saveSampleCounts()) {
+    return EXIT_FAILURE;
+  }
+  return save_png(image, kOutput) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
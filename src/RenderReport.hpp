@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "Instrumentation.hpp"
+
+namespace mp {
+
+struct ThreadUtilization {
+  std::size_t tiles{};
+  std::uint64_t samples{};
+  std::chrono::nanoseconds busy{};
+  // Empty unless built with MP_INSTRUMENTATION.
+  RenderCounters counters{};
+};
+
+struct RenderReport {
+  std::chrono::nanoseconds wall{};
+  // Spent in the denoiser after sampling, not part of wall. Zero without a
+  // denoiser.
+  std::chrono::nanoseconds denoise{};
+  std::vector<ThreadUtilization> threads;
+  // Samples needed to bring every pixel to the maximum sample count.
+  std::uint64_t sampleBudget{};
+  // Checkpoint files written during the render.
+  std::uint32_t checkpoints{};
+  // Path tracing kernel the render used, see KernelOptions.
+  std::string kernel;
+
+  // Highest entry of the last render's cost image, see
+  // Camera::cost_image().
+  std::uint64_t maxPixelCost{};
+
+  [[nodiscard]]
+  RenderCounters counters() const noexcept {
+    RenderCounters total;
+    for (const auto& t : threads) {
+      total += t.counters;
+    }
+    return total;
+  }
+
+  [[nodiscard]]
+  std::uint64_t samples() const noexcept {
+    std::uint64_t total = 0;
+    for (const auto& t : threads) {
+      total += t.samples;
+    }
+    return total;
+  }
+
+  // Fraction of the render's wall time a thread spent rendering tiles.
+  [[nodiscard]]
+  double utilization(const std::size_t thread) const {
+    if (wall.count() == 0) {
+      return 0.0;
+    }
+    return static_cast<double>(threads[thread].busy.count()) / wall.count();
+  }
+};
+
+inline std::ostream& operator<<(std::ostream& os, const RenderReport& report) {
+  using Milliseconds = std::chrono::duration<double, std::milli>;
+  os << std::format("render: {:.1f} ms on {} threads\n",
+                    Milliseconds(report.wall).count(), report.threads.size());
+  if (report.denoise.count() != 0) {
+    os << std::format("denoise: {:.1f} ms\n",
+                      Milliseconds(report.denoise).count());
+  }
+  if (report.sampleBudget != 0) {
+    const auto samples = report.samples();
+    os << std::format("samples: {} of {} ({:.1f}% saved)\n", samples,
+                      report.sampleBudget,
+                      100.0 * (1.0 - static_cast<double>(samples) /
+                                         report.sampleBudget));
+  }
+  if (report.checkpoints != 0) {
+    os << std::format("checkpoints: {} written\n", report.checkpoints);
+  }
+  if (!report.kernel.empty()) {
+    os << std::format("kernel: {}\n", report.kernel);
+  }
+  for (std::size_t t = 0; t < report.threads.size(); ++t) {
+    os << std::format(
+        "  thread {:>3}: {:>5} tiles, busy {:>10.1f} ms ({:.1f}%)\n", t,
+        report.threads[t].tiles, Milliseconds(report.threads[t].busy).count(),
+        100.0 * report.utilization(t));
+  }
+  return os;
+}
+
+namespace detail {
+// Histogram as a JSON array, without the empty buckets at the end.
+inline std::string json_array(const std::span<const std::uint64_t> values) {
+  auto size = values.size();
+  while (size > 0 && values[size - 1] == 0) {
+    --size;
+  }
+  std::string out = "[";
+  for (std::size_t i = 0; i < size; ++i) {
+    out += std::format("{}{}", i == 0 ? "" : ", ", values[i]);
+  }
+  return out + "]";
+}
+}  // namespace detail
+
+// Machine-readable form of the report. The "counters" object is only
+// present in builds with MP_INSTRUMENTATION.
+inline void write_json(std::ostream& os, const RenderReport& report) {
+  using Milliseconds = std::chrono::duration<double, std::milli>;
+  os << "{\n";
+  os << std::format("  \"wall_ms\": {:.3f},\n",
+                    Milliseconds(report.wall).count());
+  os << std::format("  \"denoise_ms\": {:.3f},\n",
+                    Milliseconds(report.denoise).count());
+  os << std::format("  \"samples\": {},\n", report.samples());
+  os << std::format("  \"sample_budget\": {},\n", report.sampleBudget);
+  os << std::format("  \"checkpoints\": {},\n", report.checkpoints);
+  os << "  \"threads\": [\n";
+  for (std::size_t t = 0; t < report.threads.size(); ++t) {
+    const auto& thread = report.threads[t];
+    const auto idle = std::max(std::chrono::nanoseconds{0},
+                               report.wall - thread.busy);
+    os << "    {";
+    os << std::format(
+        "\"tiles\": {}, \"samples\": {}, \"busy_ms\": {:.3f}, "
+        "\"idle_ms\": {:.3f}",
+        thread.tiles, thread.samples, Milliseconds(thread.busy).count(),
+        Milliseconds(idle).count());
+    os << (t + 1 == report.threads.size() ? "}\n" : "},\n");
+  }
+  os << "  ]";
+  if constexpr (instrumentation::kEnabled) {
+    const auto counters = report.counters();
+    os << ",\n  \"counters\": {\n";
+    os << std::format("    \"rays_per_bounce\": {},\n",
+                      detail::json_array(counters.raysPerBounce));
+    os << std::format("    \"path_lengths\": {},\n",
+                      detail::json_array(counters.pathLengths));
+    os << "    \"scatter_calls\": {";
+    for (std::size_t m = 0; m < counters.scatterCalls.size(); ++m) {
+      os << std::format("{}\"{}\": {}", m == 0 ? "" : ", ",
+                        to_string(static_cast<MaterialType>(m)),
+                        counters.scatterCalls[m]);
+    }
+    os << "},\n";
+    os << std::format("    \"shadow_rays\": {},\n", counters.shadowRays);
+    os << std::format("    \"intersection_tests\": {},\n",
+                      counters.intersectionTests);
+    os << std::format("    \"intersection_hits\": {},\n",
+                      counters.intersectionHits);
+    os << std::format("    \"box_tests\": {},\n", counters.boxTests);
+    os << std::format("    \"max_pixel_cost\": {}\n", report.maxPixelCost);
+    os << "  }";
+  }
+  os << "\n}\n";
+}
+
+}  // namespace mp
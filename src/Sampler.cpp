@@ -0,0 +1,137 @@
+#include "Sampler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace mp {
+namespace {
+constexpr std::size_t kPixelCount = kBlueNoiseSize * kBlueNoiseSize;
+
+// Binary pattern with, for every pixel, the Gaussian-filtered density of the
+// set pixels around it on the torus.
+class DitherPattern {
+ public:
+  DitherPattern() {
+    constexpr float kSigma = 1.5f;
+    for (std::size_t dy = 0; dy < kBlueNoiseSize; ++dy) {
+      for (std::size_t dx = 0; dx < kBlueNoiseSize; ++dx) {
+        const auto x = static_cast<float>(std::min(dx, kBlueNoiseSize - dx));
+        const auto y = static_cast<float>(std::min(dy, kBlueNoiseSize - dy));
+        m_kernel[dy * kBlueNoiseSize + dx] =
+            std::exp(-(x * x + y * y) / (2.0f * kSigma * kSigma));
+      }
+    }
+  }
+
+  [[nodiscard]]
+  bool is_set(const std::size_t pixel) const noexcept {
+    return m_set[pixel] != 0;
+  }
+
+  void set(const std::size_t pixel, const bool value) noexcept {
+    m_set[pixel] = value ? 1 : 0;
+    const float sign = value ? 1.0f : -1.0f;
+    const auto px = pixel % kBlueNoiseSize;
+    const auto py = pixel / kBlueNoiseSize;
+    for (std::size_t y = 0; y < kBlueNoiseSize; ++y) {
+      const auto dy = (y + kBlueNoiseSize - py) % kBlueNoiseSize;
+      for (std::size_t x = 0; x < kBlueNoiseSize; ++x) {
+        const auto dx = (x + kBlueNoiseSize - px) % kBlueNoiseSize;
+        m_density[y * kBlueNoiseSize + x] +=
+            sign * m_kernel[dy * kBlueNoiseSize + dx];
+      }
+    }
+  }
+
+  // Set pixel with the densest neighbourhood.
+  [[nodiscard]]
+  std::size_t tightest_cluster() const noexcept {
+    return extreme(true, [](const float a, const float b) { return a > b; });
+  }
+
+  // Unset pixel with the sparsest neighbourhood.
+  [[nodiscard]]
+  std::size_t largest_void() const noexcept {
+    return extreme(false, [](const float a, const float b) { return a < b; });
+  }
+
+ private:
+  std::vector<float> m_kernel = std::vector<float>(kPixelCount);
+  std::vector<float> m_density = std::vector<float>(kPixelCount, 0.0f);
+  std::vector<std::uint8_t> m_set = std::vector<std::uint8_t>(kPixelCount);
+
+  template <typename Better>
+  [[nodiscard]]
+  std::size_t extreme(const bool set, Better better) const noexcept {
+    std::size_t best = kPixelCount;
+    for (std::size_t pixel = 0; pixel < kPixelCount; ++pixel) {
+      if (is_set(pixel) == set &&
+          (best == kPixelCount || better(m_density[pixel], m_density[best]))) {
+        best = pixel;
+      }
+    }
+    return best;
+  }
+};
+
+BlueNoiseTile make_blue_noise_tile() {
+  // Initial pattern: a tenth of the pixels, picked at random, then relaxed
+  // by moving the tightest cluster into the largest void until that no
+  // longer changes anything.
+  constexpr std::size_t kInitialCount = kPixelCount / 10;
+  DitherPattern initial;
+  Sampler sampler{0x5EED};
+  for (std::size_t count = 0; count < kInitialCount;) {
+    const auto pixel = std::min(
+        static_cast<std::size_t>(sampler.next_float() * kPixelCount),
+        kPixelCount - 1);
+    if (!initial.is_set(pixel)) {
+      initial.set(pixel, true);
+      ++count;
+    }
+  }
+  for (std::size_t move = 0; move < kPixelCount; ++move) {
+    const auto cluster = initial.tightest_cluster();
+    initial.set(cluster, false);
+    const auto hole = initial.largest_void();
+    initial.set(hole, true);
+    if (hole == cluster) {
+      break;
+    }
+  }
+
+  std::vector<std::size_t> rank(kPixelCount);
+  // Phase 1: ranks below the initial pattern, removing clusters.
+  auto pattern = initial;
+  for (auto count = kInitialCount; count > 0; --count) {
+    const auto cluster = pattern.tightest_cluster();
+    pattern.set(cluster, false);
+    rank[cluster] = count - 1;
+  }
+  // Phases 2 and 3: ranks above it, filling voids. Ulichney switches to the
+  // clusters of the unset pixels past half, which with a linear filter are
+  // the same pixels.
+  pattern = initial;
+  for (auto count = kInitialCount; count < kPixelCount; ++count) {
+    const auto hole = pattern.largest_void();
+    pattern.set(hole, true);
+    rank[hole] = count;
+  }
+
+  BlueNoiseTile tile{};
+  for (std::size_t pixel = 0; pixel < kPixelCount; ++pixel) {
+    tile[pixel] = (static_cast<float>(rank[pixel]) + 0.5f) /
+                  static_cast<float>(kPixelCount);
+  }
+  return tile;
+}
+}  // namespace
+
+const BlueNoiseTile& blue_noise_tile() {
+  static const BlueNoiseTile tile = make_blue_noise_tile();
+  return tile;
+}
+
+}  // namespace mp
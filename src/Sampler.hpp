@@ -0,0 +1,327 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "glm/glm.hpp"
+
+namespace mp {
+
+// Sequences a Sampler can draw from, selectable per render.
+enum class SamplerType : std::uint8_t {
+  // Hashed uniform random numbers, error falls as O(1/sqrt(N)).
+  Independent,
+  // Owen-scrambled Sobol points, scrambled per pixel.
+  Sobol,
+  // Halton points with random digit permutations per pixel. Deep bounces
+  // draw on large prime bases, which stratify poorly at low sample counts.
+  Halton,
+  // One Owen-scrambled Sobol sequence for the whole image, offset per pixel
+  // by a blue-noise tile, which spreads the remaining error as
+  // high-frequency noise.
+  BlueNoise,
+  Count
+};
+
+[[nodiscard]]
+constexpr std::string_view to_string(const SamplerType type) noexcept {
+  switch (type) {
+    case SamplerType::Independent:
+      return "independent";
+    case SamplerType::Sobol:
+      return "sobol";
+    case SamplerType::Halton:
+      return "halton";
+    case SamplerType::BlueNoise:
+      return "blue_noise";
+    case SamplerType::Count:
+      break;
+  }
+  return "unknown";
+}
+
+// Side length of the tile BlueNoise offsets its samples with; the tile
+// repeats across the image.
+inline constexpr std::size_t kBlueNoiseSize = 64;
+using BlueNoiseTile = std::array<float, kBlueNoiseSize * kBlueNoiseSize>;
+
+// Ranks of a void-and-cluster pattern (Ulichney, "The void-and-cluster
+// method for dither array generation", 1993), mapped to [0, 1) and indexed
+// as y * kBlueNoiseSize + x. Generated on first use.
+[[nodiscard]]
+const BlueNoiseTile& blue_noise_tile();
+
+// Source of the sample values of one pixel sample. Every value is a pure
+// function of (seed, pixel, sample index, stream, dimension), so samplers
+// carry no shared state and an image is reproducible regardless of how
+// pixels are distributed between threads.
+//
+// A stream is one bounce of a path: start_bounce() selects a fresh stream so
+// that the dimensions a bounce uses do not depend on how many the previous
+// one consumed. Stream 0 belongs to the camera ray. next_2d() starts on an
+// even dimension, so that both values come from the same two-dimensional
+// pattern of the low-discrepancy sequences.
+//
+// Random values are hashed with pcg4d (Jarzynski & Olano, "Hash Functions
+// for GPU Rendering"), Owen scrambling follows Burley, "Practical
+// Hash-based Owen Scrambling" (JCGT 2020): every pair of dimensions is a 2D
+// Sobol pattern with its own index shuffle, which pads the sequence to any
+// number of dimensions.
+class Sampler {
+ public:
+  constexpr explicit Sampler(const std::uint32_t seed,
+                             const std::uint32_t pixelIndex = 0,
+                             const std::uint32_t sampleIndex = 0) noexcept
+      : m_seed(seed), m_pixelIndex(pixelIndex), m_sampleIndex(sampleIndex) {}
+
+  // pixel is the position in the image, only BlueNoise looks at it.
+  constexpr Sampler(const SamplerType type, const std::uint32_t seed,
+                    const std::uint32_t pixelIndex,
+                    const std::uint32_t sampleIndex,
+                    const glm::uvec2 pixel) noexcept
+      : m_seed(seed),
+        m_pixelIndex(pixelIndex),
+        m_sampleIndex(sampleIndex),
+        m_pixel(pixel),
+        m_type(type) {}
+
+  constexpr void start_bounce(const std::uint32_t bounce) noexcept {
+    m_stream = bounce + 1;
+    m_dimension = 0;
+    m_blockIndex = kNoBlock;
+  }
+
+  // Uniform in [0, 1).
+  [[nodiscard]]
+  float next_float() noexcept {
+    return sample(m_dimension++);
+  }
+
+  [[nodiscard]]
+  glm::vec2 next_2d() noexcept {
+    m_dimension += m_dimension & 1;
+    const float u = sample(m_dimension);
+    const float v = sample(m_dimension + 1);
+    m_dimension += 2;
+    return {u, v};
+  }
+
+ private:
+  using Block = std::array<std::uint32_t, 4>;
+
+  static constexpr std::uint32_t kNoBlock = ~0u;
+  // Halton dimensions each stream owns. Deeper bounces than the prime table
+  // covers fall back to random values.
+  static constexpr std::uint32_t kHaltonDimensionsPerStream = 8;
+  static constexpr std::size_t kHaltonBases = 256;
+
+  std::uint32_t m_seed;
+  std::uint32_t m_pixelIndex;
+  std::uint32_t m_sampleIndex;
+  glm::uvec2 m_pixel{0};
+  SamplerType m_type{SamplerType::Independent};
+  std::uint32_t m_stream = 0;
+  std::uint32_t m_dimension = 0;
+  std::uint32_t m_blockIndex = kNoBlock;
+  Block m_block{};
+
+  [[nodiscard]]
+  float sample(const std::uint32_t dimension) noexcept {
+    switch (m_type) {
+      case SamplerType::Sobol:
+      case SamplerType::BlueNoise:
+        return to_float(pair_bits(dimension));
+      case SamplerType::Halton:
+        return halton(dimension);
+      case SamplerType::Independent:
+      case SamplerType::Count:
+        break;
+    }
+    return to_float(random_bits(dimension));
+  }
+
+  [[nodiscard]]
+  static constexpr float to_float(const std::uint32_t bits) noexcept {
+    return static_cast<float>(bits >> 8) * 0x1p-24f;
+  }
+
+  // Four dimensions are hashed at once and kept for the following draws.
+  [[nodiscard]]
+  constexpr std::uint32_t random_bits(const std::uint32_t dimension) noexcept {
+    const auto block = dimension / 4;
+    if (block != m_blockIndex) {
+      m_block = pcg4d({m_pixelIndex, m_sampleIndex, m_seed,
+                       (m_stream << 16) | (block & 0xFFFF)});
+      m_blockIndex = block;
+    }
+    return m_block[dimension % 4];
+  }
+
+  // Both dimensions of a pair share the Sobol index shuffle, so they are
+  // computed together and kept for the following draw.
+  [[nodiscard]]
+  std::uint32_t pair_bits(const std::uint32_t dimension) noexcept {
+    const auto pair = dimension / 2;
+    if (pair != m_blockIndex) {
+      m_block = m_type == SamplerType::Sobol ? sobol(pair, m_pixelIndex)
+                                             : blue_noise(pair);
+      m_blockIndex = pair;
+    }
+    return m_block[dimension % 2];
+  }
+
+  // The pair of Owen-scrambled Sobol dimensions; samplers with the same
+  // scramble key draw the same sequence.
+  [[nodiscard]]
+  constexpr Block sobol(const std::uint32_t pair,
+                        const std::uint32_t scrambleKey) const noexcept {
+    const auto seeds = pcg4d({scrambleKey, m_seed, m_stream, pair});
+    const auto index = nested_uniform_scramble(m_sampleIndex, seeds[0]);
+    // The first dimension is the bit-reversed index.
+    return {reverse_bits(laine_karras_permutation(index, seeds[1])),
+            nested_uniform_scramble(sobol_second(index), seeds[2]), 0, 0};
+  }
+
+  [[nodiscard]]
+  Block blue_noise(const std::uint32_t pair) const {
+    // The same sequence in every pixel, so that the per-pixel offsets decide
+    // how the error is distributed over the image.
+    constexpr std::uint32_t kImageKey = 0xB1E5EEDu;
+    auto values = sobol(pair, kImageKey);
+    const auto offset = pcg4d({m_seed, m_stream, pair, kImageKey});
+    const auto& tile = blue_noise_tile();
+    for (std::size_t i = 0; i < 2; ++i) {
+      const auto x = (m_pixel.x + offset[2 * i]) % kBlueNoiseSize;
+      const auto y = (m_pixel.y + offset[2 * i + 1]) % kBlueNoiseSize;
+      // In 32-bit fixed point, where wrapping around 1 is free.
+      values[i] += static_cast<std::uint32_t>(
+          tile[y * kBlueNoiseSize + x] * 0x1p32f);
+    }
+    return values;
+  }
+
+  [[nodiscard]]
+  float halton(const std::uint32_t dimension) noexcept {
+    constexpr float kOneMinusEpsilon = 0x1.fffffep-1f;
+    const auto global = m_stream * kHaltonDimensionsPerStream + dimension;
+    if (dimension >= kHaltonDimensionsPerStream || global >= kHaltonBases) {
+      return to_float(random_bits(dimension));
+    }
+    // Radical inverse with a random affine permutation of every digit.
+    const std::uint32_t base = kPrimes[global];
+    std::uint32_t permutation =
+        pcg4d({m_pixelIndex, m_seed, global, 0x4A17u})[0];
+    std::uint32_t index = m_sampleIndex;
+    std::uint64_t reversed = 0;
+    std::uint64_t scale = 1;
+    while (scale < (1u << 24)) {
+      permutation = permutation * 747796405u + 2891336453u;
+      const auto digit = index % base;
+      index /= base;
+      const auto multiplier = 1 + (permutation >> 8) % (base - 1);
+      const auto shift = (permutation >> 20) % base;
+      reversed = reversed * base + (multiplier * digit + shift) % base;
+      scale *= base;
+    }
+    return std::min(static_cast<float>(reversed) / static_cast<float>(scale),
+                    kOneMinusEpsilon);
+  }
+
+  [[nodiscard]]
+  static constexpr std::uint32_t reverse_bits(std::uint32_t x) noexcept {
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+    x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+    return (x >> 16) | (x << 16);
+  }
+
+  // Second Sobol dimension, primitive polynomial x + 1, a byte at a time.
+  [[nodiscard]]
+  static constexpr std::uint32_t sobol_second(
+      const std::uint32_t index) noexcept {
+    return kSobolSecond[0][index & 0xFF] ^
+           kSobolSecond[1][(index >> 8) & 0xFF] ^
+           kSobolSecond[2][(index >> 16) & 0xFF] ^ kSobolSecond[3][index >> 24];
+  }
+
+  // Hash in which every bit only depends on the bits below it, so that it
+  // permutes the reversed digits the way Owen scrambling does.
+  [[nodiscard]]
+  static constexpr std::uint32_t laine_karras_permutation(
+      std::uint32_t x, const std::uint32_t seed) noexcept {
+    x ^= x * 0x3D20ADEAu;
+    x += seed;
+    x *= (seed >> 16) | 1u;
+    x ^= x * 0x05526C56u;
+    x ^= x * 0x53A22864u;
+    return x;
+  }
+
+  // Owen scrambling of all 32 bits.
+  [[nodiscard]]
+  static constexpr std::uint32_t nested_uniform_scramble(
+      const std::uint32_t x, const std::uint32_t seed) noexcept {
+    return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+  }
+
+  [[nodiscard]]
+  static constexpr Block pcg4d(Block v) noexcept {
+    for (auto& c : v) {
+      c = c * 1664525u + 1013904223u;
+    }
+    v[0] += v[1] * v[3];
+    v[1] += v[2] * v[0];
+    v[2] += v[0] * v[1];
+    v[3] += v[1] * v[2];
+    for (auto& c : v) {
+      c ^= c >> 16;
+    }
+    v[0] += v[1] * v[3];
+    v[1] += v[2] * v[0];
+    v[2] += v[0] * v[1];
+    v[3] += v[1] * v[2];
+    return v;
+  }
+
+  // XOR of the direction vectors selected by each byte of the index.
+  static constexpr auto kSobolSecond = [] {
+    std::array<std::array<std::uint32_t, 256>, 4> table{};
+    std::array<std::uint32_t, 32> directions{};
+    directions[0] = 1u << 31;
+    for (std::size_t bit = 1; bit < directions.size(); ++bit) {
+      directions[bit] = directions[bit - 1] ^ (directions[bit - 1] >> 1);
+    }
+    for (std::size_t byte = 0; byte < table.size(); ++byte) {
+      for (std::uint32_t value = 0; value < 256; ++value) {
+        for (std::size_t bit = 0; bit < 8; ++bit) {
+          if ((value >> bit & 1) != 0) {
+            table[byte][value] ^= directions[byte * 8 + bit];
+          }
+        }
+      }
+    }
+    return table;
+  }();
+
+  static constexpr std::array<std::uint32_t, kHaltonBases> kPrimes = [] {
+    std::array<std::uint32_t, kHaltonBases> primes{};
+    std::size_t count = 0;
+    for (std::uint32_t candidate = 2; count < primes.size(); ++candidate) {
+      bool prime = true;
+      for (std::size_t i = 0; i < count && primes[i] * primes[i] <= candidate;
+           ++i) {
+        prime = prime && candidate % primes[i] != 0;
+      }
+      if (prime) {
+        primes[count++] = candidate;
+      }
+    }
+    return primes;
+  }();
+};
+
+}  // namespace mp
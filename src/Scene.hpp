@@ -0,0 +1,38 @@
+#pragma once
+
+#include "BVH.hpp"
+#include "Hittable.hpp"
+#include "Instance.hpp"
+#include "Light.hpp"
+#include "Material.hpp"
+#include "PrimitiveStore.hpp"
+#include "Sphere.hpp"
+#include "SphereSoA.hpp"
+#include "TriangleMesh.hpp"
+
+namespace mp {
+
+// Primitive types the renderer dispatches to statically. Anything else goes
+// through the Hittable adapter.
+using World = PrimitiveStore<Sphere, SphereSoA, SphereBVH, TriangleMesh,
+                             InstanceBVH, BVH, Hittable>;
+
+// Everything a render reads: the geometry, the materials it refers to and
+// the lights among the geometry.
+struct Scene {
+  World world;
+  MaterialTable materials;
+  // Sampled explicitly at diffuse bounces. Emitters that are not listed
+  // still light the scene when paths hit them, only with more noise.
+  LightList lights;
+};
+
+// Lights for next-event estimation: the DiffuseLight spheres and triangle
+// meshes stored directly in world. Emitters inside an InstanceBVH, BVH or
+// Hittable are not sampled, and must not share a material with ones that
+// are, or hits on them are weighted as if they had been. make_scene() gives
+// the unsampled emitters of loaded scenes materials of their own.
+[[nodiscard]]
+LightList collect_lights(const World& world, const MaterialTable& materials);
+
+}  // namespace mp
@@ -0,0 +1,853 @@
+#include "SceneFile.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "BVH.hpp"
+#include "MeshFile.hpp"
+
+namespace mp {
+namespace {
+
+constexpr std::array<char, 8> kSceneMagic{'M', 'P', 'S', 'C',
+                                          'E', 'N', 'E', '\0'};
+constexpr std::uint32_t kSceneVersion = 6;
+
+// Arrays start at multiples of this, so the mapped data is suitably aligned
+// for every element type.
+constexpr std::uint64_t kArrayAlignment = 16;
+
+struct CompiledSceneHeader {
+  std::array<char, 8> magic;
+  std::uint32_t version;
+  std::uint32_t materialRecordSize;
+  std::uint32_t sphereSize;
+  std::uint32_t instanceSize;
+  std::uint32_t materialCount;
+  std::uint64_t sphereCount;
+  std::uint64_t instanceCount;
+  std::uint64_t meshCount;
+  std::uint64_t objectCount;
+  std::uint64_t textureCount;
+  std::uint64_t materialOffset;
+  std::uint64_t sphereOffset;
+  std::uint64_t instanceOffset;
+  std::uint64_t meshOffset;
+  std::uint64_t objectOffset;
+  std::uint64_t textureOffset;
+  CameraSettings camera;
+};
+
+// Meshes and objects are stored as tables of these, followed by the
+// texture table and then the UTF-8 paths the records point to.
+struct CompiledMeshRecord {
+  std::uint64_t pathOffset;
+  std::uint32_t pathSize;
+  MaterialId material;
+};
+
+// The path is empty unless the texture is an image.
+struct CompiledTextureRecord {
+  TextureRecord record;
+  std::uint64_t pathOffset;
+  std::uint32_t pathSize;
+  std::uint32_t reserved;
+};
+
+static_assert(std::is_trivially_copyable_v<CompiledSceneHeader>);
+
+constexpr std::uint64_t align_up(const std::uint64_t offset) noexcept {
+  return (offset + kArrayAlignment - 1) / kArrayAlignment * kArrayAlignment;
+}
+
+// Splits a line into whitespace separated tokens and converts them on
+// demand, reporting errors with the file and line they come from.
+class LineParser {
+ public:
+  LineParser(const std::filesystem::path& path, const std::size_t lineNumber,
+             const std::string_view line)
+      : m_path(path), m_lineNumber(lineNumber), m_rest(line) {}
+
+  [[nodiscard]]
+  bool empty() {
+    skip_space();
+    return m_rest.empty();
+  }
+
+  [[nodiscard]]
+  std::string_view word() {
+    skip_space();
+    if (m_rest.empty()) {
+      fail("unexpected end of line");
+    }
+    const auto end = m_rest.find_first_of(" \t\r");
+    const auto token = m_rest.substr(0, end);
+    m_rest.remove_prefix(token.size());
+    return token;
+  }
+
+  template <typename T>
+  [[nodiscard]]
+  T number() {
+    const auto token = word();
+    T value{};
+    const auto [end, error] =
+        std::from_chars(token.data(), token.data() + token.size(), value);
+    if (error != std::errc{} || end != token.data() + token.size()) {
+      fail(std::format("'{}' is not a valid number", token));
+    }
+    return value;
+  }
+
+  [[nodiscard]]
+  glm::vec3 vec3() {
+    const auto x = number<float>();
+    const auto y = number<float>();
+    const auto z = number<float>();
+    return {x, y, z};
+  }
+
+  [[noreturn]]
+  void fail(const std::string_view message) const {
+    throw std::runtime_error(
+        std::format("{}:{}: {}", m_path.string(), m_lineNumber, message));
+  }
+
+ private:
+  void skip_space() {
+    const auto start = m_rest.find_first_not_of(" \t\r");
+    m_rest.remove_prefix(start == std::string_view::npos ? m_rest.size()
+                                                         : start);
+  }
+
+  const std::filesystem::path& m_path;
+  std::size_t m_lineNumber;
+  std::string_view m_rest;
+};
+
+void parse_camera(LineParser& line, CameraSettings& camera) {
+  while (!line.empty()) {
+    const auto key = line.word();
+    if (key == "width") {
+      camera.imageWidth = line.number<std::uint64_t>();
+    } else if (key == "aspect") {
+      camera.aspectRatio = line.number<double>();
+    } else if (key == "samples") {
+      camera.samplesPerPixel = line.number<std::uint16_t>();
+    } else if (key == "depth") {
+      camera.maxDepth = line.number<std::int32_t>();
+    } else if (key == "vfov") {
+      camera.vfov = line.number<float>();
+    } else if (key == "defocus_angle") {
+      camera.defocusAngle = line.number<float>();
+    } else if (key == "focus_distance") {
+      camera.focusDistance = line.number<float>();
+    } else if (key == "look_from") {
+      camera.lookFrom = line.vec3();
+    } else if (key == "look_at") {
+      camera.lookAt = line.vec3();
+    } else if (key == "up") {
+      camera.worldUp = line.vec3();
+    } else {
+      line.fail(std::format("unknown camera setting '{}'", key));
+    }
+  }
+  if (camera.imageWidth == 0 || camera.aspectRatio <= 0.0) {
+    line.fail("camera width and aspect must be positive");
+  }
+}
+
+[[nodiscard]]
+TextureReference parse_texture(LineParser& line,
+                               const std::filesystem::path& scenePath) {
+  TextureReference texture;
+  auto& record = texture.record;
+  const auto type = line.word();
+  if (type == "checker") {
+    record.type = TextureType::Checker;
+    record.color0 = line.vec3();
+    record.color1 = line.vec3();
+    record.scale = line.number<float>();
+    if (!(record.scale > 0.0f)) {
+      line.fail("checker cells must have a positive size");
+    }
+  } else if (type == "noise") {
+    record.type = TextureType::Noise;
+    record.color0 = line.vec3();
+    record.scale = line.number<float>();
+  } else if (type == "image") {
+    record.type = TextureType::Image;
+    texture.image = scenePath.parent_path() / line.word();
+  } else {
+    line.fail(std::format("unknown texture type '{}'", type));
+  }
+  return texture;
+}
+
+// The optional "texture <name>" at the end of a material line.
+[[nodiscard]]
+TextureId parse_material_texture(
+    LineParser& line,
+    const std::unordered_map<std::string, TextureId>& textureIds) {
+  if (line.empty()) {
+    return kNoTexture;
+  }
+  if (line.word() != "texture") {
+    line.fail("expected 'texture' after the material");
+  }
+  const std::string name(line.word());
+  const auto texture = textureIds.find(name);
+  if (texture == textureIds.end()) {
+    line.fail(std::format("unknown texture '{}'", name));
+  }
+  return texture->second;
+}
+
+MaterialRecord parse_material(
+    LineParser& line,
+    const std::unordered_map<std::string, TextureId>& textureIds) {
+  MaterialRecord record;
+  const auto type = line.word();
+  if (type == "lambertian") {
+    record.type = MaterialType::Lambertian;
+    record.albedo = line.vec3();
+    record.texture = parse_material_texture(line, textureIds);
+  } else if (type == "metal") {
+    record.type = MaterialType::Metal;
+    record.albedo = line.vec3();
+    record.fuzz = line.number<float>();
+    record.texture = parse_material_texture(line, textureIds);
+  } else if (type == "dielectric") {
+    record.type = MaterialType::Dielectric;
+    record.refractionIndex = line.number<float>();
+  } else if (type == "light") {
+    record.type = MaterialType::DiffuseLight;
+    record.emission = line.vec3();
+  } else {
+    line.fail(std::format("unknown material type '{}'", type));
+  }
+  return record;
+}
+
+[[nodiscard]]
+MaterialId find_material(
+    LineParser& line,
+    const std::unordered_map<std::string, MaterialId>& materialIds) {
+  const std::string name(line.word());
+  const auto material = materialIds.find(name);
+  if (material == materialIds.end()) {
+    line.fail(std::format("unknown material '{}'", name));
+  }
+  return material->second;
+}
+
+// Transform operations applied in the order written, e.g.
+// "scale 2 2 2 rotate 0 1 0 90 translate 5 0 0".
+[[nodiscard]]
+std::vector<TransformStep> parse_transform(LineParser& line) {
+  std::vector<TransformStep> steps;
+  while (!line.empty()) {
+    const auto operation = line.word();
+    if (operation == "translate") {
+      steps.push_back({TransformOperation::Translate, line.vec3()});
+    } else if (operation == "scale") {
+      const auto scale = line.vec3();
+      // A zero factor flattens the instance and its transform has no
+      // inverse to bring rays into object space.
+      if (scale.x == 0.0f || scale.y == 0.0f || scale.z == 0.0f) {
+        line.fail("scale factors must not be zero");
+      }
+      steps.push_back({TransformOperation::Scale, scale});
+    } else if (operation == "rotate") {
+      const auto axis = line.vec3();
+      const auto degrees = line.number<float>();
+      if (glm::length(axis) == 0.0f) {
+        line.fail("rotation axis must not be zero");
+      }
+      steps.push_back({TransformOperation::Rotate, axis, degrees});
+    } else {
+      line.fail(std::format("unknown transform '{}'", operation));
+    }
+  }
+  return steps;
+}
+
+// Camera keyframe as written; missing values are filled in from the
+// keyframe before it once the whole file is read.
+struct CameraKeyDraft {
+  std::uint32_t frame;
+  std::optional<glm::vec3> lookFrom;
+  std::optional<glm::vec3> lookAt;
+  std::optional<float> vfov;
+  std::optional<float> focusDistance;
+};
+
+[[nodiscard]]
+CameraKeyDraft parse_camera_key(LineParser& line, const std::uint32_t frame) {
+  CameraKeyDraft key{.frame = frame};
+  while (!line.empty()) {
+    const auto name = line.word();
+    if (name == "look_from") {
+      key.lookFrom = line.vec3();
+    } else if (name == "look_at") {
+      key.lookAt = line.vec3();
+    } else if (name == "vfov") {
+      key.vfov = line.number<float>();
+    } else if (name == "focus_distance") {
+      key.focusDistance = line.number<float>();
+    } else {
+      line.fail(std::format("'{}' cannot be keyframed", name));
+    }
+  }
+  return key;
+}
+
+// Keyframes start from the still camera and carry every value they do not
+// set over from the keyframe before.
+[[nodiscard]]
+std::vector<CameraKeyframe> resolve_camera_keys(
+    std::vector<CameraKeyDraft> drafts, const CameraSettings& camera) {
+  std::ranges::sort(drafts, {}, &CameraKeyDraft::frame);
+  std::vector<CameraKeyframe> keyframes;
+  CameraKeyframe previous{.lookFrom = camera.lookFrom,
+                          .lookAt = camera.lookAt,
+                          .vfov = camera.vfov,
+                          .focusDistance = camera.focusDistance};
+  for (const auto& draft : drafts) {
+    previous = CameraKeyframe{
+        .frame = draft.frame,
+        .lookFrom = draft.lookFrom.value_or(previous.lookFrom),
+        .lookAt = draft.lookAt.value_or(previous.lookAt),
+        .vfov = draft.vfov.value_or(previous.vfov),
+        .focusDistance =
+            draft.focusDistance.value_or(previous.focusDistance)};
+    keyframes.push_back(previous);
+  }
+  return keyframes;
+}
+
+void add_instance_key(LineParser& line, const std::uint32_t frame,
+                      const std::size_t instanceCount,
+                      std::vector<InstanceTrack>& tracks) {
+  const auto instance = line.number<std::uint32_t>();
+  if (instance >= instanceCount) {
+    line.fail(std::format("there is no instance {} yet", instance));
+  }
+  auto steps = parse_transform(line);
+  auto track = std::ranges::find(tracks, instance, &InstanceTrack::instance);
+  if (track == tracks.end()) {
+    tracks.push_back({.instance = instance});
+    track = tracks.end() - 1;
+  } else {
+    const auto& first = track->keyframes.front().transform;
+    if (!std::ranges::equal(steps, first, {}, &TransformStep::operation,
+                            &TransformStep::operation)) {
+      line.fail("keyframes of an instance must use the same operations");
+    }
+    if (std::ranges::find(track->keyframes, frame,
+                          &InstanceKeyframe::frame) !=
+        track->keyframes.end()) {
+      line.fail(std::format("instance {} has two keyframes at frame {}",
+                            instance, frame));
+    }
+  }
+  track->keyframes.push_back({frame, std::move(steps)});
+}
+
+// Paths are stored relative to the directory of the compiled scene, so that
+// it keeps working when moved along with the files it uses or loaded from
+// another working directory. Paths on another root stay absolute.
+[[nodiscard]]
+std::u8string stored_path(const std::filesystem::path& path,
+                          const std::filesystem::path& directory) {
+  const auto absolute = std::filesystem::absolute(path);
+  const auto relative =
+      absolute.lexically_relative(std::filesystem::absolute(directory));
+  return (relative.empty() ? absolute : relative).generic_u8string();
+}
+
+// Appends the records of meshes, whose table starts at tableOffset, and
+// their paths, which follow all tables and start at pathsOffset.
+void encode_meshes(const std::span<const MeshReference> meshes,
+                   const std::filesystem::path& directory,
+                   const std::uint64_t pathsOffset,
+                   std::vector<CompiledMeshRecord>& records,
+                   std::string& paths) {
+  for (const auto& mesh : meshes) {
+    const auto meshPath = stored_path(mesh.path, directory);
+    records.push_back({.pathOffset = pathsOffset + paths.size(),
+                       .pathSize = static_cast<std::uint32_t>(meshPath.size()),
+                       .material = mesh.material});
+    paths.append(meshPath.begin(), meshPath.end());
+  }
+}
+
+void encode_textures(const std::span<const TextureReference> textures,
+                     const std::filesystem::path& directory,
+                     const std::uint64_t pathsOffset,
+                     std::vector<CompiledTextureRecord>& records,
+                     std::string& paths) {
+  for (const auto& texture : textures) {
+    const auto imagePath = texture.image.empty()
+                               ? std::u8string{}
+                               : stored_path(texture.image, directory);
+    records.push_back(
+        {.record = texture.record,
+         .pathOffset = pathsOffset + paths.size(),
+         .pathSize = static_cast<std::uint32_t>(imagePath.size()),
+         .reserved = 0});
+    paths.append(imagePath.begin(), imagePath.end());
+  }
+}
+
+// Returns an empty optional if a record is corrupt.
+[[nodiscard]]
+std::optional<std::vector<MeshReference>> decode_meshes(
+    const std::span<const std::byte> data,
+    const std::filesystem::path& directory, const std::uint64_t offset,
+    const std::uint64_t count, const std::uint32_t materialCount) {
+  std::vector<MeshReference> meshes;
+  meshes.reserve(static_cast<std::size_t>(count));
+  for (std::uint64_t i = 0; i < count; ++i) {
+    CompiledMeshRecord record;
+    std::memcpy(&record, data.data() + offset + i * sizeof(record),
+                sizeof(record));
+    if (record.material >= materialCount || record.pathOffset > data.size() ||
+        record.pathSize > data.size() - record.pathOffset) {
+      return std::nullopt;
+    }
+    const std::u8string_view meshPath(
+        reinterpret_cast<const char8_t*>(data.data() + record.pathOffset),
+        record.pathSize);
+    meshes.push_back(
+        {directory / std::filesystem::path(meshPath), record.material});
+  }
+  return meshes;
+}
+
+// Returns an empty optional if a record is corrupt.
+[[nodiscard]]
+std::optional<std::vector<TextureReference>> decode_textures(
+    const std::span<const std::byte> data,
+    const std::filesystem::path& directory, const std::uint64_t offset,
+    const std::uint64_t count) {
+  std::vector<TextureReference> textures;
+  textures.reserve(static_cast<std::size_t>(count));
+  for (std::uint64_t i = 0; i < count; ++i) {
+    CompiledTextureRecord record;
+    std::memcpy(&record, data.data() + offset + i * sizeof(record),
+                sizeof(record));
+    if (record.record.type >= TextureType::Count ||
+        (record.record.type == TextureType::Checker &&
+         !(record.record.scale > 0.0f)) ||
+        record.pathOffset > data.size() ||
+        record.pathSize > data.size() - record.pathOffset) {
+      return std::nullopt;
+    }
+    const std::u8string_view imagePath(
+        reinterpret_cast<const char8_t*>(data.data() + record.pathOffset),
+        record.pathSize);
+    textures.push_back({record.record,
+                        imagePath.empty()
+                            ? std::filesystem::path{}
+                            : directory / std::filesystem::path(imagePath)});
+  }
+  return textures;
+}
+
+[[nodiscard]]
+Texture to_texture(const TextureReference& texture) {
+  const auto& record = texture.record;
+  switch (record.type) {
+    case TextureType::Noise:
+      return NoiseTexture{record.color0, record.scale};
+    case TextureType::Image:
+      return ImageTexture{std::make_shared<const TextureImage>(texture.image)};
+    case TextureType::Checker:
+    case TextureType::Count:
+      break;
+  }
+  return CheckerTexture{record.color0, record.color1, record.scale};
+}
+
+[[nodiscard]]
+Scene make_scene(const std::span<const MaterialRecord> materials,
+                 const std::span<const TextureReference> textureReferences,
+                 const std::span<const Sphere> spheres,
+                 const std::span<const MeshReference> meshes,
+                 const std::span<const MeshReference> objects,
+                 const std::span<const Instance> instances,
+                 BVHCache* const cache) {
+  Scene scene;
+  std::vector<std::shared_ptr<const Texture>> textures;
+  textures.reserve(textureReferences.size());
+  for (const auto& texture : textureReferences) {
+    textures.push_back(std::make_shared<const Texture>(to_texture(texture)));
+  }
+  for (const auto& record : materials) {
+    scene.materials.add(to_material(record, textures));
+  }
+  // Emitters that collect_lights() does not sample, objects and inward
+  // facing spheres, get a copy of their material that no light uses. Hits
+  // on them then count with a light density of 0 rather than that of the
+  // sampled emitters they could share the material with.
+  std::unordered_map<MaterialId, MaterialId> unsampledMaterials;
+  const auto unsampled = [&](const MaterialId material) {
+    if (materials[material].type != MaterialType::DiffuseLight) {
+      return material;
+    }
+    const auto [copy, added] = unsampledMaterials.try_emplace(material);
+    if (added) {
+      copy->second = scene.materials.add(scene.materials[material]);
+    }
+    return copy->second;
+  };
+  if (std::ranges::any_of(spheres, [&](const Sphere& sphere) {
+        return !(sphere.radius > 0.0f) &&
+               materials[sphere.material].type == MaterialType::DiffuseLight;
+      })) {
+    std::vector<Sphere> remapped(spheres.begin(), spheres.end());
+    for (auto& sphere : remapped) {
+      if (!(sphere.radius > 0.0f)) {
+        sphere.material = unsampled(sphere.material);
+      }
+    }
+    scene.world.add(SphereBVH{remapped, cache});
+  } else if (!spheres.empty()) {
+    scene.world.add(SphereBVH{spheres, cache});
+  }
+  for (const auto& mesh : meshes) {
+    scene.world.add(
+        TriangleMesh{load_mesh(mesh.path), mesh.material, cache});
+  }
+  if (!instances.empty()) {
+    std::vector<Hittable> geometries;
+    geometries.reserve(objects.size());
+    for (const auto& object : objects) {
+      geometries.emplace_back(TriangleMesh{load_mesh(object.path),
+                                           unsampled(object.material), cache});
+    }
+    scene.world.add(InstanceBVH{std::move(geometries), instances, cache});
+  }
+  scene.lights = collect_lights(scene.world, scene.materials);
+  return scene;
+}
+
+}  // namespace
+
+Material to_material(
+    const MaterialRecord& record,
+    const std::span<const std::shared_ptr<const Texture>> textures) {
+  auto texture = record.texture < textures.size() ? textures[record.texture]
+                                                  : nullptr;
+  switch (record.type) {
+    case MaterialType::Metal:
+      return Metal{record.albedo, record.fuzz, std::move(texture)};
+    case MaterialType::Dielectric:
+      return Dielectric{record.refractionIndex};
+    case MaterialType::DiffuseLight:
+      return DiffuseLight{record.emission};
+    case MaterialType::Lambertian:
+    case MaterialType::Count:
+      break;
+  }
+  return Lambertian{record.albedo, std::move(texture)};
+}
+
+SceneDescription load_scene_text(const std::filesystem::path& path) {
+  const MappedFile file(path);
+  const std::string_view text(reinterpret_cast<const char*>(file.data().data()),
+                              file.size());
+
+  SceneDescription scene;
+  std::unordered_map<std::string, MaterialId> materialIds;
+  std::unordered_map<std::string, TextureId> textureIds;
+  std::unordered_map<std::string, GeometryId> objectIds;
+  std::vector<CameraKeyDraft> cameraKeys;
+  bool framesGiven = false;
+  std::size_t lineNumber = 0;
+  for (std::size_t start = 0; start < text.size();) {
+    const auto end = std::min(text.find('\n', start), text.size());
+    auto content = text.substr(start, end - start);
+    start = end + 1;
+    ++lineNumber;
+    content = content.substr(0, content.find('#'));
+
+    LineParser line(path, lineNumber, content);
+    if (line.empty()) {
+      continue;
+    }
+    const auto keyword = line.word();
+    if (keyword == "camera") {
+      parse_camera(line, scene.camera);
+      continue;
+    }
+    if (keyword == "material") {
+      const std::string name(line.word());
+      const auto id = static_cast<MaterialId>(scene.materials.size());
+      if (!materialIds.emplace(name, id).second) {
+        line.fail(std::format("material '{}' is defined twice", name));
+      }
+      scene.materials.push_back(parse_material(line, textureIds));
+    } else if (keyword == "texture") {
+      const std::string name(line.word());
+      const auto id = static_cast<TextureId>(scene.textures.size());
+      if (!textureIds.emplace(name, id).second) {
+        line.fail(std::format("texture '{}' is defined twice", name));
+      }
+      scene.textures.push_back(parse_texture(line, path));
+    } else if (keyword == "sphere") {
+      Sphere sphere;
+      sphere.center = line.vec3();
+      sphere.radius = line.number<float>();
+      sphere.material = find_material(line, materialIds);
+      scene.spheres.push_back(sphere);
+    } else if (keyword == "mesh") {
+      const auto meshPath = path.parent_path() / line.word();
+      scene.meshes.push_back({meshPath, find_material(line, materialIds)});
+    } else if (keyword == "object") {
+      const std::string name(line.word());
+      const auto id = static_cast<GeometryId>(scene.objects.size());
+      if (!objectIds.emplace(name, id).second) {
+        line.fail(std::format("object '{}' is defined twice", name));
+      }
+      const auto meshPath = path.parent_path() / line.word();
+      scene.objects.push_back({meshPath, find_material(line, materialIds)});
+    } else if (keyword == "instance") {
+      const std::string name(line.word());
+      const auto object = objectIds.find(name);
+      if (object == objectIds.end()) {
+        line.fail(std::format("unknown object '{}'", name));
+      }
+      scene.instances.emplace_back(object->second,
+                                   to_matrix(parse_transform(line)));
+    } else if (keyword == "frames") {
+      scene.animation.frameCount = line.number<std::uint32_t>();
+      if (scene.animation.frameCount == 0) {
+        line.fail("an animation needs at least one frame");
+      }
+      framesGiven = true;
+    } else if (keyword == "key") {
+      const auto frame = line.number<std::uint32_t>();
+      const auto target = line.word();
+      if (target == "camera") {
+        if (std::ranges::find(cameraKeys, frame, &CameraKeyDraft::frame) !=
+            cameraKeys.end()) {
+          line.fail(std::format("two camera keyframes at frame {}", frame));
+        }
+        cameraKeys.push_back(parse_camera_key(line, frame));
+      } else if (target == "instance") {
+        add_instance_key(line, frame, scene.instances.size(),
+                         scene.animation.instances);
+      } else {
+        line.fail(std::format("cannot keyframe '{}'", target));
+      }
+    } else {
+      line.fail(std::format("unknown keyword '{}'", keyword));
+    }
+    if (!line.empty()) {
+      line.fail("unexpected trailing values");
+    }
+  }
+
+  auto& animation = scene.animation;
+  animation.camera = resolve_camera_keys(std::move(cameraKeys), scene.camera);
+  std::uint32_t lastKey = 0;
+  for (auto& track : animation.instances) {
+    std::ranges::sort(track.keyframes, {}, &InstanceKeyframe::frame);
+    lastKey = std::max(lastKey, track.keyframes.back().frame);
+  }
+  if (!animation.camera.empty()) {
+    lastKey = std::max(lastKey, animation.camera.back().frame);
+  }
+  if (!framesGiven) {
+    animation.frameCount = lastKey + 1;
+  }
+  return scene;
+}
+
+bool save_compiled_scene(const SceneDescription& scene,
+                         const std::filesystem::path& path) {
+  CompiledSceneHeader header{
+      .magic = kSceneMagic,
+      .version = kSceneVersion,
+      .materialRecordSize = sizeof(MaterialRecord),
+      .sphereSize = sizeof(Sphere),
+      .instanceSize = sizeof(Instance),
+      .materialCount = static_cast<std::uint32_t>(scene.materials.size()),
+      .sphereCount = scene.spheres.size(),
+      .instanceCount = scene.instances.size(),
+      .meshCount = scene.meshes.size(),
+      .objectCount = scene.objects.size(),
+      .textureCount = scene.textures.size(),
+      .materialOffset = align_up(sizeof(CompiledSceneHeader)),
+      .sphereOffset = 0,
+      .instanceOffset = 0,
+      .meshOffset = 0,
+      .objectOffset = 0,
+      .textureOffset = 0,
+      .camera = scene.camera,
+  };
+  header.sphereOffset = align_up(
+      header.materialOffset + scene.materials.size() * sizeof(MaterialRecord));
+  header.instanceOffset =
+      align_up(header.sphereOffset + scene.spheres.size() * sizeof(Sphere));
+  header.meshOffset = align_up(header.instanceOffset +
+                               scene.instances.size() * sizeof(Instance));
+  header.objectOffset =
+      header.meshOffset + scene.meshes.size() * sizeof(CompiledMeshRecord);
+
+  header.textureOffset = align_up(
+      header.objectOffset + scene.objects.size() * sizeof(CompiledMeshRecord));
+
+  std::vector<CompiledMeshRecord> meshRecords;
+  std::vector<CompiledTextureRecord> textureRecords;
+  std::string paths;
+  const auto pathsOffset =
+      header.textureOffset +
+      scene.textures.size() * sizeof(CompiledTextureRecord);
+  const auto directory = path.parent_path();
+  encode_meshes(scene.meshes, directory, pathsOffset, meshRecords, paths);
+  encode_meshes(scene.objects, directory, pathsOffset, meshRecords, paths);
+  encode_textures(scene.textures, directory, pathsOffset, textureRecords,
+                  paths);
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  const auto pad_to = [&file](const std::uint64_t offset) {
+    constexpr std::array<char, kArrayAlignment> kZeros{};
+    const auto position = static_cast<std::uint64_t>(file.tellp());
+    file.write(kZeros.data(), static_cast<std::streamsize>(offset - position));
+  };
+  const auto write = [&file](const auto& elements) {
+    file.write(reinterpret_cast<const char*>(elements.data()),
+               static_cast<std::streamsize>(elements.size() *
+                                            sizeof(elements[0])));
+  };
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  pad_to(header.materialOffset);
+  write(scene.materials);
+  pad_to(header.sphereOffset);
+  write(scene.spheres);
+  pad_to(header.instanceOffset);
+  write(scene.instances);
+  pad_to(header.meshOffset);
+  write(meshRecords);
+  pad_to(header.textureOffset);
+  write(textureRecords);
+  write(paths);
+  file.close();
+  return file.good();
+}
+
+CompiledScene::CompiledScene(const std::filesystem::path& path)
+    : m_file(path) {
+  const auto data = m_file.data();
+  const auto fail = [&path](const std::string_view message) {
+    throw std::runtime_error(std::format("{}: {}", path.string(), message));
+  };
+
+  CompiledSceneHeader header;
+  if (data.size() < sizeof(header)) {
+    fail("too small for a compiled scene");
+  }
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (header.magic != kSceneMagic || header.version != kSceneVersion ||
+      header.materialRecordSize != sizeof(MaterialRecord) ||
+      header.sphereSize != sizeof(Sphere) ||
+      header.instanceSize != sizeof(Instance)) {
+    fail(std::format("not a version {} compiled scene", kSceneVersion));
+  }
+  const auto fits = [&data](const std::uint64_t offset,
+                            const std::uint64_t count,
+                            const std::size_t elementSize) {
+    return offset % kArrayAlignment == 0 && offset <= data.size() &&
+           count <= (data.size() - offset) / elementSize;
+  };
+  // Objects share the table of meshes, right after them.
+  const auto objectOffset =
+      header.meshOffset + header.meshCount * sizeof(CompiledMeshRecord);
+  if (!fits(header.materialOffset, header.materialCount,
+            sizeof(MaterialRecord)) ||
+      !fits(header.sphereOffset, header.sphereCount, sizeof(Sphere)) ||
+      !fits(header.instanceOffset, header.instanceCount, sizeof(Instance)) ||
+      !fits(header.meshOffset, header.meshCount + header.objectCount,
+            sizeof(CompiledMeshRecord)) ||
+      header.objectOffset != objectOffset ||
+      !fits(header.textureOffset, header.textureCount,
+            sizeof(CompiledTextureRecord))) {
+    fail("arrays exceed the file, it is truncated or corrupt");
+  }
+  if (header.camera.imageWidth == 0 || !(header.camera.aspectRatio > 0.0)) {
+    fail("camera width and aspect must be positive");
+  }
+
+  m_camera = header.camera;
+  m_materials = {reinterpret_cast<const MaterialRecord*>(
+                     data.data() + header.materialOffset),
+                 header.materialCount};
+  m_spheres = {
+      reinterpret_cast<const Sphere*>(data.data() + header.sphereOffset),
+      static_cast<std::size_t>(header.sphereCount)};
+  m_instances = {
+      reinterpret_cast<const Instance*>(data.data() + header.instanceOffset),
+      static_cast<std::size_t>(header.instanceCount)};
+  const auto materialCount = header.materialCount;
+  const auto textureCount = header.textureCount;
+  if (!std::ranges::all_of(m_materials, [textureCount](const auto& material) {
+        return material.texture == kNoTexture ||
+               material.texture < textureCount;
+      })) {
+    fail("a material refers to a texture that does not exist");
+  }
+  if (!std::ranges::all_of(m_spheres, [materialCount](const Sphere& sphere) {
+        return sphere.material < materialCount;
+      })) {
+    fail("a sphere refers to a material that does not exist");
+  }
+  const auto objectCount = header.objectCount;
+  if (!std::ranges::all_of(m_instances, [objectCount](const auto& instance) {
+        return instance.geometry < objectCount;
+      })) {
+    fail("an instance refers to an object that does not exist");
+  }
+
+  const auto directory = path.parent_path();
+  auto meshes = decode_meshes(data, directory, header.meshOffset,
+                              header.meshCount, materialCount);
+  auto objects = decode_meshes(data, directory, header.objectOffset,
+                               header.objectCount, materialCount);
+  if (!meshes || !objects) {
+    fail("a mesh record is corrupt");
+  }
+  auto textures = decode_textures(data, directory, header.textureOffset,
+                                  header.textureCount);
+  if (!textures) {
+    fail("a texture record is corrupt");
+  }
+  m_meshes = std::move(*meshes);
+  m_objects = std::move(*objects);
+  m_textures = std::move(*textures);
+}
+
+Scene make_scene(const SceneDescription& scene, BVHCache* const cache) {
+  return make_scene(scene.materials, scene.textures, scene.spheres,
+                    scene.meshes, scene.objects, scene.instances, cache);
+}
+
+Scene make_scene(const CompiledScene& scene, BVHCache* const cache) {
+  return make_scene(scene.materials(), scene.textures(), scene.spheres(),
+                    scene.meshes(), scene.objects(), scene.instances(),
+                    cache);
+}
+
+}  // namespace mp
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "Animation.hpp"
+#include "BVHCache.hpp"
+#include "Camera.hpp"
+#include "Instance.hpp"
+#include "MappedFile.hpp"
+#include "Material.hpp"
+#include "Scene.hpp"
+#include "Sphere.hpp"
+#include "Texture.hpp"
+#include "glm/glm.hpp"
+
+namespace mp {
+
+// Flat form of a Material as stored in compiled scene files. Only the fields
+// of its type are meaningful.
+struct MaterialRecord {
+  MaterialType type{MaterialType::Lambertian};
+  glm::vec3 albedo{0.0f};
+  float fuzz{0.0f};
+  float refractionIndex{1.0f};
+  glm::vec3 emission{0.0f};
+  // Lambertian and metal only.
+  TextureId texture{kNoTexture};
+};
+
+// Flat form of a procedural Texture; image textures are described by their
+// path. scale is the size of checker cells or the frequency of noise.
+struct TextureRecord {
+  TextureType type{TextureType::Checker};
+  glm::vec3 color0{1.0f};
+  glm::vec3 color1{0.0f};
+  float scale{1.0f};
+};
+
+static_assert(std::is_trivially_copyable_v<MaterialRecord>);
+static_assert(std::is_trivially_copyable_v<TextureRecord>);
+static_assert(std::is_trivially_copyable_v<Sphere>);
+static_assert(std::is_trivially_copyable_v<CameraSettings>);
+
+// record.texture indexes textures; materials whose texture is not among
+// them are untextured.
+[[nodiscard]]
+Material to_material(
+    const MaterialRecord& record,
+    std::span<const std::shared_ptr<const Texture>> textures = {});
+
+// Mesh file used by a scene, loaded when the scene is made renderable.
+struct MeshReference {
+  std::filesystem::path path;
+  MaterialId material;
+};
+
+// Texture used by a scene. Image textures are opened when the scene is made
+// renderable, and their tiles read as rendering needs them.
+struct TextureReference {
+  TextureRecord record;
+  // Texture file written by bake_texture(), for TextureType::Image.
+  std::filesystem::path image;
+};
+
+// A scene parsed from the text format:
+//
+//   # comment
+//   camera width 600 aspect 1.7777778 samples 100 depth 50 vfov 20
+//   camera defocus_angle 0.2 focus_distance 10
+//   camera look_from 13 2 3 look_at 0 0 0 up 0 1 0
+//   texture <name> checker <r> <g> <b> <r> <g> <b> <cell size>
+//   texture <name> noise <r> <g> <b> <frequency>
+//   texture <name> image <texture file path>
+//   material <name> lambertian <r> <g> <b> [texture <texture name>]
+//   material <name> metal <r> <g> <b> <fuzz> [texture <texture name>]
+//   material <name> dielectric <refraction index>
+//   material <name> light <r> <g> <b>
+//   sphere <x> <y> <z> <radius> <material name>
+//   mesh <.obj or .ply path> <material name>
+//   object <name> <.obj or .ply path> <material name>
+//   instance <object name> [translate <x> <y> <z>] [scale <x> <y> <z>]
+//            [rotate <axis x> <axis y> <axis z> <degrees>] ...
+//   frames <count>
+//   key <frame> camera [look_from <x> <y> <z>] [look_at <x> <y> <z>]
+//                      [vfov <degrees>] [focus_distance <distance>]
+//   key <frame> instance <index> <transform as for instance>
+//
+// Camera keys are optional and may be spread over several lines; missing
+// ones keep the CameraSettings defaults. Names must be defined before they
+// are used. Mesh and texture paths are relative to the scene file; texture
+// files are made from images with bake_texture(). A textured material
+// multiplies its color by that of the texture. An object is a mesh that is
+// loaded once and only rendered through its instances, whose transforms are
+// applied in the order written. Light materials emit radiance <r> <g> <b>
+// from the front face; spheres and meshes made of them are sampled as
+// lights, objects are not.
+//
+// Frames are numbered from 0. Key lines make an animation (see Animation):
+// camera keyframes take the values they leave out from the keyframe before,
+// the first from the camera lines. An instance is keyed by its position
+// among the instance lines, counting from 0, and replaces the transform of
+// that line; all its keyframes must list the same operations. Without a
+// frames line the animation ends at the last keyframe.
+struct SceneDescription {
+  CameraSettings camera;
+  std::vector<MaterialRecord> materials;
+  // MaterialRecord::texture indexes textures.
+  std::vector<TextureReference> textures;
+  std::vector<Sphere> spheres;
+  std::vector<MeshReference> meshes;
+  // Instance::geometry indexes objects.
+  std::vector<MeshReference> objects;
+  std::vector<Instance> instances;
+  Animation animation;
+};
+
+// Throws std::runtime_error naming the file and line of the first error.
+[[nodiscard]]
+SceneDescription load_scene_text(const std::filesystem::path& path);
+
+// Writes the binary form read by CompiledScene: a header followed by the
+// material, sphere and instance arrays exactly as they are laid out in
+// memory. Meshes, objects and image textures are stored by path, relative
+// to the directory of path. The animation is not stored; compiled scenes
+// are stills.
+[[nodiscard]]
+bool save_compiled_scene(const SceneDescription& scene,
+                         const std::filesystem::path& path);
+
+// Memory-mapped compiled scene. The arrays are used in place, so opening
+// even a very large scene costs one mapping and a validation pass over the
+// material, texture and object ids.
+class CompiledScene {
+ public:
+  // Throws std::system_error if the file cannot be mapped and
+  // std::runtime_error if it is not a compiled scene of this version.
+  explicit CompiledScene(const std::filesystem::path& path);
+
+  [[nodiscard]]
+  const CameraSettings& camera() const noexcept {
+    return m_camera;
+  }
+
+  [[nodiscard]]
+  std::span<const MaterialRecord> materials() const noexcept {
+    return m_materials;
+  }
+
+  [[nodiscard]]
+  std::span<const TextureReference> textures() const noexcept {
+    return m_textures;
+  }
+
+  [[nodiscard]]
+  std::span<const Sphere> spheres() const noexcept {
+    return m_spheres;
+  }
+
+  [[nodiscard]]
+  std::span<const MeshReference> meshes() const noexcept {
+    return m_meshes;
+  }
+
+  [[nodiscard]]
+  std::span<const MeshReference> objects() const noexcept {
+    return m_objects;
+  }
+
+  [[nodiscard]]
+  std::span<const Instance> instances() const noexcept {
+    return m_instances;
+  }
+
+ private:
+  MappedFile m_file;
+  CameraSettings m_camera;
+  std::span<const MaterialRecord> m_materials;
+  std::span<const Sphere> m_spheres;
+  std::span<const Instance> m_instances;
+  std::vector<MeshReference> m_meshes;
+  std::vector<MeshReference> m_objects;
+  std::vector<TextureReference> m_textures;
+};
+
+// Renderable scene: the material table with its textures, a SphereBVH over
+// the spheres, one TriangleMesh per mesh and an InstanceBVH over the
+// instances, with one TriangleMesh per object, and the lights among the
+// spheres and meshes. Mesh loading errors are thrown as by load_mesh(), and
+// texture file errors as by TextureImage. The trees are taken from cache if
+// given.
+[[nodiscard]]
+Scene make_scene(const SceneDescription& scene, BVHCache* cache = nullptr);
+
+[[nodiscard]]
+Scene make_scene(const CompiledScene& scene, BVHCache* cache = nullptr);
+
+}  // namespace mp
@@ -0,0 +1,454 @@
+#include "Socket.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <format>
+#include <optional>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+// winsock2.h has to come first.
+#include <afunix.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "ws2_32.lib")
+#endif
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif
+
+namespace mp {
+namespace {
+
+#ifdef _WIN32
+
+using NativeSocket = SOCKET;
+constexpr NativeSocket kInvalidSocket = INVALID_SOCKET;
+
+int last_error() noexcept { return WSAGetLastError(); }
+
+const std::error_category& error_category() noexcept {
+  return std::system_category();
+}
+
+bool interrupted(int) noexcept { return false; }
+
+void close_socket(const NativeSocket socket) noexcept {
+  ::closesocket(socket);
+}
+
+int poll_one(pollfd& fd, const int timeoutMs) noexcept {
+  return ::WSAPoll(&fd, 1, timeoutMs);
+}
+
+// Winsock needs starting once per process before the first socket.
+void start_sockets() {
+  static const int error = [] {
+    WSADATA data;
+    return ::WSAStartup(MAKEWORD(2, 2), &data);
+  }();
+  if (error != 0) {
+    throw std::system_error(error, std::system_category(), "WSAStartup");
+  }
+}
+
+#else
+
+using NativeSocket = int;
+constexpr NativeSocket kInvalidSocket = -1;
+
+int last_error() noexcept { return errno; }
+
+const std::error_category& error_category() noexcept {
+  return std::generic_category();
+}
+
+bool interrupted(const int error) noexcept { return error == EINTR; }
+
+void close_socket(const NativeSocket socket) noexcept { ::close(socket); }
+
+int poll_one(pollfd& fd, const int timeoutMs) noexcept {
+  return ::poll(&fd, 1, timeoutMs);
+}
+
+void start_sockets() {}
+
+#endif
+
+// A peer that went away must not kill the process with SIGPIPE.
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0;
+#endif
+
+[[noreturn]]
+void fail(const char* what) {
+  throw std::system_error(last_error(), error_category(), what);
+}
+
+struct Endpoint {
+  // Set for "unix:<path>", host and port are used otherwise.
+  std::optional<std::filesystem::path> unixPath;
+  std::string host;
+  std::string port;
+};
+
+Endpoint parse_endpoint(const std::string_view endpoint) {
+  constexpr std::string_view kUnixPrefix = "unix:";
+  if (endpoint.starts_with(kUnixPrefix)) {
+    if (endpoint.size() == kUnixPrefix.size()) {
+      throw std::invalid_argument(
+          std::format("{}: Unix domain socket without a path", endpoint));
+    }
+    return Endpoint{.unixPath = std::filesystem::path(
+                        endpoint.substr(kUnixPrefix.size()))};
+  }
+  const auto colon = endpoint.rfind(':');
+  if (colon == std::string_view::npos || colon + 1 == endpoint.size()) {
+    throw std::invalid_argument(std::format(
+        "{}: expected host:port or unix:<path>", endpoint));
+  }
+  auto host = endpoint.substr(0, colon);
+  // IPv6 addresses are bracketed, "[::1]:7000".
+  if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+    host = host.substr(1, host.size() - 2);
+  }
+  return Endpoint{.host = std::string(host),
+                  .port = std::string(endpoint.substr(colon + 1))};
+}
+
+sockaddr_un unix_address(const std::filesystem::path& path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  const auto name = path.string();
+  if (name.size() >= sizeof(address.sun_path)) {
+    throw std::invalid_argument(
+        std::format("{}: path too long for a Unix domain socket", name));
+  }
+  std::memcpy(address.sun_path, name.c_str(), name.size() + 1);
+  return address;
+}
+
+// Addresses host and port resolve to, freed with freeaddrinfo().
+addrinfo* resolve(const Endpoint& endpoint, const bool passive) {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = passive ? AI_PASSIVE : 0;
+  addrinfo* addresses = nullptr;
+  const int error = ::getaddrinfo(
+      endpoint.host.empty() ? nullptr : endpoint.host.c_str(),
+      endpoint.port.c_str(), &hints, &addresses);
+  if (error != 0) {
+    throw std::system_error(
+        std::make_error_code(std::errc::address_not_available),
+        std::format("getaddrinfo {}:{}: {}", endpoint.host, endpoint.port,
+                    ::gai_strerror(error)));
+  }
+  return addresses;
+}
+
+// Socket bound and listening on, or connected to, address. Returns
+// kInvalidSocket and leaves the reason in error if any step fails.
+NativeSocket open_socket(const int family, const sockaddr* address,
+                         const socklen_t length, const bool listening,
+                         int& error) {
+  const NativeSocket socket = ::socket(family, SOCK_STREAM, 0);
+  if (socket == kInvalidSocket) {
+    error = last_error();
+    return kInvalidSocket;
+  }
+  const int on = 1;
+#ifdef SO_NOSIGPIPE
+  ::setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE,
+               reinterpret_cast<const char*>(&on), sizeof(on));
+#endif
+  if (family != AF_UNIX) {
+    // Requests are a few bytes followed by a wait for the reply, which
+    // Nagle's algorithm would hold back.
+    ::setsockopt(socket, IPPROTO_TCP, TCP_NODELAY,
+                 reinterpret_cast<const char*>(&on), sizeof(on));
+  }
+  bool ok = false;
+  if (listening) {
+    if (family != AF_UNIX) {
+      ::setsockopt(socket, SOL_SOCKET, SO_REUSEADDR,
+                   reinterpret_cast<const char*>(&on), sizeof(on));
+    }
+    ok = ::bind(socket, address, length) == 0 &&
+         ::listen(socket, SOMAXCONN) == 0;
+  } else {
+    ok = ::connect(socket, address, length) == 0;
+  }
+  if (!ok) {
+    error = last_error();
+    close_socket(socket);
+    return kInvalidSocket;
+  }
+  return socket;
+}
+
+std::string numeric_address(const sockaddr* address, const socklen_t length) {
+  char host[NI_MAXHOST];
+  char port[NI_MAXSERV];
+  if (::getnameinfo(address, length, host, sizeof(host), port, sizeof(port),
+                    NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
+    return "?";
+  }
+  return address->sa_family == AF_INET6 ? std::format("[{}]:{}", host, port)
+                                        : std::format("{}:{}", host, port);
+}
+
+}  // namespace
+
+Socket::~Socket() { close(); }
+
+Socket::Socket(Socket&& other) noexcept
+    : m_handle(std::exchange(other.m_handle, kInvalidSocket)),
+      m_peer(std::move(other.m_peer)),
+      m_unixPath(std::exchange(other.m_unixPath, {})) {}
+
+Socket& Socket::operator=(Socket&& other) noexcept {
+  if (this != &other) {
+    close();
+    m_handle = std::exchange(other.m_handle, kInvalidSocket);
+    m_peer = std::move(other.m_peer);
+    m_unixPath = std::exchange(other.m_unixPath, {});
+  }
+  return *this;
+}
+
+Socket Socket::listen(const std::string_view endpoint) {
+  start_sockets();
+  const auto parsed = parse_endpoint(endpoint);
+  Socket socket;
+  int error = 0;
+  if (parsed.unixPath) {
+    const auto address = unix_address(*parsed.unixPath);
+    // A socket file is left behind by a coordinator that did not shut down
+    // cleanly. Anything else at the path is not ours to remove.
+    std::error_code ignored;
+    if (std::filesystem::is_socket(*parsed.unixPath, ignored)) {
+      std::filesystem::remove(*parsed.unixPath, ignored);
+    } else if (std::filesystem::exists(*parsed.unixPath, ignored)) {
+      throw std::system_error(
+          std::make_error_code(std::errc::address_in_use),
+          std::format("listen on {}: {} exists and is not a socket",
+                      endpoint, parsed.unixPath->string()));
+    }
+    socket.m_handle = open_socket(
+        AF_UNIX, reinterpret_cast<const sockaddr*>(&address),
+        sizeof(address), true, error);
+    if (socket.m_handle != kInvalidSocket) {
+      socket.m_unixPath = *parsed.unixPath;
+    }
+  } else {
+    addrinfo* addresses = resolve(parsed, true);
+    for (auto* a = addresses; a != nullptr; a = a->ai_next) {
+      socket.m_handle =
+          open_socket(a->ai_family, a->ai_addr,
+                      static_cast<socklen_t>(a->ai_addrlen), true, error);
+      if (socket.m_handle != kInvalidSocket) {
+        break;
+      }
+    }
+    ::freeaddrinfo(addresses);
+  }
+  if (!socket.valid()) {
+    throw std::system_error(error, error_category(),
+                            std::format("listen on {}", endpoint));
+  }
+  socket.m_peer = std::string(endpoint);
+  return socket;
+}
+
+Socket Socket::connect(const std::string_view endpoint) {
+  start_sockets();
+  const auto parsed = parse_endpoint(endpoint);
+  Socket socket;
+  int error = 0;
+  if (parsed.unixPath) {
+    const auto address = unix_address(*parsed.unixPath);
+    socket.m_handle = open_socket(
+        AF_UNIX, reinterpret_cast<const sockaddr*>(&address),
+        sizeof(address), false, error);
+  } else {
+    addrinfo* addresses = resolve(parsed, false);
+    for (auto* a = addresses; a != nullptr; a = a->ai_next) {
+      socket.m_handle =
+          open_socket(a->ai_family, a->ai_addr,
+                      static_cast<socklen_t>(a->ai_addrlen), false, error);
+      if (socket.m_handle != kInvalidSocket) {
+        break;
+      }
+    }
+    ::freeaddrinfo(addresses);
+  }
+  if (!socket.valid()) {
+    throw std::system_error(error, error_category(),
+                            std::format("connect to {}", endpoint));
+  }
+  socket.m_peer = std::string(endpoint);
+  return socket;
+}
+
+Socket Socket::accept(const std::chrono::milliseconds timeout) {
+  pollfd fd{};
+  fd.fd = static_cast<NativeSocket>(m_handle);
+  fd.events = POLLIN;
+  const int ready = poll_one(fd, static_cast<int>(timeout.count()));
+  if (ready < 0 && !interrupted(last_error())) {
+    fail("poll");
+  }
+  Socket connection;
+  if (ready <= 0) {
+    return connection;
+  }
+  sockaddr_storage address{};
+  socklen_t length = sizeof(address);
+  const NativeSocket handle =
+      ::accept(static_cast<NativeSocket>(m_handle),
+               reinterpret_cast<sockaddr*>(&address), &length);
+  if (handle == kInvalidSocket) {
+    if (interrupted(last_error())) {
+      return connection;
+    }
+    fail("accept");
+  }
+  connection.m_handle = handle;
+  if (address.ss_family == AF_UNIX) {
+    // Clients of a Unix domain socket are unnamed, tell them apart by
+    // connection.
+    static std::atomic<std::uint32_t> connections{0};
+    connection.m_peer = std::format("{} #{}", m_peer, ++connections);
+  } else {
+    const int on = 1;
+    ::setsockopt(handle, IPPROTO_TCP, TCP_NODELAY,
+                 reinterpret_cast<const char*>(&on), sizeof(on));
+    // A peer whose machine powers off or drops off the network never
+    // closes the connection; probes find out after about two minutes
+    // instead of the two hours the system waits by default.
+    ::setsockopt(handle, SOL_SOCKET, SO_KEEPALIVE,
+                 reinterpret_cast<const char*>(&on), sizeof(on));
+#if defined(TCP_KEEPIDLE) && defined(TCP_KEEPINTVL) && defined(TCP_KEEPCNT)
+    const int idleSeconds = 60;
+    const int intervalSeconds = 10;
+    const int probes = 6;
+    ::setsockopt(handle, IPPROTO_TCP, TCP_KEEPIDLE,
+                 reinterpret_cast<const char*>(&idleSeconds),
+                 sizeof(idleSeconds));
+    ::setsockopt(handle, IPPROTO_TCP, TCP_KEEPINTVL,
+                 reinterpret_cast<const char*>(&intervalSeconds),
+                 sizeof(intervalSeconds));
+    ::setsockopt(handle, IPPROTO_TCP, TCP_KEEPCNT,
+                 reinterpret_cast<const char*>(&probes), sizeof(probes));
+#endif
+    connection.m_peer =
+        numeric_address(reinterpret_cast<const sockaddr*>(&address), length);
+  }
+  return connection;
+}
+
+void Socket::send(std::span<const std::byte> data) {
+  while (!data.empty()) {
+    const auto sent = ::send(
+        static_cast<NativeSocket>(m_handle),
+        reinterpret_cast<const char*>(data.data()),
+        static_cast<int>(std::min<std::size_t>(data.size(), 1 << 30)),
+        kSendFlags);
+    if (sent < 0) {
+      if (interrupted(last_error())) {
+        continue;
+      }
+      fail("send");
+    }
+    data = data.subspan(static_cast<std::size_t>(sent));
+  }
+}
+
+bool Socket::receive(std::span<std::byte> data) {
+  std::size_t received = 0;
+  while (received < data.size()) {
+    const auto count = ::recv(
+        static_cast<NativeSocket>(m_handle),
+        reinterpret_cast<char*>(data.data() + received),
+        static_cast<int>(
+            std::min<std::size_t>(data.size() - received, 1 << 30)),
+        0);
+    if (count == 0) {
+      if (received == 0) {
+        return false;
+      }
+      throw std::system_error(
+          std::make_error_code(std::errc::connection_reset),
+          "connection closed in the middle of a message");
+    }
+    if (count < 0) {
+      const int error = last_error();
+      if (interrupted(error)) {
+        continue;
+      }
+#ifndef _WIN32
+      // What SO_RCVTIMEO reports once it expires.
+      if (error == EAGAIN || error == EWOULDBLOCK) {
+        throw std::system_error(std::make_error_code(std::errc::timed_out),
+                                "recv");
+      }
+#endif
+      throw std::system_error(error, error_category(), "recv");
+    }
+    received += static_cast<std::size_t>(count);
+  }
+  return true;
+}
+
+void Socket::set_receive_timeout(const std::chrono::milliseconds timeout) {
+#ifdef _WIN32
+  const DWORD value = static_cast<DWORD>(timeout.count());
+#else
+  timeval value{};
+  value.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+  value.tv_usec = static_cast<suseconds_t>(timeout.count() % 1000 * 1000);
+#endif
+  if (::setsockopt(static_cast<NativeSocket>(m_handle), SOL_SOCKET,
+                   SO_RCVTIMEO, reinterpret_cast<const char*>(&value),
+                   sizeof(value)) != 0) {
+    fail("setsockopt");
+  }
+}
+
+bool Socket::valid() const noexcept {
+  return static_cast<NativeSocket>(m_handle) != kInvalidSocket;
+}
+
+void Socket::close() noexcept {
+  if (valid()) {
+    close_socket(static_cast<NativeSocket>(m_handle));
+  }
+  m_handle = kInvalidSocket;
+  if (!m_unixPath.empty()) {
+    std::error_code ignored;
+    if (std::filesystem::is_socket(m_unixPath, ignored)) {
+      std::filesystem::remove(m_unixPath, ignored);
+    }
+    m_unixPath.clear();
+  }
+}
+
+}  // namespace mp
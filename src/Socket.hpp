@@ -0,0 +1,78 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace mp {
+
+// Blocking stream socket, TCP or Unix domain. Endpoints are written
+// "host:port" for TCP, with an empty host meaning every interface when
+// listening, and "unix:<path>" for a Unix domain socket.
+class Socket {
+ public:
+  Socket() = default;
+  ~Socket();
+
+  Socket(const Socket&) = delete;
+  Socket& operator=(const Socket&) = delete;
+  Socket(Socket&& other) noexcept;
+  Socket& operator=(Socket&& other) noexcept;
+
+  // Each throws std::invalid_argument for a malformed endpoint and
+  // std::system_error if the socket cannot be set up. A listening Unix
+  // domain socket replaces a stale socket file at its path and removes it
+  // again when closed; any other file at the path fails with
+  // std::errc::address_in_use.
+  [[nodiscard]]
+  static Socket listen(std::string_view endpoint);
+
+  [[nodiscard]]
+  static Socket connect(std::string_view endpoint);
+
+  // Next connection on a listening socket, or an invalid socket if none
+  // arrived within timeout. TCP connections send keepalive probes, so that
+  // a peer that vanished shows up as a failed receive().
+  [[nodiscard]]
+  Socket accept(std::chrono::milliseconds timeout);
+
+  // Throws std::system_error if the connection fails.
+  void send(std::span<const std::byte> data);
+
+  // Fills data completely. Returns false if the peer closed the connection
+  // before the first byte, throws std::system_error if it fails or closes
+  // in the middle, or if the timeout set below passes without data.
+  [[nodiscard]]
+  bool receive(std::span<std::byte> data);
+
+  // Longest receive() waits for the next bytes; zero waits forever.
+  void set_receive_timeout(std::chrono::milliseconds timeout);
+
+  [[nodiscard]]
+  bool valid() const noexcept;
+
+  // Address of the other end of an accepted or connected socket, for
+  // reports.
+  [[nodiscard]]
+  const std::string& peer() const noexcept {
+    return m_peer;
+  }
+
+ private:
+#ifdef _WIN32
+  std::uintptr_t m_handle{~std::uintptr_t{0}};
+#else
+  int m_handle{-1};
+#endif
+  std::string m_peer;
+  // Socket file a listening Unix domain socket removes when closed.
+  std::filesystem::path m_unixPath;
+
+  void close() noexcept;
+};
+
+}  // namespace mp
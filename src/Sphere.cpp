@@ -1,11 +1,13 @@
 #include "Sphere.hpp"
 
+#include "Instrumentation.hpp"
 #include "Ray.hpp"
 #include "glm/glm.hpp"
 
 namespace mp {
 bool Hit(const Sphere& sphere, const Ray& ray, Interval<float> interval,
          HitRecord& hitRecord) {
+  instrumentation::count_intersection_tests(1);
   const auto oc = sphere.center - ray.origin();
   const float a = dot(ray.direction(), ray.direction());
   const auto h = dot(ray.direction(), oc);
@@ -22,11 +24,35 @@ bool Hit(const Sphere& sphere, const Ray& ray, Interval<float> interval,
       return false;
     }
   }
+  instrumentation::count_intersection_hit();
   const auto sphereHit = ray.at(root);
   hitRecord.p = sphereHit;
   hitRecord.t = root;
   hitRecord.set_face_normal(ray, (sphereHit - sphere.center) / sphere.radius);
-  hitRecord.mat = sphere.mat;
+  hitRecord.material = sphere.material;
+  hitRecord.sphericalUv = true;
+  hitRecord.uvDensity = kSphereUvDensity / std::abs(sphere.radius);
   return true;
 }
+
+bool Occluded(const Sphere& sphere, const Ray& ray,
+              const Interval<float> interval) {
+  instrumentation::count_intersection_tests(1);
+  const auto oc = sphere.center - ray.origin();
+  const float a = dot(ray.direction(), ray.direction());
+  const auto h = dot(ray.direction(), oc);
+  const float c = dot(oc, oc) - sphere.radius * sphere.radius;
+  const auto desc = h * h - a * c;
+  if (desc < 0.0f) {
+    return false;
+  }
+  const auto sqrtd = std::sqrt(desc);
+  return interval.surrounds((h - sqrtd) / a) ||
+         interval.surrounds((h + sqrtd) / a);
+}
+
+AABB BoundingBox(const Sphere& sphere) {
+  const glm::vec3 radius{glm::abs(sphere.radius)};
+  return AABB{.min = sphere.center - radius, .max = sphere.center + radius};
+}
 }  // namespace mp
\ No newline at end of file
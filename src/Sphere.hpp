@@ -4,14 +4,25 @@
 
 namespace mp {
 
+// uv per unit of distance on a sphere of radius 1 under the mapping of
+// surface_uv(): u runs once around the equator, 2 pi long, v from pole to
+// pole, pi long. The geometric mean of both, 1 / (pi sqrt(2)).
+constexpr float kSphereUvDensity = 0.2250791f;
+
 struct Sphere {
   glm::vec3 center;
   float radius;
-  std::shared_ptr<Material> mat;
+  MaterialId material;
 };
 
 [[nodiscard]]
 bool Hit(const Sphere& sphere, const Ray& ray, Interval<float> interval,
          HitRecord& hitRecord);
 
+[[nodiscard]]
+bool Occluded(const Sphere& sphere, const Ray& ray, Interval<float> interval);
+
+[[nodiscard]]
+AABB BoundingBox(const Sphere& sphere);
+
 }  // namespace mp
@@ -0,0 +1,362 @@
+#include "SphereSoA.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <limits>
+
+#include "Instrumentation.hpp"
+
+#if MP_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace mp {
+namespace {
+struct SphereLanes {
+  const float* centerX;
+  const float* centerY;
+  const float* centerZ;
+  const float* radius;
+};
+
+// Returns the index of the closest sphere in [first, first + count) hit
+// inside interval and lowers interval.max to its distance, or kNoHit.
+using ClosestHitKernel = std::uint32_t (*)(const SphereLanes& lanes,
+                                           std::uint32_t first,
+                                           std::uint32_t count, const Ray& ray,
+                                           Interval<float>& interval);
+
+std::uint32_t closest_hit_scalar(const SphereLanes& lanes,
+                                 const std::uint32_t first,
+                                 const std::uint32_t count, const Ray& ray,
+                                 Interval<float>& interval) {
+  const auto& o = ray.origin();
+  const auto& d = ray.direction();
+  const float a = dot(d, d);
+  std::uint32_t closest = SphereSoA::kNoHit;
+  for (std::uint32_t i = first; i < first + count; ++i) {
+    const glm::vec3 oc{lanes.centerX[i] - o.x, lanes.centerY[i] - o.y,
+                       lanes.centerZ[i] - o.z};
+    const float h = dot(d, oc);
+    const float c = dot(oc, oc) - lanes.radius[i] * lanes.radius[i];
+    const float desc = h * h - a * c;
+    if (desc < 0.0f) {
+      continue;
+    }
+    const float sqrtd = std::sqrt(desc);
+    float root = (h - sqrtd) / a;
+    if (!interval.surrounds(root)) {
+      root = (h + sqrtd) / a;
+      if (!interval.surrounds(root)) {
+        continue;
+      }
+    }
+    interval.max = root;
+    closest = i;
+  }
+  return closest;
+}
+
+// Picks the closest of the per-lane winners, preferring the lowest index on
+// ties like the sequential loop does.
+template <std::size_t Width>
+std::uint32_t reduce_lanes(const std::array<float, Width>& t,
+                           const std::array<std::int32_t, Width>& index,
+                           Interval<float>& interval) {
+  std::uint32_t closest = SphereSoA::kNoHit;
+  for (std::size_t lane = 0; lane < Width; ++lane) {
+    if (index[lane] < 0) {
+      continue;
+    }
+    const auto candidate = static_cast<std::uint32_t>(index[lane]);
+    if (t[lane] < interval.max ||
+        (t[lane] == interval.max && candidate < closest)) {
+      interval.max = t[lane];
+      closest = candidate;
+    }
+  }
+  return closest;
+}
+
+#if MP_SIMD_X86
+std::uint32_t closest_hit_sse(const SphereLanes& lanes,
+                              const std::uint32_t first,
+                              const std::uint32_t count, const Ray& ray,
+                              Interval<float>& interval) {
+  const auto& o = ray.origin();
+  const auto& d = ray.direction();
+  const __m128 ox = _mm_set1_ps(o.x), oy = _mm_set1_ps(o.y),
+               oz = _mm_set1_ps(o.z);
+  const __m128 dx = _mm_set1_ps(d.x), dy = _mm_set1_ps(d.y),
+               dz = _mm_set1_ps(d.z);
+  const __m128 a = _mm_set1_ps(dot(d, d));
+  const __m128 tMin = _mm_set1_ps(interval.min);
+  const __m128i laneOffsets = _mm_setr_epi32(0, 1, 2, 3);
+  __m128 bestT = _mm_set1_ps(interval.max);
+  __m128i bestIndex = _mm_set1_epi32(-1);
+
+  const std::uint32_t end = first + count;
+  for (std::uint32_t i = first; i < end; i += 4) {
+    const __m128i index = _mm_add_epi32(_mm_set1_epi32(i), laneOffsets);
+    const __m128 inRange = _mm_castsi128_ps(
+        _mm_cmplt_epi32(index, _mm_set1_epi32(static_cast<int>(end))));
+    const __m128 ocx = _mm_sub_ps(_mm_loadu_ps(lanes.centerX + i), ox);
+    const __m128 ocy = _mm_sub_ps(_mm_loadu_ps(lanes.centerY + i), oy);
+    const __m128 ocz = _mm_sub_ps(_mm_loadu_ps(lanes.centerZ + i), oz);
+    const __m128 r = _mm_loadu_ps(lanes.radius + i);
+    const __m128 h = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(dx, ocx), _mm_mul_ps(dy, ocy)),
+        _mm_mul_ps(dz, ocz));
+    const __m128 c = _mm_sub_ps(
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)),
+                   _mm_mul_ps(ocz, ocz)),
+        _mm_mul_ps(r, r));
+    const __m128 desc = _mm_sub_ps(_mm_mul_ps(h, h), _mm_mul_ps(a, c));
+    const __m128 sqrtd = _mm_sqrt_ps(desc);
+    const __m128 nearRoot = _mm_div_ps(_mm_sub_ps(h, sqrtd), a);
+    const __m128 farRoot = _mm_div_ps(_mm_add_ps(h, sqrtd), a);
+    const __m128 nearValid = _mm_and_ps(_mm_cmpgt_ps(nearRoot, tMin),
+                                        _mm_cmplt_ps(nearRoot, bestT));
+    const __m128 farValid = _mm_and_ps(_mm_cmpgt_ps(farRoot, tMin),
+                                       _mm_cmplt_ps(farRoot, bestT));
+    const __m128 root = _mm_or_ps(_mm_and_ps(nearValid, nearRoot),
+                                  _mm_andnot_ps(nearValid, farRoot));
+    const __m128 hit =
+        _mm_and_ps(_mm_or_ps(nearValid, farValid), inRange);
+    bestT = _mm_or_ps(_mm_and_ps(hit, root), _mm_andnot_ps(hit, bestT));
+    const __m128i hitMask = _mm_castps_si128(hit);
+    bestIndex = _mm_or_si128(_mm_and_si128(hitMask, index),
+                             _mm_andnot_si128(hitMask, bestIndex));
+  }
+
+  std::array<float, 4> t;
+  std::array<std::int32_t, 4> indices;
+  _mm_storeu_ps(t.data(), bestT);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(indices.data()), bestIndex);
+  return reduce_lanes(t, indices, interval);
+}
+
+MP_TARGET("avx2")
+std::uint32_t closest_hit_avx2(const SphereLanes& lanes,
+                               const std::uint32_t first,
+                               const std::uint32_t count, const Ray& ray,
+                               Interval<float>& interval) {
+  const auto& o = ray.origin();
+  const auto& d = ray.direction();
+  const __m256 ox = _mm256_set1_ps(o.x), oy = _mm256_set1_ps(o.y),
+               oz = _mm256_set1_ps(o.z);
+  const __m256 dx = _mm256_set1_ps(d.x), dy = _mm256_set1_ps(d.y),
+               dz = _mm256_set1_ps(d.z);
+  const __m256 a = _mm256_set1_ps(dot(d, d));
+  const __m256 tMin = _mm256_set1_ps(interval.min);
+  const __m256i laneOffsets = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256 bestT = _mm256_set1_ps(interval.max);
+  __m256i bestIndex = _mm256_set1_epi32(-1);
+
+  const std::uint32_t end = first + count;
+  for (std::uint32_t i = first; i < end; i += 8) {
+    const __m256i index =
+        _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(i)), laneOffsets);
+    const __m256 inRange = _mm256_castsi256_ps(_mm256_cmpgt_epi32(
+        _mm256_set1_epi32(static_cast<int>(end)), index));
+    const __m256 ocx = _mm256_sub_ps(_mm256_loadu_ps(lanes.centerX + i), ox);
+    const __m256 ocy = _mm256_sub_ps(_mm256_loadu_ps(lanes.centerY + i), oy);
+    const __m256 ocz = _mm256_sub_ps(_mm256_loadu_ps(lanes.centerZ + i), oz);
+    const __m256 r = _mm256_loadu_ps(lanes.radius + i);
+    const __m256 h = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(dx, ocx), _mm256_mul_ps(dy, ocy)),
+        _mm256_mul_ps(dz, ocz));
+    const __m256 c = _mm256_sub_ps(
+        _mm256_add_ps(
+            _mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)),
+            _mm256_mul_ps(ocz, ocz)),
+        _mm256_mul_ps(r, r));
+    const __m256 desc =
+        _mm256_sub_ps(_mm256_mul_ps(h, h), _mm256_mul_ps(a, c));
+    const __m256 sqrtd = _mm256_sqrt_ps(desc);
+    const __m256 nearRoot = _mm256_div_ps(_mm256_sub_ps(h, sqrtd), a);
+    const __m256 farRoot = _mm256_div_ps(_mm256_add_ps(h, sqrtd), a);
+    const __m256 nearValid =
+        _mm256_and_ps(_mm256_cmp_ps(nearRoot, tMin, _CMP_GT_OQ),
+                      _mm256_cmp_ps(nearRoot, bestT, _CMP_LT_OQ));
+    const __m256 farValid =
+        _mm256_and_ps(_mm256_cmp_ps(farRoot, tMin, _CMP_GT_OQ),
+                      _mm256_cmp_ps(farRoot, bestT, _CMP_LT_OQ));
+    const __m256 root = _mm256_blendv_ps(farRoot, nearRoot, nearValid);
+    const __m256 hit =
+        _mm256_and_ps(_mm256_or_ps(nearValid, farValid), inRange);
+    bestT = _mm256_blendv_ps(bestT, root, hit);
+    bestIndex = _mm256_castps_si256(_mm256_blendv_ps(
+        _mm256_castsi256_ps(bestIndex), _mm256_castsi256_ps(index), hit));
+  }
+
+  std::array<float, 8> t;
+  std::array<std::int32_t, 8> indices;
+  _mm256_storeu_ps(t.data(), bestT);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(indices.data()), bestIndex);
+  return reduce_lanes(t, indices, interval);
+}
+
+MP_TARGET("avx512f")
+std::uint32_t closest_hit_avx512(const SphereLanes& lanes,
+                                 const std::uint32_t first,
+                                 const std::uint32_t count, const Ray& ray,
+                                 Interval<float>& interval) {
+  const auto& o = ray.origin();
+  const auto& d = ray.direction();
+  const __m512 ox = _mm512_set1_ps(o.x), oy = _mm512_set1_ps(o.y),
+               oz = _mm512_set1_ps(o.z);
+  const __m512 dx = _mm512_set1_ps(d.x), dy = _mm512_set1_ps(d.y),
+               dz = _mm512_set1_ps(d.z);
+  const __m512 a = _mm512_set1_ps(dot(d, d));
+  const __m512 tMin = _mm512_set1_ps(interval.min);
+  const __m512i laneOffsets = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9,
+                                                10, 11, 12, 13, 14, 15);
+  __m512 bestT = _mm512_set1_ps(interval.max);
+  __m512i bestIndex = _mm512_set1_epi32(-1);
+
+  const std::uint32_t end = first + count;
+  for (std::uint32_t i = first; i < end; i += 16) {
+    const __m512i index =
+        _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(i)), laneOffsets);
+    const __mmask16 inRange = _mm512_cmplt_epi32_mask(
+        index, _mm512_set1_epi32(static_cast<int>(end)));
+    const __m512 ocx = _mm512_sub_ps(_mm512_loadu_ps(lanes.centerX + i), ox);
+    const __m512 ocy = _mm512_sub_ps(_mm512_loadu_ps(lanes.centerY + i), oy);
+    const __m512 ocz = _mm512_sub_ps(_mm512_loadu_ps(lanes.centerZ + i), oz);
+    const __m512 r = _mm512_loadu_ps(lanes.radius + i);
+    const __m512 h = _mm512_add_ps(
+        _mm512_add_ps(_mm512_mul_ps(dx, ocx), _mm512_mul_ps(dy, ocy)),
+        _mm512_mul_ps(dz, ocz));
+    const __m512 c = _mm512_sub_ps(
+        _mm512_add_ps(
+            _mm512_add_ps(_mm512_mul_ps(ocx, ocx), _mm512_mul_ps(ocy, ocy)),
+            _mm512_mul_ps(ocz, ocz)),
+        _mm512_mul_ps(r, r));
+    const __m512 desc =
+        _mm512_sub_ps(_mm512_mul_ps(h, h), _mm512_mul_ps(a, c));
+    const __m512 sqrtd = _mm512_sqrt_ps(desc);
+    const __m512 nearRoot = _mm512_div_ps(_mm512_sub_ps(h, sqrtd), a);
+    const __m512 farRoot = _mm512_div_ps(_mm512_add_ps(h, sqrtd), a);
+    const __mmask16 nearValid =
+        _mm512_cmp_ps_mask(nearRoot, tMin, _CMP_GT_OQ) &
+        _mm512_cmp_ps_mask(nearRoot, bestT, _CMP_LT_OQ);
+    const __mmask16 farValid = _mm512_cmp_ps_mask(farRoot, tMin, _CMP_GT_OQ) &
+                               _mm512_cmp_ps_mask(farRoot, bestT, _CMP_LT_OQ);
+    const __m512 root = _mm512_mask_blend_ps(nearValid, farRoot, nearRoot);
+    const __mmask16 hit = (nearValid | farValid) & inRange;
+    bestT = _mm512_mask_blend_ps(hit, bestT, root);
+    bestIndex = _mm512_mask_blend_epi32(hit, bestIndex, index);
+  }
+
+  std::array<float, 16> t;
+  std::array<std::int32_t, 16> indices;
+  _mm512_storeu_ps(t.data(), bestT);
+  _mm512_storeu_si512(indices.data(), bestIndex);
+  return reduce_lanes(t, indices, interval);
+}
+#endif
+
+ClosestHitKernel kernel_for(const SimdLevel level) noexcept {
+#if MP_SIMD_X86
+  switch (level) {
+    case SimdLevel::AVX512:
+      return closest_hit_avx512;
+    case SimdLevel::AVX2:
+      return closest_hit_avx2;
+    case SimdLevel::SSE:
+      return closest_hit_sse;
+    case SimdLevel::Scalar:
+      break;
+  }
+#endif
+  return closest_hit_scalar;
+}
+
+std::atomic<SimdLevel> g_simdLevel{detect_simd_level()};
+std::atomic<ClosestHitKernel> g_kernel{kernel_for(g_simdLevel.load())};
+}  // namespace
+
+SphereSoA::SphereSoA(const std::span<const Sphere> spheres) {
+  const std::size_t paddedSize = spheres.size() + kPadding;
+  constexpr float kNaN = std::numeric_limits<float>::quiet_NaN();
+  m_centerX.assign(paddedSize, kNaN);
+  m_centerY.assign(paddedSize, kNaN);
+  m_centerZ.assign(paddedSize, kNaN);
+  m_radius.assign(paddedSize, kNaN);
+  m_materials.reserve(spheres.size());
+  for (std::size_t i = 0; i < spheres.size(); ++i) {
+    m_centerX[i] = spheres[i].center.x;
+    m_centerY[i] = spheres[i].center.y;
+    m_centerZ[i] = spheres[i].center.z;
+    m_radius[i] = spheres[i].radius;
+    m_materials.push_back(spheres[i].material);
+  }
+}
+
+bool SphereSoA::hit_range(const std::uint32_t first, const std::uint32_t count,
+                          const Ray& ray, Interval<float>& interval,
+                          HitRecord& hitRecord) const {
+  const SphereLanes lanes{m_centerX.data(), m_centerY.data(),
+                          m_centerZ.data(), m_radius.data()};
+  const auto closest =
+      g_kernel.load(std::memory_order_relaxed)(lanes, first, count, ray,
+                                               interval);
+  instrumentation::count_intersection_tests(count);
+  if (closest == kNoHit) {
+    return false;
+  }
+  instrumentation::count_intersection_hit();
+  const glm::vec3 center{m_centerX[closest], m_centerY[closest],
+                         m_centerZ[closest]};
+  const auto sphereHit = ray.at(interval.max);
+  hitRecord.p = sphereHit;
+  hitRecord.t = interval.max;
+  hitRecord.set_face_normal(ray, (sphereHit - center) / m_radius[closest]);
+  hitRecord.material = m_materials[closest];
+  hitRecord.sphericalUv = true;
+  hitRecord.uvDensity = kSphereUvDensity / std::abs(m_radius[closest]);
+  return true;
+}
+
+bool SphereSoA::occluded_range(const std::uint32_t first,
+                               const std::uint32_t count, const Ray& ray,
+                               Interval<float> interval) const {
+  // The closest-hit kernel is reused. A BVH leaf is one or two vector steps,
+  // so exiting early inside it would save little.
+  const SphereLanes lanes{m_centerX.data(), m_centerY.data(),
+                          m_centerZ.data(), m_radius.data()};
+  instrumentation::count_intersection_tests(count);
+  return g_kernel.load(std::memory_order_relaxed)(lanes, first, count, ray,
+                                                  interval) != kNoHit;
+}
+
+void SphereSoA::set_simd_level(const SimdLevel level) noexcept {
+  const auto supported = std::min(level, detect_simd_level());
+  g_simdLevel.store(supported);
+  g_kernel.store(kernel_for(supported));
+}
+
+SimdLevel SphereSoA::simd_level() noexcept { return g_simdLevel.load(); }
+
+bool Hit(const SphereSoA& spheres, const Ray& ray, Interval<float> interval,
+         HitRecord& hitRecord) {
+  return spheres.hit_range(0, static_cast<std::uint32_t>(spheres.size()), ray,
+                           interval, hitRecord);
+}
+
+bool Occluded(const SphereSoA& spheres, const Ray& ray,
+              const Interval<float> interval) {
+  return spheres.occluded_range(
+      0, static_cast<std::uint32_t>(spheres.size()), ray, interval);
+}
+
+AABB BoundingBox(const SphereSoA& spheres) {
+  AABB bounds;
+  for (std::size_t i = 0; i < spheres.size(); ++i) {
+    bounds.expand(BoundingBox(spheres[i]));
+  }
+  return bounds;
+}
+}  // namespace mp
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "AABB.hpp"
+#include "AlignedAllocator.hpp"
+#include "CpuFeatures.hpp"
+#include "Hittable.hpp"
+#include "Sphere.hpp"
+
+namespace mp {
+
+// Spheres in structure-of-arrays layout: centers and radii live in separate
+// cache-line aligned float arrays that are intersected 4, 8 or 16 at a time
+// depending on the instruction set detected at runtime. Material ids are kept
+// apart and only read for the closest sphere.
+//
+// The SIMD kernels evaluate the same expressions as Hit(const Sphere&, ...)
+// in the same order without fused multiply-adds, so with default compiler
+// settings the hit distance is bit-identical to the scalar path. Builds that
+// let the compiler contract the scalar code (e.g. -march=native) stay within
+// kHitEpsilon relative error; the difference only shows on grazing rays.
+class SphereSoA {
+ public:
+  static constexpr float kHitEpsilon = 1e-4f;
+  static constexpr std::uint32_t kNoHit = ~0u;
+
+  SphereSoA() = default;
+  explicit SphereSoA(std::span<const Sphere> spheres);
+
+  [[nodiscard]]
+  std::size_t size() const noexcept {
+    return m_materials.size();
+  }
+
+  [[nodiscard]]
+  Sphere operator[](const std::size_t i) const {
+    return Sphere{{m_centerX[i], m_centerY[i], m_centerZ[i]},
+                  m_radius[i],
+                  m_materials[i]};
+  }
+
+  // Closest hit among spheres [first, first + count). Shrinks interval.max
+  // and fills hitRecord when one is found.
+  bool hit_range(std::uint32_t first, std::uint32_t count, const Ray& ray,
+                 Interval<float>& interval, HitRecord& hitRecord) const;
+
+  // Whether any sphere in [first, first + count) is hit inside interval.
+  [[nodiscard]]
+  bool occluded_range(std::uint32_t first, std::uint32_t count, const Ray& ray,
+                      Interval<float> interval) const;
+
+  // Overrides the runtime-detected kernel for all sphere sets, e.g. to
+  // compare against the scalar path. Levels the CPU lacks are clamped.
+  static void set_simd_level(SimdLevel level) noexcept;
+
+  [[nodiscard]]
+  static SimdLevel simd_level() noexcept;
+
+ private:
+  // Widest kernel step. The arrays carry this many NaN entries past the end
+  // so that a vector load starting at the last sphere stays in bounds; NaN
+  // never compares as a hit.
+  static constexpr std::size_t kPadding = 16;
+
+  AlignedVector<float> m_centerX;
+  AlignedVector<float> m_centerY;
+  AlignedVector<float> m_centerZ;
+  AlignedVector<float> m_radius;
+  std::vector<MaterialId> m_materials;
+};
+
+[[nodiscard]]
+bool Hit(const SphereSoA& spheres, const Ray& ray, Interval<float> interval,
+         HitRecord& hitRecord);
+
+[[nodiscard]]
+bool Occluded(const SphereSoA& spheres, const Ray& ray,
+              Interval<float> interval);
+
+[[nodiscard]]
+AABB BoundingBox(const SphereSoA& spheres);
+
+}  // namespace mp
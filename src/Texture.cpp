@@ -0,0 +1,170 @@
+#include "Texture.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <utility>
+
+namespace mp {
+namespace {
+
+// Gradient noise of Perlin (SIGGRAPH 1985) with random unit gradients on
+// the integer lattice, as in "Ray Tracing: The Next Week". The tables are
+// drawn from a fixed seed without the standard distributions, whose
+// results differ between standard libraries, so every build renders the
+// same marble.
+class Perlin {
+ public:
+  Perlin() {
+    std::mt19937 random(kSeed);
+    const auto uniform = [&random] {
+      return static_cast<float>(random()) / 4294967296.0f * 2.0f - 1.0f;
+    };
+    for (auto& gradient : m_gradients) {
+      do {
+        gradient = {uniform(), uniform(), uniform()};
+      } while (glm::dot(gradient, gradient) > 1.0f ||
+               glm::dot(gradient, gradient) < 1e-4f);
+      gradient = glm::normalize(gradient);
+    }
+    for (auto& permutation : m_permutations) {
+      for (std::size_t i = 0; i < kPoints; ++i) {
+        permutation[i] = static_cast<std::uint8_t>(i);
+      }
+      for (std::size_t i = kPoints - 1; i > 0; --i) {
+        std::swap(permutation[i], permutation[random() % (i + 1)]);
+      }
+    }
+  }
+
+  // In about [-1, 1], 0 on the lattice points.
+  [[nodiscard]]
+  float noise(const glm::vec3& p) const {
+    const auto cell = glm::floor(p);
+    const auto f = p - cell;
+    const auto i = static_cast<int>(cell.x);
+    const auto j = static_cast<int>(cell.y);
+    const auto k = static_cast<int>(cell.z);
+    // Hermite smoothing keeps the noise continuous in its derivative
+    // across cells.
+    const auto s = f * f * (3.0f - 2.0f * f);
+    float sum = 0.0f;
+    for (int di = 0; di < 2; ++di) {
+      for (int dj = 0; dj < 2; ++dj) {
+        for (int dk = 0; dk < 2; ++dk) {
+          const auto& gradient =
+              m_gradients[m_permutations[0][(i + di) & kMask] ^
+                          m_permutations[1][(j + dj) & kMask] ^
+                          m_permutations[2][(k + dk) & kMask]];
+          const glm::vec3 corner{di, dj, dk};
+          const auto weight = corner * s + (1.0f - corner) * (1.0f - s);
+          sum += weight.x * weight.y * weight.z *
+                 glm::dot(gradient, f - corner);
+        }
+      }
+    }
+    return sum;
+  }
+
+  // Sum of octaves of noise, each of twice the frequency and half the
+  // amplitude of the one before.
+  [[nodiscard]]
+  float turbulence(glm::vec3 p) const {
+    constexpr int kOctaves = 7;
+    float sum = 0.0f;
+    float weight = 1.0f;
+    for (int octave = 0; octave < kOctaves; ++octave) {
+      sum += weight * noise(p);
+      weight *= 0.5f;
+      p *= 2.0f;
+    }
+    return std::abs(sum);
+  }
+
+ private:
+  static constexpr std::uint32_t kSeed = 0x5eed;
+  static constexpr std::size_t kPoints = 256;
+  static constexpr int kMask = static_cast<int>(kPoints) - 1;
+
+  std::array<glm::vec3, kPoints> m_gradients;
+  std::array<std::array<std::uint8_t, kPoints>, 3> m_permutations;
+};
+
+[[nodiscard]]
+const Perlin& perlin() {
+  static const Perlin noise;
+  return noise;
+}
+
+}  // namespace
+
+glm::vec3 CheckerTexture::value(const HitRecord& rec) const {
+  const auto cell = glm::floor(rec.p * m_inverseScale);
+  const auto parity = static_cast<std::int64_t>(cell.x) +
+                      static_cast<std::int64_t>(cell.y) +
+                      static_cast<std::int64_t>(cell.z);
+  return (parity & 1) == 0 ? m_even : m_odd;
+}
+
+glm::vec3 NoiseTexture::value(const HitRecord& rec) const {
+  return m_color * 0.5f *
+         (1.0f + std::sin(m_frequency * rec.p.z +
+                          10.0f * perlin().turbulence(rec.p)));
+}
+
+glm::vec3 ImageTexture::value(const HitRecord& rec) const {
+  const auto uv = surface_uv(rec);
+  if (!std::isfinite(uv.x) || !std::isfinite(uv.y)) {
+    return glm::vec3{0.0f};
+  }
+  const auto levels = m_image->levels();
+  // Texels of the finest level across the footprint: each level up halves
+  // them.
+  const float texels =
+      rec.footprint * rec.uvDensity *
+      static_cast<float>(std::max(levels[0].width, levels[0].height));
+  const float lod =
+      std::min(std::log2(std::max(texels, 1.0f)),
+               static_cast<float>(levels.size() - 1));
+  const auto level = static_cast<std::uint32_t>(lod);
+  const float blend = lod - static_cast<float>(level);
+  const auto repeated = uv - glm::floor(uv);
+  const auto color = bilinear(level, repeated);
+  if (blend <= 0.0f) {
+    return color;
+  }
+  return glm::mix(color, bilinear(level + 1, repeated), blend);
+}
+
+glm::vec3 ImageTexture::bilinear(const std::uint32_t level,
+                                 const glm::vec2& uv) const {
+  const auto& size = m_image->levels()[level];
+  // Texel centers are at half-integer positions, and row 0 is the top of
+  // the image. uv is in [0, 1), so the texels left of and above the
+  // position are at most one outside the level and wrap around.
+  const float x = uv.x * static_cast<float>(size.width) - 0.5f;
+  const float y = (1.0f - uv.y) * static_cast<float>(size.height) - 0.5f;
+  const float x0 = std::floor(x);
+  const float y0 = std::floor(y);
+  const float fx = x - x0;
+  const float fy = y - y0;
+  const auto wrap = [](const float c, const std::uint32_t extent) {
+    return c < 0.0f ? extent - 1
+                    : std::min(static_cast<std::uint32_t>(c), extent - 1);
+  };
+  const auto left = wrap(x0, size.width);
+  const auto top = wrap(y0, size.height);
+  const auto right = left + 1 == size.width ? 0 : left + 1;
+  const auto bottom = top + 1 == size.height ? 0 : top + 1;
+
+  auto& cache = texture_cache();
+  const auto texel = [&](const std::uint32_t tx, const std::uint32_t ty) {
+    return decode_texel(cache.texel(*m_image, level, tx, ty));
+  };
+  return glm::mix(glm::mix(texel(left, top), texel(right, top), fx),
+                  glm::mix(texel(left, bottom), texel(right, bottom), fx),
+                  fy);
+}
+
+}  // namespace mp
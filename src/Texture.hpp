@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <variant>
+
+#include "Hittable.hpp"
+#include "TextureCache.hpp"
+#include "Utility.hpp"
+#include "glm/glm.hpp"
+
+namespace mp {
+
+// Textures give material parameters that vary over a surface. They are
+// looked up with the HitRecord of the shading point: the procedural ones
+// by its position, image textures by its uv coordinates and footprint.
+
+// Index into the textures of a scene description.
+using TextureId = std::uint32_t;
+constexpr TextureId kNoTexture = ~TextureId{0};
+
+// Texture coordinates of a hit: those of its primitive, or on spheres the
+// longitude and latitude of the normal, u from -x around +y and v from the
+// bottom pole up.
+[[nodiscard]]
+inline glm::vec2 surface_uv(const HitRecord& rec) {
+  if (!rec.sphericalUv) {
+    return rec.uv;
+  }
+  const auto outward = rec.frontFace ? rec.normal : -rec.normal;
+  return {(std::atan2(-outward.z, outward.x) + pi_f) / (2.0f * pi_f),
+          std::acos(std::clamp(-outward.y, -1.0f, 1.0f)) / pi_f};
+}
+
+// Solid checkerboard of cubes with sides of scale, filling space.
+class CheckerTexture final {
+ public:
+  CheckerTexture(const glm::vec3& even, const glm::vec3& odd,
+                 const float scale)
+      : m_even(even), m_odd(odd), m_inverseScale(1.0f / scale) {}
+
+  [[nodiscard]]
+  glm::vec3 value(const HitRecord& rec) const;
+
+ private:
+  glm::vec3 m_even;
+  glm::vec3 m_odd;
+  float m_inverseScale;
+};
+
+// Marble: color in bands along z, frequency of them per unit, bent by
+// Perlin turbulence.
+class NoiseTexture final {
+ public:
+  NoiseTexture(const glm::vec3& color, const float frequency)
+      : m_color(color), m_frequency(frequency) {}
+
+  [[nodiscard]]
+  glm::vec3 value(const HitRecord& rec) const;
+
+ private:
+  glm::vec3 m_color;
+  float m_frequency;
+};
+
+// Texture file read through texture_cache(), repeated outside of [0, 1).
+// Texels are interpolated bilinearly, and mip levels linearly between the
+// two whose texels are closest in size to the footprint of the hit, so
+// that distant and secondary hits read few, small tiles.
+class ImageTexture final {
+ public:
+  explicit ImageTexture(std::shared_ptr<const TextureImage> image)
+      : m_image(std::move(image)) {}
+
+  [[nodiscard]]
+  glm::vec3 value(const HitRecord& rec) const;
+
+  [[nodiscard]]
+  const TextureImage& image() const noexcept {
+    return *m_image;
+  }
+
+ private:
+  [[nodiscard]]
+  glm::vec3 bilinear(std::uint32_t level, const glm::vec2& uv) const;
+
+  std::shared_ptr<const TextureImage> m_image;
+};
+
+// Alternatives are listed in TextureType order.
+using Texture = std::variant<CheckerTexture, NoiseTexture, ImageTexture>;
+
+enum class TextureType : std::uint8_t { Checker, Noise, Image, Count };
+
+static_assert(std::variant_size_v<Texture> ==
+              static_cast<std::size_t>(TextureType::Count));
+
+[[nodiscard]]
+inline glm::vec3 Value(const Texture& texture, const HitRecord& rec) {
+  return std::visit([&](const auto& t) { return t.value(rec); }, texture);
+}
+
+}  // namespace mp
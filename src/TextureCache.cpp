@@ -0,0 +1,473 @@
+#include "TextureCache.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include "MappedFile.hpp"
+
+namespace mp {
+namespace {
+
+constexpr std::array<char, 8> kTextureMagic{'M', 'P', 'T', 'E',
+                                            'X', 'T', 'U', 'R'};
+constexpr std::uint32_t kTextureVersion = 1;
+
+// Tiles start at multiples of their size, so every tile read is one
+// aligned page of the file.
+constexpr std::uint64_t kTileBytes = sizeof(TextureTile);
+
+// A level per halving of the largest side, down to 1x1.
+constexpr std::uint32_t kMaxLevels = std::bit_width(kMaxTextureSize);
+
+// Followed by levelCount TextureLevelRecords. Texels are stored in native
+// byte order, like the arrays of compiled scenes.
+struct TextureFileHeader {
+  std::array<char, 8> magic;
+  std::uint32_t version;
+  std::uint32_t tileSize;
+  std::uint32_t levelCount;
+  std::uint32_t reserved;
+};
+
+struct TextureLevelRecord {
+  std::uint32_t width;
+  std::uint32_t height;
+  std::uint64_t offset;
+};
+
+static_assert(std::is_trivially_copyable_v<TextureFileHeader>);
+static_assert(sizeof(TextureFileHeader) == 24);
+static_assert(sizeof(TextureLevelRecord) == 16);
+static_assert(kTileBytes == 4096);
+
+// The few tiles of any cache a thread used last, direct mapped by the
+// parity of tile column, row and level: the up to four tiles of a bilinear
+// lookup, and those of the next level it may be blended with, never take
+// each other's slot. Tiles are never changed once read and keys are never
+// reused, so an entry stays correct for as long as it is kept.
+constexpr std::size_t kRecentTiles = 8;
+static_assert(kRecentTiles == 8, "a slot per parity of column, row, level");
+
+struct RecentTile {
+  std::uint64_t key{~std::uint64_t{0}};
+  std::shared_ptr<const TextureTile> tile;
+};
+
+thread_local std::array<RecentTile, kRecentTiles> t_recentTiles;
+
+std::atomic<std::uint32_t> g_nextImageId{0};
+
+constexpr std::uint64_t align_up(const std::uint64_t offset) noexcept {
+  return (offset + kTileBytes - 1) / kTileBytes * kTileBytes;
+}
+
+[[nodiscard]]
+constexpr std::uint32_t tile_count(const std::uint32_t texels) noexcept {
+  return (texels + kTextureTileSize - 1) / kTextureTileSize;
+}
+
+// Image id, level and tile index within the level; a level has at most
+// 2^22 tiles.
+[[nodiscard]]
+constexpr std::uint64_t tile_key(const std::uint32_t image,
+                                 const std::uint32_t level,
+                                 const std::uint32_t tile) noexcept {
+  return std::uint64_t{image} << 32 | std::uint64_t{level} << 24 | tile;
+}
+
+[[nodiscard]]
+std::size_t slot_of(const std::uint64_t key, const std::size_t slots) {
+  return static_cast<std::size_t>((key * 0x9e3779b97f4a7c15ull) >> 32) %
+         slots;
+}
+
+[[nodiscard]]
+std::uint32_t encode_channel(const float linear) noexcept {
+  return static_cast<std::uint32_t>(
+      std::lround(std::sqrt(std::clamp(linear, 0.0f, 1.0f)) * 255.0f));
+}
+
+[[nodiscard]]
+std::uint32_t encode_texel(const glm::vec3& linear) noexcept {
+  return encode_channel(linear.r) | encode_channel(linear.g) << 8 |
+         encode_channel(linear.b) << 16 | 0xffu << 24;
+}
+
+struct TexelLevel {
+  std::uint32_t width;
+  std::uint32_t height;
+  // Packed texels, row by row.
+  std::vector<std::uint32_t> texels;
+};
+
+[[nodiscard]]
+TexelLevel read_ppm(const std::filesystem::path& path) {
+  const MappedFile file(path);
+  const std::string_view text(reinterpret_cast<const char*>(file.data().data()),
+                              file.size());
+  const auto fail = [&path](const std::string_view message) {
+    throw std::runtime_error(std::format("{}: {}", path.string(), message));
+  };
+
+  // Header fields are separated by whitespace and comments, the texels
+  // start after the single whitespace character that ends the last one.
+  std::size_t position = 0;
+  const auto field = [&] {
+    for (;;) {
+      while (position < text.size() &&
+             std::isspace(static_cast<unsigned char>(text[position]))) {
+        ++position;
+      }
+      if (position < text.size() && text[position] == '#') {
+        position = std::min(text.find('\n', position), text.size());
+        continue;
+      }
+      break;
+    }
+    const auto start = position;
+    while (position < text.size() &&
+           !std::isspace(static_cast<unsigned char>(text[position]))) {
+      ++position;
+    }
+    return text.substr(start, position - start);
+  };
+  const auto number = [&] {
+    const auto token = field();
+    std::uint32_t value = 0;
+    const auto [end, error] =
+        std::from_chars(token.data(), token.data() + token.size(), value);
+    if (token.empty() || error != std::errc{} ||
+        end != token.data() + token.size()) {
+      fail(std::format("'{}' is not a valid PPM header value", token));
+    }
+    return value;
+  };
+
+  if (field() != "P6") {
+    fail("not a binary PPM (P6) image");
+  }
+  TexelLevel level{.width = number(), .height = number(), .texels = {}};
+  const auto maxValue = number();
+  ++position;
+  if (level.width == 0 || level.height == 0 ||
+      level.width > kMaxTextureSize || level.height > kMaxTextureSize) {
+    fail(std::format("{}x{} is not a texture size from 1x1 to {}x{}",
+                     level.width, level.height, kMaxTextureSize,
+                     kMaxTextureSize));
+  }
+  if (maxValue == 0 || maxValue > 255) {
+    fail("only PPM images with 8-bit channels are supported");
+  }
+  const auto texelCount = std::size_t{level.width} * level.height;
+  if (position > text.size() || (text.size() - position) / 3 < texelCount) {
+    fail("image data is truncated");
+  }
+
+  level.texels.resize(texelCount);
+  const auto* data =
+      reinterpret_cast<const unsigned char*>(text.data() + position);
+  for (std::size_t i = 0; i < texelCount; ++i) {
+    const auto channel = [&](const std::size_t c) {
+      return (std::uint32_t{data[3 * i + c]} * 255 + maxValue / 2) / maxValue;
+    };
+    level.texels[i] =
+        channel(0) | channel(1) << 8 | channel(2) << 16 | 0xffu << 24;
+  }
+  return level;
+}
+
+// Next coarser level: every texel averages the 2x2 texels it covers. An odd
+// side drops its last texel, a side of one repeats it.
+[[nodiscard]]
+TexelLevel downsample(const TexelLevel& level) {
+  TexelLevel coarser{.width = std::max(1u, level.width / 2),
+                     .height = std::max(1u, level.height / 2),
+                     .texels = {}};
+  coarser.texels.resize(std::size_t{coarser.width} * coarser.height);
+  const auto at = [&level](const std::uint32_t x, const std::uint32_t y) {
+    return decode_texel(
+        level.texels[std::size_t{std::min(y, level.height - 1)} *
+                         level.width +
+                     std::min(x, level.width - 1)]);
+  };
+  for (std::uint32_t y = 0; y < coarser.height; ++y) {
+    for (std::uint32_t x = 0; x < coarser.width; ++x) {
+      const auto sum = at(2 * x, 2 * y) + at(2 * x + 1, 2 * y) +
+                       at(2 * x, 2 * y + 1) + at(2 * x + 1, 2 * y + 1);
+      coarser.texels[std::size_t{y} * coarser.width + x] =
+          encode_texel(0.25f * sum);
+    }
+  }
+  return coarser;
+}
+
+}  // namespace
+
+bool bake_texture(const std::filesystem::path& image,
+                  const std::filesystem::path& output) {
+  std::vector<TexelLevel> levels;
+  levels.push_back(read_ppm(image));
+  while (levels.back().width > 1 || levels.back().height > 1) {
+    levels.push_back(downsample(levels.back()));
+  }
+
+  const TextureFileHeader header{
+      .magic = kTextureMagic,
+      .version = kTextureVersion,
+      .tileSize = kTextureTileSize,
+      .levelCount = static_cast<std::uint32_t>(levels.size()),
+      .reserved = 0,
+  };
+  std::vector<TextureLevelRecord> records;
+  auto offset =
+      align_up(sizeof(header) + levels.size() * sizeof(TextureLevelRecord));
+  for (const auto& level : levels) {
+    records.push_back(
+        {.width = level.width, .height = level.height, .offset = offset});
+    offset += std::uint64_t{tile_count(level.width)} *
+              tile_count(level.height) * kTileBytes;
+  }
+
+  std::ofstream file(output, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(records.data()),
+             static_cast<std::streamsize>(records.size() *
+                                          sizeof(TextureLevelRecord)));
+  {
+    constexpr std::array<char, kTileBytes> kZeros{};
+    const auto position = static_cast<std::uint64_t>(file.tellp());
+    file.write(kZeros.data(),
+               static_cast<std::streamsize>(records.front().offset -
+                                            position));
+  }
+  // Texels past the edge of the level are never read and stay zero.
+  TextureTile tile;
+  for (const auto& level : levels) {
+    for (std::uint32_t tileY = 0; tileY < tile_count(level.height);
+         ++tileY) {
+      for (std::uint32_t tileX = 0; tileX < tile_count(level.width);
+           ++tileX) {
+        tile.texels.fill(0);
+        const auto x0 = tileX * kTextureTileSize;
+        const auto y0 = tileY * kTextureTileSize;
+        for (std::uint32_t y = 0;
+             y < std::min(kTextureTileSize, level.height - y0); ++y) {
+          for (std::uint32_t x = 0;
+               x < std::min(kTextureTileSize, level.width - x0); ++x) {
+            tile.texels[morton_index(x, y)] =
+                level.texels[std::size_t{y0 + y} * level.width + x0 + x];
+          }
+        }
+        file.write(reinterpret_cast<const char*>(tile.texels.data()),
+                   sizeof(tile.texels));
+      }
+    }
+  }
+  file.close();
+  return file.good();
+}
+
+TextureImage::TextureImage(std::filesystem::path path)
+    : m_path(std::move(path)),
+      m_id(g_nextImageId.fetch_add(1, std::memory_order_relaxed)) {
+  const auto fail = [this](const std::string_view message) {
+    throw std::runtime_error(
+        std::format("{}: {}", m_path.string(), message));
+  };
+  std::error_code error;
+  const auto fileSize = std::filesystem::file_size(m_path, error);
+  std::ifstream file(m_path, std::ios::binary);
+  TextureFileHeader header;
+  if (error || !file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+    fail("cannot read texture file");
+  }
+  if (header.magic != kTextureMagic || header.version != kTextureVersion ||
+      header.tileSize != kTextureTileSize || header.levelCount == 0 ||
+      header.levelCount > kMaxLevels) {
+    fail(std::format("not a version {} texture file", kTextureVersion));
+  }
+  std::vector<TextureLevelRecord> records(header.levelCount);
+  if (!file.read(reinterpret_cast<char*>(records.data()),
+                 static_cast<std::streamsize>(records.size() *
+                                              sizeof(TextureLevelRecord)))) {
+    fail("texture file is truncated");
+  }
+
+  // Each level halves the one before, down to 1x1, and its tiles must lie
+  // inside the file.
+  for (std::size_t i = 0; i < records.size(); ++i) {
+    const auto& record = records[i];
+    const bool sizeMatches =
+        i == 0 ? record.width >= 1 && record.height >= 1 &&
+                     record.width <= kMaxTextureSize &&
+                     record.height <= kMaxTextureSize
+               : record.width == std::max(1u, m_levels.back().width / 2) &&
+                     record.height == std::max(1u, m_levels.back().height / 2);
+    const Level level{.width = record.width,
+                      .height = record.height,
+                      .tilesX = tile_count(record.width),
+                      .tilesY = tile_count(record.height),
+                      .offset = record.offset};
+    const auto bytes = std::uint64_t{level.tilesX} * level.tilesY * kTileBytes;
+    if (!sizeMatches || level.offset % kTileBytes != 0 ||
+        level.offset > fileSize || bytes > fileSize - level.offset) {
+      fail("texture file is truncated or corrupt");
+    }
+    m_levels.push_back(level);
+  }
+  if (m_levels.back().width != 1 || m_levels.back().height != 1) {
+    fail("texture file lacks its smallest levels");
+  }
+}
+
+bool TextureImage::read_tile(const std::uint32_t level,
+                             const std::uint32_t tileX,
+                             const std::uint32_t tileY,
+                             TextureTile& tile) const {
+  const auto& levelInfo = m_levels[level];
+  const auto offset =
+      levelInfo.offset +
+      (std::uint64_t{tileY} * levelInfo.tilesX + tileX) * kTileBytes;
+  std::scoped_lock lock(m_fileMutex);
+  if (!m_file.is_open()) {
+    m_file.open(m_path, std::ios::binary);
+  }
+  m_file.clear();
+  m_file.seekg(static_cast<std::streamoff>(offset));
+  m_file.read(reinterpret_cast<char*>(tile.texels.data()),
+              sizeof(tile.texels));
+  return static_cast<bool>(m_file);
+}
+
+TextureCache::TextureCache(const std::size_t capacity)
+    : m_capacity(capacity) {}
+
+void TextureCache::set_capacity(const std::size_t capacity) {
+  m_capacity.store(capacity, std::memory_order_relaxed);
+  for (auto& shard : m_shards) {
+    std::scoped_lock lock(shard.mutex);
+    evict(shard);
+  }
+}
+
+std::uint32_t TextureCache::texel(const TextureImage& image,
+                                  const std::uint32_t level,
+                                  const std::uint32_t x,
+                                  const std::uint32_t y) {
+  const auto tileX = x / kTextureTileSize;
+  const auto tileY = y / kTextureTileSize;
+  const auto key = tile_key(image.id(), level,
+                            tileY * image.levels()[level].tilesX + tileX);
+  auto& recent =
+      t_recentTiles[(tileX & 1) | (tileY & 1) << 1 | (level & 1) << 2];
+  if (recent.key != key) {
+    recent.tile = tile(image, level, tileX, tileY, key);
+    recent.key = key;
+  }
+  return recent.tile->texels[morton_index(x % kTextureTileSize,
+                                          y % kTextureTileSize)];
+}
+
+std::shared_ptr<const TextureTile> TextureCache::tile(
+    const TextureImage& image, const std::uint32_t level,
+    const std::uint32_t tileX, const std::uint32_t tileY,
+    const std::uint64_t key) {
+  auto& shard = m_shards[slot_of(key, kShardCount)];
+  {
+    std::scoped_lock lock(shard.mutex);
+    ++shard.requests;
+    if (const auto entry = shard.entries.find(key);
+        entry != shard.entries.end()) {
+      shard.lru.splice(shard.lru.begin(), shard.lru, entry->second);
+      return entry->second->tile;
+    }
+    ++shard.misses;
+  }
+
+  // Read with no lock held, so that the rest of the shard stays available
+  // meanwhile.
+  auto loaded = std::make_shared<TextureTile>();
+  const bool read = image.read_tile(level, tileX, tileY, *loaded);
+  if (!read) {
+    loaded->texels.fill(0);
+  }
+
+  std::scoped_lock lock(shard.mutex);
+  shard.readErrors += read ? 0 : 1;
+  // Another thread may have read the same tile in the meantime.
+  if (const auto entry = shard.entries.find(key);
+      entry != shard.entries.end()) {
+    shard.lru.splice(shard.lru.begin(), shard.lru, entry->second);
+    return entry->second->tile;
+  }
+  shard.lru.push_front({key, loaded});
+  shard.entries.emplace(key, shard.lru.begin());
+  shard.bytes += sizeof(TextureTile);
+  m_residentBytes.fetch_add(sizeof(TextureTile), std::memory_order_relaxed);
+  evict(shard);
+  const auto resident = m_residentBytes.load(std::memory_order_relaxed);
+  auto peak = m_peakBytes.load(std::memory_order_relaxed);
+  while (resident > peak &&
+         !m_peakBytes.compare_exchange_weak(peak, resident,
+                                            std::memory_order_relaxed)) {
+  }
+  // The caller gets the tile even if it did not fit and was evicted again.
+  return loaded;
+}
+
+void TextureCache::evict(Shard& shard) {
+  const auto budget = capacity() / kShardCount;
+  while (shard.bytes > budget && !shard.lru.empty()) {
+    shard.entries.erase(shard.lru.back().key);
+    shard.lru.pop_back();
+    shard.bytes -= sizeof(TextureTile);
+    m_residentBytes.fetch_sub(sizeof(TextureTile), std::memory_order_relaxed);
+    ++shard.evictions;
+  }
+}
+
+TextureCacheReport TextureCache::report() const {
+  TextureCacheReport report{.capacity = capacity()};
+  for (const auto& shard : m_shards) {
+    std::scoped_lock lock(shard.mutex);
+    report.requests += shard.requests;
+    report.misses += shard.misses;
+    report.evictions += shard.evictions;
+    report.readErrors += shard.readErrors;
+  }
+  report.residentBytes = m_residentBytes.load(std::memory_order_relaxed);
+  report.peakBytes = m_peakBytes.load(std::memory_order_relaxed);
+  return report;
+}
+
+void TextureCache::clear() {
+  for (auto& shard : m_shards) {
+    std::scoped_lock lock(shard.mutex);
+    m_residentBytes.fetch_sub(shard.bytes, std::memory_order_relaxed);
+    shard.lru.clear();
+    shard.entries.clear();
+    shard.bytes = 0;
+    shard.requests = 0;
+    shard.misses = 0;
+    shard.evictions = 0;
+    shard.readErrors = 0;
+  }
+  m_peakBytes.store(m_residentBytes.load(std::memory_order_relaxed),
+                    std::memory_order_relaxed);
+}
+
+TextureCache& texture_cache() {
+  static TextureCache cache;
+  return cache;
+}
+
+}  // namespace mp
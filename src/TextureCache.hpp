@@ -0,0 +1,245 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+namespace mp {
+
+// Image textures are stored as square tiles of 8-bit RGBA texels, encoded
+// with the gamma 2 the renderer writes its images with. A tile is 4 KiB,
+// one page, and the unit the texture cache reads, keeps and evicts.
+constexpr std::uint32_t kTextureTileSize = 32;
+constexpr std::size_t kTextureTileTexels =
+    std::size_t{kTextureTileSize} * kTextureTileSize;
+
+// Largest width or height of a texture.
+constexpr std::uint32_t kMaxTextureSize = 1u << 16;
+
+// Texels of one tile in Morton order, see morton_index(): the texels of a
+// bilinear lookup and of nearby lookups share cache lines in both
+// directions, not only along rows.
+struct TextureTile {
+  std::array<std::uint32_t, kTextureTileTexels> texels;
+};
+
+// Position of texel (x, y) of a tile in TextureTile::texels, the bits of x
+// and y interleaved.
+[[nodiscard]]
+constexpr std::uint32_t morton_index(const std::uint32_t x,
+                                     const std::uint32_t y) noexcept {
+  static_assert(kTextureTileSize == 32, "spreads five bits per coordinate");
+  const auto spread = [](std::uint32_t bits) {
+    bits &= 0x1f;
+    bits = (bits | (bits << 4)) & 0x10f;
+    bits = (bits | (bits << 2)) & 0x133;
+    return (bits | (bits << 1)) & 0x155;
+  };
+  return spread(x) | (spread(y) << 1);
+}
+
+// Linear value of each 8-bit channel value.
+inline constexpr auto kTexelDecode = [] {
+  std::array<float, 256> table{};
+  for (std::size_t i = 0; i < table.size(); ++i) {
+    const float value = static_cast<float>(i) / 255.0f;
+    table[i] = value * value;
+  }
+  return table;
+}();
+
+// Linear color of a texel as packed by bake_texture(), red in the low byte.
+[[nodiscard]]
+inline glm::vec3 decode_texel(const std::uint32_t texel) noexcept {
+  return {kTexelDecode[texel & 0xff], kTexelDecode[(texel >> 8) & 0xff],
+          kTexelDecode[(texel >> 16) & 0xff]};
+}
+
+// Converts a binary PPM image (P6, at most 8 bits per channel) to the
+// texture file format read by TextureImage: a header and level table,
+// followed by every mip level down to 1x1 as a grid of tiles, row by row.
+// Levels are box filtered in linear space. Throws std::system_error if the
+// image cannot be mapped and std::runtime_error if it is not a PPM this
+// reads or is larger than kMaxTextureSize; returns false if output cannot
+// be written.
+[[nodiscard]]
+bool bake_texture(const std::filesystem::path& image,
+                  const std::filesystem::path& output);
+
+// Texture file written by bake_texture(). Only the header is read when the
+// image is opened; tiles are read by TextureCache when a lookup first
+// needs them, so an image costs memory for the tiles in use only.
+class TextureImage {
+ public:
+  struct Level {
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t tilesX;
+    std::uint32_t tilesY;
+    // Of the first tile in the file.
+    std::uint64_t offset;
+  };
+
+  // Throws std::runtime_error if path cannot be read or is not a texture
+  // file of this version.
+  explicit TextureImage(std::filesystem::path path);
+
+  TextureImage(const TextureImage&) = delete;
+  TextureImage& operator=(const TextureImage&) = delete;
+
+  // Unique within the process, never reused; names the image's tiles in
+  // the cache.
+  [[nodiscard]]
+  std::uint32_t id() const noexcept {
+    return m_id;
+  }
+
+  // Finest first.
+  [[nodiscard]]
+  std::span<const Level> levels() const noexcept {
+    return m_levels;
+  }
+
+  [[nodiscard]]
+  const std::filesystem::path& path() const noexcept {
+    return m_path;
+  }
+
+  // Reads a tile from the file, false if that fails. Thread safe.
+  [[nodiscard]]
+  bool read_tile(std::uint32_t level, std::uint32_t tileX,
+                 std::uint32_t tileY, TextureTile& tile) const;
+
+ private:
+  std::filesystem::path m_path;
+  std::vector<Level> m_levels;
+  std::uint32_t m_id;
+  mutable std::mutex m_fileMutex;
+  // Opened by the first read.
+  mutable std::ifstream m_file;
+};
+
+struct TextureCacheReport {
+  // Tiles asked for from the shared cache. The few tiles each thread used
+  // last are kept aside and answer most lookups without counting here.
+  std::uint64_t requests{};
+  // Requests that read the tile from its file.
+  std::uint64_t misses{};
+  std::uint64_t evictions{};
+  // Tiles that could not be read and were used as black.
+  std::uint64_t readErrors{};
+  std::size_t residentBytes{};
+  std::size_t peakBytes{};
+  std::size_t capacity{};
+};
+
+inline std::ostream& operator<<(std::ostream& os,
+                                const TextureCacheReport& report) {
+  constexpr double kMiB = 1024.0 * 1024.0;
+  os << std::format(
+      "texture cache: {} tile requests, {} misses ({:.1f}%), {} evicted, "
+      "{:.1f} MiB resident, peak {:.1f} of {:.1f} MiB",
+      report.requests, report.misses,
+      report.requests == 0 ? 0.0
+                           : 100.0 * static_cast<double>(report.misses) /
+                                 static_cast<double>(report.requests),
+      report.evictions, static_cast<double>(report.residentBytes) / kMiB,
+      static_cast<double>(report.peakBytes) / kMiB,
+      static_cast<double>(report.capacity) / kMiB);
+  if (report.readErrors != 0) {
+    os << std::format(", {} tiles unreadable", report.readErrors);
+  }
+  return os << '\n';
+}
+
+// Tiles of texture images in memory, bounded by a capacity in bytes and
+// evicted least recently used first. Lookups from any number of threads go
+// through one of several independently locked shards, picked by tile, and
+// tiles are read with no lock held. On top of that every thread keeps the
+// few tiles it used last, a handful of pages per thread beyond the
+// capacity, which answer the lookups of coherent rays without locking.
+class TextureCache {
+ public:
+  static constexpr std::size_t kDefaultCapacity = std::size_t{256} << 20;
+
+  explicit TextureCache(std::size_t capacity = kDefaultCapacity);
+
+  TextureCache(const TextureCache&) = delete;
+  TextureCache& operator=(const TextureCache&) = delete;
+
+  // Evicts down to capacity right away if the cache holds more.
+  void set_capacity(std::size_t capacity);
+
+  [[nodiscard]]
+  std::size_t capacity() const noexcept {
+    return m_capacity.load(std::memory_order_relaxed);
+  }
+
+  // Texel (x, y) of level of image, packed as by bake_texture(). x and y
+  // must be inside the level.
+  [[nodiscard]]
+  std::uint32_t texel(const TextureImage& image, std::uint32_t level,
+                      std::uint32_t x, std::uint32_t y);
+
+  [[nodiscard]]
+  TextureCacheReport report() const;
+
+  // Drops every tile and zeroes the counters.
+  void clear();
+
+ private:
+  static constexpr std::size_t kShardCount = 16;
+
+  struct Entry {
+    std::uint64_t key;
+    std::shared_ptr<const TextureTile> tile;
+  };
+
+  struct Shard {
+    mutable std::mutex mutex;
+    // Most recently used first.
+    std::list<Entry> lru;
+    std::unordered_map<std::uint64_t, std::list<Entry>::iterator> entries;
+    std::size_t bytes{};
+    std::uint64_t requests{};
+    std::uint64_t misses{};
+    std::uint64_t evictions{};
+    std::uint64_t readErrors{};
+  };
+
+  [[nodiscard]]
+  std::shared_ptr<const TextureTile> tile(const TextureImage& image,
+                                          std::uint32_t level,
+                                          std::uint32_t tileX,
+                                          std::uint32_t tileY,
+                                          std::uint64_t key);
+
+  // Evicts from the back of shard, whose lock the caller holds, until it
+  // fits in its part of the capacity.
+  void evict(Shard& shard);
+
+  std::array<Shard, kShardCount> m_shards;
+  std::atomic<std::size_t> m_capacity;
+  std::atomic<std::size_t> m_residentBytes{0};
+  std::atomic<std::size_t> m_peakBytes{0};
+};
+
+// The cache every image texture reads through, shared by all scenes of the
+// process.
+[[nodiscard]]
+TextureCache& texture_cache();
+
+}  // namespace mp
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace mp {
+
+struct Tile {
+  int x0, y0;
+  int x1, y1;  // exclusive
+};
+
+enum class TileOrder {
+  // Z-curve over the tile grid, so that consecutive tiles, and the threads
+  // working on them, touch neighbouring parts of the scene.
+  Morton,
+  // Left to right, top to bottom. Rows of tiles finish roughly in order,
+  // which streaming output relies on.
+  Scanline,
+};
+
+// Hands out tiles of the image to render threads through a single atomic
+// counter, in the given order of their grid position.
+class TileScheduler {
+ public:
+  TileScheduler(const int width, const int height, const int tileSize,
+                const TileOrder order = TileOrder::Morton)
+      : TileScheduler(Tile{.x0 = 0, .y0 = 0, .x1 = width, .y1 = height},
+                      tileSize, order) {}
+
+  // Tiles covering region only, the grid starting at its top left corner.
+  TileScheduler(const Tile& region, const int tileSize,
+                const TileOrder order = TileOrder::Morton) {
+    const int tilesX = (region.x1 - region.x0 + tileSize - 1) / tileSize;
+    const int tilesY = (region.y1 - region.y0 + tileSize - 1) / tileSize;
+    m_tiles.reserve(static_cast<std::size_t>(tilesX) * tilesY);
+    for (int ty = 0; ty < tilesY; ++ty) {
+      for (int tx = 0; tx < tilesX; ++tx) {
+        m_tiles.push_back(
+            Tile{.x0 = region.x0 + tx * tileSize,
+                 .y0 = region.y0 + ty * tileSize,
+                 .x1 = std::min(region.x1, region.x0 + (tx + 1) * tileSize),
+                 .y1 = std::min(region.y1, region.y0 + (ty + 1) * tileSize)});
+      }
+    }
+    if (order == TileOrder::Scanline) {
+      return;
+    }
+    std::ranges::sort(m_tiles, {}, [&region, tileSize](const Tile& tile) {
+      return morton_code(
+          static_cast<std::uint32_t>((tile.x0 - region.x0) / tileSize),
+          static_cast<std::uint32_t>((tile.y0 - region.y0) / tileSize));
+    });
+  }
+
+  [[nodiscard]]
+  std::optional<Tile> next() noexcept {
+    const auto index = m_next.fetch_add(1, std::memory_order_relaxed);
+    if (index >= m_tiles.size()) {
+      return std::nullopt;
+    }
+    return m_tiles[index];
+  }
+
+  [[nodiscard]]
+  std::size_t size() const noexcept {
+    return m_tiles.size();
+  }
+
+  [[nodiscard]]
+  static constexpr std::uint64_t morton_code(const std::uint32_t x,
+                                             const std::uint32_t y) noexcept {
+    return spread_bits(x) | (spread_bits(y) << 1);
+  }
+
+ private:
+  std::vector<Tile> m_tiles;
+  std::atomic<std::size_t> m_next{0};
+
+  // Inserts a zero bit between each of the 32 bits of v.
+  [[nodiscard]]
+  static constexpr std::uint64_t spread_bits(const std::uint32_t v) noexcept {
+    std::uint64_t x = v;
+    x = (x | (x << 16)) & 0x0000FFFF0000FFFFull;
+    x = (x | (x << 8)) & 0x00FF00FF00FF00FFull;
+    x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0Full;
+    x = (x | (x << 2)) & 0x3333333333333333ull;
+    x = (x | (x << 1)) & 0x5555555555555555ull;
+    return x;
+  }
+};
+
+}  // namespace mp
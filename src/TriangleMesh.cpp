@@ -0,0 +1,246 @@
+#include "TriangleMesh.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+#include "BVHCache.hpp"
+#include "Instrumentation.hpp"
+
+namespace mp {
+namespace {
+
+constexpr std::uint32_t kNoHit = ~0u;
+
+// Per-ray constants of the watertight test: the axis along which the ray
+// mostly travels becomes z, and the shear that maps the ray direction onto
+// +z is applied to the triangle vertices instead of the ray.
+struct WatertightRay {
+  explicit WatertightRay(const Ray& ray) : origin(ray.origin()) {
+    const auto& direction = ray.direction();
+    const auto magnitude = glm::abs(direction);
+    kz = magnitude.x > magnitude.y ? (magnitude.x > magnitude.z ? 0 : 2)
+                                   : (magnitude.y > magnitude.z ? 1 : 2);
+    kx = (kz + 1) % 3;
+    ky = (kx + 1) % 3;
+    // Keeps the winding order, and therefore the sign of the edge
+    // functions, independent of the ray direction.
+    if (direction[kz] < 0.0f) {
+      std::swap(kx, ky);
+    }
+    shearX = direction[kx] / direction[kz];
+    shearY = direction[ky] / direction[kz];
+    shearZ = 1.0f / direction[kz];
+  }
+
+  glm::vec3 origin;
+  int kx;
+  int ky;
+  int kz;
+  float shearX;
+  float shearY;
+  float shearZ;
+};
+
+struct TriangleHit {
+  float t;
+  // Barycentric weights of the three vertices.
+  float b0;
+  float b1;
+  float b2;
+};
+
+[[nodiscard]]
+bool intersect(const WatertightRay& ray, const glm::vec3& v0,
+               const glm::vec3& v1, const glm::vec3& v2,
+               const Interval<float> interval, TriangleHit& hit) {
+  const auto a = v0 - ray.origin;
+  const auto b = v1 - ray.origin;
+  const auto c = v2 - ray.origin;
+  const float ax = a[ray.kx] - ray.shearX * a[ray.kz];
+  const float ay = a[ray.ky] - ray.shearY * a[ray.kz];
+  const float bx = b[ray.kx] - ray.shearX * b[ray.kz];
+  const float by = b[ray.ky] - ray.shearY * b[ray.kz];
+  const float cx = c[ray.kx] - ray.shearX * c[ray.kz];
+  const float cy = c[ray.ky] - ray.shearY * c[ray.kz];
+
+  float u = cx * by - cy * bx;
+  float v = ax * cy - ay * cx;
+  float w = bx * ay - by * ax;
+  // An edge function that rounds to exactly zero is the case where float
+  // precision cannot decide the side; redo the three in double.
+  if (u == 0.0f || v == 0.0f || w == 0.0f) {
+    u = static_cast<float>(static_cast<double>(cx) * by -
+                           static_cast<double>(cy) * bx);
+    v = static_cast<float>(static_cast<double>(ax) * cy -
+                           static_cast<double>(ay) * cx);
+    w = static_cast<float>(static_cast<double>(bx) * ay -
+                           static_cast<double>(by) * ax);
+  }
+  if ((u < 0.0f || v < 0.0f || w < 0.0f) &&
+      (u > 0.0f || v > 0.0f || w > 0.0f)) {
+    return false;
+  }
+  const float det = u + v + w;
+  if (det == 0.0f) {
+    return false;
+  }
+
+  const float az = ray.shearZ * a[ray.kz];
+  const float bz = ray.shearZ * b[ray.kz];
+  const float cz = ray.shearZ * c[ray.kz];
+  const float invDet = 1.0f / det;
+  const float t = (u * az + v * bz + w * cz) * invDet;
+  if (!interval.surrounds(t)) {
+    return false;
+  }
+  hit = TriangleHit{.t = t, .b0 = u * invDet, .b1 = v * invDet,
+                    .b2 = w * invDet};
+  return true;
+}
+
+}  // namespace
+
+TriangleMesh::TriangleMesh(MeshData data, const MaterialId material,
+                           BVHCache* const cache)
+    : m_data(std::move(data)), m_material(material) {
+  const auto vertexCount = m_data.vertex_count();
+  if (m_data.y.size() != vertexCount || m_data.z.size() != vertexCount) {
+    throw std::invalid_argument("mesh position arrays differ in length");
+  }
+  if (m_data.has_normals() && (m_data.normalX.size() != vertexCount ||
+                               m_data.normalY.size() != vertexCount ||
+                               m_data.normalZ.size() != vertexCount)) {
+    throw std::invalid_argument("mesh needs one normal per vertex");
+  }
+  if (m_data.has_texcoords() && (m_data.texU.size() != vertexCount ||
+                                 m_data.texV.size() != vertexCount)) {
+    throw std::invalid_argument(
+        "mesh needs one texture coordinate per vertex");
+  }
+  if (m_data.indices.size() % 3 != 0 ||
+      std::ranges::any_of(m_data.indices, [vertexCount](const auto index) {
+        return index >= vertexCount;
+      })) {
+    throw std::invalid_argument("mesh has an out of range vertex index");
+  }
+
+  const auto triangleCount = m_data.triangle_count();
+  std::vector<AABB> bounds(triangleCount);
+  for (std::size_t i = 0; i < triangleCount; ++i) {
+    for (std::size_t corner = 0; corner < 3; ++corner) {
+      bounds[i].expand(m_data.position(m_data.indices[3 * i + corner]));
+    }
+  }
+  m_tree = cached_tree(cache, bounds);
+  bounds = {};
+
+  std::vector<std::uint32_t> ordered;
+  ordered.reserve(m_data.indices.size());
+  for (const auto triangle : m_tree.primitive_indices()) {
+    const auto first = m_data.indices.begin() + 3 * triangle;
+    ordered.insert(ordered.end(), first, first + 3);
+  }
+  m_data.indices = std::move(ordered);
+}
+
+bool Hit(const TriangleMesh& mesh, const Ray& ray, Interval<float> interval,
+         HitRecord& hitRecord) {
+  const auto& data = mesh.data();
+  const WatertightRay watertightRay(ray);
+  std::uint32_t closest = kNoHit;
+  TriangleHit closestHit;
+  mesh.tree().traverse(
+      ray, interval,
+      [&](const std::uint32_t first, const std::uint32_t count,
+          Interval<float>& currentInterval) {
+        instrumentation::count_intersection_tests(count);
+        bool hitAnything = false;
+        for (std::uint32_t i = first; i < first + count; ++i) {
+          const auto* index = &data.indices[3 * static_cast<std::size_t>(i)];
+          TriangleHit hit;
+          if (intersect(watertightRay, data.position(index[0]),
+                        data.position(index[1]), data.position(index[2]),
+                        currentInterval, hit)) {
+            instrumentation::count_intersection_hit();
+            currentInterval.max = hit.t;
+            closest = i;
+            closestHit = hit;
+            hitAnything = true;
+          }
+        }
+        return hitAnything;
+      });
+  if (closest == kNoHit) {
+    return false;
+  }
+
+  const auto* index = &data.indices[3 * static_cast<std::size_t>(closest)];
+  const auto v0 = data.position(index[0]);
+  const auto edgeNormal =
+      glm::cross(data.position(index[1]) - v0, data.position(index[2]) - v0);
+  const auto geometricNormal = glm::normalize(edgeNormal);
+  hitRecord.p = ray.at(closestHit.t);
+  hitRecord.t = closestHit.t;
+  hitRecord.set_face_normal(ray, geometricNormal);
+  if (data.has_normals()) {
+    // The side is decided by the winding, the interpolated normal only
+    // shades and is turned towards the same side as the geometric one.
+    const auto shadingNormal = closestHit.b0 * data.normal(index[0]) +
+                               closestHit.b1 * data.normal(index[1]) +
+                               closestHit.b2 * data.normal(index[2]);
+    const float length = glm::length(shadingNormal);
+    if (length > 0.0f) {
+      const float side =
+          glm::dot(shadingNormal, hitRecord.normal) < 0.0f ? -1.0f : 1.0f;
+      hitRecord.normal = shadingNormal * (side / length);
+    }
+  }
+  hitRecord.material = mesh.material();
+
+  // Meshes without texture coordinates use the barycentrics, which map
+  // every triangle onto the same half of the unit square. The density
+  // compares the areas of the triangle in uv and in space.
+  float uvArea = 1.0f;
+  hitRecord.sphericalUv = false;
+  hitRecord.uv = {closestHit.b1, closestHit.b2};
+  if (data.has_texcoords()) {
+    const auto uv0 = data.texcoord(index[0]);
+    const auto uv1 = data.texcoord(index[1]);
+    const auto uv2 = data.texcoord(index[2]);
+    hitRecord.uv =
+        closestHit.b0 * uv0 + closestHit.b1 * uv1 + closestHit.b2 * uv2;
+    const auto e1 = uv1 - uv0;
+    const auto e2 = uv2 - uv0;
+    uvArea = std::abs(e1.x * e2.y - e1.y * e2.x);
+  }
+  const float area = glm::length(edgeNormal);
+  hitRecord.uvDensity = area > 0.0f ? std::sqrt(uvArea / area) : 0.0f;
+  return true;
+}
+
+bool Occluded(const TriangleMesh& mesh, const Ray& ray,
+              const Interval<float> interval) {
+  const auto& data = mesh.data();
+  const WatertightRay watertightRay(ray);
+  return mesh.tree().occluded(
+      ray, interval,
+      [&](const std::uint32_t first, const std::uint32_t count) {
+        instrumentation::count_intersection_tests(count);
+        for (std::uint32_t i = first; i < first + count; ++i) {
+          const auto* index = &data.indices[3 * static_cast<std::size_t>(i)];
+          TriangleHit hit;
+          if (intersect(watertightRay, data.position(index[0]),
+                        data.position(index[1]), data.position(index[2]),
+                        interval, hit)) {
+            return true;
+          }
+        }
+        return false;
+      });
+}
+
+AABB BoundingBox(const TriangleMesh& mesh) { return mesh.tree().bounds(); }
+
+}  // namespace mp
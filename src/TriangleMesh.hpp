@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "AABB.hpp"
+#include "BVH.hpp"
+#include "Hittable.hpp"
+#include "Interval.hpp"
+#include "Ray.hpp"
+#include "glm/glm.hpp"
+
+namespace mp {
+
+// Indexed triangle geometry as produced by the loaders: vertex attributes in
+// structure-of-arrays layout and three 32-bit vertex indices per triangle.
+// Normals and texture coordinates are either empty or have one entry per
+// vertex.
+struct MeshData {
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<float> normalX;
+  std::vector<float> normalY;
+  std::vector<float> normalZ;
+  std::vector<float> texU;
+  std::vector<float> texV;
+  std::vector<std::uint32_t> indices;
+
+  [[nodiscard]]
+  std::size_t vertex_count() const noexcept {
+    return x.size();
+  }
+
+  [[nodiscard]]
+  std::size_t triangle_count() const noexcept {
+    return indices.size() / 3;
+  }
+
+  [[nodiscard]]
+  bool has_normals() const noexcept {
+    return !normalX.empty();
+  }
+
+  [[nodiscard]]
+  bool has_texcoords() const noexcept {
+    return !texU.empty();
+  }
+
+  [[nodiscard]]
+  glm::vec3 position(const std::uint32_t vertex) const noexcept {
+    return {x[vertex], y[vertex], z[vertex]};
+  }
+
+  [[nodiscard]]
+  glm::vec3 normal(const std::uint32_t vertex) const noexcept {
+    return {normalX[vertex], normalY[vertex], normalZ[vertex]};
+  }
+
+  [[nodiscard]]
+  glm::vec2 texcoord(const std::uint32_t vertex) const noexcept {
+    return {texU[vertex], texV[vertex]};
+  }
+};
+
+// Triangle mesh with a single material and its own BVH over the triangles.
+// The index buffer is reordered so that every leaf is a contiguous range of
+// triangles; besides the vertex data the mesh costs 12 bytes of indices per
+// triangle plus the BVH nodes.
+//
+// Intersection uses the watertight test of Woo, Benthin and Wald (JCGT
+// 2013): rays through a shared edge or vertex hit at least one of the
+// adjacent triangles, so closed meshes show no cracks.
+class TriangleMesh {
+ public:
+  // Throws std::invalid_argument if an index is out of range or the normal
+  // or texture coordinate count does not match the vertex count. Takes the
+  // tree from cache if given, see BVHCache.
+  TriangleMesh(MeshData data, MaterialId material, BVHCache* cache = nullptr);
+
+  [[nodiscard]]
+  const MeshData& data() const noexcept {
+    return m_data;
+  }
+
+  [[nodiscard]]
+  const BVHTree& tree() const noexcept {
+    return m_tree;
+  }
+
+  [[nodiscard]]
+  MaterialId material() const noexcept {
+    return m_material;
+  }
+
+ private:
+  MeshData m_data;
+  BVHTree m_tree;
+  MaterialId m_material;
+};
+
+[[nodiscard]]
+bool Hit(const TriangleMesh& mesh, const Ray& ray, Interval<float> interval,
+         HitRecord& hitRecord);
+
+[[nodiscard]]
+bool Occluded(const TriangleMesh& mesh, const Ray& ray,
+              Interval<float> interval);
+
+[[nodiscard]]
+AABB BoundingBox(const TriangleMesh& mesh);
+
+}  // namespace mp
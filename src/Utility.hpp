@@ -1,54 +1,63 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <limits>
 #include <numbers>
 #include <numeric>
-#include <random>
 
+#include "Sampler.hpp"
 #include "glm/glm.hpp"
 
 namespace mp {
 constexpr auto infinity_f = std::numeric_limits<float>::max();
 constexpr auto pi_f = std::numbers::pi_v<float>;
 
-inline float random_float() {
-  static std::random_device dev;
-  static std::mt19937 gen(dev());
-  static std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
-  return distribution(gen);
-}
+inline float random_float(Sampler& sampler) { return sampler.next_float(); }
 
-inline float random_float(const float min, const float max) {
-  return min + (max - min) * random_float();
+inline float random_float(Sampler& sampler, const float min, const float max) {
+  return min + (max - min) * random_float(sampler);
 }
 
-inline glm::vec3 random_vec() {
-  return glm::vec3{random_float(), random_float(), random_float()};
+// Components are drawn in separate statements: argument evaluation order is
+// unspecified, and the image must not depend on the compiler.
+inline glm::vec3 random_vec(Sampler& sampler) {
+  const float x = random_float(sampler);
+  const float y = random_float(sampler);
+  return glm::vec3{x, y, random_float(sampler)};
 }
-inline glm::vec3 random_vec(const float min, const float max) {
-  return glm::vec3{random_float(min, max), random_float(min, max),
-                   random_float(min, max)};
+inline glm::vec3 random_vec(Sampler& sampler, const float min,
+                            const float max) {
+  const float x = random_float(sampler, min, max);
+  const float y = random_float(sampler, min, max);
+  return glm::vec3{x, y, random_float(sampler, min, max)};
 }
 
-inline glm::vec3 random_unit_vector() {
-  while (true) {
-    const auto p = random_vec(-1.0f, 1.0f);
-    const auto pLengthSquared = dot(p, p);
-    constexpr float kMinAcceptableValue = 1e-40f;
-    if (kMinAcceptableValue < pLengthSquared && pLengthSquared <= 1) {
-      return p / std::sqrt(pLengthSquared);
-    }
-  }
+// Uniform on the sphere: z is uniform in [-1, 1] (Archimedes), the angle
+// around it uniform. One 2D sample per direction, so low-discrepancy points
+// stay well distributed after the warp.
+inline glm::vec3 random_unit_vector(Sampler& sampler) {
+  const auto u = sampler.next_2d();
+  const float z = 1.0f - 2.0f * u.x;
+  const float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+  const float phi = 2.0f * pi_f * u.y;
+  return {r * std::cos(phi), r * std::sin(phi), z};
 }
 
-inline glm::vec3 random_on_hemisphere(const glm::vec3& normal) {
-  const auto vectorOnHemisphere = random_unit_vector();
+inline glm::vec3 random_on_hemisphere(Sampler& sampler,
+                                      const glm::vec3& normal) {
+  const auto vectorOnHemisphere = random_unit_vector(sampler);
   if (dot(vectorOnHemisphere, normal) > 0.0f) {
     return vectorOnHemisphere;
   }
   return -vectorOnHemisphere;
 }
 
+// Relative luminance of linear Rec. 709 RGB.
+inline float luminance(const glm::vec3& color) noexcept {
+  return dot(color, glm::vec3{0.2126f, 0.7152f, 0.0722f});
+}
+
 inline bool near_zero(const float x) noexcept {
   constexpr float kEpsilon = 1e-6f;
   return std::fabs(x) < kEpsilon;
@@ -74,14 +83,23 @@ inline glm::vec3 refract(const glm::vec3& direction, const glm::vec3 normal,
   return refractDirectionOrth + refractDirectionPar;
 }
 
-inline glm::vec3 random_in_unit_disk() {
-  while (true) {
-    const auto p =
-        glm::vec3(random_float(-1.0f, 1.0f), random_float(-1.0f, 1.0f), 0.0f);
-    if (dot(p, p) < 1) {
-      return p;
-    }
+// Concentric mapping of the unit square onto the disk (Shirley & Chiu, "A
+// Low Distortion Map Between Disk and Square", 1997).
+inline glm::vec3 random_in_unit_disk(Sampler& sampler) {
+  const auto u = 2.0f * sampler.next_2d() - 1.0f;
+  if (u.x == 0.0f && u.y == 0.0f) {
+    return glm::vec3{0.0f};
+  }
+  float r = 0.0f;
+  float theta = 0.0f;
+  if (std::fabs(u.x) > std::fabs(u.y)) {
+    r = u.x;
+    theta = 0.25f * pi_f * (u.y / u.x);
+  } else {
+    r = u.y;
+    theta = 0.5f * pi_f - 0.25f * pi_f * (u.x / u.y);
   }
+  return {r * std::cos(theta), r * std::sin(theta), 0.0f};
 }
 
 }  // namespace mp
\ No newline at end of file
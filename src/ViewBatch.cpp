@@ -0,0 +1,125 @@
+#include "ViewBatch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#include "PathBatch.hpp"
+#include "TileScheduler.hpp"
+
+namespace mp {
+
+ViewBatchReport render_views(const std::span<Camera> views,
+                             const Scene& scene, unsigned int threadCount) {
+  using Clock = std::chrono::steady_clock;
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  struct ViewTile {
+    std::size_t view;
+    Tile tile;
+  };
+
+  // Each view's tiles in the order its own render would take them, the
+  // views one after another.
+  std::vector<ViewTile> tiles;
+  std::vector<std::uint32_t> targetSamples;
+  targetSamples.reserve(views.size());
+  std::vector<std::atomic<std::size_t>> remaining(views.size());
+  for (std::size_t v = 0; v < views.size(); ++v) {
+    auto& camera = views[v];
+    auto& accumulation = camera.m_accumulation;
+    if (accumulation.get_width() != camera.m_width ||
+        accumulation.get_height() != camera.m_height) {
+      accumulation = AccumulationBuffer(camera.m_width, camera.m_height);
+    } else {
+      accumulation.clear();
+    }
+    targetSamples.push_back(camera.target_samples());
+    camera.begin_render(scene, accumulation, targetSamples.back());
+    camera.m_report.threads.assign(threadCount, ThreadUtilization{});
+
+    TileScheduler scheduler(static_cast<int>(camera.m_width),
+                            static_cast<int>(camera.m_height),
+                            camera.m_tileSize);
+    remaining[v] = scheduler.size();
+    while (const auto tile = scheduler.next()) {
+      tiles.push_back({v, *tile});
+    }
+  }
+
+  ViewBatchReport report{.views = views.size(),
+                         .tiles = tiles.size(),
+                         .threads = std::vector<ThreadUtilization>(
+                             threadCount)};
+  std::atomic<std::size_t> nextTile{0};
+  const auto start = Clock::now();
+
+  // Tiles of a view cover disjoint pixels of its buffer, so threads write
+  // them back unlocked. The last one to finish a view sees every write to
+  // it through the release and acquire on remaining.
+  const auto renderTiles = [&](const std::size_t thread) {
+    PathBatch batch;
+    std::vector<AccumulatedPixel> tilePixels;
+    auto& poolUtilization = report.threads[thread];
+    for (auto index = nextTile.fetch_add(1, std::memory_order_relaxed);
+         index < tiles.size();
+         index = nextTile.fetch_add(1, std::memory_order_relaxed)) {
+      const auto& [v, tile] = tiles[index];
+      auto& camera = views[v];
+      auto& utilization = camera.m_report.threads[thread];
+      const auto tileStart = Clock::now();
+      const int tileWidth = tile.x1 - tile.x0;
+      tilePixels.assign(
+          static_cast<std::size_t>(tileWidth) * (tile.y1 - tile.y0),
+          AccumulatedPixel{});
+      instrumentation::counters() = RenderCounters{};
+
+      const auto samples = camera.sample_tile(tile, scene, targetSamples[v],
+                                              tilePixels, batch);
+      for (int y = tile.y0; y < tile.y1; ++y) {
+        for (int x = tile.x0; x < tile.x1; ++x) {
+          camera.m_accumulation[x, y] =
+              tilePixels[(y - tile.y0) * tileWidth + (x - tile.x0)];
+        }
+      }
+
+      const auto busy = Clock::now() - tileStart;
+      utilization.samples += samples;
+      utilization.busy += busy;
+      ++utilization.tiles;
+      utilization.counters += instrumentation::counters();
+      poolUtilization.samples += samples;
+      poolUtilization.busy += busy;
+      ++poolUtilization.tiles;
+      poolUtilization.counters += instrumentation::counters();
+
+      if (remaining[v].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        camera.m_report.wall = Clock::now() - start;
+        // The denoiser starts threads of its own, which would compete with
+        // the pool; views that use it are resolved once the pool is done.
+        if (!camera.m_denoise) {
+          camera.resolve(camera.m_accumulation, targetSamples[v]);
+        }
+      }
+    }
+  };
+
+  {
+    std::vector<std::jthread> threads;
+    threads.reserve(threadCount);
+    for (std::size_t t = 0; t < threadCount; ++t) {
+      threads.emplace_back(renderTiles, t);
+    }
+  }
+  for (std::size_t v = 0; v < views.size(); ++v) {
+    if (views[v].m_denoise) {
+      views[v].resolve(views[v].m_accumulation, targetSamples[v]);
+    }
+  }
+  report.wall = Clock::now() - start;
+  return report;
+}
+
+}  // namespace mp
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <ostream>
+#include <span>
+#include <vector>
+
+#include "Camera.hpp"
+#include "RenderReport.hpp"
+#include "Scene.hpp"
+
+namespace mp {
+
+// The pool of a render_views() call as a whole; each view's own report is
+// on its camera.
+struct ViewBatchReport {
+  std::chrono::nanoseconds wall{};
+  std::size_t views{};
+  std::size_t tiles{};
+  // Per pool thread, over the tiles of every view.
+  std::vector<ThreadUtilization> threads;
+
+  [[nodiscard]]
+  std::uint64_t samples() const noexcept {
+    std::uint64_t total = 0;
+    for (const auto& t : threads) {
+      total += t.samples;
+    }
+    return total;
+  }
+};
+
+inline std::ostream& operator<<(std::ostream& os,
+                                const ViewBatchReport& report) {
+  using Milliseconds = std::chrono::duration<double, std::milli>;
+  const std::chrono::duration<double> seconds = report.wall;
+  os << std::format(
+      "batch: {} views, {} tiles in {:.1f} ms on {} threads, {:.2f} "
+      "Msamples/s\n",
+      report.views, report.tiles, Milliseconds(report.wall).count(),
+      report.threads.size(),
+      seconds.count() > 0.0
+          ? static_cast<double>(report.samples()) / seconds.count() * 1e-6
+          : 0.0);
+  for (std::size_t t = 0; t < report.threads.size(); ++t) {
+    os << std::format(
+        "  thread {:>3}: {:>5} tiles, busy {:>10.1f} ms ({:.1f}%)\n", t,
+        report.threads[t].tiles,
+        Milliseconds(report.threads[t].busy).count(),
+        report.wall.count() == 0
+            ? 0.0
+            : 100.0 * static_cast<double>(report.threads[t].busy.count()) /
+                  static_cast<double>(report.wall.count()));
+  }
+  return os;
+}
+
+// Renders every camera of views from scratch, as render(scene) would, into
+// its own accumulation buffer and image, but with one pool of threadCount
+// threads (0 uses std::thread::hardware_concurrency()) that takes the tiles
+// of all views from one queue. Views with few tiles therefore cost no
+// thread start-up of their own, and no thread idles at the end of one
+// view while another has tiles left. The queue holds the views in order,
+// and each view is resolved by the thread that finishes its last tile while
+// the others go on with the next views. Views with a denoiser are resolved
+// after the pool is done instead, so that the threads of the denoiser do
+// not compete with it.
+//
+// The cameras keep their own settings and give the images render() would;
+// their thread counts and checkpoints are ignored. Each camera's report()
+// covers its own tiles, per pool thread, with wall time from the start of
+// the batch to its last tile. scene is only read.
+ViewBatchReport render_views(std::span<Camera> views, const Scene& scene,
+                             unsigned int threadCount = 0);
+
+}  // namespace mp